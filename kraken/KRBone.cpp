@@ -61,7 +61,8 @@ void KRBone::render(KRCamera *pCamera, std::vector<KRPointLight *> &point_lights
         // Disable z-buffer test
         GLDEBUG(glDisable(GL_DEPTH_TEST));
 
-        KRShader *pShader = getContext().getShaderManager()->getShader("visualize_overlay", pCamera, point_lights, directional_lights, spot_lights, 0, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, renderPass);
+        static const int visualize_overlay_shader_id = KRShaderManager::GetShaderNameID("visualize_overlay");
+        KRShader *pShader = getContext().getShaderManager()->getShader(visualize_overlay_shader_id, pCamera, point_lights, directional_lights, spot_lights, 0, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, renderPass);
         
         if(getContext().getShaderManager()->selectShader(*pCamera, pShader, viewport, sphereModelMatrix, point_lights, directional_lights, spot_lights, 0, renderPass, Vector3::Zero(), 0.0f, Vector4::Zero())) {
             std::vector<KRMesh *> sphereModels = getContext().getMeshManager()->getModel("__sphere");
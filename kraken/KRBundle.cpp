@@ -35,6 +35,12 @@
 
 const int KRENGINE_KRBUNDLE_HEADER_SIZE = 512;
 
+// The optional table of contents is stored as a hidden tar entry, so plain tar tools and older readers skip over it.
+// Its contents are padded to a multiple of the header size so the footer always ends at the start of the two terminating headers.
+const char *KRENGINE_KRBUNDLE_INDEX_FILE_NAME = ".krbundle_index";
+const char KRENGINE_KRBUNDLE_INDEX_MAGIC[8] = {'K', 'R', 'B', 'N', 'D', 'I', 'D', 'X'};
+const __uint32_t KRENGINE_KRBUNDLE_INDEX_VERSION = 2;
+
 typedef struct _tar_header
 {
     char file_name[100];
@@ -49,9 +55,55 @@ typedef struct _tar_header
     
 } tar_header_type;
 
+typedef struct _krbundle_index_footer
+{
+    char magic[8];
+    __uint32_t version;
+    __uint32_t entry_count;
+    __uint64_t index_size; // Size of the index file contents, including entries, padding, and this footer
+} krbundle_index_footer;
+
+// Populate a zero-ed out tar header
+static void InitTarHeader(tar_header_type *file_header, const std::string &file_name, size_t file_size)
+{
+    strncpy(file_header->file_name, file_name.c_str(), 100);
+    strcpy(file_header->file_mode, "000644 ");
+    strcpy(file_header->owner_id, "000000 ");
+    strcpy(file_header->group_id, "000000 ");
+    sprintf(file_header->file_size, "%011o", (int)file_size);
+    file_header->file_size[11] = ' '; // Terminate with space rather than '\0'
+    sprintf(file_header->mod_time, "%011o", (int)time(NULL));
+    file_header->mod_time[11] = ' '; // Terminate with space rather than '\0'
+    
+    // Calculate and write checksum for header
+    memset(file_header->checksum, ' ', 8); // Must be filled with spaces and no null terminator during checksum calculation
+    int check_sum = 0;
+    for(int i=0; i < KRENGINE_KRBUNDLE_HEADER_SIZE; i++) {
+        unsigned char *byte_ptr = (unsigned char *)file_header;
+        check_sum += byte_ptr[i];
+    }
+    sprintf(file_header->checksum, "%07o", check_sum);
+}
+
 KRBundle::KRBundle(KRContext &context, std::string name, KRDataBlock *pData) : KRResource(context, name)
 {
     m_pData = pData;
+    m_indexFilePos = 0;
+    m_indexFileSize = 0;
+    
+    // Files loaded when the bundle is opened are parsed together on the loader threads
+    std::vector<std::pair<std::string, KRDataBlock *> > files;
+    
+    if(loadIndex()) {
+        // Indexed bundle; register the files without reading each tar header.  Textures, meshes and scenes are loaded on first use.
+        for(auto itr = m_index.begin(); itr != m_index.end(); itr++) {
+            if(!context.getBundleManager()->registerResource(this, (*itr).file_name)) {
+                files.push_back(std::make_pair(std::string((*itr).file_name), m_pData->getSubBlock((int)(*itr).offset, (int)(*itr).size)));
+            }
+        }
+        context.loadResources(files);
+        return;
+    }
     
     __int64_t file_pos = 0;
     while(file_pos < m_pData->getSize()) {
@@ -62,16 +114,19 @@ KRBundle::KRBundle(KRContext &context, std::string name, KRDataBlock *pData) : K
         if(file_header.file_name[0] != '\0' && file_header.file_name[0] != '.') {
             // We ignore the last two records in the tar file, which are zero'ed out tar_header structures
             KRDataBlock *pFileData = pData->getSubBlock(file_pos, file_size);
-            context.loadResource(file_header.file_name, pFileData);
+            files.push_back(std::make_pair(std::string(file_header.file_name), pFileData));
         }
         file_pos += RoundUpSize(file_size);
     }
+    context.loadResources(files);
 }
 
 KRBundle::KRBundle(KRContext &context, std::string name) : KRResource(context, name)
 {
     // Create an empty krbundle (tar) file, initialized with two zero-ed out file headers, which terminate it.
     m_pData = new KRDataBlock();
+    m_indexFilePos = 0;
+    m_indexFileSize = 0;
     m_pData->expand(KRENGINE_KRBUNDLE_HEADER_SIZE * 2);
     m_pData->lock();
     memset(m_pData->getStart(), 0, m_pData->getSize());
@@ -103,14 +158,153 @@ std::string KRBundle::getExtension()
 
 bool KRBundle::save(const std::string& path)
 {
-    return m_pData->save(path);
+    if(m_index.empty()) {
+        return m_pData->save(path);
+    } else {
+        KRDataBlock data;
+        saveBundle(data);
+        return data.save(path);
+    }
 }
 
 bool KRBundle::save(KRDataBlock &data) {
     if(m_pData->getSize() > KRENGINE_KRBUNDLE_HEADER_SIZE * 2) {
         // Only output krbundles that contain files
+        saveBundle(data);
+    }
+    return true;
+}
+
+void KRBundle::saveBundle(KRDataBlock &data)
+{
+    if(m_index.empty()) {
         data.append(*m_pData);
+        return;
+    }
+    
+    // Copy the files, excluding the terminating headers and the index the bundle was loaded with
+    size_t files_end = m_pData->getSize() - KRENGINE_KRBUNDLE_HEADER_SIZE * 2;
+    std::vector<index_entry> index = m_index;
+    if(m_indexFileSize > 0) {
+        KRDataBlock *files = m_pData->getSubBlock(0, (int)m_indexFilePos);
+        data.append(*files);
+        delete files;
+        files = m_pData->getSubBlock((int)(m_indexFilePos + m_indexFileSize), (int)(files_end - m_indexFilePos - m_indexFileSize));
+        data.append(*files);
+        delete files;
+        
+        // Files appended after the old index move up to take its place
+        for(auto itr = index.begin(); itr != index.end(); itr++) {
+            if((*itr).offset > m_indexFilePos) {
+                (*itr).offset -= m_indexFileSize;
+            }
+        }
+    } else {
+        KRDataBlock *files = m_pData->getSubBlock(0, (int)files_end);
+        data.append(*files);
+        delete files;
     }
+    
+    // Append the index as the last file in the archive, followed by the terminating headers
+    size_t entries_size = sizeof(index_entry) * index.size();
+    size_t index_size = RoundUpSize(entries_size + sizeof(krbundle_index_footer));
+    size_t block_size = KRENGINE_KRBUNDLE_HEADER_SIZE + index_size + KRENGINE_KRBUNDLE_HEADER_SIZE * 2;
+    
+    KRDataBlock index_block;
+    index_block.expand(block_size);
+    index_block.lock();
+    unsigned char *start = (unsigned char *)index_block.getStart();
+    memset(start, 0, block_size);
+    
+    InitTarHeader((tar_header_type *)start, KRENGINE_KRBUNDLE_INDEX_FILE_NAME, index_size);
+    memcpy(start + KRENGINE_KRBUNDLE_HEADER_SIZE, &index[0], entries_size);
+    
+    krbundle_index_footer *footer = (krbundle_index_footer *)(start + KRENGINE_KRBUNDLE_HEADER_SIZE + index_size - sizeof(krbundle_index_footer));
+    memcpy(footer->magic, KRENGINE_KRBUNDLE_INDEX_MAGIC, sizeof(footer->magic));
+    footer->version = KRENGINE_KRBUNDLE_INDEX_VERSION;
+    footer->entry_count = (__uint32_t)index.size();
+    footer->index_size = index_size;
+    index_block.unlock();
+    
+    data.append(index_block);
+}
+
+bool KRBundle::loadIndex()
+{
+    // Look for the index footer immediately before the two terminating headers.  Only one page of the bundle is read if there is no index.
+    size_t bundle_size = m_pData->getSize();
+    if(bundle_size < KRENGINE_KRBUNDLE_HEADER_SIZE * 4) {
+        return false;
+    }
+    size_t footer_pos = bundle_size - KRENGINE_KRBUNDLE_HEADER_SIZE * 2 - sizeof(krbundle_index_footer);
+    krbundle_index_footer footer;
+    m_pData->copy(&footer, (int)footer_pos, sizeof(footer));
+    if(memcmp(footer.magic, KRENGINE_KRBUNDLE_INDEX_MAGIC, sizeof(footer.magic)) != 0 || footer.version != KRENGINE_KRBUNDLE_INDEX_VERSION) {
+        return false;
+    }
+    
+    // Compared by subtraction, so a corrupt size can not overflow.  bundle_size is at least four headers.
+    if(footer.index_size > bundle_size - KRENGINE_KRBUNDLE_HEADER_SIZE * 3 || footer.index_size < sizeof(krbundle_index_footer) || footer.entry_count > (footer.index_size - sizeof(krbundle_index_footer)) / sizeof(index_entry)) {
+        KRContext::Log(KRContext::LOG_LEVEL_WARNING, "Ignoring corrupt krbundle index in \"%s\"", getName().c_str());
+        return false;
+    }
+    
+    size_t index_pos = bundle_size - KRENGINE_KRBUNDLE_HEADER_SIZE * 2 - footer.index_size;
+    tar_header_type index_header;
+    m_pData->copy(&index_header, (int)(index_pos - KRENGINE_KRBUNDLE_HEADER_SIZE), sizeof(index_header));
+    if(strncmp(index_header.file_name, KRENGINE_KRBUNDLE_INDEX_FILE_NAME, 100) != 0 || (size_t)strtol(index_header.file_size, NULL, 8) != footer.index_size) {
+        KRContext::Log(KRContext::LOG_LEVEL_WARNING, "Ignoring corrupt krbundle index in \"%s\"", getName().c_str());
+        return false;
+    }
+    
+    size_t entries_size = sizeof(index_entry) * footer.entry_count;
+    m_index.resize(footer.entry_count);
+    if(entries_size > 0) {
+        m_pData->copy(&m_index[0], (int)index_pos, (int)entries_size);
+    }
+    for(size_t i=0; i < m_index.size(); i++) {
+        index_entry &entry = m_index[i];
+        entry.file_name[sizeof(entry.file_name) - 1] = '\0';
+        if(entry.offset > index_pos || entry.size > index_pos - entry.offset) {
+            KRContext::Log(KRContext::LOG_LEVEL_WARNING, "Ignoring corrupt krbundle index in \"%s\"", getName().c_str());
+            m_index.clear();
+            m_indexLookup.clear();
+            return false;
+        }
+        m_indexLookup[entry.file_name] = i;
+    }
+    m_indexFilePos = index_pos - KRENGINE_KRBUNDLE_HEADER_SIZE;
+    m_indexFileSize = KRENGINE_KRBUNDLE_HEADER_SIZE + footer.index_size;
+    return true;
+}
+
+void KRBundle::addIndexEntry(const std::string &file_name, size_t offset, size_t size)
+{
+    index_entry entry;
+    memset(&entry, 0, sizeof(entry));
+    strncpy(entry.file_name, file_name.c_str(), sizeof(entry.file_name) - 1);
+    entry.offset = offset;
+    entry.size = size;
+    
+    auto itr = m_indexLookup.find(entry.file_name);
+    if(itr == m_indexLookup.end()) {
+        m_indexLookup[entry.file_name] = m_index.size();
+        m_index.push_back(entry);
+    } else {
+        // A later file with the same name replaces the earlier one, as with tar extraction
+        m_index[(*itr).second] = entry;
+    }
+}
+
+bool KRBundle::loadIndexedResource(const std::string &file_name)
+{
+    auto itr = m_indexLookup.find(file_name);
+    if(itr == m_indexLookup.end()) {
+        return false;
+    }
+    const index_entry &entry = m_index[(*itr).second];
+    KRDataBlock *pFileData = m_pData->getSubBlock((int)entry.offset, (int)entry.size);
+    getContext().loadResource(entry.file_name, pFileData);
     return true;
 }
 
@@ -144,23 +338,10 @@ void KRBundle::append(KRResource &resource)
     memset((unsigned char *)m_pData->getEnd() - padding_size, 0, padding_size);
     
     // Populate new file header fields
-    strncpy(file_header->file_name, file_name.c_str(), 100);
-    strcpy(file_header->file_mode, "000644 ");
-    strcpy(file_header->owner_id, "000000 ");
-    strcpy(file_header->group_id, "000000 ");
-    sprintf(file_header->file_size, "%011o", (int)resource_data.getSize());
-    file_header->file_size[11] = ' '; // Terminate with space rather than '\0'
-    sprintf(file_header->mod_time, "%011o", (int)time(NULL));
-    file_header->mod_time[11] = ' '; // Terminate with space rather than '\0'
-    
-    // Calculate and write checksum for header
-    memset(file_header->checksum, ' ', 8); // Must be filled with spaces and no null terminator during checksum calculation
-    int check_sum = 0;
-    for(int i=0; i < KRENGINE_KRBUNDLE_HEADER_SIZE; i++) {
-        unsigned char *byte_ptr = (unsigned char *)file_header;
-        check_sum += byte_ptr[i];
-    }
-    sprintf(file_header->checksum, "%07o", check_sum);
+    InitTarHeader(file_header, file_name, resource_data.getSize());
     
     m_pData->unlock();
+    
+    // Record the file in the table of contents written by save()
+    addIndexEntry(file_name, m_pData->getSize() - padding_size - resource_data.getSize(), resource_data.getSize());
 }
@@ -46,9 +46,31 @@ public:
     
     void append(KRResource &resource);
     
+    // Load a file that was registered with the KRBundleManager from the bundle's index, rather than loaded when the bundle was opened
+    bool loadIndexedResource(const std::string &file_name);
+    
+    // Entry in the optional table of contents stored as the last file of a krbundle.  The resource type is given by the file extension.
+    typedef struct {
+        char file_name[100]; // Same limit as the tar header
+        char padding[4];
+        __uint64_t offset; // Start of the file contents, relative to the start of the bundle
+        __uint64_t size;
+    } index_entry;
+    
 private:
     KRDataBlock *m_pData;
     static size_t RoundUpSize(size_t s);
+    
+    std::vector<index_entry> m_index;
+    unordered_map<std::string, size_t> m_indexLookup; // File name to position in m_index
+    
+    // Tar entry of the index the bundle was loaded with, including its header.  It is left out when the bundle is saved with a new index.
+    size_t m_indexFilePos;
+    size_t m_indexFileSize;
+    
+    bool loadIndex();
+    void addIndexEntry(const std::string &file_name, size_t offset, size_t size);
+    void saveBundle(KRDataBlock &data);
 };
 
 #endif /* defined(KRBUNDLE_H) */
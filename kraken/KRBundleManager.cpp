@@ -32,12 +32,14 @@
 #include "KRBundleManager.h"
 
 #include "KRBundle.h"
+#include "KRMesh.h"
 
 KRBundleManager::KRBundleManager(KRContext &context) : KRContextObject(context) {
     
 }
 
 KRBundleManager::~KRBundleManager() {
+    m_pendingResources.clear();
     for(unordered_map<std::string, KRBundle *>::iterator itr = m_bundles.begin(); itr != m_bundles.end(); ++itr){
         delete (*itr).second;
     }
@@ -57,4 +59,68 @@ KRBundle *KRBundleManager::getBundle(const char *szName) {
 
 unordered_map<std::string, KRBundle *> KRBundleManager::getBundles() {
     return m_bundles;
+}
+
+std::string KRBundleManager::PendingResourceKey(const std::string &name, const std::string &extension)
+{
+    std::string key = name + "." + extension;
+    std::transform(key.begin(), key.end(),
+                   key.begin(), ::tolower);
+    return key;
+}
+
+bool KRBundleManager::registerResource(KRBundle *bundle, const std::string &file_name)
+{
+    std::string name = KRResource::GetFileBase(file_name);
+    std::string extension = KRResource::GetFileExtension(file_name);
+    
+    if(extension.compare("krmesh") == 0) {
+        m_pendingResources.insert(std::make_pair(PendingResourceKey(KRMesh::GetLODBaseName(name), extension), std::make_pair(bundle, file_name)));
+    } else if(extension.compare("ktx") == 0 || extension.compare("pvr") == 0 || extension.compare("tga") == 0 || extension.compare("krscene") == 0) {
+        m_pendingResources.insert(std::make_pair(PendingResourceKey(name, extension), std::make_pair(bundle, file_name)));
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool KRBundleManager::loadPendingResource(const std::string &name, const std::string &extension)
+{
+    if(m_pendingResources.empty()) {
+        return false;
+    }
+    
+    auto range = m_pendingResources.equal_range(PendingResourceKey(name, extension));
+    if(range.first == range.second) {
+        return false;
+    }
+    
+    // Remove the entries before loading, as loading may request other resources
+    std::vector<std::pair<KRBundle *, std::string> > pending;
+    for(auto itr = range.first; itr != range.second; itr++) {
+        pending.push_back((*itr).second);
+    }
+    m_pendingResources.erase(range.first, range.second);
+    
+    for(auto itr = pending.begin(); itr != pending.end(); itr++) {
+        (*itr).first->loadIndexedResource((*itr).second);
+    }
+    return true;
+}
+
+void KRBundleManager::loadPendingResources(const std::string &extension)
+{
+    std::vector<std::pair<KRBundle *, std::string> > pending;
+    for(auto itr = m_pendingResources.begin(); itr != m_pendingResources.end();) {
+        if(extension.empty() || KRResource::GetFileExtension((*itr).second.second).compare(extension) == 0) {
+            pending.push_back((*itr).second);
+            itr = m_pendingResources.erase(itr);
+        } else {
+            itr++;
+        }
+    }
+    
+    for(auto itr = pending.begin(); itr != pending.end(); itr++) {
+        (*itr).first->loadIndexedResource((*itr).second);
+    }
 }
\ No newline at end of file
@@ -51,8 +51,22 @@ public:
     std::vector<std::string> getBundleNames();
     unordered_map<std::string, KRBundle *> getBundles();
     
+    // Called by indexed bundles for each file they contain.  Textures, meshes and scenes are deferred until first requested.  Returns false for other files, which the bundle must load immediately.
+    bool registerResource(KRBundle *bundle, const std::string &file_name);
+    
+    // Load deferred files matching the name and extension.  Meshes are matched by their LOD base name, loading all LOD levels.  Returns true if any files were loaded.
+    bool loadPendingResource(const std::string &name, const std::string &extension);
+    
+    // Load all deferred files with the extension, or all deferred files if the extension is empty
+    void loadPendingResources(const std::string &extension = "");
+    
 private:
     unordered_map<std::string, KRBundle *> m_bundles;
+    
+    // Deferred files, keyed by lower case name and extension, with the bundle and file name used to load them
+    unordered_multimap<std::string, std::pair<KRBundle *, std::string> > m_pendingResources;
+    
+    static std::string PendingResourceKey(const std::string &name, const std::string &extension);
 };
 
 #endif /* defined(KRBUNDLEMANAGER_H) */
@@ -0,0 +1,56 @@
+//
+//  KRCPUFeatures.h
+//  KREngine
+//
+//  Copyright 2012 Kearwood Gilbert. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are
+//  permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this list of
+//  conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list
+//  of conditions and the following disclaimer in the documentation and/or other materials
+//  provided with the distribution.
+//
+//  THIS SOFTWARE IS PROVIDED BY KEARWOOD GILBERT ''AS IS'' AND ANY EXPRESS OR IMPLIED
+//  WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+//  FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL KEARWOOD GILBERT OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+//  ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+//  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+//  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//  The views and conclusions contained in the software and documentation are those of the
+//  authors and should not be interpreted as representing official policies, either expressed
+//  or implied, of Kearwood Gilbert.
+//
+
+#ifndef KRCPUFEATURES_H
+#define KRCPUFEATURES_H
+
+#include "KREngine-common.h"
+
+#if defined(KRAKEN_USE_SSE2)
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#define KRAKEN_TARGET_AVX2
+#else
+// Compiles a function with AVX2 enabled even when the rest of the engine does not target AVX2.
+// Such functions must only be called when KRCPUFeatures::SupportsAVX2() returns true.
+#define KRAKEN_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+// Instruction set extensions supported by the CPU the engine is running on, detected once at runtime.
+// SIMD kernels compiled for extensions beyond the build target are selected with these.
+namespace KRCPUFeatures {
+    
+    // True if the CPU and OS support AVX2, including saving the YMM registers
+    bool SupportsAVX2();
+}
+
+#endif
@@ -124,6 +124,11 @@ void KRCamera::renderFrame(GLint defaultFBO, GLint renderBufferWidth, GLint rend
     
     scene.updateOctree(m_viewport);
     
+    // ----====---- Software occlusion culling ----====----
+    if(settings.getEnableSoftwareOcclusion()) {
+        scene.rasterizeOccluders(m_viewport);
+    }
+    
     // ----====---- Pre-stream resources ----====----
     scene.render(this, m_viewport.getVisibleBounds(), m_viewport, KRNode::RENDER_PASS_PRESTREAM, true);
     
@@ -312,7 +317,8 @@ void KRCamera::renderFrame(GLint defaultFBO, GLint renderBufferWidth, GLint rend
     }
     
     if(m_pSkyBoxTexture) {
-        getContext().getShaderManager()->selectShader("sky_box", *this, std::vector<KRPointLight *>(), std::vector<KRDirectionalLight *>(), std::vector<KRSpotLight *>(), 0, m_viewport, Matrix4(), false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, KRNode::RENDER_PASS_FORWARD_OPAQUE, Vector3::Zero(), 0.0f, Vector4::Zero());
+        static const int sky_box_shader_id = KRShaderManager::GetShaderNameID("sky_box");
+        getContext().getShaderManager()->selectShader(sky_box_shader_id, *this, std::vector<KRPointLight *>(), std::vector<KRDirectionalLight *>(), std::vector<KRSpotLight *>(), 0, m_viewport, Matrix4(), false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, KRNode::RENDER_PASS_FORWARD_OPAQUE, Vector3::Zero(), 0.0f, Vector4::Zero());
 
         getContext().getTextureManager()->selectTexture(0, m_pSkyBoxTexture, 0.0f, KRTexture::TEXTURE_USAGE_SKY_CUBE);
         
@@ -473,7 +479,8 @@ void KRCamera::renderFrame(GLint defaultFBO, GLint renderBufferWidth, GLint rend
         GLDEBUG(glBlendFunc(GL_ONE, GL_ONE));
         
         
-        KRShader *pVisShader = getContext().getShaderManager()->getShader("visualize_overlay", this, std::vector<KRPointLight *>(), std::vector<KRDirectionalLight *>(), std::vector<KRSpotLight *>(), 0, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, KRNode::RENDER_PASS_FORWARD_TRANSPARENT);
+        static const int visualize_overlay_shader_id = KRShaderManager::GetShaderNameID("visualize_overlay");
+        KRShader *pVisShader = getContext().getShaderManager()->getShader(visualize_overlay_shader_id, this, std::vector<KRPointLight *>(), std::vector<KRDirectionalLight *>(), std::vector<KRSpotLight *>(), 0, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, KRNode::RENDER_PASS_FORWARD_TRANSPARENT);
         
         m_pContext->getMeshManager()->bindVBO(&getContext().getMeshManager()->KRENGINE_VBO_DATA_3D_CUBE_VERTICES, 1.0f);
         for(unordered_map<AABB, int>::iterator itr=m_viewport.getVisibleBounds().begin(); itr != m_viewport.getVisibleBounds().end(); itr++) {
@@ -692,7 +699,8 @@ void KRCamera::renderPost()
 
 	GLDEBUG(glViewport(0, 0, m_viewport.getSize().x, m_viewport.getSize().y));
     GLDEBUG(glDisable(GL_DEPTH_TEST));
-    KRShader *postShader = m_pContext->getShaderManager()->getShader("PostShader", this, std::vector<KRPointLight *>(), std::vector<KRDirectionalLight *>(), std::vector<KRSpotLight *>(), 0, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, KRNode::RENDER_PASS_FORWARD_TRANSPARENT);
+    static const int post_shader_id = KRShaderManager::GetShaderNameID("PostShader");
+    KRShader *postShader = m_pContext->getShaderManager()->getShader(post_shader_id, this, std::vector<KRPointLight *>(), std::vector<KRDirectionalLight *>(), std::vector<KRSpotLight *>(), 0, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, KRNode::RENDER_PASS_FORWARD_TRANSPARENT);
     
     Vector3 rim_color;
     getContext().getShaderManager()->selectShader(*this, postShader, m_viewport, Matrix4(), std::vector<KRPointLight *>(), std::vector<KRDirectionalLight *>(), std::vector<KRSpotLight *>(), 0, KRNode::RENDER_PASS_FORWARD_TRANSPARENT, rim_color, 0.0f, m_fade_color);
@@ -878,7 +886,8 @@ void KRCamera::renderPost()
         GLDEBUG(glEnable(GL_BLEND));
         GLDEBUG(glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA));
         
-        KRShader *fontShader = m_pContext->getShaderManager()->getShader("debug_font", this, std::vector<KRPointLight *>(), std::vector<KRDirectionalLight *>(), std::vector<KRSpotLight *>(), 0, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, KRNode::RENDER_PASS_FORWARD_TRANSPARENT);
+        static const int debug_font_shader_id = KRShaderManager::GetShaderNameID("debug_font");
+        KRShader *fontShader = m_pContext->getShaderManager()->getShader(debug_font_shader_id, this, std::vector<KRPointLight *>(), std::vector<KRDirectionalLight *>(), std::vector<KRSpotLight *>(), 0, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, KRNode::RENDER_PASS_FORWARD_TRANSPARENT);
         getContext().getShaderManager()->selectShader(*this, fontShader, m_viewport, Matrix4(), std::vector<KRPointLight *>(), std::vector<KRDirectionalLight *>(), std::vector<KRSpotLight *>(), 0, KRNode::RENDER_PASS_FORWARD_TRANSPARENT, Vector3::Zero(), 0.0f, Vector4::Zero());
         
         m_pContext->getTextureManager()->selectTexture(0, m_pContext->getTextureManager()->getTexture("font"), 0.0f, KRTexture::TEXTURE_USAGE_UI);
@@ -987,6 +996,15 @@ std::string KRCamera::getDebugText()
             stream << "Textures\t" << texture_count_active << "\t" << texture_count << "\t" << (texture_mem_active / 1024) << " KB\t" << (texture_mem_used / 1024) << " KB\t" << (texture_mem_throughput / 1024) << " KB / frame\n";
             stream << "VBO's\t" << vbo_count_active << "\t" << vbo_count_active << "\t" << (vbo_mem_active / 1024) <<" KB\t" << (vbo_mem_used / 1024) << " KB\t" << (vbo_mem_throughput / 1024) << " KB / frame\n";
             stream << "\nGPU Total\t\t\t" << (total_mem_active / 1024) << " KB\t"  << (total_mem_used / 1024) << " KB\t" << (total_mem_throughput / 1024) << " KB / frame";
+            
+            // ---- Streamer ----
+            stream << "\n\n\n\tSkipped\tDeferred\n";
+            stream << "Textures\t" << m_pContext->getTextureManager()->getStreamerFramesSkipped() << " frames\t" << m_pContext->getTextureManager()->getStreamerFramesDeferred() << " frames\n";
+            stream << "VBO's\t" << m_pContext->getMeshManager()->getStreamerFramesSkipped() << " frames\t" << m_pContext->getMeshManager()->getStreamerFramesDeferred() << " frames";
+            
+            // ---- Octree ----
+            stream << "\n\n\n\tRelocated\tStayed\n";
+            stream << "Octree\t" << getScene().getOctreeRelocationCount() << " nodes\t" << getScene().getOctreeStayCount() << " nodes";
         }
         break;
             
@@ -1029,10 +1047,17 @@ std::string KRCamera::getDebugText()
             
             long draw_call_count = 0;
             long vertex_count = 0;
-            stream << "\tVerts\tPass\tObject\tMaterial";
+            long instance_count = 0;
+            long bind_count[KRMeshManager::BIND_TYPE_COUNT] = {0, 0, 0};
+            stream << "\tVerts\tInst\tBinds\tPass\tObject\tMaterial";
             for(std::vector<KRMeshManager::draw_call_info>::iterator itr = draw_calls.begin(); itr != draw_calls.end(); itr++) {
                 draw_call_count++;
-                stream << "\n" << draw_call_count << "\t" << (*itr).vertex_count << "\t";
+                stream << "\n" << draw_call_count << "\t" << (*itr).vertex_count << "\t" << (*itr).instance_count << "\t";
+                // Shader / texture / VBO binds made before this draw call
+                stream << (*itr).bind_count[KRMeshManager::BIND_SHADER] << "/" << (*itr).bind_count[KRMeshManager::BIND_TEXTURE] << "/" << (*itr).bind_count[KRMeshManager::BIND_VBO] << "\t";
+                for(int i=0; i < KRMeshManager::BIND_TYPE_COUNT; i++) {
+                    bind_count[i] += (*itr).bind_count[i];
+                }
                 switch((*itr).pass) {
                     case KRNode::RENDER_PASS_FORWARD_OPAQUE:
                         stream << "opaq";
@@ -1069,9 +1094,13 @@ std::string KRCamera::getDebugText()
                         break;
                 }
                 stream << "\t" << (*itr).object_name << "\t" << (*itr).material_name;
-                vertex_count += (*itr).vertex_count;
+                vertex_count += (*itr).vertex_count * (*itr).instance_count;
+                instance_count += (*itr).instance_count;
             }
-            stream << "\n\n\t\tTOTAL:\t" << draw_call_count << " draw calls\t" << vertex_count << " vertices";
+            stream << "\n\n\t\tTOTAL:\t" << draw_call_count << " draw calls\t" << instance_count << " instances\t" << vertex_count << " vertices";
+            stream << "\n\t\tBINDS:\t" << bind_count[KRMeshManager::BIND_SHADER] << " shader\t" << bind_count[KRMeshManager::BIND_TEXTURE] << " texture\t" << bind_count[KRMeshManager::BIND_VBO] << " VBO\t(" << (settings.getEnableDrawSorting() ? "sorted" : "unsorted") << ")";
+            // glUniform* calls and uniform block uploads, counted over the previous frame
+            stream << "\n\t\tUNIFORMS:\t" << m_pContext->getShaderManager()->getUniformUploadsLastFrame() << " uploads\t" << m_pContext->getShaderManager()->getUniformBytesLastFrame() << " bytes";
         }
         break;
     case KRRenderSettings::KRENGINE_DEBUG_DISPLAY_OCTREE:
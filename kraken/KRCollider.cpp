@@ -123,25 +123,43 @@ bool KRCollider::rayCast(const Vector3 &v0, const Vector3 &dir, HitInfo &hitinfo
         loadModel();
         if(m_models.size()) {
             if(getBounds().intersectsRay(v0, dir)) {
-                Vector3 v0_model_space = Matrix4::Dot(getInverseModelMatrix(), v0);
-                Vector3 dir_model_space = Vector3::Normalize(Matrix4::DotNoTranslate(getInverseModelMatrix(), dir));
-                HitInfo hitinfo_model_space;
-                if(hitinfo.didHit()) {
-                    Vector3 hit_position_model_space = Matrix4::Dot(getInverseModelMatrix(), hitinfo.getPosition());
-                    hitinfo_model_space = HitInfo(hit_position_model_space, Vector3::Normalize(Matrix4::DotNoTranslate(getInverseModelMatrix(), hitinfo.getNormal())), (hit_position_model_space - v0_model_space).magnitude(), hitinfo.getNode());
-                }
-
-                if(m_models[0]->rayCast(v0_model_space, dir_model_space, hitinfo_model_space)) {
-                    Vector3 hit_position_world_space = Matrix4::Dot(getModelMatrix(), hitinfo_model_space.getPosition());
-                    hitinfo = HitInfo(hit_position_world_space, Vector3::Normalize(Matrix4::DotNoTranslate(getModelMatrix(), hitinfo_model_space.getNormal())), (hit_position_world_space - v0).magnitude(), this);
-                    return true;
-                }
+                const KRMeshBVH *bvh = m_models[0]->beginCasts();
+                bool hit_found = rayCast(v0, dir, hitinfo, m_models[0], bvh, getModelMatrix(), getInverseModelMatrix());
+                m_models[0]->endCasts();
+                return hit_found;
             }
         }
     }
     return false;
 }
 
+bool KRCollider::rayCast(const Vector3 &v0, const Vector3 &dir, HitInfo &hitinfo, const KRMesh *model, const KRMeshBVH *bvh, const Matrix4 &model_matrix, const Matrix4 &inverse_model_matrix)
+{
+    Vector3 v0_model_space = Matrix4::Dot(inverse_model_matrix, v0);
+    Vector3 dir_model_space = Vector3::Normalize(Matrix4::DotNoTranslate(inverse_model_matrix, dir));
+    HitInfo hitinfo_model_space;
+    if(hitinfo.didHit()) {
+        Vector3 hit_position_model_space = Matrix4::Dot(inverse_model_matrix, hitinfo.getPosition());
+        hitinfo_model_space = HitInfo(hit_position_model_space, Vector3::Normalize(Matrix4::DotNoTranslate(inverse_model_matrix, hitinfo.getNormal())), (hit_position_model_space - v0_model_space).magnitude(), hitinfo.getNode());
+    }
+
+    if(model->rayCastLocked(bvh, v0_model_space, dir_model_space, hitinfo_model_space)) {
+        Vector3 hit_position_world_space = Matrix4::Dot(model_matrix, hitinfo_model_space.getPosition());
+        hitinfo = HitInfo(hit_position_world_space, Vector3::Normalize(Matrix4::DotNoTranslate(model_matrix, hitinfo_model_space.getNormal())), (hit_position_world_space - v0).magnitude(), this);
+        return true;
+    }
+    return false;
+}
+
+KRMesh *KRCollider::getModel()
+{
+    loadModel();
+    if(m_models.size()) {
+        return m_models[0];
+    }
+    return NULL;
+}
+
 bool KRCollider::sphereCast(const Vector3 &v0, const Vector3 &v1, float radius, HitInfo &hitinfo, unsigned int layer_mask)
 {
     if(layer_mask & m_layer_mask) { // Only test if layer masks have a common bit set
@@ -196,7 +214,8 @@ void KRCollider::render(KRCamera *pCamera, std::vector<KRPointLight *> &point_li
             
             GL_PUSH_GROUP_MARKER("Debug Overlays");
             
-            KRShader *pShader = getContext().getShaderManager()->getShader("visualize_overlay", pCamera, point_lights, directional_lights, spot_lights, 0, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, renderPass);
+            static const int visualize_overlay_shader_id = KRShaderManager::GetShaderNameID("visualize_overlay");
+            KRShader *pShader = getContext().getShaderManager()->getShader(visualize_overlay_shader_id, pCamera, point_lights, directional_lights, spot_lights, 0, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, renderPass);
             
             if(getContext().getShaderManager()->selectShader(*pCamera, pShader, viewport, getModelMatrix(), point_lights, directional_lights, spot_lights, 0, renderPass, Vector3::Zero(), 0.0f, Vector4::Zero())) {
                 
@@ -61,6 +61,11 @@ public:
     bool rayCast(const Vector3 &v0, const Vector3 &v1, HitInfo &hitinfo, unsigned int layer_mask);
     bool sphereCast(const Vector3 &v0, const Vector3 &v1, float radius, HitInfo &hitinfo, unsigned int layer_mask);
     
+    // Ray cast with the model and transforms captured beforehand, so KROctree can cast batches of rays from several threads.  bvh must have been returned by model->beginCasts().
+    bool rayCast(const Vector3 &v0, const Vector3 &dir, HitInfo &hitinfo, const KRMesh *model, const KRMeshBVH *bvh, const Matrix4 &model_matrix, const Matrix4 &inverse_model_matrix);
+    
+    KRMesh *getModel(); // The highest detail collision mesh, or NULL if it is not available
+    
     unsigned int getLayerMask();
     void setLayerMask(unsigned int layer_mask);
     
@@ -12,6 +12,7 @@
 #include "KRCamera.h"
 #include "KRAudioManager.h"
 #include "KRAudioSample.h"
+#include "KRWorkerPool.h"
 
 #if defined(_WIN32) || defined(_WIN64)
 #include <windows.h>
@@ -26,6 +27,30 @@ int KRContext::KRENGINE_PRESTREAM_DISTANCE;
 int KRContext::KRENGINE_SYS_ALLOCATION_GRANULARITY;
 int KRContext::KRENGINE_SYS_PAGE_SIZE;
 
+#define KRENGINE_MAX_LOAD_THREADS 8
+#define KRENGINE_DEFAULT_STREAMING_TIME_BUDGET 10
+
+#if KRENGINE_BENCHMARK_ALLOCATIONS
+#include <new>
+
+static std::atomic<long> s_allocation_count(0);
+
+void *operator new(size_t size)
+{
+    s_allocation_count++;
+    void *p = malloc(size ? size : 1);
+    if(p == NULL) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+#endif
+
 #if TARGET_OS_IPHONE
 
 
@@ -33,6 +58,8 @@ int KRContext::KRENGINE_SYS_PAGE_SIZE;
 
 #elif defined(_WIN32) || defined(_WIN64)
 
+#elif defined(__linux__) || defined(__unix__) || defined(__posix__)
+
 #else
 
 #error Unsupported Platform
@@ -59,6 +86,8 @@ KRContext::KRContext() : m_streamer(*this)
     m_last_memory_warning_frame = 0;
     m_last_fully_streamed_frame = 0;
     m_absolute_time = 0.0f;
+    m_streamingTimeBudget = KRENGINE_DEFAULT_STREAMING_TIME_BUDGET;
+    m_streamingDeadline = 0;
     
     m_pBundleManager = new KRBundleManager(*this);
     m_pShaderManager = new KRShaderManager(*this);
@@ -86,6 +115,11 @@ KRContext::KRContext() : m_streamer(*this)
     KRENGINE_SYS_PAGE_SIZE = getpagesize();
     KRENGINE_SYS_ALLOCATION_GRANULARITY = KRENGINE_SYS_PAGE_SIZE;
 
+#elif defined(__linux__) || defined(__unix__) || defined(__posix__)
+
+    KRENGINE_SYS_PAGE_SIZE = (int)sysconf(_SC_PAGESIZE);
+    KRENGINE_SYS_ALLOCATION_GRANULARITY = KRENGINE_SYS_PAGE_SIZE;
+
 #else
 #error Unsupported
 #endif
@@ -175,6 +209,15 @@ void KRContext::Log(log_level level, const std::string message_format, ...)
     va_end(args);
 }
 
+long KRContext::GetAllocationCount()
+{
+#if KRENGINE_BENCHMARK_ALLOCATIONS
+    return s_allocation_count;
+#else
+    return 0;
+#endif
+}
+
 KRBundleManager *KRContext::getBundleManager() {
     return m_pBundleManager;
 }
@@ -211,6 +254,9 @@ std::vector<KRResource *> KRContext::getResources()
     
     std::vector<KRResource *> resources;
     
+    // Include files from indexed bundles that have not been used yet
+    m_pBundleManager->loadPendingResources();
+    
     for(unordered_map<std::string, KRScene *>::iterator itr = m_pSceneManager->getScenes().begin(); itr != m_pSceneManager->getScenes().end(); itr++) {
         resources.push_back((*itr).second);
     }
@@ -251,6 +297,8 @@ void KRContext::loadResource(const std::string &file_name, KRDataBlock *data) {
     
 //    fprintf(stderr, "KRContext::loadResource - Loading: %s\n", file_name.c_str());
     
+    std::lock_guard<std::recursive_mutex> lock(m_resourceMutex);
+    
     if(extension.compare("krbundle") == 0) {
         m_pBundleManager->loadBundle(name.c_str(), data);
     } else if(extension.compare("krmesh") == 0) {
@@ -302,6 +350,167 @@ void KRContext::loadResource(std::string path) {
     }
 }
 
+bool KRContext::parseResource(const std::string &file_name, KRDataBlock *data, std::vector<KRResource *> &resources) {
+    std::string name = KRResource::GetFileBase(file_name);
+    std::string extension = KRResource::GetFileExtension(file_name);
+    
+    // Only types whose constructors do not access the managers are parsed here
+    if(extension.compare("krmesh") == 0) {
+        resources.push_back(new KRMesh(*this, name, data));
+    } else if(extension.compare("krscene") == 0) {
+        KRScene *pScene = KRScene::Load(*this, name, data);
+        if(pScene) {
+            resources.push_back(pScene);
+        }
+    } else if(extension.compare("kranimation") == 0) {
+        KRAnimation *pAnimation = KRAnimation::Load(*this, name, data);
+        if(pAnimation) {
+            resources.push_back(pAnimation);
+        }
+    } else if(extension.compare("kranimationcurve") == 0) {
+        KRAnimationCurve *pAnimationCurve = KRAnimationCurve::Load(*this, name, data);
+        if(pAnimationCurve) {
+            resources.push_back(pAnimationCurve);
+        }
+    } else if(extension.compare("pvr") == 0 || extension.compare("ktx") == 0 || extension.compare("tga") == 0) {
+        KRTexture *pTexture = m_pTextureManager->createTexture(name.c_str(), extension.c_str(), data);
+        if(pTexture) {
+            resources.push_back(pTexture);
+        }
+    } else if(extension.compare("mtl") == 0) {
+        std::vector<KRMaterial *> materials;
+        m_pMaterialManager->parse(name.c_str(), data, materials);
+        resources.insert(resources.end(), materials.begin(), materials.end());
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void KRContext::addResource(KRResource *resource) {
+    std::string extension = resource->getExtension();
+    
+    if(extension.compare("krmesh") == 0) {
+        m_pMeshManager->addModel((KRMesh *)resource);
+    } else if(extension.compare("krscene") == 0) {
+        m_pSceneManager->add((KRScene *)resource);
+    } else if(extension.compare("kranimation") == 0) {
+        m_pAnimationManager->addAnimation((KRAnimation *)resource);
+    } else if(extension.compare("kranimationcurve") == 0) {
+        m_pAnimationCurveManager->addAnimationCurve((KRAnimationCurve *)resource);
+    } else if(extension.compare("pvr") == 0 || extension.compare("ktx") == 0 || extension.compare("tga") == 0) {
+        m_pTextureManager->addTexture((KRTexture *)resource);
+    } else if(extension.compare("mtl") == 0) {
+        m_pMaterialManager->addParsed((KRMaterial *)resource);
+    }
+}
+
+int KRContext::getLoadThreadCount() const {
+    // The worker pool threads and the calling thread
+    int thread_count = KRWorkerPool::get().getThreadCount() + 1;
+    if(thread_count > KRENGINE_MAX_LOAD_THREADS) {
+        thread_count = KRENGINE_MAX_LOAD_THREADS;
+    }
+    return thread_count;
+}
+
+void KRContext::parseResources(const std::vector<std::pair<std::string, KRDataBlock *> > &files, std::vector<std::vector<KRResource *> > &parsed, std::vector<char> &is_parsed, int thread_count) {
+    // Results are written to the slot for each file, so no locking is needed until they are registered
+    KRWorkerPool::get().parallelFor(files.size(), [this, &files, &parsed, &is_parsed](size_t file_index) {
+        if(parseResource(files[file_index].first, files[file_index].second, parsed[file_index])) {
+            is_parsed[file_index] = 1;
+        }
+    }, thread_count);
+}
+
+void KRContext::loadResources(const std::vector<std::pair<std::string, KRDataBlock *> > &files) {
+    long start_time = getAbsoluteTimeMilliseconds();
+    
+    size_t file_count = files.size();
+    std::vector<std::vector<KRResource *> > parsed(file_count);
+    std::vector<char> is_parsed(file_count, 0); // Not std::vector<bool>, so workers may write neighbouring elements concurrently
+    
+    int thread_count = getLoadThreadCount();
+    if(thread_count > (int)file_count) {
+        thread_count = (int)file_count;
+    }
+    
+    if(thread_count > 1) {
+        parseResources(files, parsed, is_parsed, thread_count);
+    }
+    
+    // Register the parsed resources in file order, so later files replace earlier ones with the same name, as they would when loaded one at a time.  Other types are loaded here on the calling thread.
+    {
+        std::lock_guard<std::recursive_mutex> lock(m_resourceMutex);
+        for(size_t file_index=0; file_index < file_count; file_index++) {
+            if(is_parsed[file_index]) {
+                for(std::vector<KRResource *>::iterator itr = parsed[file_index].begin(); itr != parsed[file_index].end(); itr++) {
+                    addResource(*itr);
+                }
+            } else {
+                loadResource(files[file_index].first, files[file_index].second);
+            }
+        }
+    }
+    
+    if(file_count > 0) {
+        KRContext::Log(KRContext::LOG_LEVEL_INFORMATION, "KRContext::loadResources - Loaded %i files in %i ms with %i threads", (int)file_count, (int)(getAbsoluteTimeMilliseconds() - start_time), thread_count > 1 ? thread_count : 1);
+    }
+}
+
+void KRContext::benchmarkLoading() {
+    const int FILE_COUNT = 64; // Of each type
+    const int MATERIALS_PER_FILE = 256;
+    const int NODES_PER_SCENE = 1024;
+    
+    // Generate the files once, so every thread count parses the same text
+    std::vector<std::pair<std::string, std::string> > sources;
+    char szLine[256];
+    for(int file_index=0; file_index < FILE_COUNT; file_index++) {
+        std::string mtl;
+        for(int material_index=0; material_index < MATERIALS_PER_FILE; material_index++) {
+            float c = (float)material_index / MATERIALS_PER_FILE;
+            sprintf(szLine, "newmtl benchmark_material_%i_%i\nka %f %f %f\nkd %f %f %f\nks %f %f %f\nns %f\n\n", file_index, material_index, c, c, c, 1.0f - c, c, 0.5f, c, 1.0f - c, 0.5f, c * 100.0f);
+            mtl += szLine;
+        }
+        sources.push_back(std::make_pair(std::string("benchmark_") + std::to_string(file_index) + ".mtl", mtl));
+        
+        std::string scene = "<scene>\n<node name=\"benchmark_root\">\n";
+        for(int node_index=0; node_index < NODES_PER_SCENE; node_index++) {
+            sprintf(szLine, "<node name=\"benchmark_node_%i_%i\" translate_x=\"%i\" translate_y=\"0\" translate_z=\"%i\" rotate_x=\"0\" rotate_y=\"%f\" rotate_z=\"0\"/>\n", file_index, node_index, node_index % 32, node_index / 32, (float)node_index);
+            scene += szLine;
+        }
+        scene += "</node>\n</scene>\n";
+        sources.push_back(std::make_pair(std::string("benchmark_") + std::to_string(file_index) + ".krscene", scene));
+    }
+    
+    int max_thread_count = getLoadThreadCount();
+    for(int thread_count=1; thread_count <= max_thread_count; thread_count++) {
+        // Parsing takes ownership of the data blocks, so each run is given new ones
+        std::vector<std::pair<std::string, KRDataBlock *> > files;
+        for(std::vector<std::pair<std::string, std::string> >::iterator itr = sources.begin(); itr != sources.end(); itr++) {
+            KRDataBlock *data = new KRDataBlock();
+            data->append((*itr).second);
+            files.push_back(std::make_pair((*itr).first, data));
+        }
+        std::vector<std::vector<KRResource *> > parsed(files.size());
+        std::vector<char> is_parsed(files.size(), 0);
+        
+        std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+        parseResources(files, parsed, is_parsed, thread_count);
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+        
+        KRContext::Log(KRContext::LOG_LEVEL_INFORMATION, "KRContext::benchmarkLoading - Parsed %i files in %.2f ms with %i threads", (int)files.size(), elapsed * 1000.0, thread_count);
+        
+        // The resources were never registered with their managers
+        for(std::vector<std::vector<KRResource *> >::iterator file_itr = parsed.begin(); file_itr != parsed.end(); file_itr++) {
+            for(std::vector<KRResource *>::iterator itr = (*file_itr).begin(); itr != (*file_itr).end(); itr++) {
+                delete *itr;
+            }
+        }
+    }
+}
+
 void KRContext::detectExtensions() {
     m_bDetectedExtensions = true;
     
@@ -314,6 +523,8 @@ void KRContext::startFrame(float deltaTime)
     m_pAnimationManager->startFrame(deltaTime);
     m_pSoundManager->startFrame(deltaTime);
     m_pMeshManager->startFrame(deltaTime);
+    m_pShaderManager->startFrame(deltaTime);
+    m_streamer.signalFrame(m_pTextureManager->getStreamerPrioritiesChanged() || m_pMeshManager->getStreamerPrioritiesChanged());
 }
 
 void KRContext::endFrame(float deltaTime)
@@ -345,8 +556,12 @@ long KRContext::getAbsoluteTimeMilliseconds()
 {
 #ifdef __APPLE__
     return (long)(mach_absolute_time() / 1000 * m_timebase_info.numer / m_timebase_info.denom); // Division done first to avoid potential overflow
-#else
+#elif defined(_WIN32) || defined(_WIN64)
     return (long)GetTickCount64();
+#else
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
 #endif
 }
 
@@ -360,6 +575,21 @@ void KRContext::setStreamingEnabled(bool enable)
     m_streamingEnabled = enable;
 }
 
+long KRContext::getStreamingTimeBudget()
+{
+    return m_streamingTimeBudget;
+}
+
+void KRContext::setStreamingTimeBudget(long milliseconds)
+{
+    m_streamingTimeBudget = milliseconds;
+}
+
+bool KRContext::getStreamingTimeExceeded()
+{
+    return getAbsoluteTimeMilliseconds() > m_streamingDeadline;
+}
+
 
 #if TARGET_OS_IPHONE || TARGET_OS_MAC
 
@@ -385,8 +615,9 @@ void KRContext::getMemoryStats(long &free_memory)
 
 #endif
 
-void KRContext::doStreaming()
+bool KRContext::doStreaming()
 {
+    bool streamed = false;
     if(m_streamingEnabled) {
         /*
         long free_memory = KRENGINE_GPU_MEM_TARGET;
@@ -429,6 +660,7 @@ void KRContext::doStreaming()
         
         
         long streaming_start_frame = m_current_frame;
+        m_streamingDeadline = getAbsoluteTimeMilliseconds() + m_streamingTimeBudget;
         
         long memoryRemaining = KRENGINE_GPU_MEM_TARGET;
         long memoryRemainingThisFrame = KRENGINE_GPU_MEM_MAX - m_pTextureManager->getMemUsed() - m_pMeshManager->getMemUsed();
@@ -436,11 +668,14 @@ void KRContext::doStreaming()
         m_pMeshManager->doStreaming(memoryRemaining, memoryRemainingThisFrame);
         m_pTextureManager->doStreaming(memoryRemaining, memoryRemainingThisFrame);
         
-        if(memoryRemainingThisFrame == memoryRemainingThisFrameStart && memoryRemainingThisFrame > 0) {
+        if(memoryRemainingThisFrame != memoryRemainingThisFrameStart || getStreamingTimeExceeded()) {
+            streamed = true;
+        } else if(memoryRemainingThisFrame > 0) {
             m_last_fully_streamed_frame = streaming_start_frame;
         }
         
     }
+    return streamed;
 }
 
 void KRContext::receivedMemoryWarning()
@@ -41,6 +41,12 @@ public:
     void loadResource(const std::string &file_name, KRDataBlock *data);
     void loadResource(std::string path);
     
+    // Load a set of files, such as the contents of a krbundle.  Files are parsed on a pool of worker threads, then registered with their managers in the order given.
+    void loadResources(const std::vector<std::pair<std::string, KRDataBlock *> > &files);
+    
+    // Time the parsing of a fixed set of generated material and scene files with 1 to the maximum number of loader threads, and log the results
+    void benchmarkLoading();
+    
     KRBundleManager *getBundleManager();
     KRSceneManager *getSceneManager();
     KRTextureManager *getTextureManager();
@@ -75,6 +81,11 @@ public:
     bool getStreamingEnabled();
     void setStreamingEnabled(bool enable);
     
+    // Milliseconds the streamer may spend uploading data for each frame.  Data that does not fit is prefetched for the next frame.
+    long getStreamingTimeBudget();
+    void setStreamingTimeBudget(long milliseconds);
+    bool getStreamingTimeExceeded();
+    
 #if TARGET_OS_IPHONE || TARGET_OS_MAC
     // XXX This doesn't belong here, and might not actually be needed at all
     void getMemoryStats(long &free_memory);
@@ -91,7 +102,10 @@ public:
     static void SetLogCallback(log_callback *log_callback, void *user_data);
     static void Log(log_level level, const std::string message_format, ...);
     
-    void doStreaming();
+    // Allocations made with operator new by the whole process so far.  Always 0 unless built with KRENGINE_BENCHMARK_ALLOCATIONS.
+    static long GetAllocationCount();
+    
+    bool doStreaming(); // Returns true if anything was streamed
     void receivedMemoryWarning();
 
     static void activateStreamerContext();
@@ -116,6 +130,16 @@ private:
     void detectExtensions();
     bool m_bDetectedExtensions;
     
+    // Construct the resources in a file without registering them with a manager.  Returns false for file types that must be loaded with loadResource.
+    bool parseResource(const std::string &file_name, KRDataBlock *data, std::vector<KRResource *> &resources);
+    // Parse the files with up to thread_count threads from the KRWorkerPool.  is_parsed is set for the files that parseResource accepted.
+    void parseResources(const std::vector<std::pair<std::string, KRDataBlock *> > &files, std::vector<std::vector<KRResource *> > &parsed, std::vector<char> &is_parsed, int thread_count);
+    int getLoadThreadCount() const;
+    void addResource(KRResource *resource);
+    
+    // Held while resources are registered with the managers.  Recursive, as loading a krbundle loads the files it contains.
+    std::recursive_mutex m_resourceMutex;
+    
     long m_current_frame; // TODO - Does this need to be atomic?
     long m_last_memory_warning_frame; // TODO - Does this need to be atomic?
     long m_last_fully_streamed_frame; // TODO - Does this need to be atomic?
@@ -126,6 +150,8 @@ private:
 #endif
 
     std::atomic<bool> m_streamingEnabled;
+    std::atomic<long> m_streamingTimeBudget;
+    long m_streamingDeadline; // Only accessed by the streamer thread
     
     
     static log_callback *s_log_callback;
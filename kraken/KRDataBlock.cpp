@@ -35,13 +35,157 @@
 #include "KRContext.h"
 
 #include <errno.h>
+#include <mutex>
+#include <condition_variable>
 
 #define KRAKEN_MEM_ROUND_DOWN_PAGE(x) ((x) & ~(KRContext::KRENGINE_SYS_ALLOCATION_GRANULARITY - 1))
 #define KRAKEN_MEM_ROUND_UP_PAGE(x) ((((x) - 1) & ~(KRContext::KRENGINE_SYS_ALLOCATION_GRANULARITY - 1)) + KRContext::KRENGINE_SYS_ALLOCATION_GRANULARITY)
 
-int m_mapCount = 0;
-size_t m_mapSize = 0;
-size_t m_mapOverhead = 0;
+#define KRENGINE_PREFETCH_THREADS 2
+#define KRENGINE_PREFETCH_QUEUE_MAX 256
+
+std::atomic<int> m_mapCount(0);
+std::atomic<size_t> m_mapSize(0);
+std::atomic<size_t> m_mapOverhead(0);
+
+// Small pool of I/O threads that pull file ranges into the page cache ahead of KRDataBlock::lock() and copy()
+class KRDataBlockPrefetcher {
+public:
+#if defined(_WIN32) || defined(_WIN64)
+    typedef HANDLE file_handle;
+#else
+    typedef int file_handle;
+#endif
+    
+    static KRDataBlockPrefetcher &get()
+    {
+        static KRDataBlockPrefetcher prefetcher;
+        return prefetcher;
+    }
+    
+    KRDataBlockPrefetcher()
+    {
+        m_stop = false;
+        for(int i=0; i < KRENGINE_PREFETCH_THREADS; i++) {
+            m_threads.push_back(std::thread(&KRDataBlockPrefetcher::run, this));
+        }
+    }
+    
+    ~KRDataBlockPrefetcher()
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_wake.notify_all();
+        for(auto itr = m_threads.begin(); itr != m_threads.end(); itr++) {
+            (*itr).join();
+        }
+        for(auto itr = m_queue.begin(); itr != m_queue.end(); itr++) {
+            closeFile((*itr).second.file);
+        }
+    }
+    
+    // Takes ownership of file, which must be a duplicate of the data block's file handle so that it remains valid if the block is unloaded first.
+    // Returns false if the request was dropped, as the queue is full of more important requests.  If the request is accepted but later
+    // evicted by more important ones, queued is cleared.
+    bool enqueue(file_handle file, size_t offset, size_t length, float priority, const std::shared_ptr<std::atomic<bool> > &queued)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if(m_queue.size() >= KRENGINE_PREFETCH_QUEUE_MAX) {
+                auto lowest = m_queue.begin();
+                if((*lowest).first >= priority) {
+                    // Queue is full of more important requests
+                    closeFile(file);
+                    return false;
+                }
+                closeFile((*lowest).second.file);
+                *(*lowest).second.queued = false;
+                m_queue.erase(lowest);
+            }
+            prefetch_request request;
+            request.file = file;
+            request.offset = offset;
+            request.length = length;
+            request.queued = queued;
+            m_queue.insert(std::pair<float, prefetch_request>(priority, request));
+        }
+        m_wake.notify_one();
+        return true;
+    }
+    
+private:
+    typedef struct {
+        file_handle file;
+        size_t offset;
+        size_t length;
+        std::shared_ptr<std::atomic<bool> > queued; // Shared with the requesting block
+    } prefetch_request;
+    
+    std::multimap<float, prefetch_request> m_queue; // Highest priority requests are at the end
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::vector<std::thread> m_threads;
+    bool m_stop;
+    
+    static void closeFile(file_handle file)
+    {
+#if defined(_WIN32) || defined(_WIN64)
+        CloseHandle(file);
+#else
+        close(file);
+#endif
+    }
+    
+    void run()
+    {
+        while(true) {
+            prefetch_request request;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                while(!m_stop && m_queue.empty()) {
+                    m_wake.wait(lock);
+                }
+                if(m_stop) {
+                    return;
+                }
+                auto highest = --m_queue.end();
+                request = (*highest).second;
+                m_queue.erase(highest);
+            }
+            
+#if defined(_WIN32) || defined(_WIN64)
+            // Map the range just long enough to ask the memory manager to read it into the file cache, where it stays for the later lock() or copy()
+            HANDLE hFileMapping = CreateFileMappingFromApp(request.file, NULL, PAGE_READONLY, 0, NULL);
+            if(hFileMapping != NULL) {
+                size_t alignment_offset = request.offset & (KRContext::KRENGINE_SYS_ALLOCATION_GRANULARITY - 1);
+                size_t view_size = request.length + alignment_offset;
+                void *view = MapViewOfFileFromApp(hFileMapping, FILE_MAP_READ, request.offset - alignment_offset, view_size);
+                if(view != NULL) {
+                    WIN32_MEMORY_RANGE_ENTRY range;
+                    range.VirtualAddress = view;
+                    range.NumberOfBytes = view_size;
+                    PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+                    UnmapViewOfFile(view);
+                }
+                CloseHandle(hFileMapping);
+            }
+#elif defined(__linux__)
+            // readahead() blocks until the pages are in the page cache, which is the work we want to take off the streamer thread
+            readahead(request.file, request.offset, request.length);
+#elif defined(__APPLE__)
+            struct radvisory advisory;
+            advisory.ra_offset = request.offset;
+            advisory.ra_count = (int)std::min(request.length, (size_t)std::numeric_limits<int>::max());
+            fcntl(request.file, F_RDADVISE, &advisory);
+#elif defined(POSIX_FADV_WILLNEED)
+            posix_fadvise(request.file, request.offset, request.length, POSIX_FADV_WILLNEED);
+#endif
+            closeFile(request.file);
+        }
+    }
+};
 
 KRDataBlock::KRDataBlock() {
     m_data = NULL;
@@ -50,7 +194,7 @@ KRDataBlock::KRDataBlock() {
 #if defined(_WIN32) || defined(_WIN64)
     m_hPackFile = INVALID_HANDLE_VALUE;
     m_hFileMapping = NULL;
-#elif defined(__APPLE__)
+#else
     m_fdPackFile = 0;
 #endif
     m_fileName = "";
@@ -68,7 +212,7 @@ KRDataBlock::KRDataBlock(void *data, size_t size) {
 #if defined(_WIN32) || defined(_WIN64)
     m_hPackFile = INVALID_HANDLE_VALUE;
     m_hFileMapping = NULL;
-#elif defined(__APPLE__)
+#else
     m_fdPackFile = 0;
 #endif
     m_fileName = "";
@@ -94,7 +238,7 @@ void KRDataBlock::unload()
       CloseHandle(m_hPackFile);
       m_hPackFile = INVALID_HANDLE_VALUE;
     }
-#elif defined(__APPLE__)
+#else
     if(m_fdPackFile) {
         // Memory mapped file
         if(m_fileOwnerDataBlock == this) {
@@ -151,7 +295,7 @@ bool KRDataBlock::load(const std::string &path)
         success = true;
       }
     }
-#elif defined(__APPLE__)
+#else
     m_fdPackFile = open(path.c_str(), O_RDONLY);
     if(m_fdPackFile >= 0) {
       m_fileOwnerDataBlock = this;
@@ -179,11 +323,9 @@ KRDataBlock *KRDataBlock::getSubBlock(int start, int length)
 #if defined(_WIN32) || defined(_WIN64)
     if(m_hPackFile) {
         new_block->m_hPackFile = m_hPackFile;
-#elif defined(__APPLE__)
+#else
     if (m_fdPackFile) {
       new_block->m_fdPackFile = m_fdPackFile;
-#else
-#error Unsupported
 #endif
         new_block->m_fileOwnerDataBlock = m_fileOwnerDataBlock;
         new_block->m_data_offset = start + m_data_offset;
@@ -217,10 +359,8 @@ void KRDataBlock::expand(size_t size)
 {
 #if defined(_WIN32) || defined(_WIN64)
     if(m_data == NULL && m_hPackFile == 0) {
-#elif defined(__APPLE__)
-    if (m_data == NULL && m_fdPackFile == 0) {
 #else
-#error Unsupported
+    if (m_data == NULL && m_fdPackFile == 0) {
 #endif
         // Starting with an empty data block; allocate memory on the heap
         m_data = malloc(size);
@@ -290,13 +430,27 @@ void KRDataBlock::copy(void *dest, int start, int count) {
       bytes_remaining -= bytes_read;
     }
     assert(bytes_remaining == 0);
-#elif defined(__APPLE__)
+#else
     if(m_lockCount == 0 && m_fdPackFile != 0) {
         // Optimization: If we haven't mmap'ed or malloced the data already, pread() it directly from the file into the buffer
-        ssize_t r = pread(m_fdPackFile, dest, count, start + m_data_offset);
-        assert(r != -1);
-#else
-#error Unsupported
+        m_prefetchQueued.reset();
+        unsigned char *w = (unsigned char *)dest;
+        size_t bytes_remaining = count;
+        off_t read_offset = start + m_data_offset;
+        while(bytes_remaining > 0) {
+            ssize_t r = pread(m_fdPackFile, w, bytes_remaining, read_offset);
+            if(r == -1 && errno == EINTR) {
+                continue;
+            }
+            assert(r > 0);
+            if(r <= 0) {
+                KRContext::Log(KRContext::LOG_LEVEL_ERROR, "pread failed with errno: %i", errno);
+                break;
+            }
+            w += r;
+            read_offset += r;
+            bytes_remaining -= r;
+        }
 #endif
     } else {
         lock();
@@ -365,36 +519,41 @@ bool KRDataBlock::save(const std::string& path) {
 
   return success;
 
-#elif defined(__APPLE__)
+#else
     int fdNewFile = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, (mode_t)0600);
     if(fdNewFile == -1) {
         return false;
     }
 
-    // Seek to end of file and write a byte to enlarge it
-    lseek(fdNewFile, m_data_size-1, SEEK_SET);
-    write(fdNewFile, "", 1);
+    if(m_data_size == 0) {
+        // Nothing to map; leave an empty file
+        close(fdNewFile);
+        return true;
+    }
+
+    // Enlarge the file to its final size before mapping it
+    if(ftruncate(fdNewFile, m_data_size) == -1) {
+        close(fdNewFile);
+        return false;
+    }
 
     // Now map it...
     void *pNewData = mmap(0, m_data_size, PROT_READ | PROT_WRITE, MAP_SHARED, fdNewFile, 0);
-    if(pNewData == (caddr_t) -1) {
+    if(pNewData == MAP_FAILED) {
         close(fdNewFile);
         return false;
     }
-    if(m_data != NULL) {
-        // Copy data to new file
-        copy(pNewData);
 
-        // Unmap the new file
-        munmap(pNewData, m_data_size);
+    // Copy data to new file.  Unlocked file-backed blocks are pread() directly into the mapping.
+    copy(pNewData);
 
-        // Close the new file
-        close(fdNewFile);
-    }
+    // Unmap the new file
+    munmap(pNewData, m_data_size);
+
+    // Close the new file
+    close(fdNewFile);
     return true;
 
-#else
-#error Unsupported
 #endif
 }
 
@@ -414,14 +573,13 @@ std::string KRDataBlock::getString()
 void KRDataBlock::lock()
 {
     if(m_lockCount == 0) {
+        m_prefetchQueued.reset();
 
         // Memory mapped file; ensure data is mapped to ram
 #if defined(_WIN32) || defined(_WIN64)
         if(m_hFileMapping) {
-#elif defined(__APPLE__)
-        if(m_fdPackFile) {
 #else
-#error Unsupported
+        if(m_fdPackFile) {
 #endif
             if(m_data_size < KRENGINE_MIN_MMAP) {
                 m_data = malloc(m_data_size);
@@ -436,11 +594,11 @@ void KRDataBlock::lock()
 
               m_mmapData = MapViewOfFileFromApp(m_hPackFile, m_bReadOnly ? FILE_MAP_READ : FILE_MAP_WRITE, m_data_offset - alignment_offset, m_data_size + alignment_offset);
               assert(m_mmapData != NULL);
-#elif defined(__APPLE__)
+#else
                 //fprintf(stderr, "KRDataBlock::lock - \"%s\" (%i)\n", m_fileOwnerDataBlock->m_fileName.c_str(), m_lockCount);
                 // Round m_data_offset down to the next memory page, as required by mmap
 
-                if ((m_mmapData = mmap(0, m_data_size + alignment_offset, m_bReadOnly ? PROT_READ : PROT_WRITE, MAP_SHARED, m_fdPackFile, m_data_offset - alignment_offset)) == (caddr_t) -1) {
+                if ((m_mmapData = mmap(0, m_data_size + alignment_offset, m_bReadOnly ? PROT_READ : PROT_WRITE, MAP_SHARED, m_fdPackFile, m_data_offset - alignment_offset)) == MAP_FAILED) {
                     int iError = errno;
                     switch(iError) {
                         case EACCES:
@@ -470,8 +628,11 @@ void KRDataBlock::lock()
                     }
                     assert(false); // mmap() failed.
                 }
-#else
-#error Unsupported
+#if defined(MADV_SEQUENTIAL) && defined(MADV_WILLNEED)
+                // Textures and meshes are consumed front-to-back as soon as they are locked; let the kernel read ahead aggressively
+                madvise(m_mmapData, m_data_size + alignment_offset, MADV_SEQUENTIAL);
+                madvise(m_mmapData, m_data_size + alignment_offset, MADV_WILLNEED);
+#endif
 #endif
                 m_mapCount++;
                 m_mapSize += m_data_size;
@@ -496,10 +657,8 @@ void KRDataBlock::unlock()
         // Memory mapped file; ensure data is unmapped from ram
 #if defined(_WIN32) || defined(_WIN64)
         if (m_hPackFile) {
-#elif defined(__APPLE__)
-        if(m_fdPackFile) {
 #else
-#error Undefined
+        if(m_fdPackFile) {
 #endif
             if(m_data_size < KRENGINE_MIN_MMAP) {
                 free(m_data);
@@ -514,16 +673,15 @@ void KRDataBlock::unlock()
                   CloseHandle(m_hFileMapping);
                   m_hFileMapping = NULL;
                 }
-#elif defined(__APPLE__)
-                munmap(m_mmapData, m_data_size);
-#else
-#error Undefined
+#endif
+                size_t alignment_offset = m_data_offset & (KRContext::KRENGINE_SYS_ALLOCATION_GRANULARITY - 1);
+#if !defined(_WIN32) && !defined(_WIN64)
+                munmap(m_mmapData, m_data_size + alignment_offset);
 #endif
                 m_data = NULL;
                 m_mmapData = NULL;
                 m_mapCount--;
                 m_mapSize -= m_data_size;
-                size_t alignment_offset = m_data_offset & (KRContext::KRENGINE_SYS_ALLOCATION_GRANULARITY - 1);
                 m_mapOverhead -= alignment_offset + KRAKEN_MEM_ROUND_UP_PAGE(m_data_size + alignment_offset) - m_data_size + alignment_offset;
                 // fprintf(stderr, "Mapped: %i Size: %d Overhead: %d\n", m_mapCount, m_mapSize, m_mapOverhead);
             }
@@ -532,6 +690,38 @@ void KRDataBlock::unlock()
     m_lockCount--;
 }
 
+// Hint that a range of the data block will be locked or copied soon
+void KRDataBlock::prefetch(size_t start, size_t length, float priority)
+{
+#if defined(_WIN32) || defined(_WIN64)
+    bool file_backed = m_hPackFile != INVALID_HANDLE_VALUE && m_hPackFile != 0;
+#else
+    bool file_backed = m_fdPackFile != 0;
+#endif
+    if(m_lockCount > 0 || !file_backed || (m_prefetchQueued && *m_prefetchQueued) || start >= m_data_size) {
+        // Already in ram, not file backed, or already queued
+        return;
+    }
+    if(length == 0 || start + length > m_data_size) {
+        length = m_data_size - start;
+    }
+#if defined(_WIN32) || defined(_WIN64)
+    HANDLE file = INVALID_HANDLE_VALUE;
+    if(!DuplicateHandle(GetCurrentProcess(), m_hPackFile, GetCurrentProcess(), &file, 0, FALSE, DUPLICATE_SAME_ACCESS)) {
+        return;
+    }
+#else
+    int file = dup(m_fdPackFile);
+    if(file == -1) {
+        return;
+    }
+#endif
+    std::shared_ptr<std::atomic<bool> > queued = std::make_shared<std::atomic<bool> >(true);
+    if(KRDataBlockPrefetcher::get().enqueue(file, m_data_offset + start, length, priority, queued)) {
+        m_prefetchQueued = queued;
+    }
+}
+
 // Assert if not locked
 void KRDataBlock::assertLocked()
 {
@@ -34,6 +34,8 @@
 
 #include "KREngine-common.h"
 
+#include <memory>
+
 #if defined(_WIN32) || defined(_WIN64)
 #include <Windows.h>
 #endif
@@ -97,6 +99,11 @@ public:
     // Unlock the memory, releasing the address space for use by other allocations
     void unlock();
     
+    // Hint that a range of the data block will be locked or copied soon.  File backed blocks queue an asynchronous read-ahead
+    // on the I/O prefetch threads so the later lock() or copy() does not stall on disk.  A length of 0 extends to the end of the block.
+    // Higher priority requests are serviced first.  The hint is ignored for blocks already in ram.
+    void prefetch(size_t start = 0, size_t length = 0, float priority = 0.0f);
+    
 private:
     void *m_data;
     size_t m_data_size;
@@ -106,7 +113,7 @@ private:
 #if defined(_WIN32) || defined(_WIN64)
     HANDLE m_hPackFile;
     HANDLE m_hFileMapping;
-#elif defined(__APPLE__)
+#else
     int m_fdPackFile;
 #endif
     
@@ -123,6 +130,10 @@ private:
     // Read-only allocation
     bool m_bReadOnly;
     
+    // Set while a prefetch queued since the data was last read is still wanted.  Shared with the queued request, so the prefetcher can clear it
+    // if the request is evicted by more important ones, letting the block be prefetched again.
+    std::shared_ptr<std::atomic<bool> > m_prefetchQueued;
+    
     // Assert if not locked
     void assertLocked();
 
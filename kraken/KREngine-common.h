@@ -27,6 +27,7 @@ using namespace kraken;
 
 #include <stack>
 #include <queue>
+#include <deque>
 #include <iostream>
 #include <sstream>
 #include <fstream>
@@ -34,6 +35,14 @@ using namespace kraken;
 #include <stdio.h>
 
 #include "../3rdparty/tinyxml2/tinyxml2.h"
+#if defined(__linux__) || defined(__unix__) || defined(__posix__)
+
+#include <sys/mman.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#endif
+
 #if defined(__APPLE__)
 
 #include <sys/mman.h>
@@ -67,6 +76,7 @@ using namespace kraken;
 
 #include <atomic>
 #include <thread>
+#include <functional>
 
 
 
@@ -93,10 +103,15 @@ using std::queue;
 #define KRENGINE_MAX_TEXTURE_UNITS 8
 
 
-#if !defined(__i386__) && defined(__arm__)
+#if (!defined(__i386__) && defined(__arm__)) || defined(__aarch64__)
 #define KRAKEN_USE_ARM_NEON
 #endif
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define KRAKEN_USE_SSE2
+#include <emmintrin.h>
+#endif
+
 
 #include <unordered_map>
 using std::unordered_map;
@@ -126,6 +141,7 @@ typedef uint8_t __uint8_t;
 #define glTexStorage2DEXT glTexStorage2D
 #define GL_ANY_SAMPLES_PASSED_EXT GL_ANY_SAMPLES_PASSED
 #define GL_QUERY_RESULT_EXT GL_QUERY_RESULT
+#define GL_QUERY_RESULT_AVAILABLE_EXT GL_QUERY_RESULT_AVAILABLE
 
 #elif TARGET_OS_IPHONE
 
@@ -148,6 +164,7 @@ typedef uint8_t __uint8_t;
 #define glTexStorage2DEXT glTexStorage2D
 #define GL_ANY_SAMPLES_PASSED_EXT GL_ANY_SAMPLES_PASSED
 #define GL_QUERY_RESULT_EXT GL_QUERY_RESULT
+#define GL_QUERY_RESULT_AVAILABLE_EXT GL_QUERY_RESULT_AVAILABLE
 
 #define GL_OES_mapbuffer 1
 #define glMapBufferOES glMapBuffer
@@ -161,6 +178,40 @@ typedef uint8_t __uint8_t;
 
 #endif
 
+// Stage texture uploads through pixel buffer objects and track their completion with fence syncs
+#if GL_VERSION_3_2 || GL_ES_VERSION_3_0
+#define KRENGINE_TEXTURE_PBO_UPLOADS 1
+#else
+#define KRENGINE_TEXTURE_PBO_UPLOADS 0
+#endif
+
+// Cache linked shader programs on disk with glGetProgramBinary
+#if GL_VERSION_4_1 || GL_ES_VERSION_3_0 || GL_ARB_get_program_binary
+#define KRENGINE_PROGRAM_BINARY_CACHE 1
+#else
+#define KRENGINE_PROGRAM_BINARY_CACHE 0
+#endif
+
+// Replace the global operator new with one that counts every allocation in the process, so benchmarks can report the allocations of the code they time.
+// Off unless defined by the build, as it applies to the whole application.
+#ifndef KRENGINE_BENCHMARK_ALLOCATIONS
+#define KRENGINE_BENCHMARK_ALLOCATIONS 0
+#endif
+
+// Draw repeated meshes with glDrawElementsInstanced and per-instance vertex attributes
+#if GL_VERSION_3_3 || GL_ES_VERSION_3_0
+#define KRENGINE_INSTANCED_DRAWING 1
+#else
+#define KRENGINE_INSTANCED_DRAWING 0
+#endif
+
+// Share uniform values between programs in std140 uniform blocks, for shaders that declare them
+#if GL_VERSION_3_1 || GL_ES_VERSION_3_0
+#define KRENGINE_UNIFORM_BUFFERS 1
+#else
+#define KRENGINE_UNIFORM_BUFFERS 0
+#endif
+
 #if defined(DEBUG) || defined(_DEBUG)
 #define GLDEBUG(x) \
 x; \
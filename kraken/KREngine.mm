@@ -187,6 +187,10 @@ void kraken::set_debug_text(const std::string &print_text)
         } copy];
         [self loadShaders];
         
+        NSString *programCachePath = [[NSSearchPathForDirectoriesInDomains(NSCachesDirectory, NSUserDomainMask, YES) objectAtIndex:0] stringByAppendingPathComponent:@"kraken_programs"];
+        if([[NSFileManager defaultManager] createDirectoryAtPath:programCachePath withIntermediateDirectories:YES attributes:nil error:nil]) {
+            _context->getShaderManager()->setProgramCacheDirectory([programCachePath UTF8String]);
+        }
     }
     
     return self;
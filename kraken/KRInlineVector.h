@@ -0,0 +1,110 @@
+//
+//  KRInlineVector.h
+//  KREngine
+//
+//  Copyright 2012 Kearwood Gilbert. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are
+//  permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this list of
+//  conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list
+//  of conditions and the following disclaimer in the documentation and/or other materials
+//  provided with the distribution.
+//
+//  THIS SOFTWARE IS PROVIDED BY KEARWOOD GILBERT ''AS IS'' AND ANY EXPRESS OR IMPLIED
+//  WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+//  FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL KEARWOOD GILBERT OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+//  ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+//  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+//  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//  The views and conclusions contained in the software and documentation are those of the
+//  authors and should not be interpreted as representing official policies, either expressed
+//  or implied, of Kearwood Gilbert.
+//
+
+#ifndef KRINLINEVECTOR_H
+#define KRINLINEVECTOR_H
+
+// A vector that stores its first N elements inline, only allocating once it grows past them.
+// Elements are unordered; swapRemove() fills the hole with the last element.  The storage is never released by clear(), so a recycled KRInlineVector stops allocating once it has reached its working size.
+template <class T, int N> class KRInlineVector {
+public:
+    typedef T *iterator;
+    
+    KRInlineVector()
+    {
+        m_heap = NULL;
+        m_size = 0;
+        m_capacity = N;
+    }
+    
+    ~KRInlineVector()
+    {
+        if(m_heap) {
+            delete[] m_heap;
+        }
+    }
+    
+    KRInlineVector(const KRInlineVector &) = delete;
+    KRInlineVector &operator=(const KRInlineVector &) = delete;
+    
+    iterator begin() { return data(); }
+    iterator end() { return data() + m_size; }
+    
+    int size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+    
+    T &operator[](int index) { return data()[index]; }
+    T &back() { return data()[m_size - 1]; }
+    
+    void push_back(const T &value)
+    {
+        if(m_size == m_capacity) {
+            T *heap = new T[m_capacity * 2];
+            T *old = data();
+            for(int i=0; i < m_size; i++) {
+                heap[i] = old[i];
+            }
+            if(m_heap) {
+                delete[] m_heap;
+            }
+            m_heap = heap;
+            m_capacity *= 2;
+        }
+        data()[m_size++] = value;
+    }
+    
+    void pop_back()
+    {
+        m_size--;
+    }
+    
+    void swapRemove(int index)
+    {
+        T *d = data();
+        d[index] = d[m_size - 1];
+        m_size--;
+    }
+    
+    void clear()
+    {
+        m_size = 0;
+    }
+    
+private:
+    T *data() { return m_heap ? m_heap : m_inline; }
+    
+    T m_inline[N];
+    T *m_heap;
+    int m_size;
+    int m_capacity;
+};
+
+#endif /* defined(KRINLINEVECTOR_H) */
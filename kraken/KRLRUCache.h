@@ -0,0 +1,227 @@
+//
+//  KRLRUCache.h
+//  KREngine
+//
+//  Copyright 2012 Kearwood Gilbert. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are
+//  permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this list of
+//  conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list
+//  of conditions and the following disclaimer in the documentation and/or other materials
+//  provided with the distribution.
+//
+//  THIS SOFTWARE IS PROVIDED BY KEARWOOD GILBERT ''AS IS'' AND ANY EXPRESS OR IMPLIED
+//  WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+//  FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL KEARWOOD GILBERT OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+//  ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+//  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+//  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//  The views and conclusions contained in the software and documentation are those of the
+//  authors and should not be interpreted as representing official policies, either expressed
+//  or implied, of Kearwood Gilbert.
+//
+
+#ifndef KRLRUCACHE_H
+#define KRLRUCACHE_H
+
+// A hash table that keeps its entries in order of use, so that the least recently used entry can be evicted.
+// Entries are stored contiguously and found through an open addressed table of indices, so find() never allocates and insert() only allocates when the table grows.
+template <class K, class V, class Hash> class KRLRUCache {
+public:
+    KRLRUCache()
+    {
+        m_mostRecent = -1;
+        m_leastRecent = -1;
+    }
+    
+    KRLRUCache(const KRLRUCache &) = delete;
+    KRLRUCache &operator=(const KRLRUCache &) = delete;
+    
+    size_t size() const
+    {
+        return m_entries.size();
+    }
+    
+    // Grow the storage to hold count entries without allocating again
+    void reserve(size_t count)
+    {
+        m_entries.reserve(count);
+        size_t slot_count = 16;
+        while(slot_count < count * 2) {
+            slot_count *= 2;
+        }
+        if(slot_count > m_slots.size()) {
+            rehash(slot_count);
+        }
+    }
+    
+    // Returns NULL if key is not in the cache.  Otherwise, the entry becomes the most recently used.
+    V *find(const K &key)
+    {
+        if(m_slots.empty()) {
+            return NULL;
+        }
+        int slot = findSlot(key, m_hash(key));
+        if(m_slots[slot] < 0) {
+            return NULL;
+        }
+        int index = m_slots[slot];
+        unlink(index);
+        linkMostRecent(index);
+        return &m_entries[index].value;
+    }
+    
+    // key must not already be in the cache.  The new entry becomes the most recently used.
+    void insert(const K &key, const V &value)
+    {
+        if((m_entries.size() + 1) * 2 > m_slots.size()) {
+            rehash(m_slots.empty() ? 16 : m_slots.size() * 2);
+        }
+        entry e;
+        e.key = key;
+        e.value = value;
+        e.hash = m_hash(key);
+        int index = (int)m_entries.size();
+        m_entries.push_back(e);
+        m_slots[findSlot(key, e.hash)] = index;
+        linkMostRecent(index);
+    }
+    
+    // Remove the least recently used entry, returning its value.  Returns false if the cache is empty.
+    bool evict(V &value)
+    {
+        if(m_leastRecent < 0) {
+            return false;
+        }
+        int index = m_leastRecent;
+        value = m_entries[index].value;
+        unlink(index);
+        removeSlot(findSlot(m_entries[index].key, m_entries[index].hash));
+        
+        // Fill the hole with the last entry
+        int last = (int)m_entries.size() - 1;
+        if(index != last) {
+            int last_slot = findSlot(m_entries[last].key, m_entries[last].hash);
+            m_entries[index] = m_entries[last];
+            m_slots[last_slot] = index;
+            entry &moved = m_entries[index];
+            if(moved.prev >= 0) {
+                m_entries[moved.prev].next = index;
+            } else {
+                m_mostRecent = index;
+            }
+            if(moved.next >= 0) {
+                m_entries[moved.next].prev = index;
+            } else {
+                m_leastRecent = index;
+            }
+        }
+        m_entries.pop_back();
+        return true;
+    }
+    
+    // Iterate over the values, most recently used first
+    template <class F> void forEach(F f)
+    {
+        for(int index=m_mostRecent; index >= 0; index = m_entries[index].next) {
+            f(m_entries[index].value);
+        }
+    }
+    
+    void clear()
+    {
+        m_entries.clear();
+        m_slots.assign(m_slots.size(), -1);
+        m_mostRecent = -1;
+        m_leastRecent = -1;
+    }
+    
+private:
+    typedef struct {
+        K key;
+        V value;
+        size_t hash;
+        int prev; // More recently used entry
+        int next; // Less recently used entry
+    } entry;
+    
+    std::vector<entry> m_entries;
+    std::vector<int> m_slots; // Indices into m_entries, or -1 for empty slots.  The size is a power of two.
+    int m_mostRecent;
+    int m_leastRecent;
+    Hash m_hash;
+    
+    // The slot holding key, or the empty slot where it would be inserted
+    int findSlot(const K &key, size_t hash) const
+    {
+        size_t mask = m_slots.size() - 1;
+        size_t slot = hash & mask;
+        while(m_slots[slot] >= 0 && !(m_entries[m_slots[slot]].key == key)) {
+            slot = (slot + 1) & mask;
+        }
+        return (int)slot;
+    }
+    
+    // Empty a slot, moving back any entries that were displaced past it so that they can still be found
+    void removeSlot(int slot)
+    {
+        size_t mask = m_slots.size() - 1;
+        size_t hole = slot;
+        size_t i = (hole + 1) & mask;
+        while(m_slots[i] >= 0) {
+            size_t home = m_entries[m_slots[i]].hash & mask;
+            if(((i - home) & mask) >= ((i - hole) & mask)) {
+                m_slots[hole] = m_slots[i];
+                hole = i;
+            }
+            i = (i + 1) & mask;
+        }
+        m_slots[hole] = -1;
+    }
+    
+    void rehash(size_t slot_count)
+    {
+        m_slots.assign(slot_count, -1);
+        for(int index=0; index < (int)m_entries.size(); index++) {
+            m_slots[findSlot(m_entries[index].key, m_entries[index].hash)] = index;
+        }
+    }
+    
+    void unlink(int index)
+    {
+        entry &e = m_entries[index];
+        if(e.prev >= 0) {
+            m_entries[e.prev].next = e.next;
+        } else {
+            m_mostRecent = e.next;
+        }
+        if(e.next >= 0) {
+            m_entries[e.next].prev = e.prev;
+        } else {
+            m_leastRecent = e.prev;
+        }
+    }
+    
+    void linkMostRecent(int index)
+    {
+        entry &e = m_entries[index];
+        e.prev = -1;
+        e.next = m_mostRecent;
+        if(m_mostRecent >= 0) {
+            m_entries[m_mostRecent].prev = index;
+        } else {
+            m_leastRecent = index;
+        }
+        m_mostRecent = index;
+    }
+};
+
+#endif /* defined(KRLRUCACHE_H) */
@@ -302,7 +302,7 @@ void KRMaterial::getTextures()
     }
 }
 
-bool KRMaterial::bind(KRCamera *pCamera, std::vector<KRPointLight *> &point_lights, std::vector<KRDirectionalLight *> &directional_lights, std::vector<KRSpotLight *>&spot_lights, const std::vector<KRBone *> &bones, const std::vector<Matrix4> &bind_poses, const KRViewport &viewport, const Matrix4 &matModel, KRTexture *pLightMap, KRNode::RenderPass renderPass, const Vector3 &rim_color, float rim_power, float lod_coverage) {
+KRShader *KRMaterial::getShader(KRCamera *pCamera, std::vector<KRPointLight *> &point_lights, std::vector<KRDirectionalLight *> &directional_lights, std::vector<KRSpotLight *>&spot_lights, int bone_count, KRTexture *pLightMap, KRNode::RenderPass renderPass, float rim_power, bool instanced) {
     bool bLightMap = pLightMap && pCamera->settings.bEnableLightMap;
     
     getTextures();
@@ -319,8 +319,19 @@ bool KRMaterial::bind(KRCamera *pCamera, std::vector<KRPointLight *> &point_ligh
     bool bAlphaTest = (m_alpha_mode == KRMATERIAL_ALPHA_MODE_TEST) && bDiffuseMap;
     bool bAlphaBlend = (m_alpha_mode == KRMATERIAL_ALPHA_MODE_BLENDONESIDE) || (m_alpha_mode == KRMATERIAL_ALPHA_MODE_BLENDTWOSIDE);
     
-    KRShader *pShader = getContext().getShaderManager()->getShader("ObjectShader", pCamera, point_lights, directional_lights, spot_lights, bones.size(), bDiffuseMap, bNormalMap, bSpecMap, bReflectionMap, bReflectionCubeMap, bLightMap, m_diffuseMapScale != default_scale && bDiffuseMap, m_specularMapScale != default_scale && bSpecMap, m_normalMapScale != default_scale && bNormalMap, m_reflectionMapScale != default_scale && bReflectionMap, m_diffuseMapOffset != default_offset && bDiffuseMap, m_specularMapOffset != default_offset && bSpecMap, m_normalMapOffset != default_offset && bNormalMap, m_reflectionMapOffset != default_offset && bReflectionMap, bAlphaTest, bAlphaBlend, renderPass, rim_power != 0.0f);
+    static const int object_shader_id = KRShaderManager::GetShaderNameID("ObjectShader");
+    return getContext().getShaderManager()->getShader(object_shader_id, pCamera, point_lights, directional_lights, spot_lights, bone_count, bDiffuseMap, bNormalMap, bSpecMap, bReflectionMap, bReflectionCubeMap, bLightMap, m_diffuseMapScale != default_scale && bDiffuseMap, m_specularMapScale != default_scale && bSpecMap, m_normalMapScale != default_scale && bNormalMap, m_reflectionMapScale != default_scale && bReflectionMap, m_diffuseMapOffset != default_offset && bDiffuseMap, m_specularMapOffset != default_offset && bSpecMap, m_normalMapOffset != default_offset && bNormalMap, m_reflectionMapOffset != default_offset && bReflectionMap, bAlphaTest, bAlphaBlend, renderPass, rim_power != 0.0f, instanced);
+}
 
+bool KRMaterial::bind(KRCamera *pCamera, std::vector<KRPointLight *> &point_lights, std::vector<KRDirectionalLight *> &directional_lights, std::vector<KRSpotLight *>&spot_lights, const std::vector<Matrix4> &bone_palette, const KRViewport &viewport, const Matrix4 &matModel, KRTexture *pLightMap, KRNode::RenderPass renderPass, const Vector3 &rim_color, float rim_power, float lod_coverage, bool instanced) {
+    KRShader *pShader = getShader(pCamera, point_lights, directional_lights, spot_lights, bone_palette.size(), pLightMap, renderPass, rim_power, instanced);
+    
+    bool bHasReflection = m_reflectionColor != Vector3::Zero();
+    bool bDiffuseMap = m_pDiffuseMap != NULL && pCamera->settings.bEnableDiffuseMap;
+    bool bNormalMap = m_pNormalMap != NULL && pCamera->settings.bEnableNormalMap;
+    bool bSpecMap = m_pSpecularMap != NULL && pCamera->settings.bEnableSpecMap;
+    bool bReflectionMap = m_pReflectionMap != NULL && pCamera->settings.bEnableReflectionMap && pCamera->settings.bEnableReflection && bHasReflection;
+    bool bReflectionCubeMap = m_pReflectionCube != NULL && pCamera->settings.bEnableReflection && bHasReflection;
     
     Vector4 fade_color;
     if(!getContext().getShaderManager()->selectShader(*pCamera, pShader, viewport, matModel, point_lights, directional_lights, spot_lights, 0, renderPass, rim_color, rim_power, fade_color)) {
@@ -328,36 +339,9 @@ bool KRMaterial::bind(KRCamera *pCamera, std::vector<KRPointLight *> &point_ligh
     }
     
     // Bind bones
-    if(pShader->m_uniforms[KRShader::KRENGINE_UNIFORM_BONE_TRANSFORMS] != -1) {
-        GLfloat bone_mats[256 * 16];
-        GLfloat *bone_mat_component = bone_mats;
-        for(int bone_index=0; bone_index < bones.size(); bone_index++) {
-            KRBone *bone = bones[bone_index];
-            
-//                Vector3 initialRotation = bone->getInitialLocalRotation();
-//                Vector3 rotation = bone->getLocalRotation();
-//                Vector3 initialTranslation = bone->getInitialLocalTranslation();
-//                Vector3 translation = bone->getLocalTranslation();
-//                Vector3 initialScale = bone->getInitialLocalScale();
-//                Vector3 scale = bone->getLocalScale();
-//                
-            //printf("%s - delta rotation: %.4f %.4f %.4f\n", bone->getName().c_str(), (rotation.x - initialRotation.x) * 180.0 / M_PI, (rotation.y - initialRotation.y) * 180.0 / M_PI, (rotation.z - initialRotation.z) * 180.0 / M_PI);
-            //printf("%s - delta translation: %.4f %.4f %.4f\n", bone->getName().c_str(), translation.x - initialTranslation.x, translation.y - initialTranslation.y, translation.z - initialTranslation.z);
-//                printf("%s - delta scale: %.4f %.4f %.4f\n", bone->getName().c_str(), scale.x - initialScale.x, scale.y - initialScale.y, scale.z - initialScale.z);
-            
-            Matrix4 skin_bone_bind_pose = bind_poses[bone_index];
-            Matrix4 active_mat = bone->getActivePoseMatrix();
-            Matrix4 inv_bind_mat = bone->getInverseBindPoseMatrix();
-            Matrix4 inv_bind_mat2 = Matrix4::Invert(bind_poses[bone_index]);
-            Matrix4 t = (inv_bind_mat * active_mat);
-            Matrix4 t2 = inv_bind_mat2 * bone->getModelMatrix();
-            for(int i=0; i < 16; i++) {
-                *bone_mat_component++ = t[i];
-            }
-        }
-        if(pShader->m_uniforms[KRShader::KRENGINE_UNIFORM_BONE_TRANSFORMS] != -1) {
-            glUniformMatrix4fv(pShader->m_uniforms[KRShader::KRENGINE_UNIFORM_BONE_TRANSFORMS], bones.size(), GL_FALSE, bone_mats);
-        }
+    if(pShader->hasUniform(KRShader::KRENGINE_UNIFORM_BONE_TRANSFORMS)) {
+        // The palette is computed once per frame by the KRModel, rather than for each submesh and pass
+        pShader->setUniform(KRShader::KRENGINE_UNIFORM_BONE_TRANSFORMS, bone_palette);
     }
 
     
@@ -410,7 +394,8 @@ bool KRMaterial::bind(KRCamera *pCamera, std::vector<KRPointLight *> &point_ligh
         // GL_TEXTURE7 is used for reading the depth buffer in gBuffer pass 2 and re-used for the reflection map in gBuffer Pass 3 and in forward rendering
         m_pContext->getTextureManager()->selectTexture(7, m_pReflectionMap, lod_coverage, KRTexture::TEXTURE_USAGE_REFLECTION_MAP);
     }
-
+    
+    getContext().getShaderManager()->uploadUniformBlocks();
     
     return true;
 }
@@ -97,7 +97,22 @@ void KRMaterialManager::add(KRMaterial *new_material) {
     m_materials[lowerName] = new_material;
 }
 
+void KRMaterialManager::addParsed(KRMaterial *new_material) {
+    m_materials[new_material->getName()] = new_material;
+}
+
 bool KRMaterialManager::load(const char *szName, KRDataBlock *data) {
+    std::vector<KRMaterial *> materials;
+    if(!parse(szName, data, materials)) {
+        return false;
+    }
+    for(std::vector<KRMaterial *>::iterator itr = materials.begin(); itr != materials.end(); itr++) {
+        addParsed(*itr);
+    }
+    return true;
+}
+
+bool KRMaterialManager::parse(const char *szName, KRDataBlock *data, std::vector<KRMaterial *> &materials) {
     KRMaterial *pMaterial = NULL;
     char szSymbol[16][256];
     data->lock();
@@ -143,7 +158,7 @@ bool KRMaterialManager::load(const char *szName, KRDataBlock *data) {
                 if(strcmp(szSymbol[0], "newmtl") == 0 && cSymbols >= 2) {
                     
                     pMaterial = new KRMaterial(*m_pContext, szSymbol[1]);
-                    m_materials[szSymbol[1]] = pMaterial;
+                    materials.push_back(pMaterial);
                 }
                 if(pMaterial != NULL) {
                     if(strcmp(szSymbol[0], "alpha_mode") == 0) {
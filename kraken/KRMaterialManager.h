@@ -50,6 +50,11 @@ public:
     virtual ~KRMaterialManager();
     
     bool load(const char *szName, KRDataBlock *data);
+    
+    // Parse the materials in a .mtl file without adding them to the manager.  Does not access the manager, so may be called from any thread.
+    bool parse(const char *szName, KRDataBlock *data, std::vector<KRMaterial *> &materials);
+    // Add a material returned by parse() under its name as written in the .mtl file, as load() does
+    void addParsed(KRMaterial *new_material);
     void add(KRMaterial *new_material);
     KRMaterial *getMaterial(const std::string &name);
     
@@ -33,10 +33,12 @@
 #include "KREngine-common.h"
 
 #include "KRMesh.h"
+#include "KRMeshBVH.h"
 
 #include "KRShader.h"
 #include "KRShaderManager.h"
 #include "KRContext.h"
+#include "KRRenderQueue.h"
 #include "../3rdparty/forsyth/forsyth.h"
 
 KRMesh::KRMesh(KRContext &context, std::string name) : KRResource(context, name)  {
@@ -46,6 +48,7 @@ KRMesh::KRMesh(KRContext &context, std::string name) : KRResource(context, name)
     m_pData = NULL;
     m_pMetaData = NULL;
     m_pIndexBaseData = NULL;
+    m_bvh = NULL;
     m_constant = false;
 }
 
@@ -56,14 +59,21 @@ KRMesh::KRMesh(KRContext &context, std::string name, KRDataBlock *data) : KRReso
     m_pData = NULL;
     m_pMetaData = NULL;
     m_pIndexBaseData = NULL;
+    m_bvh = NULL;
     m_constant = false;
     
     loadPack(data);
 }
 
 void KRMesh::setName(const std::string name) {
-    m_lodCoverage = 100;
-    m_lodBaseName = name;
+    ParseLODName(name, m_lodBaseName, m_lodCoverage);
+}
+
+// Split a mesh name with an "_lod<coverage>" suffix into its base name and LOD coverage.  Names without a suffix are the full detail LOD.
+void KRMesh::ParseLODName(const std::string &name, std::string &base_name, int &lod_coverage)
+{
+    lod_coverage = 100;
+    base_name = name;
     
     size_t last_underscore_pos = name.find_last_of('_');
     if(last_underscore_pos != std::string::npos) {
@@ -74,34 +84,29 @@ void KRMesh::setName(const std::string name) {
             char *end = NULL;
             int c = (int)strtol(lod_level_string.c_str(), &end, 10);
             if(c >= 0 && c <= 100 && *end == '\0') {
-                m_lodCoverage = c;
-                m_lodBaseName = name.substr(0, last_underscore_pos);
+                lod_coverage = c;
+                base_name = name.substr(0, last_underscore_pos);
             }
         }
     }
-
 }
 
 int KRMesh::GetLODCoverage(const std::string &name)
 {
-    int lod_coverage = 100;
-    size_t last_underscore_pos = name.find_last_of('_');
-    if(last_underscore_pos != std::string::npos) {
-        // Found an underscore
-        std::string suffix = name.substr(last_underscore_pos + 1);
-        if(suffix.find("lod") == 0) {
-            std::string lod_level_string = suffix.substr(3);
-            char *end = NULL;
-            int c = (int)strtol(lod_level_string.c_str(), &end, 10);
-            if(c >= 0 && c <= 100 && *end == '\0') {
-                lod_coverage = c;
-                //m_lodBaseName = name.substr(0, last_underscore_pos);
-            }
-        }
-    }
+    std::string base_name;
+    int lod_coverage;
+    ParseLODName(name, base_name, lod_coverage);
     return lod_coverage;
 }
 
+std::string KRMesh::GetLODBaseName(const std::string &name)
+{
+    std::string base_name;
+    int lod_coverage;
+    ParseLODName(name, base_name, lod_coverage);
+    return base_name;
+}
+
 
 
 KRMesh::~KRMesh() {
@@ -109,6 +114,7 @@ KRMesh::~KRMesh() {
 }
 
 void KRMesh::releaseData() {
+    releaseBVH();
     m_hasTransparency = false;
     m_submeshes.clear();
     if(m_pIndexBaseData) {
@@ -248,7 +254,7 @@ kraken_stream_level KRMesh::getStreamLevel()
     return stream_level;
 }
 
-void KRMesh::render(const std::string &object_name, KRCamera *pCamera, std::vector<KRPointLight *> &point_lights, std::vector<KRDirectionalLight *> &directional_lights, std::vector<KRSpotLight *>&spot_lights, const KRViewport &viewport, const Matrix4 &matModel, KRTexture *pLightMap, KRNode::RenderPass renderPass, const std::vector<KRBone *> &bones, const Vector3 &rim_color, float rim_power, float lod_coverage) {
+void KRMesh::render(const std::string &object_name, KRCamera *pCamera, std::vector<KRPointLight *> &point_lights, std::vector<KRDirectionalLight *> &directional_lights, std::vector<KRSpotLight *>&spot_lights, const KRViewport &viewport, const Matrix4 &matModel, KRTexture *pLightMap, KRNode::RenderPass renderPass, const std::vector<Matrix4> &bone_palette, const Vector3 &rim_color, float rim_power, float lod_coverage, KRRenderQueue *render_queue) {
 
     //fprintf(stderr, "Rendering model: %s\n", m_name.c_str());
     if(renderPass != KRNode::RENDER_PASS_ADDITIVE_PARTICLES && renderPass != KRNode::RENDER_PASS_PARTICLE_OCCLUSION && renderPass != KRNode::RENDER_PASS_VOLUMETRIC_EFFECTS_ADDITIVE) {
@@ -274,6 +280,14 @@ void KRMesh::render(const std::string &object_name, KRCamera *pCamera, std::vect
                     }
                     
                 }
+            } else if(render_queue && render_queue->isCollecting(renderPass)) {
+                // The queue orders the submeshes of every model in the pass by their state
+                for(int iSubmesh=0; iSubmesh<cSubmeshes; iSubmesh++) {
+                    KRMaterial *pMaterial = m_materials[iSubmesh];
+                    if(pMaterial != NULL && !pMaterial->isTransparent() && !m_submeshes[iSubmesh]->vbo_data_blocks.empty()) {
+                        render_queue->add(this, iSubmesh, pMaterial, m_submeshes[iSubmesh]->vbo_data_blocks[0]->m_data, object_name, point_lights, directional_lights, spot_lights, matModel, pLightMap, bone_palette, rim_color, rim_power, lod_coverage);
+                    }
+                }
             } else {
                 // Apply submeshes in per-material batches to reduce number of state changes
                 for(std::set<KRMaterial *>::iterator mat_itr = m_uniqueMaterials.begin(); mat_itr != m_uniqueMaterials.end(); mat_itr++) {
@@ -282,31 +296,7 @@ void KRMesh::render(const std::string &object_name, KRCamera *pCamera, std::vect
                         
                         if(pMaterial != NULL && pMaterial == (*mat_itr)) {
                             if((!pMaterial->isTransparent() && renderPass != KRNode::RENDER_PASS_FORWARD_TRANSPARENT) || (pMaterial->isTransparent() && renderPass == KRNode::RENDER_PASS_FORWARD_TRANSPARENT)) {
-                                std::vector<Matrix4> bone_bind_poses;
-                                for(int i=0; i < bones.size(); i++) {
-                                    bone_bind_poses.push_back(getBoneBindPose(i));
-                                }
-                                if(pMaterial->bind(pCamera, point_lights, directional_lights, spot_lights, bones, bone_bind_poses, viewport, matModel, pLightMap, renderPass, rim_color, rim_power, lod_coverage)) {
-                                
-                                    switch(pMaterial->getAlphaMode()) {
-                                        case KRMaterial::KRMATERIAL_ALPHA_MODE_OPAQUE: // Non-transparent materials
-                                        case KRMaterial::KRMATERIAL_ALPHA_MODE_TEST: // Alpha in diffuse texture is interpreted as punch-through when < 0.5
-                                            renderSubmesh(iSubmesh, renderPass, object_name, pMaterial->getName(), lod_coverage);
-                                            break;
-                                        case KRMaterial::KRMATERIAL_ALPHA_MODE_BLENDONESIDE: // Blended alpha with backface culling
-                                            renderSubmesh(iSubmesh, renderPass, object_name, pMaterial->getName(), lod_coverage);
-                                            break;
-                                        case KRMaterial::KRMATERIAL_ALPHA_MODE_BLENDTWOSIDE: // Blended alpha rendered in two passes.  First pass renders backfaces; second pass renders frontfaces.
-                                            // Render back faces first
-                                            GLDEBUG(glCullFace(GL_FRONT));
-                                            renderSubmesh(iSubmesh, renderPass, object_name, pMaterial->getName(), lod_coverage);
-
-                                            // Render front faces second
-                                            GLDEBUG(glCullFace(GL_BACK));
-                                            renderSubmesh(iSubmesh, renderPass, object_name, pMaterial->getName(), lod_coverage);
-                                            break;
-                                    }
-                                }
+                                renderMaterialSubmesh(iSubmesh, pMaterial, object_name, pCamera, point_lights, directional_lights, spot_lights, viewport, matModel, pLightMap, renderPass, bone_palette, rim_color, rim_power, lod_coverage);
                             }
                         }
                     }
@@ -316,6 +306,54 @@ void KRMesh::render(const std::string &object_name, KRCamera *pCamera, std::vect
     }
 }
 
+void KRMesh::renderMaterialSubmesh(int iSubmesh, KRMaterial *pMaterial, const std::string &object_name, KRCamera *pCamera, std::vector<KRPointLight *> &point_lights, std::vector<KRDirectionalLight *> &directional_lights, std::vector<KRSpotLight *>&spot_lights, const KRViewport &viewport, const Matrix4 &matModel, KRTexture *pLightMap, KRNode::RenderPass renderPass, const std::vector<Matrix4> &bone_palette, const Vector3 &rim_color, float rim_power, float lod_coverage)
+{
+    if(pLightMap && pCamera->settings.bEnableLightMap) {
+        m_pContext->getTextureManager()->selectTexture(5, pLightMap, lod_coverage, KRTexture::TEXTURE_USAGE_LIGHT_MAP);
+    }
+    
+    if(pMaterial->bind(pCamera, point_lights, directional_lights, spot_lights, bone_palette, viewport, matModel, pLightMap, renderPass, rim_color, rim_power, lod_coverage)) {
+    
+        switch(pMaterial->getAlphaMode()) {
+            case KRMaterial::KRMATERIAL_ALPHA_MODE_OPAQUE: // Non-transparent materials
+            case KRMaterial::KRMATERIAL_ALPHA_MODE_TEST: // Alpha in diffuse texture is interpreted as punch-through when < 0.5
+                renderSubmesh(iSubmesh, renderPass, object_name, pMaterial->getName(), lod_coverage);
+                break;
+            case KRMaterial::KRMATERIAL_ALPHA_MODE_BLENDONESIDE: // Blended alpha with backface culling
+                renderSubmesh(iSubmesh, renderPass, object_name, pMaterial->getName(), lod_coverage);
+                break;
+            case KRMaterial::KRMATERIAL_ALPHA_MODE_BLENDTWOSIDE: // Blended alpha rendered in two passes.  First pass renders backfaces; second pass renders frontfaces.
+                // Render back faces first
+                GLDEBUG(glCullFace(GL_FRONT));
+                renderSubmesh(iSubmesh, renderPass, object_name, pMaterial->getName(), lod_coverage);
+
+                // Render front faces second
+                GLDEBUG(glCullFace(GL_BACK));
+                renderSubmesh(iSubmesh, renderPass, object_name, pMaterial->getName(), lod_coverage);
+                break;
+        }
+    }
+}
+
+void KRMesh::renderInstancedSubmesh(int iSubmesh, KRMaterial *pMaterial, const std::string &object_name, KRCamera *pCamera, std::vector<KRPointLight *> &point_lights, std::vector<KRDirectionalLight *> &directional_lights, std::vector<KRSpotLight *>&spot_lights, const KRViewport &viewport, const std::vector<Matrix4> &instance_matrices, KRTexture *pLightMap, KRNode::RenderPass renderPass, const Vector3 &rim_color, float rim_power, float lod_coverage)
+{
+#if KRENGINE_INSTANCED_DRAWING
+    assert(getModelFormat() == KRENGINE_MODEL_FORMAT_INDEXED_TRIANGLES);
+    
+    if(pLightMap && pCamera->settings.bEnableLightMap) {
+        m_pContext->getTextureManager()->selectTexture(5, pLightMap, lod_coverage, KRTexture::TEXTURE_USAGE_LIGHT_MAP);
+    }
+    
+    std::vector<Matrix4> bone_palette;
+    
+    // Each instance is transformed to world space by its own model matrix in the vertex shader, so the material is bound with an identity model matrix and the model space uniforms are given in world space
+    if(pMaterial->bind(pCamera, point_lights, directional_lights, spot_lights, bone_palette, viewport, Matrix4(), pLightMap, renderPass, rim_color, rim_power, lod_coverage, true)) {
+        m_pContext->getMeshManager()->uploadInstances(instance_matrices);
+        renderSubmesh(iSubmesh, renderPass, object_name, pMaterial->getName(), lod_coverage, (int)instance_matrices.size());
+    }
+#endif
+}
+
 GLfloat KRMesh::getMaxDimension() {
     GLfloat m = 0.0;
     if(m_maxPoint.x - m_minPoint.x > m) m = m_maxPoint.x - m_minPoint.x;
@@ -425,7 +463,7 @@ void KRMesh::createDataBlocks(KRMeshManager::KRVBOData::vbo_type t)
     }
 }
 
-void KRMesh::renderSubmesh(int iSubmesh, KRNode::RenderPass renderPass, const std::string &object_name, const std::string &material_name, float lodCoverage) {
+void KRMesh::renderSubmesh(int iSubmesh, KRNode::RenderPass renderPass, const std::string &object_name, const std::string &material_name, float lodCoverage, int instance_count) {
     getSubmeshes();
     
     Submesh *pSubmesh = m_submeshes[iSubmesh];
@@ -450,13 +488,22 @@ void KRMesh::renderSubmesh(int iSubmesh, KRNode::RenderPass renderPass, const st
             int vertex_draw_count = cVertexes;
             if(vertex_draw_count > index_count - index_group_offset) vertex_draw_count = index_count - index_group_offset;
             
-            glDrawElements(GL_TRIANGLES, vertex_draw_count, GL_UNSIGNED_SHORT, BUFFER_OFFSET(index_group_offset * 2));
-            m_pContext->getMeshManager()->log_draw_call(renderPass, object_name, material_name, vertex_draw_count);
+            if(instance_count > 1) {
+#if KRENGINE_INSTANCED_DRAWING
+                m_pContext->getMeshManager()->bindInstanceAttribs();
+                GLDEBUG(glDrawElementsInstanced(GL_TRIANGLES, vertex_draw_count, GL_UNSIGNED_SHORT, BUFFER_OFFSET(index_group_offset * 2), instance_count));
+                m_pContext->getMeshManager()->unbindInstanceAttribs();
+#endif
+            } else {
+                glDrawElements(GL_TRIANGLES, vertex_draw_count, GL_UNSIGNED_SHORT, BUFFER_OFFSET(index_group_offset * 2));
+            }
+            m_pContext->getMeshManager()->log_draw_call(renderPass, object_name, material_name, vertex_draw_count, instance_count);
             cVertexes -= vertex_draw_count;
             index_group_offset = 0;
         }
         
     } else {
+        assert(instance_count == 1);
         int cBuffers = (cVertexes + MAX_VBO_SIZE - 1) / MAX_VBO_SIZE;
         int iVertex = pSubmesh->start_vertex;
         int iBuffer = iVertex / MAX_VBO_SIZE;
@@ -913,6 +960,7 @@ Vector2 KRMesh::getVertexUVB(int index) const
 
 void KRMesh::setVertexPosition(int index, const Vector3 &v)
 {
+    releaseBVH();
     if(has_vertex_attribute(KRENGINE_ATTRIB_VERTEX_SHORT)) {
         short *vert = (short *)(getVertexData(index) + m_vertex_attribute_offset[KRENGINE_ATTRIB_VERTEX_SHORT]);
         vert[0] = v.x * 32767.0f;
@@ -1132,7 +1180,7 @@ bool KRMesh::rayCast(const Vector3 &start, const Vector3 &dir, const Triangle3 &
 }
 
 
-bool KRMesh::rayCast(const Vector3 &start, const Vector3 &dir, HitInfo &hitinfo) const
+bool KRMesh::rayCastBruteForce(const Vector3 &start, const Vector3 &dir, HitInfo &hitinfo) const
 {
     m_pData->lock();
     bool hit_found = false;
@@ -1178,7 +1226,7 @@ bool KRMesh::rayCast(const Vector3 &start, const Vector3 &dir, HitInfo &hitinfo)
 }
 
 
-bool KRMesh::sphereCast(const Matrix4 &model_to_world, const Vector3 &v0, const Vector3 &v1, float radius, HitInfo &hitinfo) const
+bool KRMesh::sphereCastBruteForce(const Matrix4 &model_to_world, const Vector3 &v0, const Vector3 &v1, float radius, HitInfo &hitinfo) const
 {
     m_pData->lock();
 
@@ -1230,6 +1278,55 @@ bool KRMesh::sphereCast(const Matrix4 &model_to_world, const Vector3 &v0, const
     return hit_found;
 }
 
+void KRMesh::PrepareSphereCast(const Matrix4 &model_to_world, const Vector3 &v0, const Vector3 &v1, float radius, sphere_cast_query &query)
+{
+    query.v0 = v0;
+    query.v1 = v1;
+    query.radius = radius;
+    query.length = (v1 - v0).magnitude();
+    
+    // When model_to_world has a uniform scale, the sphere is still a sphere in model space, so the cast can be made against the untransformed triangles
+    Vector3 axis_x = Matrix4::DotNoTranslate(model_to_world, Vector3::Create(1.0f, 0.0f, 0.0f));
+    Vector3 axis_y = Matrix4::DotNoTranslate(model_to_world, Vector3::Create(0.0f, 1.0f, 0.0f));
+    Vector3 axis_z = Matrix4::DotNoTranslate(model_to_world, Vector3::Create(0.0f, 0.0f, 1.0f));
+    float scale = axis_x.magnitude();
+    float tolerance = scale * 0.0001f;
+    bool uniform = scale > 0.0f
+        && fabsf(axis_y.magnitude() - scale) <= tolerance && fabsf(axis_z.magnitude() - scale) <= tolerance
+        && fabsf(Vector3::Dot(axis_x, axis_y)) <= tolerance * scale && fabsf(Vector3::Dot(axis_y, axis_z)) <= tolerance * scale && fabsf(Vector3::Dot(axis_z, axis_x)) <= tolerance * scale;
+    query.normal_sign = Vector3::Dot(Vector3::Cross(axis_x, axis_y), axis_z) < 0.0f ? -1.0f : 1.0f;
+    if(uniform) {
+        Matrix4 world_to_model = Matrix4::Invert(model_to_world);
+        query.scale = scale;
+        query.model_v0 = Matrix4::Dot(world_to_model, v0);
+        query.model_v1 = Matrix4::Dot(world_to_model, v1);
+        query.model_dir = Vector3::Normalize(query.model_v1 - query.model_v0);
+        query.model_radius = radius / scale;
+    } else {
+        query.scale = 0.0f;
+    }
+}
+
+bool KRMesh::sphereCast(const Matrix4 &model_to_world, const sphere_cast_query &query, const Triangle3 &tri, HitInfo &hitinfo)
+{
+    Vector3 new_hit_point;
+    float new_hit_distance;
+    
+    if(query.scale > 0.0f) {
+        if(tri.sphereCast(query.model_v0, query.model_dir, query.model_radius, new_hit_point, new_hit_distance)) {
+            new_hit_distance *= query.scale;
+            if((!hitinfo.didHit() || hitinfo.getDistance() > new_hit_distance) && new_hit_distance <= query.length) {
+                Vector3 normal = Vector3::Normalize(Matrix4::DotNoTranslate(model_to_world, tri.calculateNormal())) * query.normal_sign;
+                hitinfo = HitInfo(Matrix4::Dot(model_to_world, new_hit_point), normal, new_hit_distance);
+                return true;
+            }
+        }
+        return false;
+    }
+    
+    return sphereCast(model_to_world, query.v0, query.v1, query.radius, tri, hitinfo);
+}
+
 bool KRMesh::sphereCast(const Matrix4 &model_to_world, const Vector3 &v0, const Vector3 &v1, float radius, const Triangle3 &tri, HitInfo &hitinfo)
 {
     
@@ -1263,12 +1360,12 @@ bool KRMesh::sphereCast(const Matrix4 &model_to_world, const Vector3 &v0, const
     return false;
 }
 
-bool KRMesh::lineCast(const Vector3 &v0, const Vector3 &v1, HitInfo &hitinfo) const
+bool KRMesh::lineCastBruteForce(const Vector3 &v0, const Vector3 &v1, HitInfo &hitinfo) const
 {
     m_pData->lock();
     HitInfo new_hitinfo;
     Vector3 dir = Vector3::Normalize(v1 - v0);
-    if(rayCast(v0, dir, new_hitinfo)) {
+    if(rayCastBruteForce(v0, dir, new_hitinfo)) {
         if((new_hitinfo.getPosition() - v0).sqrMagnitude() <= (v1 - v0).sqrMagnitude()) {
             // The hit was between v1 and v2
             hitinfo = new_hitinfo;
@@ -1514,8 +1611,241 @@ int KRMesh::getTriangleVertexIndex(int submesh, int index) const
     }
 }
 
+const KRMeshBVH *KRMesh::getBVH() const
+{
+    std::lock_guard<std::mutex> lock(m_bvhMutex);
+    if(m_bvh == NULL) {
+        m_bvh = new KRMeshBVH(*this);
+    }
+    return m_bvh;
+}
+
+void KRMesh::releaseBVH()
+{
+    std::lock_guard<std::mutex> lock(m_bvhMutex);
+    if(m_bvh) {
+        delete m_bvh;
+        m_bvh = NULL;
+    }
+    m_occluderVertices.clear();
+}
+
+const std::vector<Vector3> &KRMesh::getOccluderVertices() const
+{
+    std::lock_guard<std::mutex> lock(m_bvhMutex);
+    if(m_occluderVertices.empty()) {
+        m_pData->lock();
+        for(int submesh_index=0; submesh_index < getSubmeshCount(); submesh_index++) {
+            int vertex_count = getVertexCount(submesh_index);
+            switch(getModelFormat()) {
+                case KRENGINE_MODEL_FORMAT_TRIANGLES:
+                case KRENGINE_MODEL_FORMAT_INDEXED_TRIANGLES:
+                    for(int i=0; i < vertex_count / 3 * 3; i++) {
+                        m_occluderVertices.push_back(getVertexPosition(getTriangleVertexIndex(submesh_index, i)));
+                    }
+                    break;
+                default:
+                    break; // Strips are not yet supported
+            }
+        }
+        m_pData->unlock();
+    }
+    return m_occluderVertices;
+}
+
+const KRMeshBVH *KRMesh::beginCasts() const
+{
+    m_pData->lock();
+    return getBVH();
+}
+
+void KRMesh::endCasts() const
+{
+    m_pData->unlock();
+}
+
+bool KRMesh::rayCast(const Vector3 &start, const Vector3 &dir, HitInfo &hitinfo) const
+{
+    m_pData->lock();
+    bool hit_found = rayCastLocked(getBVH(), start, dir, hitinfo);
+    m_pData->unlock();
+    return hit_found;
+}
+
+bool KRMesh::rayCastLocked(const KRMeshBVH *bvh, const Vector3 &start, const Vector3 &dir, HitInfo &hitinfo) const
+{
+    bool hit_found = false;
+    const KRMeshBVH::triangle_info *t = bvh->rayCast(start, dir, hitinfo.didHit() ? hitinfo.getDistance() : std::numeric_limits<float>::max());
+    if(t) {
+        // Evaluate the nearest triangle the same way as rayCastBruteForce, so the normal is interpolated identically
+        hit_found = rayCast(start, dir, t->tri, getVertexNormal(t->vertex_index[0]), getVertexNormal(t->vertex_index[1]), getVertexNormal(t->vertex_index[2]), hitinfo);
+    }
+    return hit_found;
+}
+
+bool KRMesh::lineCast(const Vector3 &v0, const Vector3 &v1, HitInfo &hitinfo) const
+{
+    m_pData->lock();
+    HitInfo new_hitinfo;
+    Vector3 dir = Vector3::Normalize(v1 - v0);
+    
+    // Hits slightly beyond v1 are still returned by the BVH, so the end of the line is tested below exactly as in lineCastBruteForce
+    float line_length = (v1 - v0).magnitude();
+    const KRMeshBVH::triangle_info *t = getBVH()->rayCast(v0, dir, line_length * 1.0001f + 0.0001f);
+    if(t && rayCast(v0, dir, t->tri, getVertexNormal(t->vertex_index[0]), getVertexNormal(t->vertex_index[1]), getVertexNormal(t->vertex_index[2]), new_hitinfo)) {
+        if((new_hitinfo.getPosition() - v0).sqrMagnitude() <= (v1 - v0).sqrMagnitude()) {
+            // The hit was between v1 and v2
+            hitinfo = new_hitinfo;
+            m_pData->unlock();
+            return true;
+        }
+    }
+    m_pData->unlock();
+    return false; // Either no hit, or the hit was beyond v1
+}
+
+bool KRMesh::sphereCast(const Matrix4 &model_to_world, const Vector3 &v0, const Vector3 &v1, float radius, HitInfo &hitinfo) const
+{
+    m_pData->lock();
+    
+    sphere_cast_query query;
+    PrepareSphereCast(model_to_world, v0, v1, radius, query);
+    
+    std::vector<const KRMeshBVH::triangle_info *> triangles;
+    if(query.scale > 0.0f) {
+        // Only triangles with planes that the sphere touches between v0 and v1 can be hit
+        getBVH()->findTriangles(query.model_v0, query.model_v1, query.model_radius, triangles);
+    } else {
+        // Only triangles within the box swept by the sphere between v0 and v1 can be hit.  The box is transformed to model space to search the BVH.
+        float padding = radius * 1.0001f + query.length * 0.0001f + 0.0001f;
+        Vector3 world_min = Vector3::Create(KRMIN(v0.x, v1.x) - padding, KRMIN(v0.y, v1.y) - padding, KRMIN(v0.z, v1.z) - padding);
+        Vector3 world_max = Vector3::Create(KRMAX(v0.x, v1.x) + padding, KRMAX(v0.y, v1.y) + padding, KRMAX(v0.z, v1.z) + padding);
+        AABB model_bounds = AABB::Create(world_min, world_max, Matrix4::Invert(model_to_world));
+        getBVH()->findTriangles(model_bounds, triangles);
+    }
+    
+    // The candidates are in mesh order, so ties are resolved the same way as sphereCastBruteForce
+    bool hit_found = false;
+    for(std::vector<const KRMeshBVH::triangle_info *>::iterator itr = triangles.begin(); itr != triangles.end(); itr++) {
+        if(sphereCast(model_to_world, query, (*itr)->tri, hitinfo)) hit_found = true;
+    }
+    
+    m_pData->unlock();
+    
+    return hit_found;
+}
+
+void KRMesh::benchmarkCasts(int cast_count)
+{
+    m_pData->lock();
+    
+    std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+    const KRMeshBVH *bvh = getBVH();
+    double build_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+    
+    // Generate the same casts on every run, starting from within a box around the mesh and aimed at points within the mesh bounds
+    Vector3 size = m_maxPoint - m_minPoint;
+    float extent = KRMAX(size.magnitude(), 0.001f);
+    unsigned int seed = 1;
+    std::vector<Vector3> starts, targets;
+    for(int i=0; i < cast_count; i++) {
+        Vector3 p[2];
+        for(int j=0; j < 2; j++) {
+            float r[3];
+            for(int axis=0; axis < 3; axis++) {
+                seed = seed * 1664525 + 1013904223;
+                r[axis] = (float)(seed >> 8) / (float)(1 << 24);
+            }
+            float scale = j == 0 ? 2.0f : 1.0f;
+            p[j] = Vector3::Create(m_minPoint.x + size.x * (0.5f + (r[0] - 0.5f) * scale), m_minPoint.y + size.y * (0.5f + (r[1] - 0.5f) * scale), m_minPoint.z + size.z * (0.5f + (r[2] - 0.5f) * scale));
+        }
+        starts.push_back(p[0]);
+        targets.push_back(p[1]);
+    }
+    
+    // Sphere casts are made with a uniform scale and translation, so the BVH path works in model space while the brute force reference transforms every triangle to world space
+    Matrix4 model_to_world = Matrix4::Create();
+    model_to_world.scale(2.0f);
+    model_to_world.translate(size);
+    std::vector<Vector3> world_starts, world_targets;
+    for(int i=0; i < cast_count; i++) {
+        world_starts.push_back(Matrix4::Dot(model_to_world, starts[i]));
+        world_targets.push_back(Matrix4::Dot(model_to_world, targets[i]));
+    }
+    float radius = extent * 2.0f * 0.02f;
+    float tolerance = extent * 2.0f * 0.0001f;
+    
+    const char *cast_names[3] = {"ray", "line", "sphere"};
+    for(int cast_type=0; cast_type < 3; cast_type++) {
+        std::vector<HitInfo> brute_force_hits(cast_count), bvh_hits(cast_count);
+        double cast_time[2];
+        for(int use_bvh=0; use_bvh < 2; use_bvh++) {
+            std::vector<HitInfo> &hits = use_bvh ? bvh_hits : brute_force_hits;
+            start_time = std::chrono::steady_clock::now();
+            for(int i=0; i < cast_count; i++) {
+                switch(cast_type) {
+                    case 0:
+                        if(use_bvh) {
+                            rayCast(starts[i], targets[i] - starts[i], hits[i]);
+                        } else {
+                            rayCastBruteForce(starts[i], targets[i] - starts[i], hits[i]);
+                        }
+                        break;
+                    case 1:
+                        if(use_bvh) {
+                            lineCast(starts[i], targets[i], hits[i]);
+                        } else {
+                            lineCastBruteForce(starts[i], targets[i], hits[i]);
+                        }
+                        break;
+                    case 2:
+                        if(use_bvh) {
+                            sphereCast(model_to_world, world_starts[i], world_targets[i], radius, hits[i]);
+                        } else {
+                            sphereCastBruteForce(model_to_world, world_starts[i], world_targets[i], radius, hits[i]);
+                        }
+                        break;
+                }
+            }
+            cast_time[use_bvh] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+        }
+        
+        int hit_count = 0;
+        int mismatch_count = 0;
+        for(int i=0; i < cast_count; i++) {
+            const HitInfo &a = brute_force_hits[i];
+            const HitInfo &b = bvh_hits[i];
+            if(a.didHit()) {
+                hit_count++;
+            }
+            if(a.didHit() != b.didHit()) {
+                mismatch_count++;
+            } else if(a.didHit()) {
+                if(cast_type == 2) {
+                    // The world space reference rounds differently, and may pick a different one of several triangles hit at the same distance
+                    if(fabsf(a.getDistance() - b.getDistance()) > tolerance || (a.getPosition() - b.getPosition()).magnitude() > tolerance) {
+                        mismatch_count++;
+                    }
+                } else if(a.getPosition() != b.getPosition() || a.getNormal() != b.getNormal() || a.getDistance() != b.getDistance()) {
+                    mismatch_count++;
+                }
+            }
+        }
+        
+        KRContext::Log(KRContext::LOG_LEVEL_INFORMATION, "KRMesh::benchmarkCasts - %s, %i triangles, %i %s casts (%i hits): brute force %.0f casts/s, BVH %.0f casts/s, %i mismatches",
+                       getName().c_str(), bvh->getTriangleCount(), cast_count, cast_names[cast_type], hit_count, cast_count / KRMAX(cast_time[0], 0.000001), cast_count / KRMAX(cast_time[1], 0.000001), mismatch_count);
+        if(mismatch_count) {
+            KRContext::Log(KRContext::LOG_LEVEL_ERROR, "KRMesh::benchmarkCasts - %s: BVH %s casts differ from brute force", getName().c_str(), cast_names[cast_type]);
+        }
+    }
+    KRContext::Log(KRContext::LOG_LEVEL_INFORMATION, "KRMesh::benchmarkCasts - %s: BVH with %i nodes built in %.2f ms", getName().c_str(), bvh->getNodeCount(), build_time * 1000.0);
+    
+    m_pData->unlock();
+}
+
 void KRMesh::optimizeIndexes()
 {
+    releaseBVH();
     m_pData->lock();
     if(getModelFormat() == KRENGINE_MODEL_FORMAT_INDEXED_TRIANGLES) {
 
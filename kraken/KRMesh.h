@@ -56,6 +56,8 @@ using namespace kraken;
 
 class KRMaterial;
 class KRNode;
+class KRMeshBVH;
+class KRRenderQueue;
 
 class KRMesh : public KRResource {
 
@@ -87,6 +89,9 @@ public:
         KRENGINE_ATTRIB_TEXUVB_SHORT,
         KRENGINE_NUM_ATTRIBUTES
     } vertex_attrib_t;
+    
+    // Attribute location of the per-instance model matrix of instanced draws.  It follows the vertex attribute locations and takes four of them, one per column.
+    static const int KRENGINE_ATTRIB_INSTANCE_MODEL_MATRIX = KRENGINE_ATTRIB_BONEWEIGHTS + 1;
 
     typedef enum {
         KRENGINE_MODEL_FORMAT_TRIANGLES = 0,
@@ -113,7 +118,14 @@ public:
         std::vector<std::vector<float> > bone_weights;
     } mesh_info;
 
-    void render(const std::string &object_name, KRCamera *pCamera, std::vector<KRPointLight *> &point_lights, std::vector<KRDirectionalLight *> &directional_lights, std::vector<KRSpotLight *>&spot_lights, const KRViewport &viewport, const Matrix4 &matModel, KRTexture *pLightMap, KRNode::RenderPass renderPass, const std::vector<KRBone *> &bones, const Vector3 &rim_color, float rim_power, float lod_coverage = 0.0f);
+    // Opaque submeshes are added to render_queue instead of being drawn, if it is collecting renderPass
+    void render(const std::string &object_name, KRCamera *pCamera, std::vector<KRPointLight *> &point_lights, std::vector<KRDirectionalLight *> &directional_lights, std::vector<KRSpotLight *>&spot_lights, const KRViewport &viewport, const Matrix4 &matModel, KRTexture *pLightMap, KRNode::RenderPass renderPass, const std::vector<Matrix4> &bone_palette, const Vector3 &rim_color, float rim_power, float lod_coverage = 0.0f, KRRenderQueue *render_queue = NULL);
+    
+    // Bind pMaterial and draw a submesh with it
+    void renderMaterialSubmesh(int iSubmesh, KRMaterial *pMaterial, const std::string &object_name, KRCamera *pCamera, std::vector<KRPointLight *> &point_lights, std::vector<KRDirectionalLight *> &directional_lights, std::vector<KRSpotLight *>&spot_lights, const KRViewport &viewport, const Matrix4 &matModel, KRTexture *pLightMap, KRNode::RenderPass renderPass, const std::vector<Matrix4> &bone_palette, const Vector3 &rim_color, float rim_power, float lod_coverage);
+    
+    // Bind pMaterial and draw a submesh once for each model matrix, in one instanced draw call.  The submesh must be indexed and unskinned.
+    void renderInstancedSubmesh(int iSubmesh, KRMaterial *pMaterial, const std::string &object_name, KRCamera *pCamera, std::vector<KRPointLight *> &point_lights, std::vector<KRDirectionalLight *> &directional_lights, std::vector<KRSpotLight *>&spot_lights, const KRViewport &viewport, const std::vector<Matrix4> &instance_matrices, KRTexture *pLightMap, KRNode::RenderPass renderPass, const Vector3 &rim_color, float rim_power, float lod_coverage);
 
     std::string m_lodBaseName;
 
@@ -128,7 +140,8 @@ public:
     void optimize();
     void optimizeIndexes();
 
-    void renderSubmesh(int iSubmesh, KRNode::RenderPass renderPass, const std::string &object_name, const std::string &material_name, float lodCoverage);
+    // With an instance_count above one, the instance matrices must have been uploaded with KRMeshManager::uploadInstances
+    void renderSubmesh(int iSubmesh, KRNode::RenderPass renderPass, const std::string &object_name, const std::string &material_name, float lodCoverage, int instance_count = 1);
 
     GLfloat getMaxDimension();
 
@@ -193,6 +206,9 @@ public:
     Vector2 getVertexUVB(int index) const;
     int getBoneIndex(int index, int weight_index) const;
     float getBoneWeight(int index, int weight_index) const;
+    
+    // Three model space corners for each triangle, for rasterizing into KROcclusionCuller.  Built on first use
+    const std::vector<Vector3> &getOccluderVertices() const;
 
     void setVertexPosition(int index, const Vector3 &v);
     void setVertexNormal(int index, const Vector3 &v);
@@ -215,8 +231,19 @@ public:
     bool lineCast(const Vector3 &v0, const Vector3 &v1, HitInfo &hitinfo) const;
     bool rayCast(const Vector3 &v0, const Vector3 &dir, HitInfo &hitinfo) const;
     bool sphereCast(const Matrix4 &model_to_world, const Vector3 &v0, const Vector3 &v1, float radius, HitInfo &hitinfo) const;
+    
+    // Lock the mesh data and build the BVH, so rayCastLocked can be called from several threads at once until endCasts is called.
+    // Returns the BVH to pass to rayCastLocked, which then casts without taking the BVH mutex.
+    const KRMeshBVH *beginCasts() const;
+    void endCasts() const;
+    bool rayCastLocked(const KRMeshBVH *bvh, const Vector3 &v0, const Vector3 &dir, HitInfo &hitinfo) const;
+    
+    // Time cast_count random ray, line, and sphere casts against the mesh with and without the BVH, log the results, and report any casts where the results differ
+    void benchmarkCasts(int cast_count);
 
     static int GetLODCoverage(const std::string &name);
+    static std::string GetLODBaseName(const std::string &name);
+    static void ParseLODName(const std::string &name, std::string &base_name, int &lod_coverage);
 
     void load(); // Load immediately into the GPU rather than passing through the streamer
 
@@ -232,7 +259,33 @@ private:
     void getMaterials();
 
     static bool rayCast(const Vector3 &start, const Vector3 &dir, const Triangle3 &tri, const Vector3 &tri_n0, const Vector3 &tri_n1, const Vector3 &tri_n2, HitInfo &hitinfo);
-    static bool sphereCast(const Matrix4 &model_to_world, const Vector3 &v0, const Vector3 &v1, float radius, const Triangle3 &tri, HitInfo &hitinfo);
+    typedef struct {
+        Vector3 v0; // World space
+        Vector3 v1;
+        float radius;
+        float length; // |v1 - v0|
+        float scale; // World units per model unit, or 0 if model_to_world is not just a uniform scale, rotation and translation, and triangles must be transformed to world space
+        float normal_sign; // -1 if model_to_world mirrors the model
+        Vector3 model_v0; // Model space, if scale is not 0
+        Vector3 model_v1;
+        Vector3 model_dir;
+        float model_radius;
+    } sphere_cast_query;
+    
+    static void PrepareSphereCast(const Matrix4 &model_to_world, const Vector3 &v0, const Vector3 &v1, float radius, sphere_cast_query &query);
+    static bool sphereCast(const Matrix4 &model_to_world, const sphere_cast_query &query, const Triangle3 &tri, HitInfo &hitinfo);
+    static bool sphereCast(const Matrix4 &model_to_world, const Vector3 &v0, const Vector3 &v1, float radius, const Triangle3 &tri, HitInfo &hitinfo); // Transforms tri to world space
+    
+    // Test every triangle, without using the BVH
+    bool rayCastBruteForce(const Vector3 &v0, const Vector3 &dir, HitInfo &hitinfo) const;
+    bool lineCastBruteForce(const Vector3 &v0, const Vector3 &v1, HitInfo &hitinfo) const;
+    bool sphereCastBruteForce(const Matrix4 &model_to_world, const Vector3 &v0, const Vector3 &v1, float radius, HitInfo &hitinfo) const;
+    
+    const KRMeshBVH *getBVH() const; // Built on first use
+    void releaseBVH();
+    mutable KRMeshBVH *m_bvh;
+    mutable std::mutex m_bvhMutex;
+    mutable std::vector<Vector3> m_occluderVertices; // Guarded by m_bvhMutex and released with the BVH
 
     int m_lodCoverage; // This LOD level is activated when the bounding box of the model will cover less than this percent of the screen (100 = highest detail model)
     vector<KRMaterial *> m_materials;
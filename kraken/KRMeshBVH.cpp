@@ -0,0 +1,847 @@
+//
+//  KRMeshBVH.cpp
+//  KREngine
+//
+//  Copyright 2012 Kearwood Gilbert. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are
+//  permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this list of
+//  conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list
+//  of conditions and the following disclaimer in the documentation and/or other materials
+//  provided with the distribution.
+//
+//  THIS SOFTWARE IS PROVIDED BY KEARWOOD GILBERT ''AS IS'' AND ANY EXPRESS OR IMPLIED
+//  WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+//  FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL KEARWOOD GILBERT OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+//  ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+//  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+//  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//  The views and conclusions contained in the software and documentation are those of the
+//  authors and should not be interpreted as representing official policies, either expressed
+//  or implied, of Kearwood Gilbert.
+//
+
+#include "KRMeshBVH.h"
+#include "KRMesh.h"
+#include "KRCPUFeatures.h"
+
+#if defined(KRAKEN_USE_ARM_NEON) && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+#define KRMESHBVH_NEON
+#include <arm_neon.h>
+#endif
+
+#define KRENGINE_BVH_BARYCENTRIC_TOLERANCE 0.0001f // Ray hits this close to the edge of a triangle are confirmed with Triangle3::rayCast
+#define KRENGINE_BVH_PARALLEL_TOLERANCE 0.00001f // Rays this close to parallel with a triangle are confirmed with Triangle3::rayCast
+
+namespace {
+    
+    // The kernels below only reject triangles that can't be hit.  The remaining candidates are tested exactly with Triangle3, so results match a search over every triangle.
+    
+    typedef struct {
+        float start[3];
+        float dir[3];
+        float dir_length;
+        float min_distance;
+        float max_distance;
+        float parallel_tolerance; // |edge1 . (dir x edge2)| below area times this is treated as parallel
+    } ray_kernel_query;
+    
+    typedef struct {
+        float start[3];
+        float end[3];
+        float radius;
+    } sphere_kernel_query;
+    
+    // Each kernel tests one or two blocks, returning a bit for each candidate triangle
+    typedef int (*ray_kernel)(const KRMeshBVH::triangle_block *blocks, int block_count, const ray_kernel_query &q);
+    typedef int (*sphere_kernel)(const KRMeshBVH::triangle_block *blocks, int block_count, const sphere_kernel_query &q);
+    
+    int RayBlock_Scalar(const KRMeshBVH::triangle_block &b, const ray_kernel_query &q)
+    {
+        int candidates = 0;
+        for(int lane=0; lane < KRENGINE_BVH_BLOCK_SIZE; lane++) {
+            // Moller-Trumbore
+            float e1x = b.edge1[0][lane], e1y = b.edge1[1][lane], e1z = b.edge1[2][lane];
+            float e2x = b.edge2[0][lane], e2y = b.edge2[1][lane], e2z = b.edge2[2][lane];
+            float px = q.dir[1] * e2z - q.dir[2] * e2y;
+            float py = q.dir[2] * e2x - q.dir[0] * e2z;
+            float pz = q.dir[0] * e2y - q.dir[1] * e2x;
+            float det = e1x * px + e1y * py + e1z * pz;
+            float tx = q.start[0] - b.v0[0][lane];
+            float ty = q.start[1] - b.v0[1][lane];
+            float tz = q.start[2] - b.v0[2][lane];
+            float qx = ty * e1z - tz * e1y;
+            float qy = tz * e1x - tx * e1z;
+            float qz = tx * e1y - ty * e1x;
+            float inv_det = 1.0f / det;
+            float u = (tx * px + ty * py + tz * pz) * inv_det;
+            float v = (q.dir[0] * qx + q.dir[1] * qy + q.dir[2] * qz) * inv_det;
+            float distance = (e2x * qx + e2y * qy + e2z * qz) * inv_det * q.dir_length;
+            bool hit = u >= -KRENGINE_BVH_BARYCENTRIC_TOLERANCE && v >= -KRENGINE_BVH_BARYCENTRIC_TOLERANCE && u + v <= 1.0f + KRENGINE_BVH_BARYCENTRIC_TOLERANCE && distance >= q.min_distance && distance <= q.max_distance;
+            bool parallel = fabsf(det) <= b.area[lane] * q.parallel_tolerance;
+            if(hit || parallel) {
+                candidates |= 1 << lane;
+            }
+        }
+        return candidates;
+    }
+    
+    int SphereBlock_Scalar(const KRMeshBVH::triangle_block &b, const sphere_kernel_query &q)
+    {
+        int candidates = 0;
+        for(int lane=0; lane < KRENGINE_BVH_BLOCK_SIZE; lane++) {
+            // The sphere can only touch the triangle if it touches the triangle's plane
+            float start_distance = b.normal[0][lane] * q.start[0] + b.normal[1][lane] * q.start[1] + b.normal[2][lane] * q.start[2] - b.plane_distance[lane];
+            float end_distance = b.normal[0][lane] * q.end[0] + b.normal[1][lane] * q.end[1] + b.normal[2][lane] * q.end[2] - b.plane_distance[lane];
+            bool above = start_distance > q.radius && end_distance > q.radius;
+            bool below = start_distance < -q.radius && end_distance < -q.radius;
+            if(!above && !below) {
+                candidates |= 1 << lane;
+            }
+        }
+        return candidates;
+    }
+    
+    int RayBlocks_Scalar(const KRMeshBVH::triangle_block *blocks, int block_count, const ray_kernel_query &q)
+    {
+        int candidates = RayBlock_Scalar(blocks[0], q);
+        if(block_count > 1) {
+            candidates |= RayBlock_Scalar(blocks[1], q) << KRENGINE_BVH_BLOCK_SIZE;
+        }
+        return candidates;
+    }
+    
+    int SphereBlocks_Scalar(const KRMeshBVH::triangle_block *blocks, int block_count, const sphere_kernel_query &q)
+    {
+        int candidates = SphereBlock_Scalar(blocks[0], q);
+        if(block_count > 1) {
+            candidates |= SphereBlock_Scalar(blocks[1], q) << KRENGINE_BVH_BLOCK_SIZE;
+        }
+        return candidates;
+    }
+    
+#if defined(KRAKEN_USE_SSE2)
+    
+    int RayBlock_SSE2(const KRMeshBVH::triangle_block &b, const ray_kernel_query &q)
+    {
+        __m128 dx = _mm_set1_ps(q.dir[0]);
+        __m128 dy = _mm_set1_ps(q.dir[1]);
+        __m128 dz = _mm_set1_ps(q.dir[2]);
+        __m128 e1x = _mm_loadu_ps(b.edge1[0]);
+        __m128 e1y = _mm_loadu_ps(b.edge1[1]);
+        __m128 e1z = _mm_loadu_ps(b.edge1[2]);
+        __m128 e2x = _mm_loadu_ps(b.edge2[0]);
+        __m128 e2y = _mm_loadu_ps(b.edge2[1]);
+        __m128 e2z = _mm_loadu_ps(b.edge2[2]);
+        __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+        __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+        __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+        __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+        __m128 tx = _mm_sub_ps(_mm_set1_ps(q.start[0]), _mm_loadu_ps(b.v0[0]));
+        __m128 ty = _mm_sub_ps(_mm_set1_ps(q.start[1]), _mm_loadu_ps(b.v0[1]));
+        __m128 tz = _mm_sub_ps(_mm_set1_ps(q.start[2]), _mm_loadu_ps(b.v0[2]));
+        __m128 qx = _mm_sub_ps(_mm_mul_ps(ty, e1z), _mm_mul_ps(tz, e1y));
+        __m128 qy = _mm_sub_ps(_mm_mul_ps(tz, e1x), _mm_mul_ps(tx, e1z));
+        __m128 qz = _mm_sub_ps(_mm_mul_ps(tx, e1y), _mm_mul_ps(ty, e1x));
+        __m128 inv_det = _mm_div_ps(_mm_set1_ps(1.0f), det);
+        __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, px), _mm_mul_ps(ty, py)), _mm_mul_ps(tz, pz)), inv_det);
+        __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), inv_det);
+        __m128 distance = _mm_mul_ps(_mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inv_det), _mm_set1_ps(q.dir_length));
+        
+        __m128 min_barycentric = _mm_set1_ps(-KRENGINE_BVH_BARYCENTRIC_TOLERANCE);
+        __m128 hit = _mm_and_ps(_mm_cmpge_ps(u, min_barycentric), _mm_cmpge_ps(v, min_barycentric));
+        hit = _mm_and_ps(hit, _mm_cmple_ps(_mm_add_ps(u, v), _mm_set1_ps(1.0f + KRENGINE_BVH_BARYCENTRIC_TOLERANCE)));
+        hit = _mm_and_ps(hit, _mm_cmpge_ps(distance, _mm_set1_ps(q.min_distance)));
+        hit = _mm_and_ps(hit, _mm_cmple_ps(distance, _mm_set1_ps(q.max_distance)));
+        __m128 abs_det = _mm_andnot_ps(_mm_set1_ps(-0.0f), det);
+        __m128 parallel = _mm_cmple_ps(abs_det, _mm_mul_ps(_mm_loadu_ps(b.area), _mm_set1_ps(q.parallel_tolerance)));
+        return _mm_movemask_ps(_mm_or_ps(hit, parallel));
+    }
+    
+    int SphereBlock_SSE2(const KRMeshBVH::triangle_block &b, const sphere_kernel_query &q)
+    {
+        __m128 nx = _mm_loadu_ps(b.normal[0]);
+        __m128 ny = _mm_loadu_ps(b.normal[1]);
+        __m128 nz = _mm_loadu_ps(b.normal[2]);
+        __m128 plane_distance = _mm_loadu_ps(b.plane_distance);
+        __m128 start_distance = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, _mm_set1_ps(q.start[0])), _mm_mul_ps(ny, _mm_set1_ps(q.start[1]))), _mm_mul_ps(nz, _mm_set1_ps(q.start[2]))), plane_distance);
+        __m128 end_distance = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, _mm_set1_ps(q.end[0])), _mm_mul_ps(ny, _mm_set1_ps(q.end[1]))), _mm_mul_ps(nz, _mm_set1_ps(q.end[2]))), plane_distance);
+        __m128 radius = _mm_set1_ps(q.radius);
+        __m128 neg_radius = _mm_set1_ps(-q.radius);
+        __m128 above = _mm_and_ps(_mm_cmpgt_ps(start_distance, radius), _mm_cmpgt_ps(end_distance, radius));
+        __m128 below = _mm_and_ps(_mm_cmplt_ps(start_distance, neg_radius), _mm_cmplt_ps(end_distance, neg_radius));
+        return _mm_movemask_ps(_mm_or_ps(above, below)) ^ 0xf;
+    }
+    
+    int RayBlocks_SSE2(const KRMeshBVH::triangle_block *blocks, int block_count, const ray_kernel_query &q)
+    {
+        int candidates = RayBlock_SSE2(blocks[0], q);
+        if(block_count > 1) {
+            candidates |= RayBlock_SSE2(blocks[1], q) << KRENGINE_BVH_BLOCK_SIZE;
+        }
+        return candidates;
+    }
+    
+    int SphereBlocks_SSE2(const KRMeshBVH::triangle_block *blocks, int block_count, const sphere_kernel_query &q)
+    {
+        int candidates = SphereBlock_SSE2(blocks[0], q);
+        if(block_count > 1) {
+            candidates |= SphereBlock_SSE2(blocks[1], q) << KRENGINE_BVH_BLOCK_SIZE;
+        }
+        return candidates;
+    }
+    
+    // Load the same row of two blocks into one register, so both blocks are tested at once
+    KRAKEN_TARGET_AVX2 inline __m256 LoadPair(const float *a, const float *b)
+    {
+        return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(a)), _mm_loadu_ps(b), 1);
+    }
+    
+    KRAKEN_TARGET_AVX2 int RayBlocks_AVX2(const KRMeshBVH::triangle_block *blocks, int block_count, const ray_kernel_query &q)
+    {
+        if(block_count < 2) {
+            return RayBlock_SSE2(blocks[0], q);
+        }
+        const KRMeshBVH::triangle_block &a = blocks[0];
+        const KRMeshBVH::triangle_block &b = blocks[1];
+        __m256 dx = _mm256_set1_ps(q.dir[0]);
+        __m256 dy = _mm256_set1_ps(q.dir[1]);
+        __m256 dz = _mm256_set1_ps(q.dir[2]);
+        __m256 e1x = LoadPair(a.edge1[0], b.edge1[0]);
+        __m256 e1y = LoadPair(a.edge1[1], b.edge1[1]);
+        __m256 e1z = LoadPair(a.edge1[2], b.edge1[2]);
+        __m256 e2x = LoadPair(a.edge2[0], b.edge2[0]);
+        __m256 e2y = LoadPair(a.edge2[1], b.edge2[1]);
+        __m256 e2z = LoadPair(a.edge2[2], b.edge2[2]);
+        __m256 px = _mm256_sub_ps(_mm256_mul_ps(dy, e2z), _mm256_mul_ps(dz, e2y));
+        __m256 py = _mm256_sub_ps(_mm256_mul_ps(dz, e2x), _mm256_mul_ps(dx, e2z));
+        __m256 pz = _mm256_sub_ps(_mm256_mul_ps(dx, e2y), _mm256_mul_ps(dy, e2x));
+        __m256 det = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e1x, px), _mm256_mul_ps(e1y, py)), _mm256_mul_ps(e1z, pz));
+        __m256 tx = _mm256_sub_ps(_mm256_set1_ps(q.start[0]), LoadPair(a.v0[0], b.v0[0]));
+        __m256 ty = _mm256_sub_ps(_mm256_set1_ps(q.start[1]), LoadPair(a.v0[1], b.v0[1]));
+        __m256 tz = _mm256_sub_ps(_mm256_set1_ps(q.start[2]), LoadPair(a.v0[2], b.v0[2]));
+        __m256 qx = _mm256_sub_ps(_mm256_mul_ps(ty, e1z), _mm256_mul_ps(tz, e1y));
+        __m256 qy = _mm256_sub_ps(_mm256_mul_ps(tz, e1x), _mm256_mul_ps(tx, e1z));
+        __m256 qz = _mm256_sub_ps(_mm256_mul_ps(tx, e1y), _mm256_mul_ps(ty, e1x));
+        __m256 inv_det = _mm256_div_ps(_mm256_set1_ps(1.0f), det);
+        __m256 u = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(tx, px), _mm256_mul_ps(ty, py)), _mm256_mul_ps(tz, pz)), inv_det);
+        __m256 v = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, qx), _mm256_mul_ps(dy, qy)), _mm256_mul_ps(dz, qz)), inv_det);
+        __m256 distance = _mm256_mul_ps(_mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e2x, qx), _mm256_mul_ps(e2y, qy)), _mm256_mul_ps(e2z, qz)), inv_det), _mm256_set1_ps(q.dir_length));
+        
+        __m256 min_barycentric = _mm256_set1_ps(-KRENGINE_BVH_BARYCENTRIC_TOLERANCE);
+        __m256 hit = _mm256_and_ps(_mm256_cmp_ps(u, min_barycentric, _CMP_GE_OQ), _mm256_cmp_ps(v, min_barycentric, _CMP_GE_OQ));
+        hit = _mm256_and_ps(hit, _mm256_cmp_ps(_mm256_add_ps(u, v), _mm256_set1_ps(1.0f + KRENGINE_BVH_BARYCENTRIC_TOLERANCE), _CMP_LE_OQ));
+        hit = _mm256_and_ps(hit, _mm256_cmp_ps(distance, _mm256_set1_ps(q.min_distance), _CMP_GE_OQ));
+        hit = _mm256_and_ps(hit, _mm256_cmp_ps(distance, _mm256_set1_ps(q.max_distance), _CMP_LE_OQ));
+        __m256 abs_det = _mm256_andnot_ps(_mm256_set1_ps(-0.0f), det);
+        __m256 parallel = _mm256_cmp_ps(abs_det, _mm256_mul_ps(LoadPair(a.area, b.area), _mm256_set1_ps(q.parallel_tolerance)), _CMP_LE_OQ);
+        return _mm256_movemask_ps(_mm256_or_ps(hit, parallel));
+    }
+    
+    KRAKEN_TARGET_AVX2 int SphereBlocks_AVX2(const KRMeshBVH::triangle_block *blocks, int block_count, const sphere_kernel_query &q)
+    {
+        if(block_count < 2) {
+            return SphereBlock_SSE2(blocks[0], q);
+        }
+        const KRMeshBVH::triangle_block &a = blocks[0];
+        const KRMeshBVH::triangle_block &b = blocks[1];
+        __m256 nx = LoadPair(a.normal[0], b.normal[0]);
+        __m256 ny = LoadPair(a.normal[1], b.normal[1]);
+        __m256 nz = LoadPair(a.normal[2], b.normal[2]);
+        __m256 plane_distance = LoadPair(a.plane_distance, b.plane_distance);
+        __m256 start_distance = _mm256_sub_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, _mm256_set1_ps(q.start[0])), _mm256_mul_ps(ny, _mm256_set1_ps(q.start[1]))), _mm256_mul_ps(nz, _mm256_set1_ps(q.start[2]))), plane_distance);
+        __m256 end_distance = _mm256_sub_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, _mm256_set1_ps(q.end[0])), _mm256_mul_ps(ny, _mm256_set1_ps(q.end[1]))), _mm256_mul_ps(nz, _mm256_set1_ps(q.end[2]))), plane_distance);
+        __m256 radius = _mm256_set1_ps(q.radius);
+        __m256 neg_radius = _mm256_set1_ps(-q.radius);
+        __m256 above = _mm256_and_ps(_mm256_cmp_ps(start_distance, radius, _CMP_GT_OQ), _mm256_cmp_ps(end_distance, radius, _CMP_GT_OQ));
+        __m256 below = _mm256_and_ps(_mm256_cmp_ps(start_distance, neg_radius, _CMP_LT_OQ), _mm256_cmp_ps(end_distance, neg_radius, _CMP_LT_OQ));
+        return _mm256_movemask_ps(_mm256_or_ps(above, below)) ^ 0xff;
+    }
+    
+#endif
+    
+#if defined(KRMESHBVH_NEON)
+    
+    int Movemask_NEON(uint32x4_t mask)
+    {
+        return (vgetq_lane_u32(mask, 0) & 1) | (vgetq_lane_u32(mask, 1) & 2) | (vgetq_lane_u32(mask, 2) & 4) | (vgetq_lane_u32(mask, 3) & 8);
+    }
+    
+    int RayBlock_NEON(const KRMeshBVH::triangle_block &b, const ray_kernel_query &q)
+    {
+        float32x4_t dx = vdupq_n_f32(q.dir[0]);
+        float32x4_t dy = vdupq_n_f32(q.dir[1]);
+        float32x4_t dz = vdupq_n_f32(q.dir[2]);
+        float32x4_t e1x = vld1q_f32(b.edge1[0]);
+        float32x4_t e1y = vld1q_f32(b.edge1[1]);
+        float32x4_t e1z = vld1q_f32(b.edge1[2]);
+        float32x4_t e2x = vld1q_f32(b.edge2[0]);
+        float32x4_t e2y = vld1q_f32(b.edge2[1]);
+        float32x4_t e2z = vld1q_f32(b.edge2[2]);
+        float32x4_t px = vsubq_f32(vmulq_f32(dy, e2z), vmulq_f32(dz, e2y));
+        float32x4_t py = vsubq_f32(vmulq_f32(dz, e2x), vmulq_f32(dx, e2z));
+        float32x4_t pz = vsubq_f32(vmulq_f32(dx, e2y), vmulq_f32(dy, e2x));
+        float32x4_t det = vaddq_f32(vaddq_f32(vmulq_f32(e1x, px), vmulq_f32(e1y, py)), vmulq_f32(e1z, pz));
+        float32x4_t tx = vsubq_f32(vdupq_n_f32(q.start[0]), vld1q_f32(b.v0[0]));
+        float32x4_t ty = vsubq_f32(vdupq_n_f32(q.start[1]), vld1q_f32(b.v0[1]));
+        float32x4_t tz = vsubq_f32(vdupq_n_f32(q.start[2]), vld1q_f32(b.v0[2]));
+        float32x4_t qx = vsubq_f32(vmulq_f32(ty, e1z), vmulq_f32(tz, e1y));
+        float32x4_t qy = vsubq_f32(vmulq_f32(tz, e1x), vmulq_f32(tx, e1z));
+        float32x4_t qz = vsubq_f32(vmulq_f32(tx, e1y), vmulq_f32(ty, e1x));
+        // Two Newton-Raphson steps refine the reciprocal estimate well within the tolerances below
+        float32x4_t inv_det = vrecpeq_f32(det);
+        inv_det = vmulq_f32(vrecpsq_f32(det, inv_det), inv_det);
+        inv_det = vmulq_f32(vrecpsq_f32(det, inv_det), inv_det);
+        float32x4_t u = vmulq_f32(vaddq_f32(vaddq_f32(vmulq_f32(tx, px), vmulq_f32(ty, py)), vmulq_f32(tz, pz)), inv_det);
+        float32x4_t v = vmulq_f32(vaddq_f32(vaddq_f32(vmulq_f32(dx, qx), vmulq_f32(dy, qy)), vmulq_f32(dz, qz)), inv_det);
+        float32x4_t distance = vmulq_f32(vmulq_f32(vaddq_f32(vaddq_f32(vmulq_f32(e2x, qx), vmulq_f32(e2y, qy)), vmulq_f32(e2z, qz)), inv_det), vdupq_n_f32(q.dir_length));
+        
+        float32x4_t min_barycentric = vdupq_n_f32(-KRENGINE_BVH_BARYCENTRIC_TOLERANCE);
+        uint32x4_t hit = vandq_u32(vcgeq_f32(u, min_barycentric), vcgeq_f32(v, min_barycentric));
+        hit = vandq_u32(hit, vcleq_f32(vaddq_f32(u, v), vdupq_n_f32(1.0f + KRENGINE_BVH_BARYCENTRIC_TOLERANCE)));
+        hit = vandq_u32(hit, vcgeq_f32(distance, vdupq_n_f32(q.min_distance)));
+        hit = vandq_u32(hit, vcleq_f32(distance, vdupq_n_f32(q.max_distance)));
+        uint32x4_t parallel = vcleq_f32(vabsq_f32(det), vmulq_f32(vld1q_f32(b.area), vdupq_n_f32(q.parallel_tolerance)));
+        return Movemask_NEON(vorrq_u32(hit, parallel));
+    }
+    
+    int SphereBlock_NEON(const KRMeshBVH::triangle_block &b, const sphere_kernel_query &q)
+    {
+        float32x4_t nx = vld1q_f32(b.normal[0]);
+        float32x4_t ny = vld1q_f32(b.normal[1]);
+        float32x4_t nz = vld1q_f32(b.normal[2]);
+        float32x4_t plane_distance = vld1q_f32(b.plane_distance);
+        float32x4_t start_distance = vsubq_f32(vaddq_f32(vaddq_f32(vmulq_f32(nx, vdupq_n_f32(q.start[0])), vmulq_f32(ny, vdupq_n_f32(q.start[1]))), vmulq_f32(nz, vdupq_n_f32(q.start[2]))), plane_distance);
+        float32x4_t end_distance = vsubq_f32(vaddq_f32(vaddq_f32(vmulq_f32(nx, vdupq_n_f32(q.end[0])), vmulq_f32(ny, vdupq_n_f32(q.end[1]))), vmulq_f32(nz, vdupq_n_f32(q.end[2]))), plane_distance);
+        float32x4_t radius = vdupq_n_f32(q.radius);
+        float32x4_t neg_radius = vdupq_n_f32(-q.radius);
+        uint32x4_t above = vandq_u32(vcgtq_f32(start_distance, radius), vcgtq_f32(end_distance, radius));
+        uint32x4_t below = vandq_u32(vcltq_f32(start_distance, neg_radius), vcltq_f32(end_distance, neg_radius));
+        return Movemask_NEON(vorrq_u32(above, below)) ^ 0xf;
+    }
+    
+    int RayBlocks_NEON(const KRMeshBVH::triangle_block *blocks, int block_count, const ray_kernel_query &q)
+    {
+        int candidates = RayBlock_NEON(blocks[0], q);
+        if(block_count > 1) {
+            candidates |= RayBlock_NEON(blocks[1], q) << KRENGINE_BVH_BLOCK_SIZE;
+        }
+        return candidates;
+    }
+    
+    int SphereBlocks_NEON(const KRMeshBVH::triangle_block *blocks, int block_count, const sphere_kernel_query &q)
+    {
+        int candidates = SphereBlock_NEON(blocks[0], q);
+        if(block_count > 1) {
+            candidates |= SphereBlock_NEON(blocks[1], q) << KRENGINE_BVH_BLOCK_SIZE;
+        }
+        return candidates;
+    }
+    
+#endif
+    
+    typedef struct {
+        ray_kernel ray;
+        sphere_kernel sphere;
+    } cast_kernels;
+    
+    const cast_kernels &Kernels()
+    {
+        static cast_kernels kernels = []() {
+            cast_kernels k;
+            k.ray = RayBlocks_Scalar;
+            k.sphere = SphereBlocks_Scalar;
+#if defined(KRAKEN_USE_SSE2)
+            if(KRCPUFeatures::SupportsAVX2()) {
+                k.ray = RayBlocks_AVX2;
+                k.sphere = SphereBlocks_AVX2;
+            } else {
+                k.ray = RayBlocks_SSE2;
+                k.sphere = SphereBlocks_SSE2;
+            }
+#elif defined(KRMESHBVH_NEON)
+            k.ray = RayBlocks_NEON;
+            k.sphere = SphereBlocks_NEON;
+#endif
+            return k;
+        }();
+        return kernels;
+    }
+    
+    int BlockCount(int triangle_count)
+    {
+        return (triangle_count + KRENGINE_BVH_BLOCK_SIZE - 1) / KRENGINE_BVH_BLOCK_SIZE;
+    }
+}
+
+KRMeshBVH::KRMeshBVH(const KRMesh &mesh)
+{
+    // Gather the triangles in the same order that KRMesh visits them
+    int triangle_index = 0;
+    for(int submesh_index=0; submesh_index < mesh.getSubmeshCount(); submesh_index++) {
+        int vertex_count = mesh.getVertexCount(submesh_index);
+        switch(mesh.getModelFormat()) {
+            case KRMesh::KRENGINE_MODEL_FORMAT_TRIANGLES:
+            case KRMesh::KRENGINE_MODEL_FORMAT_INDEXED_TRIANGLES:
+                for(int i=0; i < vertex_count / 3; i++) {
+                    triangle_info t;
+                    for(int v=0; v < 3; v++) {
+                        t.vertex_index[v] = mesh.getTriangleVertexIndex(submesh_index, i*3 + v);
+                    }
+                    t.tri = Triangle3::Create(mesh.getVertexPosition(t.vertex_index[0]), mesh.getVertexPosition(t.vertex_index[1]), mesh.getVertexPosition(t.vertex_index[2]));
+                    t.triangle_index = triangle_index++;
+                    m_triangles.push_back(t);
+                }
+                break;
+            default:
+                break; // Strips are not yet supported
+        }
+    }
+    
+    m_padding = 0.0f;
+    m_nodes.push_back(node());
+    if(m_triangles.empty()) {
+        for(int axis=0; axis < 3; axis++) {
+            m_nodes[0].min[axis] = 0.0f;
+            m_nodes[0].max[axis] = -1.0f; // Empty box, so nothing will intersect it
+        }
+        m_nodes[0].first = 0;
+        m_nodes[0].count = 0;
+        return;
+    }
+    
+    float min[3], max[3];
+    calculateBounds(0, (int)m_triangles.size(), min, max);
+    float extent = 0.0f;
+    for(int axis=0; axis < 3; axis++) {
+        extent = KRMAX(extent, max[axis] - min[axis]);
+        extent = KRMAX(extent, fabsf(min[axis]));
+        extent = KRMAX(extent, fabsf(max[axis]));
+    }
+    m_padding = extent * 1.0e-4f + 1.0e-6f;
+    
+    std::vector<Vector3> centroids;
+    centroids.reserve(m_triangles.size());
+    for(std::vector<triangle_info>::iterator itr = m_triangles.begin(); itr != m_triangles.end(); itr++) {
+        const Triangle3 &tri = (*itr).tri;
+        centroids.push_back((tri[0] + tri[1] + tri[2]) / 3.0f);
+    }
+    
+    build(0, 0, (int)m_triangles.size(), centroids, 0);
+    buildBlocks();
+}
+
+KRMeshBVH::~KRMeshBVH()
+{
+    
+}
+
+int KRMeshBVH::getTriangleCount() const
+{
+    return (int)m_triangles.size();
+}
+
+int KRMeshBVH::getNodeCount() const
+{
+    return (int)m_nodes.size();
+}
+
+void KRMeshBVH::calculateBounds(int begin, int end, float *min, float *max) const
+{
+    for(int axis=0; axis < 3; axis++) {
+        min[axis] = std::numeric_limits<float>::max();
+        max[axis] = -std::numeric_limits<float>::max();
+    }
+    for(int i=begin; i < end; i++) {
+        const Triangle3 &tri = m_triangles[i].tri;
+        for(int v=0; v < 3; v++) {
+            Vector3 p = tri[v];
+            for(int axis=0; axis < 3; axis++) {
+                min[axis] = KRMIN(min[axis], p[axis]);
+                max[axis] = KRMAX(max[axis], p[axis]);
+            }
+        }
+    }
+}
+
+void KRMeshBVH::build(int node_index, int begin, int end, std::vector<Vector3> &centroids, int depth)
+{
+    float min[3], max[3];
+    calculateBounds(begin, end, min, max);
+    for(int axis=0; axis < 3; axis++) {
+        m_nodes[node_index].min[axis] = min[axis] - m_padding;
+        m_nodes[node_index].max[axis] = max[axis] + m_padding;
+    }
+    m_nodes[node_index].first = begin;
+    m_nodes[node_index].count = end - begin;
+    
+    int count = end - begin;
+    if(count <= KRENGINE_BVH_MIN_LEAF_SIZE || depth >= KRENGINE_BVH_MAX_DEPTH) {
+        return;
+    }
+    
+    // Bin the triangle centroids along each axis, and choose the split with the lowest surface area heuristic cost
+    float centroid_min[3], centroid_max[3];
+    for(int axis=0; axis < 3; axis++) {
+        centroid_min[axis] = std::numeric_limits<float>::max();
+        centroid_max[axis] = -std::numeric_limits<float>::max();
+    }
+    for(int i=begin; i < end; i++) {
+        for(int axis=0; axis < 3; axis++) {
+            centroid_min[axis] = KRMIN(centroid_min[axis], centroids[i][axis]);
+            centroid_max[axis] = KRMAX(centroid_max[axis], centroids[i][axis]);
+        }
+    }
+    
+    float best_cost = std::numeric_limits<float>::max();
+    int best_axis = -1;
+    int best_split = 0;
+    for(int axis=0; axis < 3; axis++) {
+        float range = centroid_max[axis] - centroid_min[axis];
+        if(range <= 0.0f) {
+            continue;
+        }
+        
+        int bin_count[KRENGINE_BVH_BIN_COUNT];
+        float bin_min[KRENGINE_BVH_BIN_COUNT][3], bin_max[KRENGINE_BVH_BIN_COUNT][3];
+        for(int bin=0; bin < KRENGINE_BVH_BIN_COUNT; bin++) {
+            bin_count[bin] = 0;
+            for(int a=0; a < 3; a++) {
+                bin_min[bin][a] = std::numeric_limits<float>::max();
+                bin_max[bin][a] = -std::numeric_limits<float>::max();
+            }
+        }
+        for(int i=begin; i < end; i++) {
+            int bin = KRMIN(KRENGINE_BVH_BIN_COUNT - 1, (int)((centroids[i][axis] - centroid_min[axis]) / range * KRENGINE_BVH_BIN_COUNT));
+            bin_count[bin]++;
+            const Triangle3 &tri = m_triangles[i].tri;
+            for(int v=0; v < 3; v++) {
+                Vector3 p = tri[v];
+                for(int a=0; a < 3; a++) {
+                    bin_min[bin][a] = KRMIN(bin_min[bin][a], p[a]);
+                    bin_max[bin][a] = KRMAX(bin_max[bin][a], p[a]);
+                }
+            }
+        }
+        
+        // Sweep from the right to find the area and count to the right of each split, then from the left to evaluate each split
+        float right_area[KRENGINE_BVH_BIN_COUNT];
+        int right_count[KRENGINE_BVH_BIN_COUNT];
+        float sweep_min[3], sweep_max[3];
+        int sweep_count = 0;
+        for(int a=0; a < 3; a++) {
+            sweep_min[a] = std::numeric_limits<float>::max();
+            sweep_max[a] = -std::numeric_limits<float>::max();
+        }
+        for(int bin=KRENGINE_BVH_BIN_COUNT - 1; bin > 0; bin--) {
+            sweep_count += bin_count[bin];
+            for(int a=0; a < 3; a++) {
+                sweep_min[a] = KRMIN(sweep_min[a], bin_min[bin][a]);
+                sweep_max[a] = KRMAX(sweep_max[a], bin_max[bin][a]);
+            }
+            right_count[bin] = sweep_count;
+            right_area[bin] = sweep_count ? (sweep_max[0] - sweep_min[0]) * (sweep_max[1] - sweep_min[1]) + (sweep_max[1] - sweep_min[1]) * (sweep_max[2] - sweep_min[2]) + (sweep_max[2] - sweep_min[2]) * (sweep_max[0] - sweep_min[0]) : 0.0f;
+        }
+        sweep_count = 0;
+        for(int a=0; a < 3; a++) {
+            sweep_min[a] = std::numeric_limits<float>::max();
+            sweep_max[a] = -std::numeric_limits<float>::max();
+        }
+        for(int bin=0; bin < KRENGINE_BVH_BIN_COUNT - 1; bin++) {
+            sweep_count += bin_count[bin];
+            for(int a=0; a < 3; a++) {
+                sweep_min[a] = KRMIN(sweep_min[a], bin_min[bin][a]);
+                sweep_max[a] = KRMAX(sweep_max[a], bin_max[bin][a]);
+            }
+            if(sweep_count == 0 || right_count[bin + 1] == 0) {
+                continue;
+            }
+            float left_area = (sweep_max[0] - sweep_min[0]) * (sweep_max[1] - sweep_min[1]) + (sweep_max[1] - sweep_min[1]) * (sweep_max[2] - sweep_min[2]) + (sweep_max[2] - sweep_min[2]) * (sweep_max[0] - sweep_min[0]);
+            float cost = left_area * BlockCount(sweep_count) + right_area[bin + 1] * BlockCount(right_count[bin + 1]);
+            if(cost < best_cost) {
+                best_cost = cost;
+                best_axis = axis;
+                best_split = bin + 1;
+            }
+        }
+    }
+    
+    if(best_axis == -1) {
+        return; // All of the centroids are at the same point, so the triangles can't be separated
+    }
+    
+    // Compare against the cost of testing every block of triangles in a leaf, with the cost of traversing the node equal to one block test
+    float area = (max[0] - min[0]) * (max[1] - min[1]) + (max[1] - min[1]) * (max[2] - min[2]) + (max[2] - min[2]) * (max[0] - min[0]);
+    float leaf_cost = (float)BlockCount(count);
+    float split_cost = 1.0f + (area > 0.0f ? best_cost / area : leaf_cost);
+    if(split_cost >= leaf_cost && count <= KRENGINE_BVH_MAX_LEAF_SIZE) {
+        return;
+    }
+    
+    // Partition the triangles at the chosen split
+    float range = centroid_max[best_axis] - centroid_min[best_axis];
+    int mid = begin;
+    for(int i=begin; i < end; i++) {
+        int bin = KRMIN(KRENGINE_BVH_BIN_COUNT - 1, (int)((centroids[i][best_axis] - centroid_min[best_axis]) / range * KRENGINE_BVH_BIN_COUNT));
+        if(bin < best_split) {
+            std::swap(m_triangles[i], m_triangles[mid]);
+            std::swap(centroids[i], centroids[mid]);
+            mid++;
+        }
+    }
+    if(mid == begin || mid == end) {
+        return;
+    }
+    
+    int first_child = (int)m_nodes.size();
+    m_nodes.push_back(node());
+    m_nodes.push_back(node());
+    m_nodes[node_index].first = first_child;
+    m_nodes[node_index].count = 0;
+    build(first_child, begin, mid, centroids, depth + 1);
+    build(first_child + 1, mid, end, centroids, depth + 1);
+}
+
+void KRMeshBVH::buildBlocks()
+{
+    // Replace the first triangle index of each leaf with the index of its first block
+    for(std::vector<node>::iterator itr = m_nodes.begin(); itr != m_nodes.end(); itr++) {
+        node &n = *itr;
+        if(n.count == 0) {
+            continue;
+        }
+        int first_triangle = n.first;
+        n.first = (int)m_blocks.size();
+        for(int block_start=0; block_start < n.count; block_start += KRENGINE_BVH_BLOCK_SIZE) {
+            triangle_block b;
+            for(int lane=0; lane < KRENGINE_BVH_BLOCK_SIZE; lane++) {
+                if(block_start + lane < n.count) {
+                    int triangle = first_triangle + block_start + lane;
+                    const Triangle3 &tri = m_triangles[triangle].tri;
+                    Vector3 edge1 = tri[1] - tri[0];
+                    Vector3 edge2 = tri[2] - tri[0];
+                    Vector3 normal = Vector3::Cross(edge1, edge2);
+                    float area = normal.magnitude();
+                    normal = area > 0.0f ? normal / area : Vector3::Zero();
+                    for(int axis=0; axis < 3; axis++) {
+                        b.v0[axis][lane] = tri[0][axis];
+                        b.edge1[axis][lane] = edge1[axis];
+                        b.edge2[axis][lane] = edge2[axis];
+                        b.normal[axis][lane] = normal[axis];
+                    }
+                    b.plane_distance[lane] = Vector3::Dot(normal, tri[0]);
+                    b.area[lane] = area;
+                    b.triangle[lane] = triangle;
+                } else {
+                    // Unused lanes have zero length edges and a plane at infinity, which every kernel rejects
+                    for(int axis=0; axis < 3; axis++) {
+                        b.v0[axis][lane] = 0.0f;
+                        b.edge1[axis][lane] = 0.0f;
+                        b.edge2[axis][lane] = 0.0f;
+                        b.normal[axis][lane] = 0.0f;
+                    }
+                    b.plane_distance[lane] = std::numeric_limits<float>::max();
+                    b.area[lane] = -1.0f;
+                    b.triangle[lane] = -1;
+                }
+            }
+            m_blocks.push_back(b);
+        }
+    }
+}
+
+bool KRMeshBVH::intersectsRay(const node &n, const Vector3 &start, const float *inv_dir, float &entry) const
+{
+    float t_min = 0.0f;
+    float t_max = std::numeric_limits<float>::max();
+    for(int axis=0; axis < 3; axis++) {
+        if(inv_dir[axis] == std::numeric_limits<float>::infinity()) {
+            // The ray is parallel to this pair of planes
+            if(start[axis] < n.min[axis] || start[axis] > n.max[axis]) {
+                return false;
+            }
+        } else {
+            float t0 = (n.min[axis] - start[axis]) * inv_dir[axis];
+            float t1 = (n.max[axis] - start[axis]) * inv_dir[axis];
+            if(t0 > t1) {
+                std::swap(t0, t1);
+            }
+            t_min = KRMAX(t_min, t0);
+            t_max = KRMIN(t_max, t1);
+            if(t_min > t_max) {
+                return false;
+            }
+        }
+    }
+    entry = t_min;
+    return true;
+}
+
+const KRMeshBVH::triangle_info *KRMeshBVH::rayCast(const Vector3 &start, const Vector3 &dir, float max_distance) const
+{
+    if(m_triangles.empty()) {
+        return NULL;
+    }
+    
+    float inv_dir[3];
+    for(int axis=0; axis < 3; axis++) {
+        inv_dir[axis] = dir[axis] == 0.0f ? std::numeric_limits<float>::infinity() : 1.0f / dir[axis];
+    }
+    float dir_length = dir.magnitude();
+    
+    const triangle_info *best = NULL;
+    float best_distance = max_distance;
+    
+    const cast_kernels &kernels = Kernels();
+    ray_kernel_query q;
+    for(int axis=0; axis < 3; axis++) {
+        q.start[axis] = start[axis];
+        q.dir[axis] = dir[axis];
+    }
+    q.dir_length = dir_length;
+    q.min_distance = -m_padding;
+    q.max_distance = best_distance * 1.0001f + m_padding;
+    q.parallel_tolerance = dir_length * KRENGINE_BVH_PARALLEL_TOLERANCE;
+    
+    // Visit the nearest node first, so distant nodes can be skipped once a hit is found
+    int stack[KRENGINE_BVH_MAX_DEPTH * 2 + 2];
+    float stack_entry[KRENGINE_BVH_MAX_DEPTH * 2 + 2];
+    int stack_size = 0;
+    float entry = 0.0f;
+    if(intersectsRay(m_nodes[0], start, inv_dir, entry)) {
+        stack[stack_size] = 0;
+        stack_entry[stack_size++] = entry;
+    }
+    while(stack_size > 0) {
+        stack_size--;
+        const node &n = m_nodes[stack[stack_size]];
+        if(stack_entry[stack_size] * dir_length > best_distance + m_padding) {
+            continue; // A closer hit has been found since this node was pushed
+        }
+        
+        if(n.count > 0) {
+            int block_count = BlockCount(n.count);
+            for(int block=0; block < block_count; block += 2) {
+                const triangle_block *blocks = &m_blocks[n.first + block];
+                int candidates = kernels.ray(blocks, KRMIN(2, block_count - block), q);
+                for(int lane=0; candidates; lane++, candidates >>= 1) {
+                    if((candidates & 1) == 0) {
+                        continue;
+                    }
+                    const triangle_info &t = m_triangles[blocks[lane / KRENGINE_BVH_BLOCK_SIZE].triangle[lane % KRENGINE_BVH_BLOCK_SIZE]];
+                    Vector3 hit_point;
+                    if(t.tri.rayCast(start, dir, hit_point)) {
+                        float distance = (hit_point - start).magnitude();
+                        if(distance < best_distance || (best && distance == best_distance && t.triangle_index < best->triangle_index)) {
+                            best = &t;
+                            best_distance = distance;
+                            q.max_distance = best_distance * 1.0001f + m_padding;
+                        }
+                    }
+                }
+            }
+        } else {
+            float entry0 = 0.0f, entry1 = 0.0f;
+            bool hit0 = intersectsRay(m_nodes[n.first], start, inv_dir, entry0);
+            bool hit1 = intersectsRay(m_nodes[n.first + 1], start, inv_dir, entry1);
+            if(hit0 && hit1) {
+                int near_child = entry0 <= entry1 ? n.first : n.first + 1;
+                int far_child = entry0 <= entry1 ? n.first + 1 : n.first;
+                stack[stack_size] = far_child;
+                stack_entry[stack_size++] = KRMAX(entry0, entry1);
+                stack[stack_size] = near_child;
+                stack_entry[stack_size++] = KRMIN(entry0, entry1);
+            } else if(hit0) {
+                stack[stack_size] = n.first;
+                stack_entry[stack_size++] = entry0;
+            } else if(hit1) {
+                stack[stack_size] = n.first + 1;
+                stack_entry[stack_size++] = entry1;
+            }
+        }
+    }
+    return best;
+}
+
+void KRMeshBVH::findTriangles(const AABB &bounds, std::vector<const triangle_info *> &triangles) const
+{
+    float min[3], max[3];
+    for(int axis=0; axis < 3; axis++) {
+        min[axis] = bounds.min[axis];
+        max[axis] = bounds.max[axis];
+    }
+    findTriangles(min, max, NULL, NULL, 0.0f, triangles);
+}
+
+void KRMeshBVH::findTriangles(const Vector3 &start, const Vector3 &end, float radius, std::vector<const triangle_info *> &triangles) const
+{
+    float padded_radius = radius * 1.0001f + m_padding;
+    float min[3], max[3];
+    for(int axis=0; axis < 3; axis++) {
+        min[axis] = KRMIN(start[axis], end[axis]) - padded_radius;
+        max[axis] = KRMAX(start[axis], end[axis]) + padded_radius;
+    }
+    findTriangles(min, max, &start, &end, padded_radius, triangles);
+}
+
+void KRMeshBVH::findTriangles(const float *min, const float *max, const Vector3 *sweep_start, const Vector3 *sweep_end, float radius, std::vector<const triangle_info *> &triangles) const
+{
+    if(m_triangles.empty()) {
+        return;
+    }
+    
+    const cast_kernels &kernels = Kernels();
+    sphere_kernel_query q;
+    if(sweep_start) {
+        for(int axis=0; axis < 3; axis++) {
+            q.start[axis] = (*sweep_start)[axis];
+            q.end[axis] = (*sweep_end)[axis];
+        }
+        q.radius = radius;
+    }
+    
+    size_t first_found = triangles.size();
+    int stack[KRENGINE_BVH_MAX_DEPTH * 2 + 2];
+    int stack_size = 0;
+    stack[stack_size++] = 0;
+    while(stack_size > 0) {
+        const node &n = m_nodes[stack[--stack_size]];
+        bool overlaps = true;
+        for(int axis=0; axis < 3; axis++) {
+            if(n.max[axis] < min[axis] || n.min[axis] > max[axis]) {
+                overlaps = false;
+            }
+        }
+        if(!overlaps) {
+            continue;
+        }
+        if(n.count > 0) {
+            int block_count = BlockCount(n.count);
+            for(int block=0; block < block_count; block += 2) {
+                const triangle_block *blocks = &m_blocks[n.first + block];
+                int block_pair_count = KRMIN(2, block_count - block);
+                int candidates = sweep_start ? kernels.sphere(blocks, block_pair_count, q) : -1;
+                for(int lane=0; lane < block_pair_count * KRENGINE_BVH_BLOCK_SIZE; lane++) {
+                    int triangle = blocks[lane / KRENGINE_BVH_BLOCK_SIZE].triangle[lane % KRENGINE_BVH_BLOCK_SIZE];
+                    if((candidates & (1 << lane)) && triangle != -1) {
+                        triangles.push_back(&m_triangles[triangle]);
+                    }
+                }
+            }
+        } else {
+            stack[stack_size++] = n.first;
+            stack[stack_size++] = n.first + 1;
+        }
+    }
+    std::sort(triangles.begin() + first_found, triangles.end(), [](const triangle_info *a, const triangle_info *b) {
+        return a->triangle_index < b->triangle_index;
+    });
+}
@@ -0,0 +1,100 @@
+//
+//  KRMeshBVH.h
+//  KREngine
+//
+//  Copyright 2012 Kearwood Gilbert. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are
+//  permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this list of
+//  conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list
+//  of conditions and the following disclaimer in the documentation and/or other materials
+//  provided with the distribution.
+//
+//  THIS SOFTWARE IS PROVIDED BY KEARWOOD GILBERT ''AS IS'' AND ANY EXPRESS OR IMPLIED
+//  WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+//  FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL KEARWOOD GILBERT OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+//  ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+//  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+//  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//  The views and conclusions contained in the software and documentation are those of the
+//  authors and should not be interpreted as representing official policies, either expressed
+//  or implied, of Kearwood Gilbert.
+//
+
+#ifndef KRMESHBVH_H
+#define KRMESHBVH_H
+
+#include "KREngine-common.h"
+
+class KRMesh;
+
+#define KRENGINE_BVH_BIN_COUNT 12 // Number of buckets evaluated along each axis when choosing a split with the surface area heuristic
+#define KRENGINE_BVH_MIN_LEAF_SIZE 4 // Nodes with this many triangles or fewer are never split
+#define KRENGINE_BVH_MAX_LEAF_SIZE 16 // Nodes with more triangles than this are always split
+#define KRENGINE_BVH_BLOCK_SIZE 4 // Triangles in each block of a leaf, tested together with SIMD instructions
+#define KRENGINE_BVH_MAX_DEPTH 64
+
+// Bounding volume hierarchy of the triangles in a KRMesh, in model space, used to accelerate ray, line and sphere casts
+class KRMeshBVH {
+public:
+    KRMeshBVH(const KRMesh &mesh);
+    ~KRMeshBVH();
+    
+    typedef struct {
+        Triangle3 tri;
+        int vertex_index[3];
+        int triangle_index; // Order of the triangle in the mesh, used to break ties the same way as a search over every triangle
+    } triangle_info;
+    
+    // Structure of arrays copy of the triangles in a leaf, so the SIMD kernels can reject KRENGINE_BVH_BLOCK_SIZE triangles at once.  Unused lanes are never returned by the kernels.
+    typedef struct {
+        float v0[3][KRENGINE_BVH_BLOCK_SIZE];
+        float edge1[3][KRENGINE_BVH_BLOCK_SIZE];
+        float edge2[3][KRENGINE_BVH_BLOCK_SIZE];
+        float normal[3][KRENGINE_BVH_BLOCK_SIZE]; // Unit length, or zero for degenerate triangles
+        float plane_distance[KRENGINE_BVH_BLOCK_SIZE];
+        float area[KRENGINE_BVH_BLOCK_SIZE]; // Magnitude of edge1 x edge2
+        __int32_t triangle[KRENGINE_BVH_BLOCK_SIZE]; // Index in m_triangles
+    } triangle_block;
+    
+    // Find the nearest triangle hit by a ray.  Only hits closer than max_distance are returned.  When two triangles are hit at the same distance, the first in the mesh is returned.
+    const triangle_info *rayCast(const Vector3 &start, const Vector3 &dir, float max_distance) const;
+    
+    // Append the triangles with bounds that overlap an axis aligned box to triangles, in the order they appear in the mesh
+    void findTriangles(const AABB &bounds, std::vector<const triangle_info *> &triangles) const;
+    
+    // Append the triangles that may be touched by a sphere moving from start to end, in the order they appear in the mesh
+    void findTriangles(const Vector3 &start, const Vector3 &end, float radius, std::vector<const triangle_info *> &triangles) const;
+    
+    int getTriangleCount() const;
+    int getNodeCount() const;
+    
+private:
+    typedef struct {
+        float min[3];
+        float max[3];
+        __int32_t first; // Index of the first child for interior nodes, whose children are adjacent; or the first triangle_block for leaf nodes
+        __int32_t count; // Number of triangles in leaf nodes; 0 for interior nodes
+    } node;
+    
+    std::vector<node> m_nodes;
+    std::vector<triangle_info> m_triangles;
+    std::vector<triangle_block> m_blocks;
+    float m_padding; // Node bounds are expanded by this much, so rounding in the triangle tests can't cause a triangle to be missed
+    
+    void build(int node_index, int begin, int end, std::vector<Vector3> &centroids, int depth);
+    void buildBlocks();
+    void calculateBounds(int begin, int end, float *min, float *max) const;
+    bool intersectsRay(const node &n, const Vector3 &start, const float *inv_dir, float &entry) const;
+    void findTriangles(const float *min, const float *max, const Vector3 *sweep_start, const Vector3 *sweep_end, float radius, std::vector<const triangle_info *> &triangles) const;
+};
+
+#endif
@@ -43,13 +43,22 @@ KRMeshManager::KRMeshManager(KRContext &context) : KRContextObject(context) {
     m_vboMemUsed = 0;
     m_memoryTransferredThisFrame = 0;
     m_first_frame = true;
-    m_streamerComplete = true;
+    m_streamerFramesSkipped = 0;
+    m_streamerFramesDeferred = 0;
+    m_streamerPrioritiesHash = 0;
+    m_streamerPrioritiesChanged = false;
+#if KRENGINE_INSTANCED_DRAWING
+    m_instance_buffer_handle = -1;
+#endif
     
     addModel(new KRMeshCube(context)); // FINDME - HACK!  This needs to be fixed, as it currently segfaults
     addModel(new KRMeshQuad(context)); // FINDME - HACK!  This needs to be fixed, as it currently segfaults
     addModel(new KRMeshSphere(context));
     m_draw_call_logging_enabled = false;
     m_draw_call_log_used = false;
+    for(int i=0; i < BIND_TYPE_COUNT; i++) {
+        m_bind_count[i] = 0;
+    }
     
     
     
@@ -103,6 +112,12 @@ KRMeshManager::~KRMeshManager() {
         delete (*itr).second;
     }
     m_models.empty();
+#if KRENGINE_INSTANCED_DRAWING
+    if(m_instance_buffer_handle != -1) {
+        GLDEBUG(glDeleteBuffers(1, &m_instance_buffer_handle));
+        m_instance_buffer_handle = -1;
+    }
+#endif
 }
 
 KRMesh *KRMeshManager::loadModel(const char *szName, KRDataBlock *pData) {
@@ -127,6 +142,9 @@ std::vector<KRMesh *> KRMeshManager::getModel(const char *szName) {
     
     std::vector<KRMesh *> matching_models;
     
+    // Load all LOD levels of the model from an indexed bundle on first use
+    getContext().getBundleManager()->loadPendingResource(lowerName, "krmesh");
+    
     std::pair<unordered_multimap<std::string, KRMesh *>::iterator, unordered_multimap<std::string, KRMesh *>::iterator> range = m_models.equal_range(lowerName);
     for(unordered_multimap<std::string, KRMesh *>::iterator itr_match = range.first; itr_match != range.second; itr_match++) {
         matching_models.push_back(itr_match->second);
@@ -178,6 +196,7 @@ void KRMeshManager::bindVBO(KRVBOData *vbo_data, float lodCoverage)
         }
         
         m_currentVBO->bind();
+        log_bind(BIND_VBO);
     }
     
     if(!used_vbo_data && vbo_data->getType() == KRVBOData::TEMPORARY) {
@@ -194,57 +213,81 @@ void KRMeshManager::startFrame(float deltaTime)
         m_draw_call_logging_enabled = true;
     }
     m_draw_calls.clear();
+    for(int i=0; i < BIND_TYPE_COUNT; i++) {
+        m_bind_count[i] = 0;
+    }
     
     if(m_first_frame) {
         m_first_frame = false;
         firstFrame();
     }
     
-    // TODO - Implement proper double-buffering to reduce copy operations
-    m_streamerFenceMutex.lock();
+    // VBO priorities are handed to the streamer every frame without waiting for it.
+    // Streaming VBOs must not be swapped or unloaded while the streamer may be loading them, so that is deferred to a later frame if it is busy.
+    bool streamerIdle = m_streamerFenceMutex.try_lock();
+    if(!streamerIdle) {
+        m_streamerFramesDeferred++;
+    }
     
-    if(m_streamerComplete) {
-        assert(m_activeVBOs_streamer_copy.size() == 0); // The streamer should have emptied this if it really did complete
-        
-        const long KRENGINE_VBO_EXPIRY_FRAMES = 1;
-        
-        std::set<KRVBOData *> expiredVBOs;
-        for(auto itr=m_vbosActive.begin(); itr != m_vbosActive.end(); itr++) {
-            KRVBOData *activeVBO = (*itr).second;
-            activeVBO->_swapHandles();
-            if(activeVBO->getLastFrameUsed() + KRENGINE_VBO_EXPIRY_FRAMES < getContext().getCurrentFrame()) {
-                // Expire VBO's that haven't been used in a long time
-                
-                switch(activeVBO->getType()) {
-                    case KRVBOData::STREAMING:
-                        activeVBO->unload();
-                        break;
-                    case KRVBOData::TEMPORARY:
-                        delete activeVBO;
-                        break;
-                    case KRVBOData::CONSTANT:
-                        // CONSTANT VBO's are not unloaded
-                        break;
-                }
-                
-                expiredVBOs.insert(activeVBO);
-            } else {
-                if(activeVBO->getType() == KRVBOData::STREAMING) {
-                    float priority = activeVBO->getStreamPriority();
-                    m_activeVBOs_streamer_copy.push_back(std::pair<float, KRVBOData *>(priority, activeVBO));
-                }
+    const long KRENGINE_VBO_EXPIRY_FRAMES = 1;
+    
+    std::vector<std::pair<float, KRVBOData *> > &activeVBOs = m_activeVBOs_streamer.getBack();
+    activeVBOs.clear();
+    
+    std::set<KRVBOData *> expiredVBOs;
+    for(auto itr=m_vbosActive.begin(); itr != m_vbosActive.end(); itr++) {
+        KRVBOData *activeVBO = (*itr).second;
+        if(!streamerIdle && activeVBO->getType() != KRVBOData::TEMPORARY) {
+            // TEMPORARY VBO's are never seen by the streamer, so they can still be expired
+            if(activeVBO->getType() == KRVBOData::STREAMING) {
+                float priority = activeVBO->getStreamPriority();
+                activeVBOs.push_back(std::pair<float, KRVBOData *>(priority, activeVBO));
             }
+            continue;
         }
-        for(std::set<KRVBOData *>::iterator itr=expiredVBOs.begin(); itr != expiredVBOs.end(); itr++) {
-            m_vbosActive.erase((*itr)->m_data);
-        }
-        
-        if(m_activeVBOs_streamer_copy.size() > 0) {
-            m_streamerComplete = false;
+        activeVBO->_swapHandles();
+        if(activeVBO->getLastFrameUsed() + KRENGINE_VBO_EXPIRY_FRAMES < getContext().getCurrentFrame()) {
+            // Expire VBO's that haven't been used in a long time
+            
+            switch(activeVBO->getType()) {
+                case KRVBOData::STREAMING:
+                    activeVBO->unload();
+                    break;
+                case KRVBOData::TEMPORARY:
+                    delete activeVBO;
+                    break;
+                case KRVBOData::CONSTANT:
+                    // CONSTANT VBO's are not unloaded
+                    break;
+            }
+            
+            expiredVBOs.insert(activeVBO);
+        } else {
+            if(activeVBO->getType() == KRVBOData::STREAMING) {
+                float priority = activeVBO->getStreamPriority();
+                activeVBOs.push_back(std::pair<float, KRVBOData *>(priority, activeVBO));
+            }
         }
     }
-    m_streamerFenceMutex.unlock();
+    for(std::set<KRVBOData *>::iterator itr=expiredVBOs.begin(); itr != expiredVBOs.end(); itr++) {
+        m_vbosActive.erase((*itr)->m_data);
+    }
     
+    size_t prioritiesHash = 0;
+    for(auto itr=activeVBOs.begin(); itr != activeVBOs.end(); itr++) {
+        prioritiesHash = prioritiesHash * 31 + (hash<KRVBOData *>()((*itr).second) ^ hash<float>()((*itr).first));
+    }
+    m_streamerPrioritiesChanged = prioritiesHash != m_streamerPrioritiesHash;
+    m_streamerPrioritiesHash = prioritiesHash;
+    
+    // Published while still holding the lock when idle, so the streamer never sees a list containing unloaded VBO's
+    if(!m_activeVBOs_streamer.publish()) {
+        m_streamerFramesSkipped++;
+    }
+    
+    if(streamerIdle) {
+        m_streamerFenceMutex.unlock();
+    }
 }
 
 void KRMeshManager::endFrame(float deltaTime)
@@ -264,35 +307,49 @@ void KRMeshManager::firstFrame()
 
 void KRMeshManager::doStreaming(long &memoryRemaining, long &memoryRemainingThisFrame)
 {
-    
-    // TODO - Implement proper double-buffering to reduce copy operations
     m_streamerFenceMutex.lock();
-    m_activeVBOs_streamer = std::move(m_activeVBOs_streamer_copy);
-    m_streamerFenceMutex.unlock();
     
-    if(m_activeVBOs_streamer.size() > 0) {
+    // Only the latest frame's priorities are used; each list is balanced at most once
+    if(m_activeVBOs_streamer.consume() && m_activeVBOs_streamer.getFront().size() > 0) {
         balanceVBOMemory(memoryRemaining, memoryRemainingThisFrame);
-        
-        m_streamerFenceMutex.lock();
-        m_streamerComplete = true;
-        m_streamerFenceMutex.unlock();
     } else {
         memoryRemaining -= getMemUsed();
     }
+    
+    m_streamerFenceMutex.unlock();
+}
+
+long KRMeshManager::getStreamerFramesSkipped()
+{
+    return m_streamerFramesSkipped;
+}
+
+long KRMeshManager::getStreamerFramesDeferred()
+{
+    return m_streamerFramesDeferred;
+}
+
+bool KRMeshManager::getStreamerPrioritiesChanged()
+{
+    return m_streamerPrioritiesChanged;
 }
 
 void KRMeshManager::balanceVBOMemory(long &memoryRemaining, long &memoryRemainingThisFrame)
 {
-    std::sort(m_activeVBOs_streamer.begin(), m_activeVBOs_streamer.end(), std::greater<std::pair<float, KRVBOData *>>());
+    std::vector<std::pair<float, KRVBOData *> > &activeVBOs = m_activeVBOs_streamer.getFront();
+    std::sort(activeVBOs.begin(), activeVBOs.end(), std::greater<std::pair<float, KRVBOData *>>());
     
 
-    for(auto vbo_itr = m_activeVBOs_streamer.begin(); vbo_itr != m_activeVBOs_streamer.end(); vbo_itr++) {
+    for(auto vbo_itr = activeVBOs.begin(); vbo_itr != activeVBOs.end(); vbo_itr++) {
         KRVBOData *vbo_data = (*vbo_itr).second;
         long vbo_size = vbo_data->getSize();
         if(!vbo_data->isVBOLoaded()) {
-            if(memoryRemainingThisFrame > vbo_size) {
+            if(memoryRemainingThisFrame > vbo_size && !getContext().getStreamingTimeExceeded()) {
                 vbo_data->load();
                 memoryRemainingThisFrame -= vbo_size;
+            } else {
+                // Out of transfer or time budget for this pass; start reading it from disk so it is ready for the next pass
+                vbo_data->prefetch((*vbo_itr).first);
             }
         }
         memoryRemaining -= vbo_size;
@@ -308,6 +365,48 @@ void KRMeshManager::bindVBO(KRDataBlock &data, KRDataBlock &index_data, int vert
     bindVBO(vbo_data, lodCoverage);
 }
 
+#if KRENGINE_INSTANCED_DRAWING
+void KRMeshManager::uploadInstances(const std::vector<Matrix4> &model_matrices)
+{
+    m_instance_data.resize(model_matrices.size() * 16);
+    GLfloat *instance_component = &m_instance_data[0];
+    for(std::vector<Matrix4>::const_iterator itr = model_matrices.begin(); itr != model_matrices.end(); itr++) {
+        for(int i=0; i < 16; i++) {
+            *instance_component++ = (*itr)[i];
+        }
+    }
+    
+    if(m_instance_buffer_handle == -1) {
+        GLDEBUG(glGenBuffers(1, &m_instance_buffer_handle));
+    }
+    
+    // Reallocating the buffer orphans the matrices of the previous instanced draw, so the driver does not have to wait for that draw before accepting the new ones
+    GLsizeiptr size = m_instance_data.size() * sizeof(GLfloat);
+    GLDEBUG(glBindBuffer(GL_ARRAY_BUFFER, m_instance_buffer_handle));
+    GLDEBUG(glBufferData(GL_ARRAY_BUFFER, size, &m_instance_data[0], GL_STREAM_DRAW));
+    m_memoryTransferredThisFrame += size;
+}
+
+void KRMeshManager::bindInstanceAttribs()
+{
+    GLDEBUG(glBindBuffer(GL_ARRAY_BUFFER, m_instance_buffer_handle));
+    for(int column=0; column < 4; column++) {
+        GLuint location = KRMesh::KRENGINE_ATTRIB_INSTANCE_MODEL_MATRIX + column;
+        GLDEBUG(glEnableVertexAttribArray(location));
+        GLDEBUG(glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(GLfloat) * 16, BUFFER_OFFSET(sizeof(GLfloat) * 4 * column)));
+        GLDEBUG(glVertexAttribDivisor(location, 1));
+    }
+}
+
+void KRMeshManager::unbindInstanceAttribs()
+{
+    // The instance attributes are disabled again, as they would otherwise remain part of the state of the VBO's vertex array object
+    for(int column=0; column < 4; column++) {
+        GLDEBUG(glDisableVertexAttribArray(KRMesh::KRENGINE_ATTRIB_INSTANCE_MODEL_MATRIX + column));
+    }
+}
+#endif
+
 void KRMeshManager::configureAttribs(__int32_t attributes)
 {
     GLsizei data_size = (GLsizei)KRMesh::VertexSizeForAttributes(attributes);
@@ -486,7 +585,7 @@ int KRMeshManager::getActiveVBOCount()
     return m_vbosActive.size();
 }
 
-void KRMeshManager::log_draw_call(KRNode::RenderPass pass, const std::string &object_name, const std::string &material_name, int vertex_count)
+void KRMeshManager::log_draw_call(KRNode::RenderPass pass, const std::string &object_name, const std::string &material_name, int vertex_count, int instance_count)
 {
     if(m_draw_call_logging_enabled) {
         draw_call_info info;
@@ -494,10 +593,22 @@ void KRMeshManager::log_draw_call(KRNode::RenderPass pass, const std::string &ob
         strncpy(info.object_name, object_name.c_str(), 256);
         strncpy(info.material_name, material_name.c_str(), 256);
         info.vertex_count = vertex_count;
+        info.instance_count = instance_count;
+        for(int i=0; i < BIND_TYPE_COUNT; i++) {
+            info.bind_count[i] = m_bind_count[i];
+            m_bind_count[i] = 0;
+        }
         m_draw_calls.push_back(info);
     }
 }
 
+void KRMeshManager::log_bind(bind_type type)
+{
+    if(m_draw_call_logging_enabled) {
+        m_bind_count[type]++;
+    }
+}
+
 std::vector<KRMeshManager::draw_call_info> KRMeshManager::getDrawCalls()
 {
     m_draw_call_log_used = true;
@@ -689,6 +800,12 @@ float KRMeshManager::KRVBOData::getStreamPriority()
     }
 }
 
+void KRMeshManager::KRVBOData::prefetch(float priority)
+{
+    m_data->prefetch(0, 0, priority);
+    m_index_data->prefetch(0, 0, priority);
+}
+
 void KRMeshManager::KRVBOData::_swapHandles()
 {
     if(m_is_vbo_loaded) {
@@ -36,6 +36,7 @@
 #include "KRContextObject.h"
 #include "KRDataBlock.h"
 #include "KRNode.h"
+#include "KRTripleBuffer.h"
 
 class KRContext;
 class KRMesh;
@@ -97,6 +98,8 @@ public:
         
         float getStreamPriority();
         
+        void prefetch(float priority); // Queue asynchronous reads of the vertex and index data ahead of load()
+        
         void _swapHandles();
         
     private:
@@ -123,6 +126,14 @@ public:
     
     static void configureAttribs(__int32_t attributes);
     
+#if KRENGINE_INSTANCED_DRAWING
+    // Copy the model matrices of the next instanced draw to the instance buffer
+    void uploadInstances(const std::vector<Matrix4> &model_matrices);
+    // Point the instance attributes of the bound VBO at the instance buffer, for one instanced draw
+    void bindInstanceAttribs();
+    void unbindInstanceAttribs();
+#endif
+    
     typedef struct {
         GLfloat x;
         GLfloat y;
@@ -152,14 +163,24 @@ public:
 
     int getActiveVBOCount();
     
+    typedef enum {
+        BIND_SHADER,
+        BIND_TEXTURE,
+        BIND_VBO,
+        BIND_TYPE_COUNT
+    } bind_type;
+    
     struct draw_call_info {
         KRNode::RenderPass pass;
         char object_name[256];
         char material_name[256];
         int vertex_count;
+        int instance_count;
+        int bind_count[BIND_TYPE_COUNT]; // State changes made since the previous draw call
     };
     
-    void log_draw_call(KRNode::RenderPass pass, const std::string &object_name, const std::string &material_name, int vertex_count);
+    void log_draw_call(KRNode::RenderPass pass, const std::string &object_name, const std::string &material_name, int vertex_count, int instance_count = 1);
+    void log_bind(bind_type type);
     std::vector<draw_call_info> getDrawCalls();
     
     
@@ -169,6 +190,13 @@ public:
     
     void doStreaming(long &memoryRemaining, long &memoryRemainingThisFrame);
     
+    // Frames whose VBO priorities were replaced by a newer frame before the streamer read them
+    long getStreamerFramesSkipped();
+    // Frames where handle swaps and VBO expiry were deferred, as the streamer was loading VBOs
+    long getStreamerFramesDeferred();
+    // True if the VBO priorities published by the last frame differ from those of the frame before
+    bool getStreamerPrioritiesChanged();
+    
 private:
     KRDataBlock KRENGINE_VBO_3D_CUBE_VERTICES, KRENGINE_VBO_3D_CUBE_INDEXES;
     __int32_t KRENGINE_VBO_3D_CUBE_ATTRIBS;
@@ -181,22 +209,31 @@ private:
     KRVBOData *m_currentVBO;
     
     unordered_map<KRDataBlock *, KRVBOData *> m_vbosActive;
-    std::vector<std::pair<float, KRVBOData *> > m_activeVBOs_streamer;
-    std::vector<std::pair<float, KRVBOData *> > m_activeVBOs_streamer_copy;
+    // Streaming VBO priorities, handed from the render thread to the streamer thread each frame
+    KRTripleBuffer<std::vector<std::pair<float, KRVBOData *> > > m_activeVBOs_streamer;
     
     KRDataBlock m_randomParticleVertexData;
     KRDataBlock m_volumetricLightingVertexData;
     
     long m_memoryTransferredThisFrame;
     
+#if KRENGINE_INSTANCED_DRAWING
+    GLuint m_instance_buffer_handle;
+    std::vector<GLfloat> m_instance_data;
+#endif
+    
     std::vector<draw_call_info> m_draw_calls;
+    int m_bind_count[BIND_TYPE_COUNT];
     bool m_draw_call_logging_enabled;
     bool m_draw_call_log_used;
     
     bool m_first_frame;
     
-    std::mutex m_streamerFenceMutex;
-    bool m_streamerComplete;
+    std::mutex m_streamerFenceMutex; // Held by the streamer while it loads VBOs
+    std::atomic<long> m_streamerFramesSkipped;
+    std::atomic<long> m_streamerFramesDeferred;
+    size_t m_streamerPrioritiesHash;
+    bool m_streamerPrioritiesChanged;
     
     void balanceVBOMemory(long &memoryRemaining, long &memoryRemainingThisFrame);
     
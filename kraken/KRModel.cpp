@@ -35,7 +35,7 @@
 #include "KRContext.h"
 #include "KRMesh.h"
 
-KRModel::KRModel(KRScene &scene, std::string instance_name, std::string model_name, std::string light_map, float lod_min_coverage, bool receives_shadow, bool faces_camera, Vector3 rim_color, float rim_power) : KRNode(scene, instance_name) {
+KRModel::KRModel(KRScene &scene, std::string instance_name, std::string model_name, std::string light_map, float lod_min_coverage, bool receives_shadow, bool faces_camera, Vector3 rim_color, float rim_power, bool occluder) : KRNode(scene, instance_name) {
     m_lightMap = light_map;
     m_pLightMap = NULL;
     m_model_name = model_name;
@@ -44,6 +44,7 @@ KRModel::KRModel(KRScene &scene, std::string instance_name, std::string model_na
     m_faces_camera = faces_camera;
     m_rim_color = rim_color;
     m_rim_power = rim_power;
+    m_occluder = occluder;
     
     m_boundsCachedMat.c[0] = -1.0f;
     m_boundsCachedMat.c[1] = -1.0f;
@@ -81,6 +82,7 @@ tinyxml2::XMLElement *KRModel::saveXML( tinyxml2::XMLNode *parent)
     e->SetAttribute("faces_camera", m_faces_camera ? "true" : "false");
     kraken::setXMLAttribute("rim_color", e, m_rim_color, Vector3::Zero());
     e->SetAttribute("rim_power", m_rim_power);
+    e->SetAttribute("occluder", m_occluder ? "true" : "false");
     return e;
 }
 
@@ -115,6 +117,33 @@ std::string KRModel::getLightMap()
     return m_lightMap;
 }
 
+void KRModel::setOccluder(bool occluder)
+{
+    m_occluder = occluder;
+    getScene().notify_sceneGraphModify(this);
+}
+
+bool KRModel::isOccluder()
+{
+    return m_occluder;
+}
+
+void KRModel::rasterizeOcclusion(KROcclusionCuller &culler)
+{
+    loadModel();
+    if(m_models.size() == 0 || m_faces_camera) {
+        return;
+    }
+    KRMesh *mesh = m_models[0];
+    if(mesh->getBoneCount() > 0) {
+        return; // Skinned meshes move away from their bind pose, so are not used as occluders
+    }
+    const std::vector<Vector3> &corners = mesh->getOccluderVertices();
+    if(!corners.empty()) {
+        culler.rasterize(&corners[0], (int)corners.size() / 3, getModelMatrix());
+    }
+}
+
 void KRModel::loadModel() {
     if(m_models.size() == 0) {
         std::vector<KRMesh *> models = m_pContext->getMeshManager()->getModel(m_model_name.c_str()); // The model manager returns the LOD levels in sorted order, with the highest detail first
@@ -138,6 +167,11 @@ void KRModel::loadModel() {
             if(all_bones_found) {
                 m_models = models;
                 m_bones = bones;
+                for(unordered_map<KRMesh *, std::vector<KRBone *> >::iterator bone_itr = m_bones.begin(); bone_itr != m_bones.end(); bone_itr++) {
+                    bone_palette &palette = m_bone_palettes[bone_itr->first];
+                    palette.frame = -1;
+                    palette.matrices.resize(bone_itr->second.size());
+                }
                 getScene().notify_sceneGraphModify(this);
             }
             
@@ -173,7 +207,7 @@ void KRModel::render(KRCamera *pCamera, std::vector<KRPointLight *> &point_light
             
             float lod_coverage = viewport.coverage(getBounds()); // This also checks the view frustrum culling
             
-            if(lod_coverage > m_min_lod_coverage) {
+            if(lod_coverage > 0.0f && (m_min_lod_coverage <= 0.0f || viewport.distanceCoverage(getBounds()) > m_min_lod_coverage)) {
                 
                 // ---===--- Select the best LOD model based on screen coverage ---===---
                 std::vector<KRMesh *>::iterator itr=m_models.begin();
@@ -192,10 +226,6 @@ void KRModel::render(KRCamera *pCamera, std::vector<KRPointLight *> &point_light
                     m_pLightMap = getContext().getTextureManager()->getTexture(m_lightMap);
                 }
                 
-                if(m_pLightMap && pCamera->settings.bEnableLightMap && renderPass != RENDER_PASS_SHADOWMAP && renderPass != RENDER_PASS_GENERATE_SHADOWMAPS) {
-                    m_pContext->getTextureManager()->selectTexture(5, m_pLightMap, lod_coverage, KRTexture::TEXTURE_USAGE_LIGHT_MAP);
-                }
-                
                 Matrix4 matModel = getModelMatrix();
                 if(m_faces_camera) {
                     Vector3 model_center = Matrix4::Dot(matModel, Vector3::Zero());
@@ -203,12 +233,29 @@ void KRModel::render(KRCamera *pCamera, std::vector<KRPointLight *> &point_light
                     matModel = Quaternion::Create(Vector3::Forward(), Vector3::Normalize(camera_pos - model_center)).rotationMatrix() * matModel;
                 }
                 
-                pModel->render(getName(), pCamera, point_lights, directional_lights, spot_lights, viewport, matModel, m_pLightMap, renderPass, m_bones[pModel], m_rim_color, m_rim_power, lod_coverage);
+                // The light map is selected along with the material of each submesh
+                pModel->render(getName(), pCamera, point_lights, directional_lights, spot_lights, viewport, matModel, m_pLightMap, renderPass, getBonePalette(pModel), m_rim_color, m_rim_power, lod_coverage, &getScene().getRenderQueue());
             }
         }
     }
 }
 
+const std::vector<Matrix4> &KRModel::getBonePalette(KRMesh *mesh)
+{
+    bone_palette &palette = m_bone_palettes[mesh];
+    long current_frame = getContext().getCurrentFrame();
+    if(palette.frame != current_frame) {
+        // Shared by every submesh and pass that draws the mesh this frame.  The inverse bind poses are cached by the bones.
+        std::vector<KRBone *> &bones = m_bones[mesh];
+        for(int bone_index=0; bone_index < bones.size(); bone_index++) {
+            KRBone *bone = bones[bone_index];
+            palette.matrices[bone_index] = bone->getInverseBindPoseMatrix() * bone->getActivePoseMatrix();
+        }
+        palette.frame = current_frame;
+    }
+    return palette.matrices;
+}
+
 void KRModel::preStream(const KRViewport &viewport)
 {
     loadModel();
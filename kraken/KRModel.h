@@ -43,11 +43,12 @@
 #include "KRMesh.h"
 #include "KRTexture.h"
 #include "KRBone.h"
+#include "KROcclusionCuller.h"
 
 class KRModel : public KRNode {
     
 public:
-    KRModel(KRScene &scene, std::string instance_name, std::string model_name, std::string light_map, float lod_min_coverage, bool receives_shadow, bool faces_camera, Vector3 rim_color = Vector3::Zero(), float rim_power = 0.0f);
+    KRModel(KRScene &scene, std::string instance_name, std::string model_name, std::string light_map, float lod_min_coverage, bool receives_shadow, bool faces_camera, Vector3 rim_color = Vector3::Zero(), float rim_power = 0.0f, bool occluder = false);
     virtual ~KRModel();
     
     virtual std::string getElementName();
@@ -65,6 +66,11 @@ public:
     void setLightMap(const std::string &name);
     std::string getLightMap();
     
+    // Occluders are rasterized into the KROcclusionCuller of their scene when software occlusion culling is enabled.  Use large, static, opaque meshes.
+    void setOccluder(bool occluder);
+    bool isOccluder();
+    void rasterizeOcclusion(KROcclusionCuller &culler);
+    
     virtual kraken_stream_level getStreamLevel(const KRViewport &viewport);
     
 private:
@@ -72,16 +78,25 @@ private:
     
     std::vector<KRMesh *> m_models;
     unordered_map<KRMesh *, std::vector<KRBone *> > m_bones; // Outer std::map connects model to set of bones
+    
+    // Skinning palette of each mesh, recomputed once per frame after the animations have been applied
+    typedef struct {
+        long frame;
+        std::vector<Matrix4> matrices;
+    } bone_palette;
+    unordered_map<KRMesh *, bone_palette> m_bone_palettes;
+    const std::vector<Matrix4> &getBonePalette(KRMesh *mesh);
     KRTexture *m_pLightMap;
     std::string m_lightMap;
     std::string m_model_name;
     
     
-    float m_min_lod_coverage;
+    float m_min_lod_coverage; // In the units of KRViewport::distanceCoverage(), which existing scenes were authored against.  0 to always draw the model when it is in view.
     void loadModel();
     
     bool m_receivesShadow;
     bool m_faces_camera;
+    bool m_occluder;
     
     
     Matrix4 m_boundsCachedMat;
@@ -64,6 +64,8 @@ KRNode::KRNode(KRScene &scene, std::string name) : KRContextObject(scene.getCont
     m_lod_visible = LOD_VISIBILITY_HIDDEN;
     m_scale_compensation = false;
     m_boundsValid = false;
+    m_octree_node = NULL;
+    m_octree_slot = -1;
     
     m_lastRenderFrame = -1000;
     for(int i=0; i < KRENGINE_NODE_ATTRIBUTE_COUNT; i++) {
@@ -429,7 +431,11 @@ KRNode *KRNode::LoadXML(KRScene &scene, tinyxml2::XMLElement *e) {
         }
         Vector3 rim_color = Vector3::Zero();
         rim_color = kraken::getXMLAttribute("rim_color", e, Vector3::Zero());
-        new_node = new KRModel(scene, szName, e->Attribute("mesh"), e->Attribute("light_map"), lod_min_coverage, receives_shadow, faces_camera, rim_color, rim_power);
+        bool occluder = false;
+        if(e->QueryBoolAttribute("occluder", &occluder) != tinyxml2::XML_SUCCESS) {
+            occluder = false;
+        }
+        new_node = new KRModel(scene, szName, e->Attribute("mesh"), e->Attribute("light_map"), lod_min_coverage, receives_shadow, faces_camera, rim_color, rim_power, occluder);
     } else if(strcmp(szElementName, "collider") == 0) {
         new_node = new KRCollider(scene, szName, e->Attribute("mesh"), 65535, 1.0f);
     } else if(strcmp(szElementName, "bone") == 0) {
@@ -868,26 +874,27 @@ bool KRNode::getAnimationEnabled(node_attribute_type attrib) const
 
 void KRNode::removeFromOctreeNodes()
 {
-    for(std::set<KROctreeNode *>::iterator itr=m_octree_nodes.begin(); itr != m_octree_nodes.end(); itr++) {
-        KROctreeNode *octree_node = *itr;
+    KROctreeNode *octree_node = m_octree_node;
+    if(octree_node) {
         octree_node->remove(this);
-        
-        // FINDME, TODO - This should be moved to the KROctree class
-        while(octree_node) {
-            octree_node->trim();
-            if(octree_node->isEmpty()) {
-                octree_node = octree_node->getParent();
-            } else {
-                octree_node = NULL;
-            }
-        }
+        octree_node->trimAncestors();
     }
-    m_octree_nodes.clear();
 }
 
-void KRNode::addToOctreeNode(KROctreeNode *octree_node)
+void KRNode::setOctreeNode(KROctreeNode *octree_node, int slot)
+{
+    m_octree_node = octree_node;
+    m_octree_slot = slot;
+}
+
+KROctreeNode *KRNode::getOctreeNode()
+{
+    return m_octree_node;
+}
+
+int KRNode::getOctreeSlot()
 {
-    m_octree_nodes.insert(octree_node);
+    return m_octree_slot;
 }
 
 void KRNode::updateLODVisibility(const KRViewport &viewport)
@@ -239,7 +239,8 @@ private:
     
     KRScene *m_pScene;
     
-    std::set<KROctreeNode *> m_octree_nodes;
+    KROctreeNode *m_octree_node;
+    int m_octree_slot; // Index of this node within m_octree_node->getSceneNodes()
     bool m_scale_compensation;
     
     std::set<KRBehavior *> m_behaviors;
@@ -258,7 +259,9 @@ public:
         return NULL;
     }
     void removeFromOctreeNodes();
-    void addToOctreeNode(KROctreeNode *octree_node);
+    void setOctreeNode(KROctreeNode *octree_node, int slot);
+    KROctreeNode *getOctreeNode(); // Returns NULL if the node is not held by an octree node
+    int getOctreeSlot();
     void childDeleted(KRNode *child_node);
     
     template <class T> T *find()
@@ -0,0 +1,388 @@
+//
+//  KROcclusionCuller.cpp
+//  KREngine
+//
+//  Copyright 2012 Kearwood Gilbert. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are
+//  permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this list of
+//  conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list
+//  of conditions and the following disclaimer in the documentation and/or other materials
+//  provided with the distribution.
+//
+//  THIS SOFTWARE IS PROVIDED BY KEARWOOD GILBERT ''AS IS'' AND ANY EXPRESS OR IMPLIED
+//  WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+//  FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL KEARWOOD GILBERT OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+//  ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+//  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+//  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//  The views and conclusions contained in the software and documentation are those of the
+//  authors and should not be interpreted as representing official policies, either expressed
+//  or implied, of Kearwood Gilbert.
+//
+
+#include "KROcclusionCuller.h"
+#include "KRContext.h"
+
+#if defined(KRAKEN_USE_SSE2)
+#include <emmintrin.h>
+#endif
+
+#if defined(KRAKEN_USE_ARM_NEON) && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+#define KROCCLUSIONCULLER_NEON
+#include <arm_neon.h>
+#endif
+
+namespace {
+    
+    // Edge function of a triangle in screen space, positive inside the triangle
+    typedef struct {
+        float a; // Change per pixel in x
+        float b; // Change per pixel in y
+        float c; // Value at the origin
+    } edge_function;
+    
+    // Write depth to the pixels of a row, starting at x, that are inside all three edges and nearer than what has been stored.  pixel_count is a multiple of 4.
+    void RasterizeSpan(float *depth, int pixel_count, float x, float y, const edge_function *edges, float z_dx, float z_base)
+    {
+#if defined(KRAKEN_USE_SSE2)
+        const __m128 step = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+        const __m128 zero = _mm_setzero_ps();
+        __m128 px = _mm_add_ps(_mm_set1_ps(x), step);
+        __m128 e[3];
+        __m128 e_step[3];
+        for(int i=0; i < 3; i++) {
+            e[i] = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(edges[i].a), px), _mm_set1_ps(edges[i].b * y + edges[i].c));
+            e_step[i] = _mm_set1_ps(edges[i].a * 4.0f);
+        }
+        __m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(z_dx), px), _mm_set1_ps(z_base));
+        __m128 z_step = _mm_set1_ps(z_dx * 4.0f);
+        for(int i=0; i < pixel_count; i += 4) {
+            __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e[0], zero), _mm_cmpge_ps(e[1], zero)), _mm_cmpge_ps(e[2], zero));
+            if(_mm_movemask_ps(inside)) {
+                __m128 stored = _mm_loadu_ps(depth + i);
+                __m128 nearest = _mm_min_ps(stored, z);
+                _mm_storeu_ps(depth + i, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, stored)));
+            }
+            for(int j=0; j < 3; j++) {
+                e[j] = _mm_add_ps(e[j], e_step[j]);
+            }
+            z = _mm_add_ps(z, z_step);
+        }
+#elif defined(KROCCLUSIONCULLER_NEON)
+        const float step_values[4] = {0.0f, 1.0f, 2.0f, 3.0f};
+        float32x4_t px = vaddq_f32(vdupq_n_f32(x), vld1q_f32(step_values));
+        float32x4_t e[3];
+        float32x4_t e_step[3];
+        for(int i=0; i < 3; i++) {
+            e[i] = vmlaq_f32(vdupq_n_f32(edges[i].b * y + edges[i].c), vdupq_n_f32(edges[i].a), px);
+            e_step[i] = vdupq_n_f32(edges[i].a * 4.0f);
+        }
+        float32x4_t z = vmlaq_f32(vdupq_n_f32(z_base), vdupq_n_f32(z_dx), px);
+        float32x4_t z_step = vdupq_n_f32(z_dx * 4.0f);
+        for(int i=0; i < pixel_count; i += 4) {
+            uint32x4_t inside = vandq_u32(vandq_u32(vcgeq_f32(e[0], vdupq_n_f32(0.0f)), vcgeq_f32(e[1], vdupq_n_f32(0.0f))), vcgeq_f32(e[2], vdupq_n_f32(0.0f)));
+            float32x4_t stored = vld1q_f32(depth + i);
+            vst1q_f32(depth + i, vbslq_f32(inside, vminq_f32(stored, z), stored));
+            for(int j=0; j < 3; j++) {
+                e[j] = vaddq_f32(e[j], e_step[j]);
+            }
+            z = vaddq_f32(z, z_step);
+        }
+#else
+        for(int i=0; i < pixel_count; i++) {
+            float px = x + (float)i;
+            if(edges[0].a * px + edges[0].b * y + edges[0].c >= 0.0f && edges[1].a * px + edges[1].b * y + edges[1].c >= 0.0f && edges[2].a * px + edges[2].b * y + edges[2].c >= 0.0f) {
+                float z = z_dx * px + z_base;
+                if(z < depth[i]) {
+                    depth[i] = z;
+                }
+            }
+        }
+#endif
+    }
+    
+    // Farthest of pixel_count depths, a multiple of 4
+    float MaxDepth(const float *depth, int pixel_count)
+    {
+#if defined(KRAKEN_USE_SSE2)
+        __m128 m = _mm_loadu_ps(depth);
+        for(int i=4; i < pixel_count; i += 4) {
+            m = _mm_max_ps(m, _mm_loadu_ps(depth + i));
+        }
+        m = _mm_max_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 0, 3, 2)));
+        m = _mm_max_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 3, 0, 1)));
+        return _mm_cvtss_f32(m);
+#elif defined(KROCCLUSIONCULLER_NEON)
+        float32x4_t m = vld1q_f32(depth);
+        for(int i=4; i < pixel_count; i += 4) {
+            m = vmaxq_f32(m, vld1q_f32(depth + i));
+        }
+        float32x2_t m2 = vpmax_f32(vget_low_f32(m), vget_high_f32(m));
+        return vget_lane_f32(vpmax_f32(m2, m2), 0);
+#else
+        float m = depth[0];
+        for(int i=1; i < pixel_count; i++) {
+            m = KRMAX(m, depth[i]);
+        }
+        return m;
+#endif
+    }
+    
+    double ElapsedSeconds(std::chrono::steady_clock::time_point start_time)
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+    }
+    
+    float RandomFloat(float min, float max)
+    {
+        return min + (max - min) * ((float)rand() / (float)RAND_MAX);
+    }
+}
+
+KROcclusionCuller::KROcclusionCuller(int width, int height)
+{
+    m_width = width;
+    m_height = height;
+    m_tilesX = width / KRENGINE_OCCLUSION_TILE_SIZE;
+    m_tilesY = height / KRENGINE_OCCLUSION_TILE_SIZE;
+    m_depth.resize(m_width * m_height, std::numeric_limits<float>::max());
+    m_tileDepth.resize(m_tilesX * m_tilesY, std::numeric_limits<float>::max());
+    m_triangleCount = 0;
+}
+
+KROcclusionCuller::~KROcclusionCuller()
+{
+    
+}
+
+void KROcclusionCuller::begin(const Matrix4 &view_projection)
+{
+    m_viewProjection = view_projection;
+    std::fill(m_depth.begin(), m_depth.end(), std::numeric_limits<float>::max());
+    m_triangleCount = 0;
+}
+
+void KROcclusionCuller::rasterize(const Vector3 *corners, int triangle_count, const Matrix4 &model_matrix)
+{
+    Matrix4 mvp = model_matrix * m_viewProjection;
+    for(int i=0; i < triangle_count; i++) {
+        Vector4 clip[3];
+        for(int v=0; v < 3; v++) {
+            const Vector3 &corner = corners[i * 3 + v];
+            clip[v] = Matrix4::Dot4(mvp, Vector4::Create(corner.x, corner.y, corner.z, 1.0f));
+        }
+        rasterizeTriangle(clip);
+    }
+}
+
+void KROcclusionCuller::rasterizeTriangle(const Vector4 *clip)
+{
+    float sx[3], sy[3], sz[3];
+    for(int v=0; v < 3; v++) {
+        if(clip[v].w < KRENGINE_OCCLUSION_NEAR_W) {
+            return; // Clipping against the near plane is not needed, as skipping an occluder can only make the test more conservative
+        }
+        float inv_w = 1.0f / clip[v].w;
+        sx[v] = (clip[v].x * inv_w * 0.5f + 0.5f) * (float)m_width;
+        sy[v] = (clip[v].y * inv_w * 0.5f + 0.5f) * (float)m_height;
+        sz[v] = clip[v].z * inv_w;
+    }
+    
+    float area = (sx[1] - sx[0]) * (sy[2] - sy[0]) - (sx[2] - sx[0]) * (sy[1] - sy[0]);
+    if(fabsf(area) < 1.0e-6f) {
+        return;
+    }
+    
+    int min_x = KRMAX(0, (int)floorf(KRMIN(sx[0], KRMIN(sx[1], sx[2]))));
+    int max_x = KRMIN(m_width - 1, (int)ceilf(KRMAX(sx[0], KRMAX(sx[1], sx[2]))));
+    int min_y = KRMAX(0, (int)floorf(KRMIN(sy[0], KRMIN(sy[1], sy[2]))));
+    int max_y = KRMIN(m_height - 1, (int)ceilf(KRMAX(sy[0], KRMAX(sy[1], sy[2]))));
+    if(min_x > max_x || min_y > max_y) {
+        return;
+    }
+    min_x &= ~3; // Spans start on a multiple of 4 pixels; as the width is also a multiple of 4, they never run past the end of a row
+    
+    m_triangleCount++;
+    
+    // Both windings are rasterized; the edges are flipped so that they are positive inside
+    float sign = area > 0.0f ? 1.0f : -1.0f;
+    edge_function edges[3];
+    for(int i=0; i < 3; i++) {
+        int j = (i + 1) % 3;
+        edge_function &e = edges[i];
+        e.a = (sy[i] - sy[j]) * sign;
+        e.b = (sx[j] - sx[i]) * sign;
+        e.c = (sx[i] * sy[j] - sx[j] * sy[i]) * sign;
+        e.c += 0.5f * (e.a + e.b); // Evaluate at pixel centers.  Pixels exactly on an edge are written by both triangles that share it, so meshes rasterize without gaps
+    }
+    
+    // Depth varies linearly in screen space.  Store the farthest depth within each pixel.
+    float z_dx = ((sz[1] - sz[0]) * (sy[2] - sy[0]) - (sz[2] - sz[0]) * (sy[1] - sy[0])) / area;
+    float z_dy = ((sz[2] - sz[0]) * (sx[1] - sx[0]) - (sz[1] - sz[0]) * (sx[2] - sx[0])) / area;
+    float z_origin = sz[0] - z_dx * sx[0] - z_dy * sy[0] + 0.5f * (z_dx + z_dy) + 0.5f * (fabsf(z_dx) + fabsf(z_dy));
+    
+    int span_width = (max_x - min_x + 4) & ~3;
+    for(int y=min_y; y <= max_y; y++) {
+        RasterizeSpan(&m_depth[y * m_width + min_x], span_width, (float)min_x, (float)y, edges, z_dx, z_dy * (float)y + z_origin);
+    }
+}
+
+void KROcclusionCuller::end()
+{
+    for(int tile_y=0; tile_y < m_tilesY; tile_y++) {
+        for(int tile_x=0; tile_x < m_tilesX; tile_x++) {
+            float tile_depth = -std::numeric_limits<float>::max();
+            for(int y=0; y < KRENGINE_OCCLUSION_TILE_SIZE; y++) {
+                tile_depth = KRMAX(tile_depth, MaxDepth(&m_depth[(tile_y * KRENGINE_OCCLUSION_TILE_SIZE + y) * m_width + tile_x * KRENGINE_OCCLUSION_TILE_SIZE], KRENGINE_OCCLUSION_TILE_SIZE));
+            }
+            m_tileDepth[tile_y * m_tilesX + tile_x] = tile_depth;
+        }
+    }
+}
+
+bool KROcclusionCuller::isVisible(const AABB &bounds) const
+{
+    float min_x = std::numeric_limits<float>::max();
+    float min_y = std::numeric_limits<float>::max();
+    float max_x = -std::numeric_limits<float>::max();
+    float max_y = -std::numeric_limits<float>::max();
+    float min_z = std::numeric_limits<float>::max();
+    for(int iCorner=0; iCorner < 8; iCorner++) {
+        Vector4 corner = Matrix4::Dot4(m_viewProjection, Vector4::Create(
+                                                                         (iCorner & 1) == 0 ? bounds.min.x : bounds.max.x,
+                                                                         (iCorner & 2) == 0 ? bounds.min.y : bounds.max.y,
+                                                                         (iCorner & 4) == 0 ? bounds.min.z : bounds.max.z, 1.0f));
+        if(corner.w < KRENGINE_OCCLUSION_NEAR_W) {
+            return true; // The bounds reach behind the camera
+        }
+        float inv_w = 1.0f / corner.w;
+        float x = (corner.x * inv_w * 0.5f + 0.5f) * (float)m_width;
+        float y = (corner.y * inv_w * 0.5f + 0.5f) * (float)m_height;
+        min_x = KRMIN(min_x, x);
+        max_x = KRMAX(max_x, x);
+        min_y = KRMIN(min_y, y);
+        max_y = KRMAX(max_y, y);
+        min_z = KRMIN(min_z, corner.z * inv_w); // Depth is monotonic with distance from the camera, so the nearest point of the box is a corner
+    }
+    
+    // Pixels touched by the projected bounds
+    int pixel_min_x = KRMAX(0, (int)floorf(min_x));
+    int pixel_max_x = KRMIN(m_width - 1, (int)floorf(max_x));
+    int pixel_min_y = KRMAX(0, (int)floorf(min_y));
+    int pixel_max_y = KRMIN(m_height - 1, (int)floorf(max_y));
+    if(pixel_min_x > pixel_max_x || pixel_min_y > pixel_max_y) {
+        return true; // Off screen; leave it to view frustum culling
+    }
+    
+    int tile_min_x = pixel_min_x / KRENGINE_OCCLUSION_TILE_SIZE;
+    int tile_max_x = pixel_max_x / KRENGINE_OCCLUSION_TILE_SIZE;
+    int tile_min_y = pixel_min_y / KRENGINE_OCCLUSION_TILE_SIZE;
+    int tile_max_y = pixel_max_y / KRENGINE_OCCLUSION_TILE_SIZE;
+    for(int tile_y=tile_min_y; tile_y <= tile_max_y; tile_y++) {
+        for(int tile_x=tile_min_x; tile_x <= tile_max_x; tile_x++) {
+            if(min_z > m_tileDepth[tile_y * m_tilesX + tile_x]) {
+                continue; // Every pixel in the tile is nearer than the bounds
+            }
+            int x_end = KRMIN(pixel_max_x, tile_x * KRENGINE_OCCLUSION_TILE_SIZE + KRENGINE_OCCLUSION_TILE_SIZE - 1);
+            int y_end = KRMIN(pixel_max_y, tile_y * KRENGINE_OCCLUSION_TILE_SIZE + KRENGINE_OCCLUSION_TILE_SIZE - 1);
+            for(int y=KRMAX(pixel_min_y, tile_y * KRENGINE_OCCLUSION_TILE_SIZE); y <= y_end; y++) {
+                const float *row = &m_depth[y * m_width];
+                for(int x=KRMAX(pixel_min_x, tile_x * KRENGINE_OCCLUSION_TILE_SIZE); x <= x_end; x++) {
+                    if(min_z <= row[x]) {
+                        return true;
+                    }
+                }
+            }
+        }
+    }
+    return false;
+}
+
+const Matrix4 &KROcclusionCuller::getViewProjectionMatrix() const
+{
+    return m_viewProjection;
+}
+
+int KROcclusionCuller::getWidth() const
+{
+    return m_width;
+}
+
+int KROcclusionCuller::getHeight() const
+{
+    return m_height;
+}
+
+float KROcclusionCuller::getDepth(int x, int y) const
+{
+    return m_depth[y * m_width + x];
+}
+
+int KROcclusionCuller::getTriangleCount() const
+{
+    return m_triangleCount;
+}
+
+void KROcclusionCuller::benchmarkCulling()
+{
+    // Walls of random quads in front of the camera, with random boxes scattered behind and between them
+    Matrix4 projection;
+    projection.perspective(1.0f, (float)KRENGINE_OCCLUSION_BUFFER_WIDTH / (float)KRENGINE_OCCLUSION_BUFFER_HEIGHT, 0.1f, 1000.0f);
+    Matrix4 view_projection = Matrix4::LookAt(Vector3::Zero(), Vector3::Forward(), Vector3::Up()) * projection;
+    
+    int occluder_counts[] = {16, 256, 4096};
+    for(int count_index=0; count_index < 3; count_index++) {
+        int quad_count = occluder_counts[count_index];
+        srand(quad_count);
+        std::vector<Vector3> corners;
+        for(int i=0; i < quad_count; i++) {
+            Vector3 center = Vector3::Create(RandomFloat(-100.0f, 100.0f), RandomFloat(-50.0f, 50.0f), RandomFloat(20.0f, 200.0f));
+            Vector3 size = Vector3::Create(RandomFloat(1.0f, 20.0f), RandomFloat(1.0f, 20.0f), 0.0f);
+            Vector3 quad[4] = {
+                center + Vector3::Create(-size.x, -size.y, 0.0f),
+                center + Vector3::Create(size.x, -size.y, 0.0f),
+                center + Vector3::Create(size.x, size.y, 0.0f),
+                center + Vector3::Create(-size.x, size.y, 0.0f)
+            };
+            corners.push_back(quad[0]); corners.push_back(quad[1]); corners.push_back(quad[2]);
+            corners.push_back(quad[0]); corners.push_back(quad[2]); corners.push_back(quad[3]);
+        }
+        std::vector<AABB> boxes;
+        for(int i=0; i < 10000; i++) {
+            Vector3 center = Vector3::Create(RandomFloat(-150.0f, 150.0f), RandomFloat(-75.0f, 75.0f), RandomFloat(20.0f, 400.0f));
+            Vector3 half_size = Vector3::Create(RandomFloat(0.5f, 5.0f));
+            boxes.push_back(AABB::Create(center - half_size, center + half_size));
+        }
+        
+        KROcclusionCuller culler;
+        const int iterations = 20;
+        std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+        for(int i=0; i < iterations; i++) {
+            culler.begin(view_projection);
+            culler.rasterize(&corners[0], (int)corners.size() / 3, Matrix4::Create());
+            culler.end();
+        }
+        double rasterize_time = ElapsedSeconds(start_time) / iterations;
+        
+        int hidden_count = 0;
+        start_time = std::chrono::steady_clock::now();
+        for(int i=0; i < iterations; i++) {
+            for(std::vector<AABB>::iterator itr=boxes.begin(); itr != boxes.end(); itr++) {
+                if(!culler.isVisible(*itr)) hidden_count++;
+            }
+        }
+        double test_time = ElapsedSeconds(start_time) / iterations;
+        
+        KRContext::Log(KRContext::LOG_LEVEL_INFORMATION, "KROcclusionCuller::benchmarkCulling - %i triangles rasterized in %.3f ms; %i boxes tested in %.3f ms, %i hidden",
+                       (int)corners.size() / 3, rasterize_time * 1000.0, (int)boxes.size(), test_time * 1000.0, hidden_count / iterations);
+    }
+}
@@ -0,0 +1,84 @@
+//
+//  KROcclusionCuller.h
+//  KREngine
+//
+//  Copyright 2012 Kearwood Gilbert. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are
+//  permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this list of
+//  conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list
+//  of conditions and the following disclaimer in the documentation and/or other materials
+//  provided with the distribution.
+//
+//  THIS SOFTWARE IS PROVIDED BY KEARWOOD GILBERT ''AS IS'' AND ANY EXPRESS OR IMPLIED
+//  WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+//  FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL KEARWOOD GILBERT OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+//  ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+//  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+//  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//  The views and conclusions contained in the software and documentation are those of the
+//  authors and should not be interpreted as representing official policies, either expressed
+//  or implied, of Kearwood Gilbert.
+//
+
+#ifndef KROCCLUSIONCULLER_H
+#define KROCCLUSIONCULLER_H
+
+#include "KREngine-common.h"
+
+#define KRENGINE_OCCLUSION_BUFFER_WIDTH 256 // Must be a multiple of KRENGINE_OCCLUSION_TILE_SIZE
+#define KRENGINE_OCCLUSION_BUFFER_HEIGHT 128 // Must be a multiple of KRENGINE_OCCLUSION_TILE_SIZE
+#define KRENGINE_OCCLUSION_TILE_SIZE 8 // Pixels on each side of a tile in the coarse level of the depth hierarchy; a multiple of 4
+#define KRENGINE_OCCLUSION_NEAR_W 0.0001f // Clip space w below which a vertex is considered to be behind the camera
+
+// Software occlusion culling, independent of the GPU.
+// Occluder triangles are rasterized into a low resolution depth buffer, which is reduced to a coarse level of tiles.  Bounding boxes are then tested against it before anything is drawn.
+// Pixels whose centers are covered by an occluder are written with the farthest depth within the pixel.  Boxes are tested against every pixel they touch, so only detail finer than a pixel at the silhouette of an occluder can be hidden.
+class KROcclusionCuller {
+public:
+    KROcclusionCuller(int width = KRENGINE_OCCLUSION_BUFFER_WIDTH, int height = KRENGINE_OCCLUSION_BUFFER_HEIGHT);
+    ~KROcclusionCuller();
+    
+    // Clear the depth buffer, ready to rasterize occluders as seen through view_projection
+    void begin(const Matrix4 &view_projection);
+    
+    // Rasterize triangle_count triangles, each given by three model space corners.  Triangles that cross the near plane are skipped.
+    void rasterize(const Vector3 *corners, int triangle_count, const Matrix4 &model_matrix);
+    
+    // Build the coarse level of the depth hierarchy.  Call after the last occluder is rasterized, before isVisible
+    void end();
+    
+    // Returns false only if bounds are entirely hidden behind the occluders
+    bool isVisible(const AABB &bounds) const;
+    
+    const Matrix4 &getViewProjectionMatrix() const;
+    int getWidth() const;
+    int getHeight() const;
+    float getDepth(int x, int y) const; // Normalized device depth, or std::numeric_limits<float>::max() where no occluder covers the pixel
+    int getTriangleCount() const; // Triangles rasterized since begin
+    
+    // Time rasterizing and testing randomly generated scenes, and log the results
+    static void benchmarkCulling();
+    
+private:
+    int m_width;
+    int m_height;
+    int m_tilesX;
+    int m_tilesY;
+    std::vector<float> m_depth; // Row major
+    std::vector<float> m_tileDepth; // Farthest depth of the pixels within each tile
+    Matrix4 m_viewProjection;
+    int m_triangleCount;
+    
+    void rasterizeTriangle(const Vector4 *clip);
+};
+
+#endif /* defined(KROCCLUSIONCULLER_H) */
@@ -0,0 +1,146 @@
+//
+//  KROcclusionQueryPool.cpp
+//  KREngine
+//
+//  Copyright 2012 Kearwood Gilbert. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are
+//  permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this list of
+//  conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list
+//  of conditions and the following disclaimer in the documentation and/or other materials
+//  provided with the distribution.
+//
+//  THIS SOFTWARE IS PROVIDED BY KEARWOOD GILBERT ''AS IS'' AND ANY EXPRESS OR IMPLIED
+//  WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+//  FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL KEARWOOD GILBERT OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+//  ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+//  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+//  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//  The views and conclusions contained in the software and documentation are those of the
+//  authors and should not be interpreted as representing official policies, either expressed
+//  or implied, of Kearwood Gilbert.
+//
+
+#include "KROcclusionQueryPool.h"
+
+KROcclusionQueryPool::KROcclusionQueryPool()
+{
+    
+}
+
+KROcclusionQueryPool::~KROcclusionQueryPool()
+{
+    for(std::vector<pending_query>::iterator itr=m_pendingQueries.begin(); itr != m_pendingQueries.end(); itr++) {
+        m_freeQueries.push_back((*itr).query);
+    }
+    if(!m_freeQueries.empty()) {
+        GLDEBUG(glDeleteQueriesEXT((GLsizei)m_freeQueries.size(), &m_freeQueries[0]));
+    }
+}
+
+bool KROcclusionQueryPool::beginQuery(unordered_map<AABB, int> &visibleBounds, const AABB &bounds, long frame)
+{
+    if(m_pendingQueries.size() >= KRENGINE_MAX_PENDING_OCCLUSION_QUERIES) {
+        return false;
+    }
+    
+    pending_query pending;
+    if(m_freeQueries.empty()) {
+        GLDEBUG(glGenQueriesEXT(1, &pending.query));
+    } else {
+        pending.query = m_freeQueries.back();
+        m_freeQueries.pop_back();
+    }
+    pending.bounds = bounds;
+    pending.visible_bounds = &visibleBounds;
+    pending.frame = frame;
+    m_pendingQueries.push_back(pending);
+    m_pendingKeys.insert(pending_key(&visibleBounds, bounds));
+    
+#if TARGET_OS_IPHONE
+    GLDEBUG(glBeginQueryEXT(GL_ANY_SAMPLES_PASSED_EXT, pending.query));
+#else
+    GLDEBUG(glBeginQuery(GL_SAMPLES_PASSED, pending.query));
+#endif
+    return true;
+}
+
+void KROcclusionQueryPool::endQuery()
+{
+#if TARGET_OS_IPHONE
+    GLDEBUG(glEndQueryEXT(GL_ANY_SAMPLES_PASSED_EXT));
+#else
+    GLDEBUG(glEndQuery(GL_SAMPLES_PASSED));
+#endif
+}
+
+bool KROcclusionQueryPool::isPending(unordered_map<AABB, int> &visibleBounds, const AABB &bounds)
+{
+    return m_pendingKeys.find(pending_key(&visibleBounds, bounds)) != m_pendingKeys.end();
+}
+
+void KROcclusionQueryPool::poll(unordered_map<AABB, int> &visibleBounds, long frame)
+{
+    // Queries complete in roughly the order they were issued; collected and timed out queries are compacted out of the list as it is walked
+    int remaining_count = 0;
+    for(int i=0; i < (int)m_pendingQueries.size(); i++) {
+        pending_query &pending = m_pendingQueries[i];
+        bool collected = false;
+        if(pending.visible_bounds == &visibleBounds) {
+            GLuint available = 0;
+            GLDEBUG(glGetQueryObjectuivEXT(pending.query, GL_QUERY_RESULT_AVAILABLE_EXT, &available));
+            if(available) {
+                GLuint samples = 0;
+                GLDEBUG(glGetQueryObjectuivEXT(pending.query, GL_QUERY_RESULT_EXT, &samples));
+                visibleBounds[pending.bounds] = samples ? VisibleResult(frame) : OccludedResult(frame);
+                collected = true;
+            }
+        }
+        if(collected || pending.frame + KRENGINE_OCCLUSION_QUERY_TIMEOUT < frame) {
+            releaseQuery(pending);
+        } else {
+            m_pendingQueries[remaining_count++] = pending;
+        }
+    }
+    m_pendingQueries.resize(remaining_count);
+}
+
+void KROcclusionQueryPool::releaseQuery(const pending_query &pending)
+{
+    m_pendingKeys.erase(pending_key(pending.visible_bounds, pending.bounds));
+    m_freeQueries.push_back(pending.query);
+}
+
+int KROcclusionQueryPool::getPendingCount() const
+{
+    return (int)m_pendingQueries.size();
+}
+
+int KROcclusionQueryPool::VisibleResult(long frame)
+{
+    return (int)frame;
+}
+
+int KROcclusionQueryPool::OccludedResult(long frame)
+{
+    // Occluded results are negative, so that they also record the frame in which they were collected
+    return -1 - (int)frame;
+}
+
+bool KROcclusionQueryPool::IsOccluded(int result)
+{
+    return result < 0;
+}
+
+long KROcclusionQueryPool::GetResultFrame(int result)
+{
+    return result < 0 ? -1 - result : result;
+}
@@ -0,0 +1,89 @@
+//
+//  KROcclusionQueryPool.h
+//  KREngine
+//
+//  Copyright 2012 Kearwood Gilbert. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are
+//  permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this list of
+//  conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list
+//  of conditions and the following disclaimer in the documentation and/or other materials
+//  provided with the distribution.
+//
+//  THIS SOFTWARE IS PROVIDED BY KEARWOOD GILBERT ''AS IS'' AND ANY EXPRESS OR IMPLIED
+//  WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+//  FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL KEARWOOD GILBERT OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+//  ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+//  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+//  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//  The views and conclusions contained in the software and documentation are those of the
+//  authors and should not be interpreted as representing official policies, either expressed
+//  or implied, of Kearwood Gilbert.
+//
+
+#ifndef KROCCLUSIONQUERYPOOL_H
+#define KROCCLUSIONQUERYPOOL_H
+
+#include "KREngine-common.h"
+#include <unordered_set>
+
+#define KRENGINE_MAX_PENDING_OCCLUSION_QUERIES 1024 // Occlusion tests are skipped while this many are waiting on the GPU
+#define KRENGINE_OCCLUSION_QUERY_TIMEOUT 8 // Frames after which a query that has not been polled is dropped, e.g. when its viewport is no longer rendered
+
+// Issues occlusion queries for octree bounds and collects their results in later passes or frames, without waiting on the GPU.
+// Query objects are recycled rather than deleted.
+//
+// Results are stored in a viewport's visible bounds, keyed by AABB, as the frame of the result; see VisibleResult() and OccludedResult()
+class KROcclusionQueryPool {
+public:
+    KROcclusionQueryPool();
+    ~KROcclusionQueryPool();
+    
+    // Returns false, without starting a query, if too many are already pending
+    bool beginQuery(unordered_map<AABB, int> &visibleBounds, const AABB &bounds, long frame);
+    void endQuery();
+    
+    bool isPending(unordered_map<AABB, int> &visibleBounds, const AABB &bounds);
+    
+    // Store the results that the GPU has made available for visibleBounds, and drop queries that have timed out
+    void poll(unordered_map<AABB, int> &visibleBounds, long frame);
+    
+    int getPendingCount() const;
+    
+    static int VisibleResult(long frame);
+    static int OccludedResult(long frame);
+    static bool IsOccluded(int result);
+    static long GetResultFrame(int result);
+    
+private:
+    typedef struct {
+        GLuint query;
+        AABB bounds;
+        unordered_map<AABB, int> *visible_bounds; // Only compared, never dereferenced, once the query has timed out
+        long frame;
+    } pending_query;
+    
+    typedef std::pair<const unordered_map<AABB, int> *, AABB> pending_key;
+    struct pending_key_hash {
+        size_t operator()(const pending_key &key) const
+        {
+            return std::hash<AABB>()(key.second) ^ std::hash<const void *>()(key.first);
+        }
+    };
+    
+    std::vector<pending_query> m_pendingQueries; // In the order issued
+    std::unordered_set<pending_key, pending_key_hash> m_pendingKeys;
+    std::vector<GLuint> m_freeQueries;
+    
+    void releaseQuery(const pending_query &pending);
+};
+
+#endif /* defined(KROCCLUSIONQUERYPOOL_H) */
@@ -10,17 +10,259 @@
 #include "KROctree.h"
 #include "KRNode.h"
 #include "KRCollider.h"
+#include "KRWorkerPool.h"
+
+#if defined(KRAKEN_USE_ARM_NEON) && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+#define KROCTREE_NEON
+#include <arm_neon.h>
+#endif
+
+namespace {
+    
+    // Flattened copy of the octree and its colliders, made for each batch of rays so it can be traversed from several threads at once
+    typedef struct {
+        float min[3];
+        float max[3];
+        int children[8];
+        int child_count;
+        int first_collider;
+        int collider_count;
+    } cast_node;
+    
+    typedef struct {
+        KRCollider *collider;
+        const KRMesh *model;
+        const KRMeshBVH *bvh; // Set by beginCasts, once the model is locked
+        Matrix4 model_matrix;
+        Matrix4 inverse_model_matrix;
+        float min[3];
+        float max[3];
+        unsigned int layer_mask;
+    } cast_collider;
+    
+    typedef struct {
+        std::vector<cast_node> nodes;
+        std::vector<cast_collider> colliders;
+        int outer_collider_count; // The first outer_collider_count colliders are outside of the octree, and are tested against every ray
+        int root_node; // -1 if there are no colliders in the octree
+    } cast_scene;
+    
+    typedef struct {
+        float origin[3][KRENGINE_RAY_PACKET_SIZE];
+        float inv_dir[3][KRENGINE_RAY_PACKET_SIZE];
+        float max_t[KRENGINE_RAY_PACKET_SIZE]; // Rays end at the nearest hit found so far
+    } ray_packet;
+    
+    void AddCastCollider(KRNode *node, unsigned int layer_mask, cast_scene &scene)
+    {
+        KRCollider *collider = dynamic_cast<KRCollider *>(node);
+        if(collider == NULL || (collider->getLayerMask() & layer_mask) == 0) {
+            return;
+        }
+        KRMesh *model = collider->getModel();
+        if(model == NULL) {
+            return;
+        }
+        cast_collider c;
+        c.collider = collider;
+        c.model = model;
+        c.bvh = NULL;
+        c.model_matrix = collider->getModelMatrix();
+        c.inverse_model_matrix = collider->getInverseModelMatrix();
+        c.layer_mask = collider->getLayerMask();
+        AABB bounds = collider->getBounds();
+        for(int axis=0; axis < 3; axis++) {
+            c.min[axis] = bounds.min[axis];
+            c.max[axis] = bounds.max[axis];
+        }
+        scene.colliders.push_back(c);
+    }
+    
+    // Returns the index of the flattened node, or -1 if there are no colliders within octree_node or its children
+    int FlattenOctreeNode(KROctreeNode *octree_node, unsigned int layer_mask, cast_scene &scene)
+    {
+        cast_node n;
+        n.child_count = 0;
+        for(int i=0; i < 8; i++) {
+            KROctreeNode *child = octree_node->getChild(i);
+            if(child) {
+                int child_index = FlattenOctreeNode(child, layer_mask, scene);
+                if(child_index != -1) {
+                    n.children[n.child_count++] = child_index;
+                }
+            }
+        }
+        
+        n.first_collider = (int)scene.colliders.size();
+        KROctreeNode::scene_node_list &scene_nodes = octree_node->getSceneNodes();
+        for(KROctreeNode::scene_node_list::iterator itr=scene_nodes.begin(); itr != scene_nodes.end(); itr++) {
+            AddCastCollider(*itr, layer_mask, scene);
+        }
+        n.collider_count = (int)scene.colliders.size() - n.first_collider;
+        
+        if(n.child_count == 0 && n.collider_count == 0) {
+            return -1;
+        }
+        
+        AABB bounds = octree_node->getBounds();
+        for(int axis=0; axis < 3; axis++) {
+            n.min[axis] = bounds.min[axis];
+            n.max[axis] = bounds.max[axis];
+        }
+        scene.nodes.push_back(n);
+        return (int)scene.nodes.size() - 1;
+    }
+    
+    // Returns a bit for each ray in active_lanes that intersects the box before reaching its max_t
+    int IntersectPacket(const ray_packet &packet, const float *min, const float *max, int active_lanes)
+    {
+#if defined(KRAKEN_USE_SSE2)
+        __m128 t_near = _mm_setzero_ps();
+        __m128 t_far = _mm_loadu_ps(packet.max_t);
+        for(int axis=0; axis < 3; axis++) {
+            __m128 origin = _mm_loadu_ps(packet.origin[axis]);
+            __m128 inv_dir = _mm_loadu_ps(packet.inv_dir[axis]);
+            __m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(min[axis]), origin), inv_dir);
+            __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(max[axis]), origin), inv_dir);
+            t_near = _mm_max_ps(t_near, _mm_min_ps(t0, t1));
+            t_far = _mm_min_ps(t_far, _mm_max_ps(t0, t1));
+        }
+        return _mm_movemask_ps(_mm_cmple_ps(t_near, t_far)) & active_lanes;
+#elif defined(KROCTREE_NEON)
+        float32x4_t t_near = vdupq_n_f32(0.0f);
+        float32x4_t t_far = vld1q_f32(packet.max_t);
+        for(int axis=0; axis < 3; axis++) {
+            float32x4_t origin = vld1q_f32(packet.origin[axis]);
+            float32x4_t inv_dir = vld1q_f32(packet.inv_dir[axis]);
+            float32x4_t t0 = vmulq_f32(vsubq_f32(vdupq_n_f32(min[axis]), origin), inv_dir);
+            float32x4_t t1 = vmulq_f32(vsubq_f32(vdupq_n_f32(max[axis]), origin), inv_dir);
+            t_near = vmaxq_f32(t_near, vminq_f32(t0, t1));
+            t_far = vminq_f32(t_far, vmaxq_f32(t0, t1));
+        }
+        uint32x4_t hit = vcleq_f32(t_near, t_far);
+        int lanes = (vgetq_lane_u32(hit, 0) & 1) | (vgetq_lane_u32(hit, 1) & 2) | (vgetq_lane_u32(hit, 2) & 4) | (vgetq_lane_u32(hit, 3) & 8);
+        return lanes & active_lanes;
+#else
+        int lanes = 0;
+        for(int lane=0; lane < KRENGINE_RAY_PACKET_SIZE; lane++) {
+            float t_near = 0.0f;
+            float t_far = packet.max_t[lane];
+            for(int axis=0; axis < 3; axis++) {
+                float t0 = (min[axis] - packet.origin[axis][lane]) * packet.inv_dir[axis][lane];
+                float t1 = (max[axis] - packet.origin[axis][lane]) * packet.inv_dir[axis][lane];
+                t_near = KRMAX(t_near, KRMIN(t0, t1));
+                t_far = KRMIN(t_far, KRMAX(t0, t1));
+            }
+            if(t_near <= t_far) {
+                lanes |= 1 << lane;
+            }
+        }
+        return lanes & active_lanes;
+#endif
+    }
+    
+    void CastCollider(const cast_collider &c, int lanes, const KROctree::ray_query *queries, HitInfo *hitinfo, ray_packet &packet, const float *dir_length)
+    {
+        lanes = IntersectPacket(packet, c.min, c.max, lanes);
+        for(int lane=0; lanes; lane++, lanes >>= 1) {
+            if((lanes & 1) && (queries[lane].layer_mask & c.layer_mask)) {
+                if(c.collider->rayCast(queries[lane].v0, queries[lane].dir, hitinfo[lane], c.model, c.bvh, c.model_matrix, c.inverse_model_matrix)) {
+                    // Allow for rounding, so colliders touching at the hit point are still tested
+                    packet.max_t[lane] = hitinfo[lane].getDistance() / dir_length[lane] * 1.0001f + 0.0001f;
+                }
+            }
+        }
+    }
+    
+    void CastPacket(const cast_scene &scene, const KROctree::ray_query *queries, HitInfo *hitinfo, int ray_count, std::vector<std::pair<int, int> > &stack)
+    {
+        ray_packet packet;
+        float dir_length[KRENGINE_RAY_PACKET_SIZE];
+        for(int lane=0; lane < KRENGINE_RAY_PACKET_SIZE; lane++) {
+            if(lane < ray_count) {
+                const KROctree::ray_query &q = queries[lane];
+                for(int axis=0; axis < 3; axis++) {
+                    packet.origin[axis][lane] = q.v0[axis];
+                    // Keep the reciprocal finite, so the slab test never multiplies zero by infinity
+                    float d = q.dir[axis];
+                    packet.inv_dir[axis][lane] = fabsf(d) < 1.0e-20f ? (d < 0.0f ? -1.0e20f : 1.0e20f) : 1.0f / d;
+                }
+                packet.max_t[lane] = std::numeric_limits<float>::max();
+                dir_length[lane] = q.dir.magnitude();
+                hitinfo[lane] = HitInfo();
+            } else {
+                for(int axis=0; axis < 3; axis++) {
+                    packet.origin[axis][lane] = 0.0f;
+                    packet.inv_dir[axis][lane] = 1.0f;
+                }
+                packet.max_t[lane] = -1.0f; // Unused lanes never intersect anything
+                dir_length[lane] = 1.0f;
+            }
+        }
+        int all_lanes = (1 << ray_count) - 1;
+        
+        for(int i=0; i < scene.outer_collider_count; i++) {
+            CastCollider(scene.colliders[i], all_lanes, queries, hitinfo, packet, dir_length);
+        }
+        
+        if(scene.root_node == -1) {
+            return;
+        }
+        stack.clear();
+        stack.push_back(std::pair<int, int>(scene.root_node, all_lanes));
+        while(!stack.empty()) {
+            std::pair<int, int> entry = stack.back();
+            stack.pop_back();
+            const cast_node &n = scene.nodes[entry.first];
+            int lanes = IntersectPacket(packet, n.min, n.max, entry.second);
+            if(lanes == 0) {
+                continue;
+            }
+            for(int i=n.first_collider; i < n.first_collider + n.collider_count; i++) {
+                CastCollider(scene.colliders[i], lanes, queries, hitinfo, packet, dir_length);
+            }
+            for(int i=0; i < n.child_count; i++) {
+                stack.push_back(std::pair<int, int>(n.children[i], lanes));
+            }
+        }
+    }
+}
 
 KROctree::KROctree()
 {
     m_pRootNode = NULL;
+    m_relocationCount = 0;
+    m_stayCount = 0;
 }
 
 KROctree::~KROctree()
 {
-    if(m_pRootNode) {
-        delete m_pRootNode;
+
+}
+
+KROctreeNode *KROctree::allocateNode(int parent, const AABB &bounds)
+{
+    KROctreeNode *node;
+    if(m_freeNodes.empty()) {
+        m_nodePool.emplace_back(this, (int)m_nodePool.size());
+        node = &m_nodePool.back();
+    } else {
+        node = &m_nodePool[m_freeNodes.back()];
+        m_freeNodes.pop_back();
     }
+    node->init(parent, bounds);
+    return node;
+}
+
+void KROctree::releaseNode(KROctreeNode *node)
+{
+    node->release();
+    m_freeNodes.push_back(node->getIndex());
+}
+
+KROctreeNode *KROctree::getNode(int index)
+{
+    return &m_nodePool[index];
 }
 
 void KROctree::add(KRNode *pNode)
@@ -34,18 +276,22 @@ void KROctree::add(KRNode *pNode)
     } else { 
         if(m_pRootNode == NULL) {
             // First item inserted, create a node large enough to fit it
-            m_pRootNode = new KROctreeNode(NULL, nodeBounds);
+            m_pRootNode = allocateNode(-1, nodeBounds);
             m_pRootNode->add(pNode);
         } else {
             // Keep encapsulating the root node until the new root contains the inserted node
             bool bInsideRoot = false;
             while(!bInsideRoot) {
-                AABB rootBounds = m_pRootNode->getBounds();
+                AABB rootBounds = m_pRootNode->getCellBounds();
                 Vector3 rootSize = rootBounds.size();
                 if(nodeBounds.min.x < rootBounds.min.x || nodeBounds.min.y < rootBounds.min.y || nodeBounds.min.z < rootBounds.min.z) {
-                    m_pRootNode = new KROctreeNode(NULL, AABB::Create(rootBounds.min - rootSize, rootBounds.max), 7, m_pRootNode);
+                    KROctreeNode *newRoot = allocateNode(-1, AABB::Create(rootBounds.min - rootSize, rootBounds.max));
+                    newRoot->setChildNode(7, m_pRootNode);
+                    m_pRootNode = newRoot;
                 } else if(nodeBounds.max.x > rootBounds.max.x || nodeBounds.max.y > rootBounds.max.y || nodeBounds.max.z > rootBounds.max.z) {
-                    m_pRootNode = new KROctreeNode(NULL, AABB::Create(rootBounds.min, rootBounds.max + rootSize), 0, m_pRootNode);
+                    KROctreeNode *newRoot = allocateNode(-1, AABB::Create(rootBounds.min, rootBounds.max + rootSize));
+                    newRoot->setChildNode(0, m_pRootNode);
+                    m_pRootNode = newRoot;
                 } else {
                     bInsideRoot = true;
                 }
@@ -68,10 +314,50 @@ void KROctree::remove(KRNode *pNode)
 
 void KROctree::update(KRNode *pNode)
 {
-    // TODO: This may be more efficient as an incremental operation rather than removing and re-adding the node
+    KROctreeNode *octree_node = pNode->getOctreeNode();
+    AABB nodeBounds = pNode->getBounds();
+    if(octree_node && nodeBounds != AABB::Zero() && nodeBounds != AABB::Infinite()) {
+        if(octree_node->getBounds().contains(nodeBounds)) {
+            // Still within the loose bounds of its octree node, nothing to do
+            m_stayCount++;
+            return;
+        }
+        
+        // Move the node only as far up as the lowest ancestor that still contains it, then back down into the tree
+        KROctreeNode *ancestor = octree_node->getParent();
+        while(ancestor && !ancestor->getBounds().contains(nodeBounds)) {
+            ancestor = ancestor->getParent();
+        }
+        if(ancestor) {
+            octree_node->remove(pNode);
+            ancestor->add(pNode);
+            octree_node->trimAncestors(); // Trimmed after adding, so that the ancestor can not be freed
+            m_relocationCount++;
+            return;
+        }
+    }
+    
+    // The node has left the root, or is entering or leaving the outer scene nodes
     remove(pNode);
     add(pNode);
     shrink();
+    m_relocationCount++;
+}
+
+void KROctree::resetUpdateCounters()
+{
+    m_relocationCount = 0;
+    m_stayCount = 0;
+}
+
+int KROctree::getRelocationCount() const
+{
+    return m_relocationCount;
+}
+
+int KROctree::getStayCount() const
+{
+    return m_stayCount;
 }
 
 void KROctree::shrink()
@@ -79,7 +365,7 @@ void KROctree::shrink()
     if(m_pRootNode) {
         while(m_pRootNode->canShrinkRoot()) {
             KROctreeNode *newRoot = m_pRootNode->stripChild();
-            delete m_pRootNode;
+            releaseNode(m_pRootNode);
             m_pRootNode = newRoot;
             if(m_pRootNode == NULL) return;
         }
@@ -154,3 +440,54 @@ bool KROctree::sphereCast(const Vector3 &v0, const Vector3 &v1, float radius, Hi
     return hit_found;
 }
 
+int KROctree::rayCast(const ray_query *queries, HitInfo *hitinfo, int query_count)
+{
+    if(query_count <= 0) {
+        return 0;
+    }
+    
+    unsigned int layer_mask = 0;
+    for(int i=0; i < query_count; i++) {
+        layer_mask |= queries[i].layer_mask;
+    }
+    
+    // Capture the colliders, their transforms, and the octree once for the whole batch, as they can't be safely accessed from the worker threads
+    cast_scene scene;
+    for(std::set<KRNode *>::iterator itr=m_outerSceneNodes.begin(); itr != m_outerSceneNodes.end(); itr++) {
+        AddCastCollider(*itr, layer_mask, scene);
+    }
+    scene.outer_collider_count = (int)scene.colliders.size();
+    scene.root_node = m_pRootNode ? FlattenOctreeNode(m_pRootNode, layer_mask, scene) : -1;
+    
+    std::map<const KRMesh *, const KRMeshBVH *> models;
+    for(std::vector<cast_collider>::iterator itr=scene.colliders.begin(); itr != scene.colliders.end(); itr++) {
+        std::map<const KRMesh *, const KRMeshBVH *>::iterator model_itr = models.find((*itr).model);
+        if(model_itr == models.end()) {
+            model_itr = models.insert(std::make_pair((*itr).model, (*itr).model->beginCasts())).first;
+        }
+        (*itr).bvh = model_itr->second;
+    }
+    
+    int packet_count = (query_count + KRENGINE_RAY_PACKET_SIZE - 1) / KRENGINE_RAY_PACKET_SIZE;
+    int task_count = (packet_count + KRENGINE_RAY_PACKETS_PER_TASK - 1) / KRENGINE_RAY_PACKETS_PER_TASK;
+    KRWorkerPool::get().parallelFor(task_count, [&](size_t task) {
+        std::vector<std::pair<int, int> > stack;
+        int first_packet = (int)task * KRENGINE_RAY_PACKETS_PER_TASK;
+        for(int packet=first_packet; packet < first_packet + KRENGINE_RAY_PACKETS_PER_TASK && packet < packet_count; packet++) {
+            int first_ray = packet * KRENGINE_RAY_PACKET_SIZE;
+            CastPacket(scene, queries + first_ray, hitinfo + first_ray, KRMIN(KRENGINE_RAY_PACKET_SIZE, query_count - first_ray), stack);
+        }
+    });
+    
+    for(std::map<const KRMesh *, const KRMeshBVH *>::iterator itr=models.begin(); itr != models.end(); itr++) {
+        itr->first->endCasts();
+    }
+    
+    int hit_count = 0;
+    for(int i=0; i < query_count; i++) {
+        if(hitinfo[i].didHit()) {
+            hit_count++;
+        }
+    }
+    return hit_count;
+}
@@ -14,8 +14,17 @@
 
 class KRNode;
 
+#define KRENGINE_RAY_PACKET_SIZE 4 // Rays traversed together through the octree, tested against each box with one SIMD slab test
+#define KRENGINE_RAY_PACKETS_PER_TASK 4 // Packets handled by each KRWorkerPool task
+
 class KROctree {
 public:
+    typedef struct {
+        Vector3 v0;
+        Vector3 dir;
+        unsigned int layer_mask;
+    } ray_query;
+    
     KROctree();
     ~KROctree();
 
@@ -24,15 +33,31 @@ public:
     void update(KRNode *pNode);
 
     KROctreeNode *getRootNode();
+    KROctreeNode *getNode(int index);
+    KROctreeNode *allocateNode(int parent, const AABB &bounds);
+    void releaseNode(KROctreeNode *node);
     std::set<KRNode *> &getOuterSceneNodes();
 
     bool lineCast(const Vector3 &v0, const Vector3 &v1, HitInfo &hitinfo, unsigned int layer_mask);
     bool rayCast(const Vector3 &v0, const Vector3 &dir, HitInfo &hitinfo, unsigned int layer_mask);
     bool sphereCast(const Vector3 &v0, const Vector3 &v1, float radius, HitInfo &hitinfo, unsigned int layer_mask);
+    
+    // Cast query_count rays, storing the nearest hit of each in hitinfo.  Returns the number of rays that hit.
+    int rayCast(const ray_query *queries, HitInfo *hitinfo, int query_count);
+    
+    // Counts of updated nodes that moved to another octree node, or stayed within the loose bounds of their current one, since resetUpdateCounters()
+    void resetUpdateCounters();
+    int getRelocationCount() const;
+    int getStayCount() const;
 
 private:
+    std::deque<KROctreeNode> m_nodePool; // A deque never moves its elements as it grows, so KROctreeNode pointers stay valid
+    std::vector<int> m_freeNodes; // Indexes of released nodes within m_nodePool, reused before the pool grows
     KROctreeNode *m_pRootNode;
     std::set<KRNode *> m_outerSceneNodes;
+    
+    int m_relocationCount;
+    int m_stayCount;
 
     void shrink();
 };
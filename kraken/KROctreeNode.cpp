@@ -7,76 +7,58 @@
 //
 
 #include "KROctreeNode.h"
+#include "KROctree.h"
 #include "KRNode.h"
 #include "KRCollider.h"
 
-KROctreeNode::KROctreeNode(KROctreeNode *parent, const AABB &bounds) : m_bounds(bounds)
-{
-    m_parent = parent;
-    
-    for(int i=0; i<8; i++) m_children[i] = NULL;
-    
-    m_occlusionQuery = 0;
-    m_occlusionTested = false;
-    m_activeQuery = false;
+namespace {
+    AABB LooseBounds(const AABB &bounds)
+    {
+        Vector3 margin = bounds.size() * KRENGINE_OCTREE_LOOSENESS;
+        return AABB::Create(bounds.min - margin, bounds.max + margin);
+    }
 }
 
-KROctreeNode::KROctreeNode(KROctreeNode *parent, const AABB &bounds, int iChild, KROctreeNode *pChild) : m_bounds(bounds)
+KROctreeNode::KROctreeNode(KROctree *octree, int index)
 {
-    // This constructor is used when expanding the octree and replacing the root node with a new root that encapsulates it
-    m_parent = parent;
-    
-    for(int i=0; i<8; i++) m_children[i] = NULL;
-    m_children[iChild] = pChild;
-    pChild->m_parent = this;
+    m_octree = octree;
+    m_index = index;
+    m_parent = -1;
     
-    m_occlusionQuery = 0;
-    m_occlusionTested = false;
-    m_activeQuery = false;
+    for(int i=0; i<8; i++) m_children[i] = -1;
 }
 
 KROctreeNode::~KROctreeNode()
 {
-    for(int i=0; i<8; i++) {
-        if(m_children[i] != NULL) {
-            delete m_children[i];
-        }
-    }
-
-    if(m_occlusionTested) {
-        GLDEBUG(glDeleteQueriesEXT(1, &m_occlusionQuery));
-    }
+    // Children are owned by the KROctree's pool, not by their parent
 }
 
-
-void KROctreeNode::beginOcclusionQuery()
+void KROctreeNode::init(int parent, const AABB &bounds)
 {
-    if(!m_occlusionTested){
-        GLDEBUG(glGenQueriesEXT(1, &m_occlusionQuery));
-#if TARGET_OS_IPHONE
-        GLDEBUG(glBeginQueryEXT(GL_ANY_SAMPLES_PASSED_EXT, m_occlusionQuery));
-#else
-        GLDEBUG(glBeginQuery(GL_SAMPLES_PASSED, m_occlusionQuery));
-#endif
-        m_occlusionTested = true;
-        m_activeQuery = true;
-    }
+    m_parent = parent;
+    m_bounds = bounds;
+    m_looseBounds = LooseBounds(bounds);
 }
 
-void KROctreeNode::endOcclusionQuery()
+void KROctreeNode::release()
 {
-    if(m_activeQuery) {
-        // Only end a query if we started one
-#if TARGET_OS_IPHONE
-        GLDEBUG(glEndQueryEXT(GL_ANY_SAMPLES_PASSED_EXT));
-#else
-        GLDEBUG(glEndQuery(GL_SAMPLES_PASSED));
-#endif
-    }
+    // Prepare this node to be returned to the pool.  The scene node list keeps its storage for the node's next use
+    m_parent = -1;
+    for(int i=0; i<8; i++) m_children[i] = -1;
+    m_sceneNodes.clear();
 }
 
+int KROctreeNode::getIndex() const
+{
+    return m_index;
+}
 
 AABB KROctreeNode::getBounds()
+{
+    return m_looseBounds;
+}
+
+AABB KROctreeNode::getCellBounds()
 {
     return m_bounds;
 }
@@ -85,13 +67,14 @@ void KROctreeNode::add(KRNode *pNode)
 {
     int iChild = getChildIndex(pNode);
     if(iChild == -1) {
-        m_sceneNodes.insert(pNode);
-        pNode->addToOctreeNode(this);
+        pNode->setOctreeNode(this, m_sceneNodes.size());
+        m_sceneNodes.push_back(pNode);
     } else {
-        if(m_children[iChild] == NULL) {
-            m_children[iChild] = new KROctreeNode(this, getChildBounds(iChild));
+        if(m_children[iChild] == -1) {
+            // Pool nodes never move, so this node remains valid while the pool grows
+            m_children[iChild] = m_octree->allocateNode(m_index, getChildBounds(iChild))->getIndex();
         }
-        m_children[iChild]->add(pNode);
+        getChild(iChild)->add(pNode);
     }
 }
 
@@ -112,11 +95,14 @@ AABB KROctreeNode::getChildBounds(int iChild)
 }
 
 int KROctreeNode::getChildIndex(KRNode *pNode)
-{    
-    for(int iChild=0; iChild < 8; iChild++) {
-        if(getChildBounds(iChild).contains(pNode->getBounds())) {
-            return iChild;
-        }
+{
+    // The node can only belong to the child whose cell holds its center; it descends if it also fits within that child's loose bounds
+    AABB nodeBounds = pNode->getBounds();
+    Vector3 nodeCenter = nodeBounds.center();
+    Vector3 center = m_bounds.center();
+    int iChild = (nodeCenter.x < center.x ? 0 : 1) | (nodeCenter.y < center.y ? 0 : 2) | (nodeCenter.z < center.z ? 0 : 4);
+    if(LooseBounds(getChildBounds(iChild)).contains(nodeBounds)) {
+        return iChild;
     }
     return -1;
 }
@@ -124,29 +110,49 @@ int KROctreeNode::getChildIndex(KRNode *pNode)
 void KROctreeNode::trim()
 {
     for(int iChild = 0; iChild < 8; iChild++) {
-        if(m_children[iChild]) {
-            if(m_children[iChild]->isEmpty()) {
-                delete m_children[iChild];
-                m_children[iChild] = NULL;
+        KROctreeNode *child = getChild(iChild);
+        if(child) {
+            if(child->isEmpty()) {
+                m_octree->releaseNode(child);
+                m_children[iChild] = -1;
             }
         }
     }
 }
 
-void KROctreeNode::remove(KRNode *pNode)
+void KROctreeNode::trimAncestors()
 {
-    m_sceneNodes.erase(pNode);
+    // Free this node and any of its ancestors that are left empty.  The root is not freed here; see KROctree::shrink()
+    KROctreeNode *octree_node = this;
+    while(octree_node) {
+        octree_node->trim();
+        if(octree_node->isEmpty()) {
+            octree_node = octree_node->getParent();
+        } else {
+            octree_node = NULL;
+        }
+    }
 }
 
-void KROctreeNode::update(KRNode *pNode)
+void KROctreeNode::remove(KRNode *pNode)
 {
-    
+    if(pNode->getOctreeNode() != this) {
+        return;
+    }
+    // Fill the hole with the last scene node, updating its back-index
+    int slot = pNode->getOctreeSlot();
+    KRNode *last = m_sceneNodes.back();
+    m_sceneNodes.swapRemove(slot);
+    if(last != pNode) {
+        last->setOctreeNode(this, slot);
+    }
+    pNode->setOctreeNode(NULL, -1);
 }
 
 bool KROctreeNode::isEmpty() const
 {
     for(int i=0; i<8; i++) {
-        if(m_children[i]) {
+        if(m_children[i] != -1) {
             return false;
         }
     }
@@ -157,7 +163,7 @@ bool KROctreeNode::canShrinkRoot() const
 {
     int cChildren = 0;
     for(int i=0; i<8; i++) {
-        if(m_children[i]) {
+        if(m_children[i] != -1) {
             cChildren++;
         }
     }
@@ -169,10 +175,10 @@ KROctreeNode *KROctreeNode::stripChild()
     // Return the first found child and update its reference to NULL so that the destructor will not free it.  This is used for shrinking the octree
     // NOTE: The caller of this function will be responsible for freeing the child object.  It is also possible to return a NULL
     for(int i=0; i<8; i++) {
-        if(m_children[i]) {
-            KROctreeNode *child = m_children[i];
-            child->m_parent = NULL;
-            m_children[i] = NULL;
+        KROctreeNode *child = getChild(i);
+        if(child) {
+            child->m_parent = -1;
+            m_children[i] = -1;
             return child;
         }
     }
@@ -182,15 +188,21 @@ KROctreeNode *KROctreeNode::stripChild()
 
 KROctreeNode *KROctreeNode::getParent()
 {
-    return m_parent;
+    return m_parent == -1 ? NULL : m_octree->getNode(m_parent);
+}
+
+KROctreeNode *KROctreeNode::getChild(int iChild)
+{
+    return m_children[iChild] == -1 ? NULL : m_octree->getNode(m_children[iChild]);
 }
 
-KROctreeNode **KROctreeNode::getChildren()
+void KROctreeNode::setChildNode(int iChild, KROctreeNode *pChild)
 {
-    return m_children;
+    m_children[iChild] = pChild->m_index;
+    pChild->m_parent = m_index;
 }
 
-std::set<KRNode *> &KROctreeNode::getSceneNodes()
+KROctreeNode::scene_node_list &KROctreeNode::getSceneNodes()
 {
     return m_sceneNodes;
 }
@@ -204,7 +216,7 @@ bool KROctreeNode::lineCast(const Vector3 &v0, const Vector3 &v1, HitInfo &hitin
         hit_found = lineCast(v0, hitinfo.getPosition(), hitinfo, layer_mask);
     } else {
         if(getBounds().intersectsLine(v0, v1)) {
-            for(std::set<KRNode *>::iterator nodes_itr=m_sceneNodes.begin(); nodes_itr != m_sceneNodes.end(); nodes_itr++) {
+            for(scene_node_list::iterator nodes_itr=m_sceneNodes.begin(); nodes_itr != m_sceneNodes.end(); nodes_itr++) {
                 KRCollider *collider = dynamic_cast<KRCollider *>(*nodes_itr);
                 if(collider) {
                     if(collider->lineCast(v0, v1, hitinfo, layer_mask)) hit_found = true;
@@ -212,8 +224,9 @@ bool KROctreeNode::lineCast(const Vector3 &v0, const Vector3 &v1, HitInfo &hitin
             }
             
             for(int i=0; i<8; i++) {
-                if(m_children[i]) {
-                    if(m_children[i]->lineCast(v0, v1, hitinfo, layer_mask)) {
+                KROctreeNode *child = getChild(i);
+                if(child) {
+                    if(child->lineCast(v0, v1, hitinfo, layer_mask)) {
                         hit_found = true;
                     }
                 }
@@ -232,7 +245,7 @@ bool KROctreeNode::rayCast(const Vector3 &v0, const Vector3 &dir, HitInfo &hitin
         hit_found = lineCast(v0, hitinfo.getPosition(), hitinfo, layer_mask); // Note: This is purposefully lineCast as opposed to RayCast
     } else {
         if(getBounds().intersectsRay(v0, dir)) {
-            for(std::set<KRNode *>::iterator nodes_itr=m_sceneNodes.begin(); nodes_itr != m_sceneNodes.end(); nodes_itr++) {
+            for(scene_node_list::iterator nodes_itr=m_sceneNodes.begin(); nodes_itr != m_sceneNodes.end(); nodes_itr++) {
                 KRCollider *collider = dynamic_cast<KRCollider *>(*nodes_itr);
                 if(collider) {
                     if(collider->rayCast(v0, dir, hitinfo, layer_mask)) hit_found = true;
@@ -240,8 +253,9 @@ bool KROctreeNode::rayCast(const Vector3 &v0, const Vector3 &dir, HitInfo &hitin
             }
             
             for(int i=0; i<8; i++) {
-                if(m_children[i]) {
-                    if(m_children[i]->rayCast(v0, dir, hitinfo, layer_mask)) {
+                KROctreeNode *child = getChild(i);
+                if(child) {
+                    if(child->rayCast(v0, dir, hitinfo, layer_mask)) {
                         hit_found = true;
                     }
                 }
@@ -268,7 +282,7 @@ bool KROctreeNode::sphereCast(const Vector3 &v0, const Vector3 &v1, float radius
         // FINDME, TODO - Investigate AABB - swept sphere intersections or OBB - AABB intersections: "if(getBounds().intersectsSweptSphere(v0, v1, radius)) {"
         if(getBounds().intersects(swept_bounds)) {
         
-            for(std::set<KRNode *>::iterator nodes_itr=m_sceneNodes.begin(); nodes_itr != m_sceneNodes.end(); nodes_itr++) {
+            for(scene_node_list::iterator nodes_itr=m_sceneNodes.begin(); nodes_itr != m_sceneNodes.end(); nodes_itr++) {
                 KRCollider *collider = dynamic_cast<KRCollider *>(*nodes_itr);
                 if(collider) {
                     if(collider->sphereCast(v0, v1, radius, hitinfo, layer_mask)) hit_found = true;
@@ -276,8 +290,9 @@ bool KROctreeNode::sphereCast(const Vector3 &v0, const Vector3 &v1, float radius
             }
             
             for(int i=0; i<8; i++) {
-                if(m_children[i]) {
-                    if(m_children[i]->sphereCast(v0, v1, radius, hitinfo, layer_mask)) {
+                KROctreeNode *child = getChild(i);
+                if(child) {
+                    if(child->sphereCast(v0, v1, radius, hitinfo, layer_mask)) {
                         hit_found = true;
                     }
                 }
@@ -11,54 +11,62 @@
 
 #include "KREngine-common.h"
 #include "hitinfo.h"
+#include "KRInlineVector.h"
 
 class KRNode;
+class KROctree;
 
+#define KRENGINE_OCTREE_INLINE_SCENE_NODES 4 // Scene nodes held by an octree node before its list spills to the heap
+#define KRENGINE_OCTREE_LOOSENESS 0.5f // Each face of a cell's loose bounds is pushed out by this fraction of the cell size, so nodes moving near a cell boundary can stay in place.  0 gives a classic tight octree
+
+// Octree nodes are pooled by their KROctree and refer to their parent and children by index into the pool
 class KROctreeNode {
 public:
-    KROctreeNode(KROctreeNode *parent, const AABB &bounds);
-    KROctreeNode(KROctreeNode *parent, const AABB &bounds, int iChild, KROctreeNode *pChild);
+    typedef KRInlineVector<KRNode *, KRENGINE_OCTREE_INLINE_SCENE_NODES> scene_node_list;
+    
+    KROctreeNode(KROctree *octree, int index);
     ~KROctreeNode();
+    
+    void init(int parent, const AABB &bounds);
+    void release();
 
-    KROctreeNode **getChildren();
-    std::set<KRNode *> &getSceneNodes();
+    int getIndex() const;
+    KROctreeNode *getChild(int iChild);
+    void setChildNode(int iChild, KROctreeNode *pChild);
+    scene_node_list &getSceneNodes();
 
     void add(KRNode *pNode);
     void remove(KRNode *pNode);
-    void update(KRNode *pNode);
 
-    AABB getBounds();
+    AABB getBounds(); // Loose bounds, containing every scene node within this cell and its children
+    AABB getCellBounds(); // Tight bounds, subdivided between the children
 
     KROctreeNode *getParent();
-    void setChildNode(int iChild, KROctreeNode *pChild);
     int getChildIndex(KRNode *pNode);
     AABB getChildBounds(int iChild);
     void trim();
+    void trimAncestors();
     bool isEmpty() const;
 
     bool canShrinkRoot() const;
     KROctreeNode *stripChild();
 
-    void beginOcclusionQuery();
-    void endOcclusionQuery();
-
-
-    GLuint m_occlusionQuery;
-    bool m_occlusionTested;
-    bool m_activeQuery;
-
     bool lineCast(const Vector3 &v0, const Vector3 &v1, HitInfo &hitinfo, unsigned int layer_mask);
     bool rayCast(const Vector3 &v0, const Vector3 &dir, HitInfo &hitinfo, unsigned int layer_mask);
     bool sphereCast(const Vector3 &v0, const Vector3 &v1, float radius, HitInfo &hitinfo, unsigned int layer_mask);
 
 private:
 
+    KROctree *m_octree;
+    int m_index;
+    
     AABB m_bounds;
+    AABB m_looseBounds;
 
-    KROctreeNode *m_parent;
-    KROctreeNode *m_children[8];
+    int m_parent; // -1 for the root
+    int m_children[8]; // -1 where there is no child
 
-    std::set<KRNode *>m_sceneNodes;
+    scene_node_list m_sceneNodes;
 };
 
 
@@ -0,0 +1,446 @@
+//
+//  KRPixelConvert.cpp
+//  KREngine
+//
+//  Copyright 2012 Kearwood Gilbert. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are
+//  permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this list of
+//  conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list
+//  of conditions and the following disclaimer in the documentation and/or other materials
+//  provided with the distribution.
+//
+//  THIS SOFTWARE IS PROVIDED BY KEARWOOD GILBERT ''AS IS'' AND ANY EXPRESS OR IMPLIED
+//  WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+//  FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL KEARWOOD GILBERT OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+//  ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+//  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+//  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//  The views and conclusions contained in the software and documentation are those of the
+//  authors and should not be interpreted as representing official policies, either expressed
+//  or implied, of Kearwood Gilbert.
+//
+
+#include "KRPixelConvert.h"
+#include "KRContext.h"
+#include "KRCPUFeatures.h"
+
+#if defined(KRAKEN_USE_ARM_NEON) && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+#define KRPIXELCONVERT_NEON
+#include <arm_neon.h>
+#endif
+
+namespace {
+    
+    typedef void (*convert_function)(const __uint8_t *source, __uint8_t *dest, size_t pixel_count);
+    
+    typedef struct {
+        KRPixelConvert::isa_t isa;
+        convert_function expand_rgb;
+        convert_function premultiply;
+    } conversion_kernels;
+    
+    // floor(x / 255) for x <= 65535, as a multiply and shift
+    inline __uint8_t Div255(__uint32_t x)
+    {
+        return (__uint8_t)((x * 0x8081) >> 23);
+    }
+    
+    void ExpandRGBToRGBA_Scalar(const __uint8_t *source, __uint8_t *dest, size_t pixel_count)
+    {
+        const __uint8_t *pEnd = source + pixel_count * 3;
+        while(source < pEnd) {
+            *dest++ = source[0];
+            *dest++ = source[1];
+            *dest++ = source[2];
+            *dest++ = 0xff;
+            source += 3;
+        }
+    }
+    
+    void Premultiply_Scalar(const __uint8_t *source, __uint8_t *dest, size_t pixel_count)
+    {
+        const __uint8_t *pEnd = source + pixel_count * 4;
+        while(source < pEnd) {
+            __uint32_t a = source[3];
+            dest[0] = Div255(source[0] * a);
+            dest[1] = Div255(source[1] * a);
+            dest[2] = Div255(source[2] * a);
+            dest[3] = (__uint8_t)a;
+            source += 4;
+            dest += 4;
+        }
+    }
+    
+#if defined(KRAKEN_USE_SSE2)
+    
+    void ExpandRGBToRGBA_SSE2(const __uint8_t *source, __uint8_t *dest, size_t pixel_count)
+    {
+        // SSE2 has no byte shuffle, so gather four 3-byte pixels with overlapping 32-bit loads.  The last pixel is left to the scalar loop, as its load would read past the end of the source.
+        const __m128i alpha = _mm_set1_epi32((int)0xff000000);
+        size_t i = 0;
+        for(; i + 5 <= pixel_count; i += 4) {
+            __int32_t p[4];
+            memcpy(p, source, 4);
+            memcpy(p + 1, source + 3, 4);
+            memcpy(p + 2, source + 6, 4);
+            memcpy(p + 3, source + 9, 4);
+            __m128i px = _mm_or_si128(_mm_setr_epi32(p[0], p[1], p[2], p[3]), alpha);
+            _mm_storeu_si128((__m128i *)dest, px);
+            source += 12;
+            dest += 16;
+        }
+        ExpandRGBToRGBA_Scalar(source, dest, pixel_count - i);
+    }
+    
+    void Premultiply_SSE2(const __uint8_t *source, __uint8_t *dest, size_t pixel_count)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i alpha_mask = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+        const __m128i alpha_one = _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0);
+        const __m128i div_255 = _mm_set1_epi16((short)0x8081);
+        size_t i = 0;
+        for(; i + 4 <= pixel_count; i += 4) {
+            __m128i px = _mm_loadu_si128((const __m128i *)source);
+            __m128i result[2];
+            for(int half=0; half < 2; half++) {
+                __m128i x = half ? _mm_unpackhi_epi8(px, zero) : _mm_unpacklo_epi8(px, zero);
+                // Broadcast alpha to the color channels of each pixel, and multiply alpha by 255 so it is unchanged by the division
+                __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(x, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+                a = _mm_or_si128(_mm_andnot_si128(alpha_mask, a), alpha_one);
+                __m128i product = _mm_mullo_epi16(x, a);
+                result[half] = _mm_srli_epi16(_mm_mulhi_epu16(product, div_255), 7);
+            }
+            _mm_storeu_si128((__m128i *)dest, _mm_packus_epi16(result[0], result[1]));
+            source += 16;
+            dest += 16;
+        }
+        Premultiply_Scalar(source, dest, pixel_count - i);
+    }
+    
+    KRAKEN_TARGET_AVX2 void ExpandRGBToRGBA_AVX2(const __uint8_t *source, __uint8_t *dest, size_t pixel_count)
+    {
+        // Load four pixels into each 128-bit lane, then shuffle them out to four bytes each within the lane
+        const __m256i shuffle = _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+                                                 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+        const __m256i alpha = _mm256_set1_epi32((int)0xff000000);
+        size_t i = 0;
+        for(; i + 10 <= pixel_count; i += 8) {
+            // The second load reads 16 bytes from pixel 4, which runs past the 8 pixels converted.  Stop while there are at least two pixels left over.
+            __m128i lo = _mm_loadu_si128((const __m128i *)source);
+            __m128i hi = _mm_loadu_si128((const __m128i *)(source + 12));
+            __m256i px = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+            px = _mm256_or_si256(_mm256_shuffle_epi8(px, shuffle), alpha);
+            _mm256_storeu_si256((__m256i *)dest, px);
+            source += 24;
+            dest += 32;
+        }
+        ExpandRGBToRGBA_SSE2(source, dest, pixel_count - i);
+    }
+    
+    KRAKEN_TARGET_AVX2 void Premultiply_AVX2(const __uint8_t *source, __uint8_t *dest, size_t pixel_count)
+    {
+        const __m256i zero = _mm256_setzero_si256();
+        // Copy alpha to the color channels of each pixel with a byte shuffle, and use 255 for the alpha channel itself
+        const __m256i alpha_shuffle = _mm256_setr_epi8(6, 7, 6, 7, 6, 7, -1, -1, 14, 15, 14, 15, 14, 15, -1, -1,
+                                                       6, 7, 6, 7, 6, 7, -1, -1, 14, 15, 14, 15, 14, 15, -1, -1);
+        const __m256i alpha_one = _mm256_setr_epi16(0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0, 255);
+        const __m256i div_255 = _mm256_set1_epi16((short)0x8081);
+        size_t i = 0;
+        for(; i + 8 <= pixel_count; i += 8) {
+            __m256i px = _mm256_loadu_si256((const __m256i *)source);
+            // Unpacking and packing both work within 128-bit lanes, so the pixels end up back in order
+            __m256i lo = _mm256_unpacklo_epi8(px, zero);
+            __m256i hi = _mm256_unpackhi_epi8(px, zero);
+            __m256i a_lo = _mm256_or_si256(_mm256_shuffle_epi8(lo, alpha_shuffle), alpha_one);
+            __m256i a_hi = _mm256_or_si256(_mm256_shuffle_epi8(hi, alpha_shuffle), alpha_one);
+            lo = _mm256_srli_epi16(_mm256_mulhi_epu16(_mm256_mullo_epi16(lo, a_lo), div_255), 7);
+            hi = _mm256_srli_epi16(_mm256_mulhi_epu16(_mm256_mullo_epi16(hi, a_hi), div_255), 7);
+            _mm256_storeu_si256((__m256i *)dest, _mm256_packus_epi16(lo, hi));
+            source += 32;
+            dest += 32;
+        }
+        Premultiply_SSE2(source, dest, pixel_count - i);
+    }
+    
+#endif
+    
+#if defined(KRPIXELCONVERT_NEON)
+    
+    void ExpandRGBToRGBA_NEON(const __uint8_t *source, __uint8_t *dest, size_t pixel_count)
+    {
+        size_t i = 0;
+        for(; i + 16 <= pixel_count; i += 16) {
+            uint8x16x3_t bgr = vld3q_u8(source);
+            uint8x16x4_t bgra;
+            bgra.val[0] = bgr.val[0];
+            bgra.val[1] = bgr.val[1];
+            bgra.val[2] = bgr.val[2];
+            bgra.val[3] = vdupq_n_u8(0xff);
+            vst4q_u8(dest, bgra);
+            source += 48;
+            dest += 64;
+        }
+        ExpandRGBToRGBA_Scalar(source, dest, pixel_count - i);
+    }
+    
+    // floor(x / 255) of each 16-bit product, as (x + 1 + (x >> 8)) >> 8
+    inline uint8x8_t Div255_NEON(uint16x8_t x)
+    {
+        return vshrn_n_u16(vaddq_u16(vaddq_u16(x, vdupq_n_u16(1)), vshrq_n_u16(x, 8)), 8);
+    }
+    
+    void Premultiply_NEON(const __uint8_t *source, __uint8_t *dest, size_t pixel_count)
+    {
+        size_t i = 0;
+        for(; i + 8 <= pixel_count; i += 8) {
+            uint8x8x4_t px = vld4_u8(source);
+            px.val[0] = Div255_NEON(vmull_u8(px.val[0], px.val[3]));
+            px.val[1] = Div255_NEON(vmull_u8(px.val[1], px.val[3]));
+            px.val[2] = Div255_NEON(vmull_u8(px.val[2], px.val[3]));
+            vst4_u8(dest, px);
+            source += 32;
+            dest += 32;
+        }
+        Premultiply_Scalar(source, dest, pixel_count - i);
+    }
+    
+#endif
+    
+    conversion_kernels GetKernels(KRPixelConvert::isa_t isa)
+    {
+        conversion_kernels kernels;
+        kernels.isa = KRPixelConvert::ISA_SCALAR;
+        kernels.expand_rgb = ExpandRGBToRGBA_Scalar;
+        kernels.premultiply = Premultiply_Scalar;
+        switch(isa) {
+#if defined(KRAKEN_USE_SSE2)
+            case KRPixelConvert::ISA_AVX2:
+                if(KRCPUFeatures::SupportsAVX2()) {
+                    kernels.isa = KRPixelConvert::ISA_AVX2;
+                    kernels.expand_rgb = ExpandRGBToRGBA_AVX2;
+                    kernels.premultiply = Premultiply_AVX2;
+                    break;
+                }
+                // Fall back to SSE2
+            case KRPixelConvert::ISA_SSE2:
+                kernels.isa = KRPixelConvert::ISA_SSE2;
+                kernels.expand_rgb = ExpandRGBToRGBA_SSE2;
+                kernels.premultiply = Premultiply_SSE2;
+                break;
+#endif
+#if defined(KRPIXELCONVERT_NEON)
+            case KRPixelConvert::ISA_NEON:
+                kernels.isa = KRPixelConvert::ISA_NEON;
+                kernels.expand_rgb = ExpandRGBToRGBA_NEON;
+                kernels.premultiply = Premultiply_NEON;
+                break;
+#endif
+            default:
+                break;
+        }
+        return kernels;
+    }
+    
+    // The fastest kernels supported by this CPU, selected on first use
+    const conversion_kernels &Kernels()
+    {
+#if defined(KRPIXELCONVERT_NEON)
+        static const conversion_kernels kernels = GetKernels(KRPixelConvert::ISA_NEON);
+#else
+        static const conversion_kernels kernels = GetKernels(KRPixelConvert::ISA_AVX2);
+#endif
+        return kernels;
+    }
+    
+    double ElapsedSeconds(std::chrono::steady_clock::time_point start_time)
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+    }
+    
+    bool ExpandRLE(const conversion_kernels &kernels, const __uint8_t *source, const __uint8_t *source_end, __uint8_t *dest, size_t pixel_count, int bytes_per_pixel, bool premultiply_alpha)
+    {
+        __uint8_t *pEnd = dest + pixel_count * 4;
+        while(dest < pEnd) {
+            if(source >= source_end) {
+                return false;
+            }
+            size_t count = (*source & 0x7f) + 1;
+            bool rle_packet = (*source & 0x80) != 0;
+            source++;
+            if(count > (size_t)(pEnd - dest) / 4) {
+                count = (pEnd - dest) / 4;
+            }
+            if(rle_packet) {
+                // RLE Packet; convert the pixel once, then repeat it
+                if(source + bytes_per_pixel > source_end) {
+                    return false;
+                }
+                __uint8_t pixel[4];
+                pixel[0] = source[0];
+                pixel[1] = source[1];
+                pixel[2] = source[2];
+                pixel[3] = bytes_per_pixel == 4 ? source[3] : 0xff;
+                if(premultiply_alpha && bytes_per_pixel == 4) {
+                    Premultiply_Scalar(pixel, pixel, 1);
+                }
+                source += bytes_per_pixel;
+                
+                size_t i = 0;
+#if defined(KRAKEN_USE_SSE2)
+                __int32_t packed_pixel;
+                memcpy(&packed_pixel, pixel, 4);
+                __m128i repeated = _mm_set1_epi32(packed_pixel);
+                for(; i + 4 <= count; i += 4) {
+                    _mm_storeu_si128((__m128i *)(dest + i * 4), repeated);
+                }
+#elif defined(KRPIXELCONVERT_NEON)
+                uint32_t packed_pixel;
+                memcpy(&packed_pixel, pixel, 4);
+                uint32x4_t repeated = vdupq_n_u32(packed_pixel);
+                for(; i + 4 <= count; i += 4) {
+                    vst1q_u8(dest + i * 4, vreinterpretq_u8_u32(repeated));
+                }
+#endif
+                for(; i < count; i++) {
+                    memcpy(dest + i * 4, pixel, 4);
+                }
+            } else {
+                // RAW Packet
+                if(source + count * bytes_per_pixel > source_end) {
+                    return false;
+                }
+                if(bytes_per_pixel == 3) {
+                    kernels.expand_rgb(source, dest, count);
+                } else if(premultiply_alpha) {
+                    kernels.premultiply(source, dest, count);
+                } else {
+                    memcpy(dest, source, count * 4);
+                }
+                source += count * bytes_per_pixel;
+            }
+            dest += count * 4;
+        }
+        return true;
+    }
+}
+
+KRPixelConvert::isa_t KRPixelConvert::GetISA()
+{
+    return Kernels().isa;
+}
+
+const char *KRPixelConvert::GetISAName(isa_t isa)
+{
+    switch(isa) {
+        case ISA_SSE2:
+            return "SSE2";
+        case ISA_AVX2:
+            return "AVX2";
+        case ISA_NEON:
+            return "NEON";
+        default:
+            return "scalar";
+    }
+}
+
+void KRPixelConvert::ExpandRGBToRGBA(const __uint8_t *source, __uint8_t *dest, size_t pixel_count)
+{
+    Kernels().expand_rgb(source, dest, pixel_count);
+}
+
+void KRPixelConvert::Premultiply(const __uint8_t *source, __uint8_t *dest, size_t pixel_count)
+{
+    Kernels().premultiply(source, dest, pixel_count);
+}
+
+bool KRPixelConvert::ExpandRLE(const __uint8_t *source, const __uint8_t *source_end, __uint8_t *dest, size_t pixel_count, int bytes_per_pixel, bool premultiply_alpha)
+{
+    return ::ExpandRLE(Kernels(), source, source_end, dest, pixel_count, bytes_per_pixel, premultiply_alpha);
+}
+
+void KRPixelConvert::benchmarkConversions()
+{
+    const int image_sizes[] = {64, 256, 1024, 4096};
+    const isa_t isas[] = {ISA_SCALAR, ISA_SSE2, ISA_AVX2, ISA_NEON};
+    
+    for(int size_index=0; size_index < 4; size_index++) {
+        int dim = image_sizes[size_index];
+        size_t pixel_count = (size_t)dim * dim;
+        int iterations = (int)(16 * 4096 * 4096 / pixel_count);
+        if(iterations > 1000) iterations = 1000;
+        
+        // A UI atlas-like image; runs of transparent and opaque pixels with gradients at the edges
+        std::vector<__uint8_t> rgb(pixel_count * 3);
+        std::vector<__uint8_t> rgba(pixel_count * 4);
+        std::vector<__uint8_t> dest(pixel_count * 4);
+        for(size_t i=0; i < pixel_count; i++) {
+            __uint8_t a = (i / 37) % 3 == 0 ? 0 : ((i / 37) % 3 == 1 ? 0xff : (__uint8_t)(i * 7));
+            for(int c=0; c < 3; c++) {
+                rgb[i * 3 + c] = (__uint8_t)(i * (c + 1));
+                rgba[i * 4 + c] = (__uint8_t)(i * (c + 1));
+            }
+            rgba[i * 4 + 3] = a;
+        }
+        
+        // Encode the image as TGA RLE packets of 32-bit pixels
+        std::vector<__uint8_t> rle;
+        size_t i = 0;
+        while(i < pixel_count) {
+            size_t run = 1;
+            while(i + run < pixel_count && run < 128 && memcmp(&rgba[i * 4], &rgba[(i + run) * 4], 4) == 0) {
+                run++;
+            }
+            if(run > 1) {
+                rle.push_back((__uint8_t)(0x80 | (run - 1)));
+                rle.insert(rle.end(), rgba.begin() + i * 4, rgba.begin() + i * 4 + 4);
+            } else {
+                size_t raw = 1;
+                while(i + raw < pixel_count && raw < 128 && memcmp(&rgba[(i + raw - 1) * 4], &rgba[(i + raw) * 4], 4) != 0) {
+                    raw++;
+                }
+                rle.push_back((__uint8_t)(raw - 1));
+                rle.insert(rle.end(), rgba.begin() + i * 4, rgba.begin() + (i + raw) * 4);
+                run = raw;
+            }
+            i += run;
+        }
+        
+        for(int isa_index=0; isa_index < 4; isa_index++) {
+            conversion_kernels kernels = GetKernels(isas[isa_index]);
+            if(kernels.isa != isas[isa_index]) {
+                continue; // Not supported on this CPU
+            }
+            
+            std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+            for(int iteration=0; iteration < iterations; iteration++) {
+                kernels.expand_rgb(&rgb[0], &dest[0], pixel_count);
+            }
+            double expand_time = ElapsedSeconds(start_time);
+            
+            start_time = std::chrono::steady_clock::now();
+            for(int iteration=0; iteration < iterations; iteration++) {
+                kernels.premultiply(&rgba[0], &dest[0], pixel_count);
+            }
+            double premultiply_time = ElapsedSeconds(start_time);
+            
+            start_time = std::chrono::steady_clock::now();
+            for(int iteration=0; iteration < iterations; iteration++) {
+                ::ExpandRLE(kernels, &rle[0], &rle[0] + rle.size(), &dest[0], pixel_count, 4, true);
+            }
+            double rle_time = ElapsedSeconds(start_time);
+            
+            double megapixels = (double)pixel_count * iterations / 1000000.0;
+            KRContext::Log(KRContext::LOG_LEVEL_INFORMATION, "KRPixelConvert::benchmarkConversions - %ix%i %s: expand %.1f MP/s, premultiply %.1f MP/s, RLE premultiply %.1f MP/s",
+                           dim, dim, GetISAName(kernels.isa), megapixels / expand_time, megapixels / premultiply_time, megapixels / rle_time);
+        }
+    }
+}
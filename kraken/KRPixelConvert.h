@@ -0,0 +1,67 @@
+//
+//  KRPixelConvert.h
+//  KREngine
+//
+//  Copyright 2012 Kearwood Gilbert. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are
+//  permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this list of
+//  conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list
+//  of conditions and the following disclaimer in the documentation and/or other materials
+//  provided with the distribution.
+//
+//  THIS SOFTWARE IS PROVIDED BY KEARWOOD GILBERT ''AS IS'' AND ANY EXPRESS OR IMPLIED
+//  WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+//  FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL KEARWOOD GILBERT OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+//  ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+//  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+//  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//  The views and conclusions contained in the software and documentation are those of the
+//  authors and should not be interpreted as representing official policies, either expressed
+//  or implied, of Kearwood Gilbert.
+//
+
+#ifndef KRPIXELCONVERT_H
+#define KRPIXELCONVERT_H
+
+#include "KREngine-common.h"
+
+// Pixel format conversion used when decoding images, with SSE2, AVX2 and NEON implementations.
+// On x86, the fastest implementation the CPU supports is selected at runtime.
+// Pixels are in BGRA order, as stored in TGA files.
+namespace KRPixelConvert {
+    
+    typedef enum {
+        ISA_SCALAR,
+        ISA_SSE2,
+        ISA_AVX2,
+        ISA_NEON
+    } isa_t;
+    
+    // The instruction set used by the conversion functions
+    isa_t GetISA();
+    const char *GetISAName(isa_t isa);
+    
+    // Expand 24-bit BGR pixels to 32-bit BGRA pixels with an opaque alpha channel
+    void ExpandRGBToRGBA(const __uint8_t *source, __uint8_t *dest, size_t pixel_count);
+    
+    // Multiply the color channels of 32-bit BGRA pixels by alpha.  Results are rounded down, as with x * a / 255.  source and dest may be the same.
+    void Premultiply(const __uint8_t *source, __uint8_t *dest, size_t pixel_count);
+    
+    // Expand TGA run-length encoded packets of 24 or 32 bit pixels to pixel_count 32-bit BGRA pixels, optionally premultiplying alpha.
+    // Returns false if source_end is reached before all pixels were decoded.
+    bool ExpandRLE(const __uint8_t *source, const __uint8_t *source_end, __uint8_t *dest, size_t pixel_count, int bytes_per_pixel, bool premultiply_alpha);
+    
+    // Time each conversion with each instruction set supported by this CPU, over a range of image sizes, and log the results
+    void benchmarkConversions();
+}
+
+#endif
@@ -67,7 +67,10 @@ void KRPointLight::render(KRCamera *pCamera, std::vector<KRPointLight *> &point_
             
             bool bInsideLight = view_light_position.sqrMagnitude() <= (influence_radius + pCamera->settings.getPerspectiveNearZ()) * (influence_radius + pCamera->settings.getPerspectiveNearZ());
             
-            KRShader *pShader = getContext().getShaderManager()->getShader(bVisualize ? "visualize_overlay" : (bInsideLight ? "light_point_inside" : "light_point"), pCamera, this_light, std::vector<KRDirectionalLight *>(), std::vector<KRSpotLight *>(), 0, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, renderPass);
+            static const int visualize_overlay_shader_id = KRShaderManager::GetShaderNameID("visualize_overlay");
+            static const int light_point_inside_shader_id = KRShaderManager::GetShaderNameID("light_point_inside");
+            static const int light_point_shader_id = KRShaderManager::GetShaderNameID("light_point");
+            KRShader *pShader = getContext().getShaderManager()->getShader(bVisualize ? visualize_overlay_shader_id : (bInsideLight ? light_point_inside_shader_id : light_point_shader_id), pCamera, this_light, std::vector<KRDirectionalLight *>(), std::vector<KRSpotLight *>(), 0, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, renderPass);
             if(getContext().getShaderManager()->selectShader(*pCamera, pShader, viewport, sphereModelMatrix, this_light, std::vector<KRDirectionalLight *>(), std::vector<KRSpotLight *>(), 0, renderPass, Vector3::Zero(), 0.0f, Vector4::Zero())) {
                 
                 
@@ -0,0 +1,229 @@
+//
+//  KRRenderQueue.cpp
+//  KREngine
+//
+//  Copyright 2012 Kearwood Gilbert. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are
+//  permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this list of
+//  conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list
+//  of conditions and the following disclaimer in the documentation and/or other materials
+//  provided with the distribution.
+//
+//  THIS SOFTWARE IS PROVIDED BY KEARWOOD GILBERT ''AS IS'' AND ANY EXPRESS OR IMPLIED
+//  WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+//  FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL KEARWOOD GILBERT OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+//  ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+//  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+//  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//  The views and conclusions contained in the software and documentation are those of the
+//  authors and should not be interpreted as representing official policies, either expressed
+//  or implied, of Kearwood Gilbert.
+//
+
+#include "KRRenderQueue.h"
+#include "KRMesh.h"
+#include "KRMaterial.h"
+#include "KRCamera.h"
+#include "KRViewport.h"
+
+namespace {
+    // Bits of the sort key given to each state, from the most significant.  States beyond the range of a field share its last id.
+    const int KEY_PASS_BITS = 4;
+    const int KEY_STATE_BITS[] = {12, 14, 12, 12}; // Shader, material, light map and VBO
+    const int KEY_DEPTH_BITS = 10;
+    
+    const int MAX_DRAW_INSTANCES = 1024; // Model matrices uploaded for one instanced draw
+}
+
+KRRenderQueue::KRRenderQueue()
+{
+    m_camera = NULL;
+    m_viewport = NULL;
+    m_renderPass = KRNode::RENDER_PASS_FORWARD_OPAQUE;
+    m_collecting = false;
+    m_lightSetCount = 0;
+    for(int i=0; i < STATE_TYPE_COUNT; i++) {
+        m_stateCount[i] = 0;
+    }
+}
+
+KRRenderQueue::~KRRenderQueue()
+{
+    
+}
+
+bool KRRenderQueue::CanQueue(KRNode::RenderPass renderPass)
+{
+    // Transparent passes are drawn back to front, and shadow map passes with the shader bound by the light
+    return renderPass == KRNode::RENDER_PASS_FORWARD_OPAQUE || renderPass == KRNode::RENDER_PASS_DEFERRED_GBUFFER || renderPass == KRNode::RENDER_PASS_DEFERRED_OPAQUE;
+}
+
+void KRRenderQueue::begin(KRCamera *pCamera, const KRViewport &viewport, KRNode::RenderPass renderPass)
+{
+    m_camera = pCamera;
+    m_viewport = &viewport;
+    m_renderPass = renderPass;
+    m_collecting = CanQueue(renderPass);
+}
+
+void KRRenderQueue::end()
+{
+    flush();
+    m_collecting = false;
+    m_camera = NULL;
+    m_viewport = NULL;
+}
+
+bool KRRenderQueue::isCollecting(KRNode::RenderPass renderPass) const
+{
+    return m_collecting && renderPass == m_renderPass;
+}
+
+int KRRenderQueue::getStateID(const void *state, state_type type)
+{
+    unordered_map<const void *, int>::iterator itr = m_stateIDs.find(state);
+    if(itr != m_stateIDs.end()) {
+        return (*itr).second;
+    }
+    int max_id = (1 << KEY_STATE_BITS[type]) - 1;
+    int id = KRMIN(m_stateCount[type]++, max_id);
+    m_stateIDs[state] = id;
+    return id;
+}
+
+int KRRenderQueue::getLightSet(std::vector<KRPointLight *> &point_lights, std::vector<KRDirectionalLight *> &directional_lights, std::vector<KRSpotLight *>&spot_lights)
+{
+    // Lights only change between octree nodes, so neighbouring draws usually share the last set
+    if(m_lightSetCount > 0) {
+        light_set &last_set = m_lightSets[m_lightSetCount - 1];
+        if(last_set.point_lights == point_lights && last_set.directional_lights == directional_lights && last_set.spot_lights == spot_lights) {
+            return m_lightSetCount - 1;
+        }
+    }
+    if(m_lightSetCount == (int)m_lightSets.size()) {
+        m_lightSets.push_back(light_set());
+    }
+    light_set &new_set = m_lightSets[m_lightSetCount];
+    new_set.point_lights = point_lights;
+    new_set.directional_lights = directional_lights;
+    new_set.spot_lights = spot_lights;
+    return m_lightSetCount++;
+}
+
+void KRRenderQueue::add(KRMesh *pMesh, int iSubmesh, KRMaterial *pMaterial, const void *vbo, const std::string &object_name, std::vector<KRPointLight *> &point_lights, std::vector<KRDirectionalLight *> &directional_lights, std::vector<KRSpotLight *>&spot_lights, const Matrix4 &matModel, KRTexture *pLightMap, const std::vector<Matrix4> &bone_palette, const Vector3 &rim_color, float rim_power, float lod_coverage)
+{
+    draw d;
+    d.mesh = pMesh;
+    d.submesh = iSubmesh;
+    d.material = pMaterial;
+    d.object_name = &object_name;
+    d.light_set = getLightSet(point_lights, directional_lights, spot_lights);
+    d.model_matrix = matModel;
+    d.light_map = pLightMap;
+    d.bone_palette = &bone_palette;
+    d.rim_color = rim_color;
+    d.rim_power = rim_power;
+    d.lod_coverage = lod_coverage;
+    
+    KRShader *pShader = pMaterial->getShader(m_camera, point_lights, directional_lights, spot_lights, (int)bone_palette.size(), pLightMap, m_renderPass, rim_power);
+    
+    // Front to back within draws that share their state
+    float far_z = m_camera->settings.getPerspectiveFarZ();
+    float distance = (Matrix4::Dot(matModel, Vector3::Zero()) - m_viewport->getCameraPosition()).magnitude();
+    int max_depth = (1 << KEY_DEPTH_BITS) - 1;
+    int depth = far_z > 0.0f ? (int)KRCLAMP(distance / far_z * max_depth, 0.0f, (float)max_depth) : 0;
+    
+    __uint64_t key = (__uint64_t)(m_renderPass & ((1 << KEY_PASS_BITS) - 1));
+    key = (key << KEY_STATE_BITS[STATE_SHADER]) | getStateID(pShader, STATE_SHADER);
+    key = (key << KEY_STATE_BITS[STATE_MATERIAL]) | getStateID(pMaterial, STATE_MATERIAL);
+    key = (key << KEY_STATE_BITS[STATE_LIGHT_MAP]) | getStateID(pLightMap, STATE_LIGHT_MAP);
+    key = (key << KEY_STATE_BITS[STATE_VBO]) | getStateID(vbo, STATE_VBO);
+    key = (key << KEY_DEPTH_BITS) | depth;
+    
+    m_sortKeys.push_back(std::pair<__uint64_t, int>(key, (int)m_draws.size()));
+    m_draws.push_back(d);
+}
+
+bool KRRenderQueue::CanInstance(const draw &d)
+{
+    // Skinned meshes need their own bone transforms.  The instanced vertex shader transforms normals without an inverse transpose, which requires a uniform scale.
+    if(!d.bone_palette->empty() || d.mesh->getModelFormat() != KRMesh::KRENGINE_MODEL_FORMAT_INDEXED_TRIANGLES) {
+        return false;
+    }
+    const Matrix4 &m = d.model_matrix;
+    float scale_x = Vector3::Create(m[0], m[1], m[2]).sqrMagnitude();
+    float scale_y = Vector3::Create(m[4], m[5], m[6]).sqrMagnitude();
+    float scale_z = Vector3::Create(m[8], m[9], m[10]).sqrMagnitude();
+    float tolerance = scale_x * 0.001f;
+    return fabsf(scale_y - scale_x) <= tolerance && fabsf(scale_z - scale_x) <= tolerance;
+}
+
+bool KRRenderQueue::SameInstanceState(const draw &a, const draw &b)
+{
+    return a.mesh == b.mesh && a.submesh == b.submesh && a.material == b.material && a.light_map == b.light_map && a.light_set == b.light_set && a.rim_color == b.rim_color && a.rim_power == b.rim_power;
+}
+
+void KRRenderQueue::flush()
+{
+    if(m_draws.empty()) {
+        return;
+    }
+    
+    // The draw index breaks ties, so draws with the same key keep the order they were queued in
+    std::sort(m_sortKeys.begin(), m_sortKeys.end());
+    
+    bool instancing = false;
+#if KRENGINE_INSTANCED_DRAWING
+    instancing = m_camera->settings.getEnableInstancing();
+#endif
+    
+    int draw_count = (int)m_sortKeys.size();
+    int sorted_index = 0;
+    while(sorted_index < draw_count) {
+        draw &d = m_draws[m_sortKeys[sorted_index].second];
+        light_set &lights = m_lightSets[d.light_set];
+        
+        // Draws with the same state are adjacent once sorted, ordered front to back
+        int instance_count = 1;
+        if(instancing && CanInstance(d)) {
+            while(sorted_index + instance_count < draw_count && instance_count < MAX_DRAW_INSTANCES) {
+                draw &next = m_draws[m_sortKeys[sorted_index + instance_count].second];
+                if(!CanInstance(next) || !SameInstanceState(d, next)) {
+                    break;
+                }
+                instance_count++;
+            }
+        }
+        
+        if(instance_count > 1) {
+            m_instanceMatrices.clear();
+            float lod_coverage = 0.0f;
+            for(int i=0; i < instance_count; i++) {
+                draw &instance = m_draws[m_sortKeys[sorted_index + i].second];
+                m_instanceMatrices.push_back(instance.model_matrix);
+                lod_coverage = KRMAX(lod_coverage, instance.lod_coverage);
+            }
+            d.mesh->renderInstancedSubmesh(d.submesh, d.material, *d.object_name, m_camera, lights.point_lights, lights.directional_lights, lights.spot_lights, *m_viewport, m_instanceMatrices, d.light_map, m_renderPass, d.rim_color, d.rim_power, lod_coverage);
+        } else {
+            d.mesh->renderMaterialSubmesh(d.submesh, d.material, *d.object_name, m_camera, lights.point_lights, lights.directional_lights, lights.spot_lights, *m_viewport, d.model_matrix, d.light_map, m_renderPass, *d.bone_palette, d.rim_color, d.rim_power, d.lod_coverage);
+        }
+        sorted_index += instance_count;
+    }
+    
+    m_draws.clear();
+    m_sortKeys.clear();
+    m_lightSetCount = 0;
+    m_stateIDs.clear();
+    for(int i=0; i < STATE_TYPE_COUNT; i++) {
+        m_stateCount[i] = 0;
+    }
+}
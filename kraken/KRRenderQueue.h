@@ -0,0 +1,121 @@
+//
+//  KRRenderQueue.h
+//  KREngine
+//
+//  Copyright 2012 Kearwood Gilbert. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are
+//  permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this list of
+//  conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list
+//  of conditions and the following disclaimer in the documentation and/or other materials
+//  provided with the distribution.
+//
+//  THIS SOFTWARE IS PROVIDED BY KEARWOOD GILBERT ''AS IS'' AND ANY EXPRESS OR IMPLIED
+//  WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+//  FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL KEARWOOD GILBERT OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+//  ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+//  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+//  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//  The views and conclusions contained in the software and documentation are those of the
+//  authors and should not be interpreted as representing official policies, either expressed
+//  or implied, of Kearwood Gilbert.
+//
+
+#ifndef KRRENDERQUEUE_H
+#define KRRENDERQUEUE_H
+
+#include "KREngine-common.h"
+#include "KRNode.h"
+
+class KRMesh;
+class KRMaterial;
+class KRTexture;
+class KRCamera;
+class KRViewport;
+class KRPointLight;
+class KRDirectionalLight;
+class KRSpotLight;
+
+// The opaque submesh draws of a pass, collected while the scene is traversed and submitted in order of their state.
+// Draws are sorted on a 64-bit key of pass, shader, material, light map, VBO and depth.  Consecutive draws then share most of their state, and KRShader, KRTextureManager and KRMeshManager skip the binds that would repeat it.
+// Runs of sorted draws that differ only in their model matrix are submitted as one instanced draw, when instancing is enabled.
+class KRRenderQueue {
+public:
+    KRRenderQueue();
+    ~KRRenderQueue();
+    
+    // Collect the draws of renderPass until end().  Only opaque passes are queued; draws in other passes are made immediately.
+    void begin(KRCamera *pCamera, const KRViewport &viewport, KRNode::RenderPass renderPass);
+    
+    // Submit the queued draws and stop collecting
+    void end();
+    
+    // Submit the draws queued so far, such as before an occlusion query that must be tested against them
+    void flush();
+    
+    bool isCollecting(KRNode::RenderPass renderPass) const;
+    
+    // Queue a submesh to be drawn with pMaterial.  The light lists are copied; the other references must remain valid until the queue is flushed.
+    void add(KRMesh *pMesh, int iSubmesh, KRMaterial *pMaterial, const void *vbo, const std::string &object_name, std::vector<KRPointLight *> &point_lights, std::vector<KRDirectionalLight *> &directional_lights, std::vector<KRSpotLight *>&spot_lights, const Matrix4 &matModel, KRTexture *pLightMap, const std::vector<Matrix4> &bone_palette, const Vector3 &rim_color, float rim_power, float lod_coverage);
+    
+    static bool CanQueue(KRNode::RenderPass renderPass);
+    
+private:
+    typedef enum {
+        STATE_SHADER,
+        STATE_MATERIAL,
+        STATE_LIGHT_MAP,
+        STATE_VBO,
+        STATE_TYPE_COUNT
+    } state_type;
+    
+    typedef struct {
+        KRMesh *mesh;
+        int submesh;
+        KRMaterial *material;
+        const std::string *object_name;
+        int light_set; // Index into m_lightSets
+        Matrix4 model_matrix;
+        KRTexture *light_map;
+        const std::vector<Matrix4> *bone_palette;
+        Vector3 rim_color;
+        float rim_power;
+        float lod_coverage;
+    } draw;
+    
+    typedef struct {
+        std::vector<KRPointLight *> point_lights;
+        std::vector<KRDirectionalLight *> directional_lights;
+        std::vector<KRSpotLight *> spot_lights;
+    } light_set;
+    
+    KRCamera *m_camera;
+    const KRViewport *m_viewport;
+    KRNode::RenderPass m_renderPass;
+    bool m_collecting;
+    
+    // Storage is kept from flush to flush, so that the queue stops allocating once it has reached its working size
+    std::vector<draw> m_draws;
+    std::vector<std::pair<__uint64_t, int> > m_sortKeys; // Sort key and index into m_draws
+    std::vector<light_set> m_lightSets; // The first m_lightSetCount are in use
+    std::vector<Matrix4> m_instanceMatrices;
+    int m_lightSetCount;
+    unordered_map<const void *, int> m_stateIDs; // Small ids for the sort keys, numbered in the order the states are first queued
+    int m_stateCount[STATE_TYPE_COUNT];
+    
+    int getLightSet(std::vector<KRPointLight *> &point_lights, std::vector<KRDirectionalLight *> &directional_lights, std::vector<KRSpotLight *>&spot_lights);
+    int getStateID(const void *state, state_type type);
+    
+    static bool CanInstance(const draw &d);
+    static bool SameInstanceState(const draw &a, const draw &b);
+};
+
+#endif /* defined(KRRENDERQUEUE_H) */
@@ -16,6 +16,9 @@ KRRenderSettings::KRRenderSettings()
     siren_reverb_max_length = 2.0f;
     
     m_enable_realtime_occlusion = false;
+    m_enable_software_occlusion = false;
+    m_enable_draw_sorting = true;
+    m_enable_instancing = true;
     bShowShadowBuffer = false;
     bShowOctree = false;
     bShowDeferred = false;
@@ -147,6 +150,9 @@ KRRenderSettings& KRRenderSettings::operator=(const KRRenderSettings &s)
     
     m_lodBias = s.m_lodBias;
     m_enable_realtime_occlusion = s.m_enable_realtime_occlusion;
+    m_enable_software_occlusion = s.m_enable_software_occlusion;
+    m_enable_draw_sorting = s.m_enable_draw_sorting;
+    m_enable_instancing = s.m_enable_instancing;
     
     max_anisotropy = s.max_anisotropy;
     
@@ -201,4 +207,31 @@ bool KRRenderSettings::getEnableRealtimeOcclusion()
 void KRRenderSettings::setEnableRealtimeOcclusion(bool enable)
 {
     m_enable_realtime_occlusion = enable;
+}
+
+bool KRRenderSettings::getEnableSoftwareOcclusion()
+{
+    return m_enable_software_occlusion;
+}
+void KRRenderSettings::setEnableSoftwareOcclusion(bool enable)
+{
+    m_enable_software_occlusion = enable;
+}
+
+bool KRRenderSettings::getEnableDrawSorting()
+{
+    return m_enable_draw_sorting;
+}
+void KRRenderSettings::setEnableDrawSorting(bool enable)
+{
+    m_enable_draw_sorting = enable;
+}
+
+bool KRRenderSettings::getEnableInstancing()
+{
+    return m_enable_instancing;
+}
+void KRRenderSettings::setEnableInstancing(bool enable)
+{
+    m_enable_instancing = enable;
 }
\ No newline at end of file
@@ -101,6 +101,18 @@ public:
     bool getEnableRealtimeOcclusion();
     void setEnableRealtimeOcclusion(bool enable);
     
+    // Cull against models marked as occluders, rasterized on the CPU by KROcclusionCuller
+    bool getEnableSoftwareOcclusion();
+    void setEnableSoftwareOcclusion(bool enable);
+    
+    // Queue the opaque draws of each pass and submit them sorted by state, rather than in octree order
+    bool getEnableDrawSorting();
+    void setEnableDrawSorting(bool enable);
+    
+    // Draw sorted runs of the same mesh, material and light map as one instanced draw call.  Requires draw sorting.
+    bool getEnableInstancing();
+    void setEnableInstancing(bool enable);
+    
     bool siren_enable;
     bool siren_enable_reverb;
     bool siren_enable_hrtf;
@@ -111,6 +123,9 @@ public:
 private:
     float m_lodBias;
     bool m_enable_realtime_occlusion;
+    bool m_enable_software_occlusion;
+    bool m_enable_draw_sorting;
+    bool m_enable_instancing;
 };
 
 #endif
@@ -97,14 +97,19 @@ std::set<KRLight *> &KRScene::getLights()
     return m_lights;
 }
 
+KRRenderQueue &KRScene::getRenderQueue()
+{
+    return m_renderQueue;
+}
+
 void KRScene::render(KRCamera *pCamera, unordered_map<AABB, int> &visibleBounds, const KRViewport &viewport, KRNode::RenderPass renderPass, bool new_frame) {
     if(new_frame) {
         // Expire cached occlusion test results.
-        // Cached "failed" results are expired on the next frame (marked with .second of -1)
-        // Cached "success" results are expired after KRENGINE_OCCLUSION_TEST_EXPIRY frames (marked with .second of the last frame
+        // Cached "success" results are expired after KRENGINE_OCCLUSION_TEST_EXPIRY frames, after which the bounds are tested again
+        // Cached "failed" results are refreshed by a new test each frame that their bounds are reached, so they only expire once the bounds are no longer rendered
         std::set<AABB> expired_visible_bounds;
         for(unordered_map<AABB, int>::iterator visible_bounds_itr = visibleBounds.begin(); visible_bounds_itr != visibleBounds.end(); visible_bounds_itr++) {
-            if((*visible_bounds_itr).second == -1 || (*visible_bounds_itr).second + KRENGINE_OCCLUSION_TEST_EXPIRY < getContext().getCurrentFrame()) {
+            if(KROcclusionQueryPool::GetResultFrame((*visible_bounds_itr).second) + KRENGINE_OCCLUSION_TEST_EXPIRY < getContext().getCurrentFrame()) {
                 expired_visible_bounds.insert((*visible_bounds_itr).first);
             }
         }
@@ -140,250 +145,269 @@ void KRScene::render(KRCamera *pCamera, unordered_map<AABB, int> &visibleBounds,
         }
     }
     
+    bool bSortDraws = pCamera->settings.getEnableDrawSorting() && KRRenderQueue::CanQueue(renderPass);
+    if(bSortDraws) {
+        m_renderQueue.begin(pCamera, viewport, renderPass);
+    }
+    
     // Render outer nodes
     for(std::set<KRNode *>::iterator itr=outerNodes.begin(); itr != outerNodes.end(); itr++) {
         KRNode *node = (*itr);
         node->render(pCamera, point_lights, directional_lights, spot_lights, viewport, renderPass);
     }
     
-    std::vector<KROctreeNode *> remainingOctrees;
-    std::vector<KROctreeNode *> remainingOctreesTestResults;
-    std::vector<KROctreeNode *> remainingOctreesTestResultsOnly;
-    if(m_nodeTree.getRootNode() != NULL) {
-        remainingOctrees.push_back(m_nodeTree.getRootNode());
+    // Collect the occlusion test results that the GPU has completed since the last pass, without waiting for the rest
+    m_occlusionQueries.poll(visibleBounds, getContext().getCurrentFrame());
+    
+    // The software occlusion buffer is only valid for the viewport that it was rasterized through
+    bool bSoftwareOcclusion = pCamera->settings.getEnableSoftwareOcclusion() && renderPass != KRNode::RENDER_PASS_PRESTREAM && m_occlusionCuller.getViewProjectionMatrix() == viewport.getViewProjectionMatrix();
+    
+    KROctreeNode *pRootNode = m_nodeTree.getRootNode();
+    if(pRootNode && (renderPass == KRNode::RENDER_PASS_PRESTREAM || viewport.visible(pRootNode->getBounds()))) {
+        render(pRootNode, visibleBounds, pCamera, point_lights, directional_lights, spot_lights, viewport, renderPass, bSoftwareOcclusion);
+    }
+    
+    if(bSortDraws) {
+        m_renderQueue.end();
+    }
+    
+    renderOcclusionTests(pCamera, visibleBounds, point_lights, directional_lights, spot_lights, viewport, renderPass);
+}
+
+void KRScene::renderOcclusionTests(KRCamera *pCamera, unordered_map<AABB, int> &visibleBounds, std::vector<KRPointLight *> &point_lights, std::vector<KRDirectionalLight *> &directional_lights, std::vector<KRSpotLight *>&spot_lights, const KRViewport &viewport, KRNode::RenderPass renderPass)
+{
+    if(m_occlusionTests.empty()) {
+        return;
+    }
+    
+    getContext().getMeshManager()->bindVBO(&getContext().getMeshManager()->KRENGINE_VBO_DATA_3D_CUBE_VERTICES, 1.0f);
+    
+    // Enable additive blending
+    if(renderPass != KRNode::RENDER_PASS_FORWARD_TRANSPARENT && renderPass != KRNode::RENDER_PASS_ADDITIVE_PARTICLES && renderPass != KRNode::RENDER_PASS_VOLUMETRIC_EFFECTS_ADDITIVE) {
+        GLDEBUG(glEnable(GL_BLEND));
     }
+    GLDEBUG(glBlendFunc(GL_ONE, GL_ONE));
     
-    std::vector<KROctreeNode *> newRemainingOctrees;
-    std::vector<KROctreeNode *> newRemainingOctreesTestResults;
-    while((!remainingOctrees.empty() || !remainingOctreesTestResults.empty())) {
-        newRemainingOctrees.clear();
-        newRemainingOctreesTestResults.clear();
-        for(std::vector<KROctreeNode *>::iterator octree_itr = remainingOctrees.begin(); octree_itr != remainingOctrees.end(); octree_itr++) {
-            render(*octree_itr, visibleBounds, pCamera, point_lights, directional_lights, spot_lights, viewport, renderPass, newRemainingOctrees, newRemainingOctreesTestResults, remainingOctreesTestResultsOnly, false, false);
+    
+    if(renderPass == KRNode::RENDER_PASS_FORWARD_OPAQUE ||
+       renderPass == KRNode::RENDER_PASS_DEFERRED_GBUFFER ||
+       renderPass == KRNode::RENDER_PASS_DEFERRED_OPAQUE ||
+       renderPass == KRNode::RENDER_PASS_SHADOWMAP) {
+        
+        // Disable z-buffer write
+        GLDEBUG(glDepthMask(GL_FALSE));
+    }
+    
+    for(std::vector<AABB>::iterator itr=m_occlusionTests.begin(); itr != m_occlusionTests.end(); itr++) {
+        const AABB &octreeBounds = *itr;
+        if(!m_occlusionQueries.beginQuery(visibleBounds, octreeBounds, getContext().getCurrentFrame())) {
+            break; // Too many queries are pending; the remaining bounds will be tested in a later pass
         }
-        for(std::vector<KROctreeNode *>::iterator octree_itr = remainingOctreesTestResults.begin(); octree_itr != remainingOctreesTestResults.end(); octree_itr++) {
-            render(*octree_itr, visibleBounds, pCamera, point_lights, directional_lights, spot_lights, viewport, renderPass, newRemainingOctrees, newRemainingOctreesTestResults, remainingOctreesTestResultsOnly, true, false);
+        
+        Matrix4 matModel = Matrix4();
+        matModel.scale(octreeBounds.size() * 0.5f);
+        matModel.translate(octreeBounds.center());
+        
+        static const int occlusion_test_shader_id = KRShaderManager::GetShaderNameID("occlusion_test");
+        if(getContext().getShaderManager()->selectShader(occlusion_test_shader_id, *pCamera, point_lights, directional_lights, spot_lights, 0, viewport, matModel, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, KRNode::RENDER_PASS_FORWARD_TRANSPARENT, Vector3::Zero(), 0.0f, Vector4::Zero())) {
+            GLDEBUG(glDrawArrays(GL_TRIANGLE_STRIP, 0, 14));
+            m_pContext->getMeshManager()->log_draw_call(renderPass, "octree", "occlusion_test", 14);
         }
-        remainingOctrees = newRemainingOctrees;
-        remainingOctreesTestResults = newRemainingOctreesTestResults;
+        
+        m_occlusionQueries.endQuery();
     }
+    m_occlusionTests.clear();
     
-    newRemainingOctrees.clear();
-    newRemainingOctreesTestResults.clear();
-    for(std::vector<KROctreeNode *>::iterator octree_itr = remainingOctreesTestResultsOnly.begin(); octree_itr != remainingOctreesTestResultsOnly.end(); octree_itr++) {
-        render(*octree_itr, visibleBounds, pCamera, point_lights, directional_lights, spot_lights, viewport, renderPass, newRemainingOctrees, newRemainingOctreesTestResults, remainingOctreesTestResultsOnly, true, true);
+    if(renderPass == KRNode::RENDER_PASS_FORWARD_OPAQUE ||
+       renderPass == KRNode::RENDER_PASS_DEFERRED_GBUFFER ||
+       renderPass == KRNode::RENDER_PASS_DEFERRED_OPAQUE ||
+       renderPass == KRNode::RENDER_PASS_SHADOWMAP) {
+        
+        // Re-enable z-buffer write
+        GLDEBUG(glDepthMask(GL_TRUE));
     }
+    
+    if(renderPass != KRNode::RENDER_PASS_FORWARD_TRANSPARENT && renderPass != KRNode::RENDER_PASS_ADDITIVE_PARTICLES && renderPass != KRNode::RENDER_PASS_VOLUMETRIC_EFFECTS_ADDITIVE) {
+        GLDEBUG(glDisable(GL_BLEND));
+    } else if(renderPass == KRNode::RENDER_PASS_FORWARD_TRANSPARENT) {
+        GLDEBUG(glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA));
+    } else {
+        GLDEBUG(glBlendFunc(GL_ONE, GL_ONE)); // RENDER_PASS_FORWARD_TRANSPARENT and RENDER_PASS_VOLUMETRIC_EFFECTS_ADDITIVE
+    }
+}
+
+void KRScene::rasterizeOccluders(const KRViewport &viewport)
+{
+    m_occlusionCuller.begin(viewport.getViewProjectionMatrix());
+    for(std::set<KRModel *>::iterator itr=m_occluders.begin(); itr != m_occluders.end(); itr++) {
+        KRModel *model = *itr;
+        if(model->getLODVisibility() >= KRNode::LOD_VISIBILITY_VISIBLE && viewport.visible(model->getBounds())) {
+            model->rasterizeOcclusion(m_occlusionCuller);
+        }
+    }
+    m_occlusionCuller.end();
 }
 
-void KRScene::render(KROctreeNode *pOctreeNode, unordered_map<AABB, int> &visibleBounds, KRCamera *pCamera, std::vector<KRPointLight *> &point_lights, std::vector<KRDirectionalLight *> &directional_lights, std::vector<KRSpotLight *>&spot_lights, const KRViewport &viewport, KRNode::RenderPass renderPass, std::vector<KROctreeNode *> &remainingOctrees, std::vector<KROctreeNode *> &remainingOctreesTestResults, std::vector<KROctreeNode *> &remainingOctreesTestResultsOnly, bool bOcclusionResultsPass, bool bOcclusionTestResultsOnly)
+void KRScene::render(KROctreeNode *pOctreeNode, unordered_map<AABB, int> &visibleBounds, KRCamera *pCamera, std::vector<KRPointLight *> &point_lights, std::vector<KRDirectionalLight *> &directional_lights, std::vector<KRSpotLight *>&spot_lights, const KRViewport &viewport, KRNode::RenderPass renderPass, bool bSoftwareOcclusion)
 {    
     if(pOctreeNode) {
         
         AABB octreeBounds = pOctreeNode->getBounds();
         
-        if(bOcclusionResultsPass) {
-            // ----====---- Occlusion results pass ----====----
-            if(pOctreeNode->m_occlusionTested) {
-                GLuint params = 0;
-                GLDEBUG(glGetQueryObjectuivEXT(pOctreeNode->m_occlusionQuery, GL_QUERY_RESULT_EXT, &params));
-
-                if(params) {
-                    // Record the frame number that the test has passed on
-                    visibleBounds[octreeBounds] = getContext().getCurrentFrame();
-
-                    if(!bOcclusionTestResultsOnly) {
-                        // Schedule a pass to perform the rendering
-                        remainingOctrees.push_back(pOctreeNode);
-                    }
-                } else {
-                    // Record -1 to indicate that the visibility test had failed
-                    visibleBounds[octreeBounds] = -1;
-                }
+        bool in_viewport = true; // Octree nodes have already been culled against the view frustum along with their siblings
+        if(renderPass == KRNode::RENDER_PASS_PRESTREAM) {
+            // When pre-streaming, objects are streamed in behind and in-front of the camera
+            AABB viewportExtents = AABB::Create(viewport.getCameraPosition() - Vector3::Create(pCamera->settings.getPerspectiveFarZ()), viewport.getCameraPosition() + Vector3::Create(pCamera->settings.getPerspectiveFarZ()));
+            in_viewport = octreeBounds.intersects(viewportExtents);
+        } else if(bSoftwareOcclusion) {
+            in_viewport = m_occlusionCuller.isVisible(octreeBounds);
+        }
+        if(in_viewport) {
 
-                GLDEBUG(glDeleteQueriesEXT(1, &pOctreeNode->m_occlusionQuery));
-                pOctreeNode->m_occlusionTested = false;
-                pOctreeNode->m_occlusionQuery = 0;
+            // ----====---- Rendering and occlusion test pass ----====----
+            bool bVisible = false;
+            bool bNeedOcclusionTest = true;
+            
+            if(!pCamera->settings.getEnableRealtimeOcclusion()) {
+                bVisible = true;
+                bNeedOcclusionTest = false;
             }
-        } else {
-            bool in_viewport = false;
-            if(renderPass == KRNode::RENDER_PASS_PRESTREAM) {
-                // When pre-streaming, objects are streamed in behind and in-front of the camera
-                AABB viewportExtents = AABB::Create(viewport.getCameraPosition() - Vector3::Create(pCamera->settings.getPerspectiveFarZ()), viewport.getCameraPosition() + Vector3::Create(pCamera->settings.getPerspectiveFarZ()));
-                in_viewport = octreeBounds.intersects(viewportExtents);
-            } else {
-                in_viewport = viewport.visible(pOctreeNode->getBounds());
+      
+            if(!bVisible) {
+                // Assume bounding boxes are visible without occlusion test queries if the camera is inside the box.
+                // The near clipping plane of the camera is taken into consideration by expanding the match area
+                AABB cameraExtents = AABB::Create(viewport.getCameraPosition() - Vector3::Create(pCamera->settings.getPerspectiveNearZ()), viewport.getCameraPosition() + Vector3::Create(pCamera->settings.getPerspectiveNearZ()));
+                bVisible = octreeBounds.intersects(cameraExtents);
+                if(bVisible) {
+                    // Record the frame number in which the camera was within the bounds
+                    visibleBounds[octreeBounds] = KROcclusionQueryPool::VisibleResult(getContext().getCurrentFrame());
+                    bNeedOcclusionTest = false;
+                }
             }
-            if(in_viewport) {
-
-                // ----====---- Rendering and occlusion test pass ----====----
-                bool bVisible = false;
-                bool bNeedOcclusionTest = true;
-                
-                if(!pCamera->settings.getEnableRealtimeOcclusion()) {
+            
+            
+            if(!bVisible) {
+                // Occlusion test results arrive a frame or two after their queries are issued, so use the last known result, taking advantage of temporal consistency of visible elements from frame to frame
+                unordered_map<AABB, int>::iterator match_itr = visibleBounds.find(octreeBounds);
+                if(match_itr == visibleBounds.end()) {
+                    // No result is known yet; render conservatively while the test is pending
+                    bVisible = true;
+                } else if(KROcclusionQueryPool::IsOccluded((*match_itr).second)) {
+                    // Remain culled while testing again to find if these bounds have been revealed.
+                    // Once the camera moves, the result no longer matches the view, so draw the contents while the test is outstanding rather than leave a hole until it completes.
+                    if(viewport.getViewChanged() && m_occlusionQueries.isPending(visibleBounds, octreeBounds)) {
+                        bVisible = true;
+                    }
+                } else {
+                    // A recent test passed; it will be tested again once the result expires
                     bVisible = true;
                     bNeedOcclusionTest = false;
                 }
-          
-                if(!bVisible) {
-                    // Assume bounding boxes are visible without occlusion test queries if the camera is inside the box.
-                    // The near clipping plane of the camera is taken into consideration by expanding the match area
-                    AABB cameraExtents = AABB::Create(viewport.getCameraPosition() - Vector3::Create(pCamera->settings.getPerspectiveNearZ()), viewport.getCameraPosition() + Vector3::Create(pCamera->settings.getPerspectiveNearZ()));
-                    bVisible = octreeBounds.intersects(cameraExtents);
-                    if(bVisible) {
-                        // Record the frame number in which the camera was within the bounds
-                        visibleBounds[octreeBounds] = getContext().getCurrentFrame();
+            }
+            
+            if(bNeedOcclusionTest) {
+                // Optimization: If this is an empty octree node with only a single child node, then immediately try to render the child node without an occlusion test for this higher level, as it would be more expensive than the occlusion test for the child
+                if(pOctreeNode->getSceneNodes().empty()) {
+                    int child_count = 0;
+                    for(int i=0; i<8; i++) {
+                        if(pOctreeNode->getChild(i) != NULL) child_count++;
+                    }
+                    if(child_count == 1) {
+                        bVisible = true;
                         bNeedOcclusionTest = false;
                     }
                 }
+            }
+            
+            if(bNeedOcclusionTest && !m_occlusionQueries.isPending(visibleBounds, octreeBounds)) {
+                // The queries are issued together at the end of the pass, so they are tested against the depth of everything drawn in front of these bounds without breaking up the sorted draws
+                m_occlusionTests.push_back(octreeBounds);
+            }
+            
+            if(bVisible) {
                 
-                
-                if(!bVisible) {
-                    // Check if a previous occlusion query has returned true, taking advantage of temporal consistency of visible elements from frame to frame
-                    // If the previous frame rendered this octree, then attempt to render it in this frame without performing a pre-occlusion test
-                    unordered_map<AABB, int>::iterator match_itr = visibleBounds.find(octreeBounds);
-                    if(match_itr != visibleBounds.end()) {
-                        if((*match_itr).second == -1) {
-                            // We have already tested these bounds with a negative result
-                            bNeedOcclusionTest = false;
-                        } else {
-                            bVisible = true;
-                            
-                            // We set bNeedOcclusionTest to false only when the previous occlusion test is old and we need to perform an occlusion test to record if this octree node was visible for the next frame
-                            bNeedOcclusionTest = false;
-                        }
+                // Add lights that influence this octree level and its children to the stack
+                int directional_light_count = 0;
+                int spot_light_count = 0;
+                int point_light_count = 0;
+                for(KROctreeNode::scene_node_list::iterator itr=pOctreeNode->getSceneNodes().begin(); itr != pOctreeNode->getSceneNodes().end(); itr++) {
+                    KRNode *node = (*itr);
+                    KRDirectionalLight *directional_light = dynamic_cast<KRDirectionalLight *>(node);
+                    if(directional_light) {
+                        directional_lights.push_back(directional_light);
+                        directional_light_count++;
+                    }
+                    KRSpotLight *spot_light = dynamic_cast<KRSpotLight *>(node);
+                    if(spot_light) {
+                        spot_lights.push_back(spot_light);
+                        spot_light_count++;
+                    }
+                    KRPointLight *point_light = dynamic_cast<KRPointLight *>(node);
+                    if(point_light) {
+                        point_lights.push_back(point_light);
+                        point_light_count++;
                     }
-                    
                 }
                 
-                if(!bVisible && bNeedOcclusionTest) {
-                    // Optimization: If this is an empty octree node with only a single child node, then immediately try to render the child node without an occlusion test for this higher level, as it would be more expensive than the occlusion test for the child
-                    if(pOctreeNode->getSceneNodes().empty()) {
-                        int child_count = 0;
-                        for(int i=0; i<8; i++) {
-                            if(pOctreeNode->getChildren()[i] != NULL) child_count++;
-                        }
-                        if(child_count == 1) {
-                            bVisible = true;
-                            bNeedOcclusionTest = false;
+                // Render objects that are at this octree level
+                for(KROctreeNode::scene_node_list::iterator itr=pOctreeNode->getSceneNodes().begin(); itr != pOctreeNode->getSceneNodes().end(); itr++) {
+                    //assert(pOctreeNode->getBounds().contains((*itr)->getBounds()));  // Sanity check
+                    if(bSoftwareOcclusion) {
+                        KRModel *model = dynamic_cast<KRModel *>(*itr);
+                        if(model && !m_occlusionCuller.isVisible(model->getBounds())) {
+                            continue;
                         }
                     }
+                    (*itr)->render(pCamera, point_lights, directional_lights, spot_lights, viewport, renderPass);
                 }
                 
-                if(bNeedOcclusionTest) {
-                    pOctreeNode->beginOcclusionQuery();
-                    
-
-
-                    Matrix4 matModel = Matrix4();
-                    matModel.scale(octreeBounds.size() * 0.5f);
-                    matModel.translate(octreeBounds.center());
-                    Matrix4 mvpmatrix = matModel * viewport.getViewProjectionMatrix();
-                    
-
-                    getContext().getMeshManager()->bindVBO(&getContext().getMeshManager()->KRENGINE_VBO_DATA_3D_CUBE_VERTICES, 1.0f);
-                    
-                    // Enable additive blending
-                    if(renderPass != KRNode::RENDER_PASS_FORWARD_TRANSPARENT && renderPass != KRNode::RENDER_PASS_ADDITIVE_PARTICLES && renderPass != KRNode::RENDER_PASS_VOLUMETRIC_EFFECTS_ADDITIVE) {
-                        GLDEBUG(glEnable(GL_BLEND));
-                    }
-                    GLDEBUG(glBlendFunc(GL_ONE, GL_ONE));
-                    
-                    
-                    if(renderPass == KRNode::RENDER_PASS_FORWARD_OPAQUE ||
-                       renderPass == KRNode::RENDER_PASS_DEFERRED_GBUFFER ||
-                       renderPass == KRNode::RENDER_PASS_DEFERRED_OPAQUE ||
-                       renderPass == KRNode::RENDER_PASS_SHADOWMAP) {
-                        
-                        // Disable z-buffer write
-                        GLDEBUG(glDepthMask(GL_FALSE));
-                    }
-                    
-                    if(getContext().getShaderManager()->selectShader("occlusion_test", *pCamera, point_lights, directional_lights, spot_lights, 0, viewport, matModel, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, KRNode::RENDER_PASS_FORWARD_TRANSPARENT, Vector3::Zero(), 0.0f, Vector4::Zero())) {
-                        GLDEBUG(glDrawArrays(GL_TRIANGLE_STRIP, 0, 14));
-                        m_pContext->getMeshManager()->log_draw_call(renderPass, "octree", "occlusion_test", 14);
-                    }
-                    
-                    if(renderPass == KRNode::RENDER_PASS_FORWARD_OPAQUE ||
-                       renderPass == KRNode::RENDER_PASS_DEFERRED_GBUFFER ||
-                       renderPass == KRNode::RENDER_PASS_DEFERRED_OPAQUE ||
-                       renderPass == KRNode::RENDER_PASS_SHADOWMAP) {
-                        
-                        // Re-enable z-buffer write
-                        GLDEBUG(glDepthMask(GL_TRUE));
-                    }
-                    
-                    pOctreeNode->endOcclusionQuery();
-                    
-                    if(renderPass != KRNode::RENDER_PASS_FORWARD_TRANSPARENT && renderPass != KRNode::RENDER_PASS_ADDITIVE_PARTICLES && renderPass != KRNode::RENDER_PASS_VOLUMETRIC_EFFECTS_ADDITIVE) {
-                        GLDEBUG(glDisable(GL_BLEND));
-                    } else if(renderPass == KRNode::RENDER_PASS_FORWARD_TRANSPARENT) {
-                        GLDEBUG(glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA));
-                    } else {
-                        GLDEBUG(glBlendFunc(GL_ONE, GL_ONE)); // RENDER_PASS_FORWARD_TRANSPARENT and RENDER_PASS_VOLUMETRIC_EFFECTS_ADDITIVE
-                    }
-                    
-                    
-                    if(bVisible) {
-                        // Schedule a pass to get the result of the occlusion test only for future frames and passes, without rendering the model or recurring further
-                        remainingOctreesTestResultsOnly.push_back(pOctreeNode);
-                    } else {
-                        // Schedule a pass to get the result of the occlusion test and continue recursion and rendering if test is true
-                        remainingOctreesTestResults.push_back(pOctreeNode);
+                // Render child octrees
+                const int *childOctreeOrder = renderPass == KRNode::RENDER_PASS_FORWARD_TRANSPARENT || renderPass == KRNode::RENDER_PASS_ADDITIVE_PARTICLES || renderPass == KRNode::RENDER_PASS_VOLUMETRIC_EFFECTS_ADDITIVE ? viewport.getBackToFrontOrder() : viewport.getFrontToBackOrder();
+                
+                KROctreeNode *children[8];
+                int child_count = 0;
+                for(int i=0; i<8; i++) {
+                    KROctreeNode *child = pOctreeNode->getChild(childOctreeOrder[i]);
+                    if(child) {
+                        children[child_count++] = child;
                     }
                 }
                 
-                if(bVisible) {
-                    
-                    // Add lights that influence this octree level and its children to the stack
-                    int directional_light_count = 0;
-                    int spot_light_count = 0;
-                    int point_light_count = 0;
-                    for(std::set<KRNode *>::iterator itr=pOctreeNode->getSceneNodes().begin(); itr != pOctreeNode->getSceneNodes().end(); itr++) {
-                        KRNode *node = (*itr);
-                        KRDirectionalLight *directional_light = dynamic_cast<KRDirectionalLight *>(node);
-                        if(directional_light) {
-                            directional_lights.push_back(directional_light);
-                            directional_light_count++;
-                        }
-                        KRSpotLight *spot_light = dynamic_cast<KRSpotLight *>(node);
-                        if(spot_light) {
-                            spot_lights.push_back(spot_light);
-                            spot_light_count++;
-                        }
-                        KRPointLight *point_light = dynamic_cast<KRPointLight *>(node);
-                        if(point_light) {
-                            point_lights.push_back(point_light);
-                            point_light_count++;
-                        }
-                    }
-                    
-                    // Render objects that are at this octree level
-                    for(std::set<KRNode *>::iterator itr=pOctreeNode->getSceneNodes().begin(); itr != pOctreeNode->getSceneNodes().end(); itr++) {
-                        //assert(pOctreeNode->getBounds().contains((*itr)->getBounds()));  // Sanity check
-                        (*itr)->render(pCamera, point_lights, directional_lights, spot_lights, viewport, renderPass);
-                    }
-                    
-                    // Render child octrees
-                    const int *childOctreeOrder = renderPass == KRNode::RENDER_PASS_FORWARD_TRANSPARENT || renderPass == KRNode::RENDER_PASS_ADDITIVE_PARTICLES || renderPass == KRNode::RENDER_PASS_VOLUMETRIC_EFFECTS_ADDITIVE ? viewport.getBackToFrontOrder() : viewport.getFrontToBackOrder();
-                    
-                    for(int i=0; i<8; i++) {
-                        render(pOctreeNode->getChildren()[childOctreeOrder[i]], visibleBounds, pCamera, point_lights, directional_lights, spot_lights, viewport, renderPass, remainingOctrees, remainingOctreesTestResults, remainingOctreesTestResultsOnly, false, false);
-                    }
-                    
-                    // Remove lights added at this octree level from the stack
-                    while(directional_light_count--) {
-                        directional_lights.pop_back();
+                // Cull all of the children against the view frustum at once
+                bool child_in_viewport[8];
+                if(renderPass == KRNode::RENDER_PASS_PRESTREAM) {
+                    for(int i=0; i<child_count; i++) {
+                        child_in_viewport[i] = true;
                     }
-                    while(spot_light_count--) {
-                        spot_lights.pop_back();
+                } else {
+                    float child_center[3][8];
+                    float child_extent[3][8];
+                    KRViewport::aabb_batch child_bounds = {{child_center[0], child_center[1], child_center[2]}, {child_extent[0], child_extent[1], child_extent[2]}};
+                    for(int i=0; i<child_count; i++) {
+                        KRViewport::SetBatchBounds(child_bounds, i, children[i]->getBounds());
                     }
-                    while(point_light_count--) {
-                        point_lights.pop_back();
+                    viewport.visible(child_bounds, child_count, child_in_viewport, KRViewport::CULL_TIGHT);
+                }
+                
+                for(int i=0; i<child_count; i++) {
+                    if(child_in_viewport[i]) {
+                        render(children[i], visibleBounds, pCamera, point_lights, directional_lights, spot_lights, viewport, renderPass, bSoftwareOcclusion);
                     }
                 }
+                
+                // Remove lights added at this octree level from the stack
+                while(directional_light_count--) {
+                    directional_lights.pop_back();
+                }
+                while(spot_light_count--) {
+                    spot_lights.pop_back();
+                }
+                while(point_light_count--) {
+                    point_lights.pop_back();
+                }
             }
-            
         }
+        
     }
 //  fprintf(stderr, "Octree culled: (%f, %f, %f) - (%f, %f, %f)\n", pOctreeNode->getBounds().min.x, pOctreeNode->getBounds().min.y, pOctreeNode->getBounds().min.z, pOctreeNode->getBounds().max.x, pOctreeNode->getBounds().max.y, pOctreeNode->getBounds().max.z);
 }
@@ -473,6 +497,10 @@ void KRScene::notify_sceneGraphDelete(KRNode *pNode)
     if(light) {
         m_lights.erase(light);
     }
+    KRModel *model = dynamic_cast<KRModel *>(pNode);
+    if(model) {
+        m_occluders.erase(model);
+    }
     m_modifiedNodes.erase(pNode);
     if(!m_newNodes.erase(pNode)) {
         m_nodeTree.remove(pNode);
@@ -484,6 +512,8 @@ void KRScene::updateOctree(const KRViewport &viewport)
     m_pRootNode->setLODVisibility(KRNode::LOD_VISIBILITY_VISIBLE);
     m_pRootNode->updateLODVisibility(viewport);
     
+    m_nodeTree.resetUpdateCounters();
+    
     std::set<KRNode *> newNodes = std::move(m_newNodes);
     std::set<KRNode *> modifiedNodes = std::move(m_modifiedNodes);
     m_newNodes.clear();
@@ -511,6 +541,10 @@ void KRScene::updateOctree(const KRViewport &viewport)
         if(light) {
             m_lights.insert(light);
         }
+        KRModel *model = dynamic_cast<KRModel *>(node);
+        if(model && model->isOccluder()) {
+            m_occluders.insert(model);
+        }
     }
     for(std::set<KRNode *>::iterator itr=modifiedNodes.begin(); itr != modifiedNodes.end(); itr++) {
         KRNode *node = *itr;
@@ -522,6 +556,14 @@ void KRScene::updateOctree(const KRViewport &viewport)
         } else if(!node->hasPhysics()) {
             m_physicsNodes.erase(node);
         }
+        KRModel *model = dynamic_cast<KRModel *>(node);
+        if(model) {
+            if(model->isOccluder()) {
+                m_occluders.insert(model);
+            } else {
+                m_occluders.erase(model);
+            }
+        }
     }
 }
 
@@ -551,6 +593,10 @@ void KRScene::buildOctreeForTheFirstTime()
         if(light) {
             m_lights.insert(light);
         }
+        KRModel *model = dynamic_cast<KRModel *>(node);
+        if(model && model->isOccluder()) {
+            m_occluders.insert(model);
+        }
     }
 }
 
@@ -578,6 +624,16 @@ AABB KRScene::getRootOctreeBounds()
     }
 }
 
+int KRScene::getOctreeRelocationCount()
+{
+    return m_nodeTree.getRelocationCount();
+}
+
+int KRScene::getOctreeStayCount()
+{
+    return m_nodeTree.getStayCount();
+}
+
 
 bool KRScene::lineCast(const Vector3 &v0, const Vector3 &v1, HitInfo &hitinfo, unsigned int layer_mask)
 {
@@ -594,6 +650,11 @@ bool KRScene::sphereCast(const Vector3 &v0, const Vector3 &v1, float radius, Hit
     return m_nodeTree.sphereCast(v0, v1, radius, hitinfo, layer_mask);
 }
 
+int KRScene::rayCast(const KROctree::ray_query *queries, HitInfo *hitinfo, int query_count)
+{
+    return m_nodeTree.rayCast(queries, hitinfo, query_count);
+}
+
 
 kraken_stream_level KRScene::getStreamLevel()
 {
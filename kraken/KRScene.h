@@ -43,6 +43,9 @@
 #include "KRAmbientZone.h"
 #include "KRReverbZone.h"
 #include "KROctree.h"
+#include "KROcclusionQueryPool.h"
+#include "KROcclusionCuller.h"
+#include "KRRenderQueue.h"
 class KRModel;
 class KRLight;
 
@@ -68,11 +71,21 @@ public:
     bool lineCast(const Vector3 &v0, const Vector3 &v1, HitInfo &hitinfo, unsigned int layer_mask);
     bool rayCast(const Vector3 &v0, const Vector3 &dir, HitInfo &hitinfo, unsigned int layer_mask);
     bool sphereCast(const Vector3 &v0, const Vector3 &v1, float radius, HitInfo &hitinfo, unsigned int layer_mask);
+    
+    // Cast a batch of rays, each with its own layer mask, spread across the worker threads.  hitinfo receives the nearest hit of each ray.  Returns the number of rays that hit.
+    int rayCast(const KROctree::ray_query *queries, HitInfo *hitinfo, int query_count);
 
     void renderFrame(GLint defaultFBO, float deltaTime, int width, int height);
     void render(KRCamera *pCamera, unordered_map<AABB, int> &visibleBounds, const KRViewport &viewport, KRNode::RenderPass renderPass, bool new_frame);
 
-    void render(KROctreeNode *pOctreeNode, unordered_map<AABB, int> &visibleBounds, KRCamera *pCamera, std::vector<KRPointLight *> &point_lights, std::vector<KRDirectionalLight *> &directional_lights, std::vector<KRSpotLight *>&spot_lights, const KRViewport &viewport, KRNode::RenderPass renderPass, std::vector<KROctreeNode *> &remainingOctrees, std::vector<KROctreeNode *> &remainingOctreesTestResults, std::vector<KROctreeNode *> &remainingOctreesTestResultsOnly, bool bOcclusionResultsPass, bool bOcclusionTestResultsOnly);
+    // pOctreeNode must already be within the viewport; its children are culled together before they are rendered
+    void render(KROctreeNode *pOctreeNode, unordered_map<AABB, int> &visibleBounds, KRCamera *pCamera, std::vector<KRPointLight *> &point_lights, std::vector<KRDirectionalLight *> &directional_lights, std::vector<KRSpotLight *>&spot_lights, const KRViewport &viewport, KRNode::RenderPass renderPass, bool bSoftwareOcclusion);
+    
+    // Issue the queued occlusion queries for the pass, testing against the depth of everything the pass has drawn
+    void renderOcclusionTests(KRCamera *pCamera, unordered_map<AABB, int> &visibleBounds, std::vector<KRPointLight *> &point_lights, std::vector<KRDirectionalLight *> &directional_lights, std::vector<KRSpotLight *>&spot_lights, const KRViewport &viewport, KRNode::RenderPass renderPass);
+    
+    // Rasterize the occluders within the viewport into the software occlusion buffer.  Passes rendered through the same viewport are then culled against it.
+    void rasterizeOccluders(const KRViewport &viewport);
 
     void updateOctree(const KRViewport &viewport);
     void buildOctreeForTheFirstTime();
@@ -85,11 +98,16 @@ public:
     void addDefaultLights();
 
     AABB getRootOctreeBounds();
+    int getOctreeRelocationCount(); // Modified nodes moved to another octree node by the last updateOctree()
+    int getOctreeStayCount(); // Modified nodes that stayed within the loose bounds of their octree node during the last updateOctree()
 
     std::set<KRAmbientZone *> &getAmbientZones();
     std::set<KRReverbZone *> &getReverbZones();
     std::set<KRLocator *> &getLocators();
     std::set<KRLight *> &getLights();
+    
+    // Opaque draws of the pass being rendered, submitted sorted by state
+    KRRenderQueue &getRenderQueue();
 
 private:
 
@@ -106,8 +124,13 @@ private:
     std::set<KRReverbZone *> m_reverbZoneNodes;
     std::set<KRLocator *> m_locatorNodes;
     std::set<KRLight *> m_lights;
+    std::set<KRModel *> m_occluders;
 
     KROctree m_nodeTree;
+    KROcclusionQueryPool m_occlusionQueries;
+    std::vector<AABB> m_occlusionTests; // Bounds reached during the pass being rendered that need an occlusion query, issued together once the pass has been drawn
+    KROcclusionCuller m_occlusionCuller;
+    KRRenderQueue m_renderQueue;
 
 public:
 
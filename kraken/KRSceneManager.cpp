@@ -65,7 +65,11 @@ KRScene *KRSceneManager::getScene(const std::string &name) {
     std::transform(lowerName.begin(), lowerName.end(),
                    lowerName.begin(), ::tolower);
     
-    static unordered_map<std::string, KRScene *>::iterator scene_itr = m_scenes.find(lowerName);
+    unordered_map<std::string, KRScene *>::iterator scene_itr = m_scenes.find(lowerName);
+    if(scene_itr == m_scenes.end() && getContext().getBundleManager()->loadPendingResource(lowerName, "krscene")) {
+        // Loaded the scene from an indexed bundle on first use
+        scene_itr = m_scenes.find(lowerName);
+    }
     if(scene_itr != m_scenes.end()) {
         return (*scene_itr).second;
     } else {
@@ -74,6 +78,9 @@ KRScene *KRSceneManager::getScene(const std::string &name) {
 }
 
 KRScene *KRSceneManager::getFirstScene() {
+    if(m_scenes.empty()) {
+        getContext().getBundleManager()->loadPendingResources("krscene");
+    }
     static unordered_map<std::string, KRScene *>::iterator scene_itr = m_scenes.begin();
     if(scene_itr != m_scenes.end()) {
         return (*scene_itr).second;
@@ -174,6 +174,12 @@ KRShader::KRShader(KRContext &context, char *szKey, std::string options, std::st
         GLDEBUG(glBindAttribLocation(m_iProgram, KRMesh::KRENGINE_ATTRIB_TEXUVB, "vertex_lightmap_uv"));
         GLDEBUG(glBindAttribLocation(m_iProgram, KRMesh::KRENGINE_ATTRIB_BONEINDEXES, "bone_indexes"));
         GLDEBUG(glBindAttribLocation(m_iProgram, KRMesh::KRENGINE_ATTRIB_BONEWEIGHTS, "bone_weights"));
+        GLDEBUG(glBindAttribLocation(m_iProgram, KRMesh::KRENGINE_ATTRIB_INSTANCE_MODEL_MATRIX, "instance_model_matrix"));
+        
+#if KRENGINE_PROGRAM_BINARY_CACHE
+        // Keep the linked binary available for KRShaderManager to cache
+        GLDEBUG(glProgramParameteri(m_iProgram, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE));
+#endif
         
         // Link program.
         GLDEBUG(glLinkProgram(m_iProgram));
@@ -199,12 +205,7 @@ KRShader::KRShader(KRContext &context, char *szKey, std::string options, std::st
             GLDEBUG(glDeleteProgram(m_iProgram));
             m_iProgram = 0;
         } else {
-        
-            // Get uniform locations
-            for(int i=0; i < KRENGINE_NUM_UNIFORMS; i++ ){
-                GLDEBUG(m_uniforms[i] = glGetUniformLocation(m_iProgram, KRENGINE_UNIFORM_NAMES[i]));
-                m_uniform_value_index[i] = -1;
-            }
+            getUniformLocations();
         }
         
     } catch(...) {
@@ -231,6 +232,28 @@ KRShader::KRShader(KRContext &context, char *szKey, std::string options, std::st
 	}
 }
 
+KRShader::KRShader(KRContext &context, char *szKey, GLenum binary_format, const void *binary, GLsizei binary_length) : KRContextObject(context)
+{
+    strcpy(m_szKey, szKey);
+    m_iProgram = 0;
+    
+#if KRENGINE_PROGRAM_BINARY_CACHE
+    GLDEBUG(m_iProgram = glCreateProgram());
+    GLDEBUG(glProgramBinary(m_iProgram, binary_format, binary, binary_length));
+    
+    // The attribute locations were bound when the cached program was first linked
+    GLint link_success = GL_FALSE;
+    GLDEBUG(glGetProgramiv(m_iProgram, GL_LINK_STATUS, &link_success));
+    if(link_success != GL_TRUE) {
+        // Expected after a driver update; the caller compiles the program again
+        GLDEBUG(glDeleteProgram(m_iProgram));
+        m_iProgram = 0;
+    } else {
+        getUniformLocations();
+    }
+#endif
+}
+
 KRShader::~KRShader() {
     if(m_iProgram) {
         GLDEBUG(glDeleteProgram(m_iProgram));
@@ -242,6 +265,12 @@ KRShader::~KRShader() {
 
 void KRShader::setUniform(int location, float value)
 {
+#if KRENGINE_UNIFORM_BUFFERS
+    if(m_uniform_block[location] != -1) {
+        setUniformBlockValue(location, &value, sizeof(GLfloat));
+        return;
+    }
+#endif
     if(m_uniforms[location] != -1) {
         int value_index = m_uniform_value_index[location];
         bool needs_update = true;
@@ -255,11 +284,18 @@ void KRShader::setUniform(int location, float value)
         }
         if(needs_update) {
             GLDEBUG(glUniform1f(m_uniforms[location], value));
+            getContext().getShaderManager()->log_uniform_upload(sizeof(GLfloat));
         }
     }
 }
 void KRShader::setUniform(int location, int value)
 {
+#if KRENGINE_UNIFORM_BUFFERS
+    if(m_uniform_block[location] != -1) {
+        setUniformBlockValue(location, &value, sizeof(GLint));
+        return;
+    }
+#endif
     if(m_uniforms[location] != -1) {
         int value_index = m_uniform_value_index[location];
         bool needs_update = true;
@@ -273,12 +309,20 @@ void KRShader::setUniform(int location, int value)
         }
         if(needs_update) {
             GLDEBUG(glUniform1i(m_uniforms[location], value));
+            getContext().getShaderManager()->log_uniform_upload(sizeof(GLint));
         }
     }
 }
 
 void KRShader::setUniform(int location, const Vector2 &value)
 {
+#if KRENGINE_UNIFORM_BUFFERS
+    if(m_uniform_block[location] != -1) {
+        GLfloat v[2] = {value.x, value.y};
+        setUniformBlockValue(location, v, sizeof(v));
+        return;
+    }
+#endif
     if(m_uniforms[location] != -1) {
         int value_index = m_uniform_value_index[location];
         bool needs_update = true;
@@ -292,11 +336,19 @@ void KRShader::setUniform(int location, const Vector2 &value)
         }
         if(needs_update) {
             GLDEBUG(glUniform2f(m_uniforms[location], value.x, value.y));
+            getContext().getShaderManager()->log_uniform_upload(sizeof(GLfloat) * 2);
         }
     }
 }
 void KRShader::setUniform(int location, const Vector3 &value)
 {
+#if KRENGINE_UNIFORM_BUFFERS
+    if(m_uniform_block[location] != -1) {
+        GLfloat v[3] = {value.x, value.y, value.z};
+        setUniformBlockValue(location, v, sizeof(v));
+        return;
+    }
+#endif
     if(m_uniforms[location] != -1) {
         int value_index = m_uniform_value_index[location];
         bool needs_update = true;
@@ -310,11 +362,19 @@ void KRShader::setUniform(int location, const Vector3 &value)
         }
         if(needs_update) {
             GLDEBUG(glUniform3f(m_uniforms[location], value.x, value.y, value.z));
+            getContext().getShaderManager()->log_uniform_upload(sizeof(GLfloat) * 3);
         }
     }
 }
 void KRShader::setUniform(int location, const Vector4 &value)
 {
+#if KRENGINE_UNIFORM_BUFFERS
+    if(m_uniform_block[location] != -1) {
+        GLfloat v[4] = {value.x, value.y, value.z, value.w};
+        setUniformBlockValue(location, v, sizeof(v));
+        return;
+    }
+#endif
     if(m_uniforms[location] != -1) {
         int value_index = m_uniform_value_index[location];
         bool needs_update = true;
@@ -328,12 +388,19 @@ void KRShader::setUniform(int location, const Vector4 &value)
         }
         if(needs_update) {
             GLDEBUG(glUniform4f(m_uniforms[location], value.x, value.y, value.z, value.w));
+            getContext().getShaderManager()->log_uniform_upload(sizeof(GLfloat) * 4);
         }
     }
 }
 
 void KRShader::setUniform(int location, const Matrix4 &value)
 {
+#if KRENGINE_UNIFORM_BUFFERS
+    if(m_uniform_block[location] != -1) {
+        setUniformBlockValue(location, value.c, sizeof(GLfloat) * 16);
+        return;
+    }
+#endif
     if(m_uniforms[location] != -1) {
         int value_index = m_uniform_value_index[location];
         bool needs_update = true;
@@ -347,10 +414,30 @@ void KRShader::setUniform(int location, const Matrix4 &value)
         }
         if(needs_update) {
             GLDEBUG(glUniformMatrix4fv(m_uniforms[location], 1, GL_FALSE, value.c));
+            getContext().getShaderManager()->log_uniform_upload(sizeof(GLfloat) * 16);
         }
     }
 }
 
+void KRShader::setUniform(int location, const std::vector<Matrix4> &values)
+{
+    if(values.empty()) {
+        return;
+    }
+    // Matrix4 is stored as 16 packed floats, so the array is uploaded in place.  Its stride also matches the std140 layout of a mat4 array.
+    size_t size = sizeof(GLfloat) * 16 * values.size();
+#if KRENGINE_UNIFORM_BUFFERS
+    if(m_uniform_block[location] != -1) {
+        setUniformBlockValue(location, values[0].c, size);
+        return;
+    }
+#endif
+    if(m_uniforms[location] != -1) {
+        GLDEBUG(glUniformMatrix4fv(m_uniforms[location], (GLsizei)values.size(), GL_FALSE, values[0].c));
+        getContext().getShaderManager()->log_uniform_upload(size);
+    }
+}
+
 bool KRShader::bind(KRCamera &camera, const KRViewport &viewport, const Matrix4 &matModel, const std::vector<KRPointLight *> &point_lights, const std::vector<KRDirectionalLight *> &directional_lights, const std::vector<KRSpotLight *>&spot_lights, const KRNode::RenderPass &renderPass, const Vector3 &rim_color, float rim_power, const Vector4 &fade_color) {
     if(m_iProgram == 0) {
         return false;
@@ -360,6 +447,7 @@ bool KRShader::bind(KRCamera &camera, const KRViewport &viewport, const Matrix4
     if(getContext().getShaderManager()->m_active_shader != this) {
         getContext().getShaderManager()->m_active_shader = this;
         GLDEBUG(glUseProgram(m_iProgram));
+        getContext().getMeshManager()->log_bind(KRMeshManager::BIND_SHADER);
         shander_changed = true;
     }
     
@@ -377,7 +465,7 @@ bool KRShader::bind(KRCamera &camera, const KRViewport &viewport, const Matrix4
             KRDirectionalLight *directional_light = (*light_itr);
             if(light_directional_count == 0) {
                 int cShadowBuffers = directional_light->getShadowBufferCount();
-                if(m_uniforms[KRENGINE_UNIFORM_SHADOWTEXTURE1] != -1 && cShadowBuffers > 0) {
+                if(hasUniform(KRENGINE_UNIFORM_SHADOWTEXTURE1) && cShadowBuffers > 0) {
                     if(m_pContext->getTextureManager()->selectTexture(GL_TEXTURE_2D, 3, directional_light->getShadowTextures()[0])) {
                         GLDEBUG(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
                         GLDEBUG(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
@@ -387,7 +475,7 @@ bool KRShader::bind(KRCamera &camera, const KRViewport &viewport, const Matrix4
                     m_pContext->getTextureManager()->_setWrapModeT(3, GL_CLAMP_TO_EDGE);
                 }
                 
-                if(m_uniforms[KRENGINE_UNIFORM_SHADOWTEXTURE2] != -1 && cShadowBuffers > 1 && camera.settings.m_cShadowBuffers > 1) {
+                if(hasUniform(KRENGINE_UNIFORM_SHADOWTEXTURE2) && cShadowBuffers > 1 && camera.settings.m_cShadowBuffers > 1) {
                     if(m_pContext->getTextureManager()->selectTexture(GL_TEXTURE_2D, 4, directional_light->getShadowTextures()[1])) {
                         GLDEBUG(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
                         GLDEBUG(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
@@ -396,7 +484,7 @@ bool KRShader::bind(KRCamera &camera, const KRViewport &viewport, const Matrix4
                     m_pContext->getTextureManager()->_setWrapModeT(4, GL_CLAMP_TO_EDGE);
                 }
                 
-                if(m_uniforms[KRENGINE_UNIFORM_SHADOWTEXTURE3] != -1 && cShadowBuffers > 2 && camera.settings.m_cShadowBuffers > 2) {
+                if(hasUniform(KRENGINE_UNIFORM_SHADOWTEXTURE3) && cShadowBuffers > 2 && camera.settings.m_cShadowBuffers > 2) {
                     if(m_pContext->getTextureManager()->selectTexture(GL_TEXTURE_2D, 5, directional_light->getShadowTextures()[2])) {
                         GLDEBUG(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
                         GLDEBUG(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
@@ -412,7 +500,7 @@ bool KRShader::bind(KRCamera &camera, const KRViewport &viewport, const Matrix4
                     setUniform(KRENGINE_UNIFORM_SHADOWMVP1 + iShadow, matModel * directional_light->getShadowViewports()[iShadow].getViewProjectionMatrix() * matBias);
                 }
                 
-                if(m_uniforms[KRENGINE_UNIFORM_LIGHT_DIRECTION_MODEL_SPACE] != -1) {
+                if(hasUniform(KRENGINE_UNIFORM_LIGHT_DIRECTION_MODEL_SPACE)) {
                     Matrix4 inverseModelMatrix = matModel;
                     inverseModelMatrix.invert();
                     
@@ -432,38 +520,38 @@ bool KRShader::bind(KRCamera &camera, const KRViewport &viewport, const Matrix4
     
 
     
-    if(m_uniforms[KRENGINE_UNIFORM_CAMERAPOS_MODEL_SPACE] != -1) {
+    if(hasUniform(KRENGINE_UNIFORM_CAMERAPOS_MODEL_SPACE)) {
         Matrix4 inverseModelMatrix = matModel;
         inverseModelMatrix.invert();
         
-        if(m_uniforms[KRENGINE_UNIFORM_CAMERAPOS_MODEL_SPACE] != -1) {
+        if(hasUniform(KRENGINE_UNIFORM_CAMERAPOS_MODEL_SPACE)) {
             // Transform location of camera to object space for calculation of specular halfVec
             Vector3 cameraPosObject = Matrix4::Dot(inverseModelMatrix, viewport.getCameraPosition());
             setUniform(KRENGINE_UNIFORM_CAMERAPOS_MODEL_SPACE, cameraPosObject);
         }
     }
     
-    if(m_uniforms[KRENGINE_UNIFORM_MVP] != -1 || m_uniforms[KRShader::KRENGINE_UNIFORM_INVMVP] != -1) {
+    if(hasUniform(KRENGINE_UNIFORM_MVP) || hasUniform(KRENGINE_UNIFORM_INVMVP)) {
         // Bind our modelmatrix variable to be a uniform called mvpmatrix in our shaderprogram
         Matrix4 mvpMatrix = matModel * viewport.getViewProjectionMatrix();
         setUniform(KRENGINE_UNIFORM_MVP, mvpMatrix);
         
-        if(m_uniforms[KRShader::KRENGINE_UNIFORM_INVMVP] != -1) {
+        if(hasUniform(KRENGINE_UNIFORM_INVMVP)) {
             setUniform(KRShader::KRENGINE_UNIFORM_INVMVP, Matrix4::Invert(mvpMatrix));
         }
     }
     
-    if(m_uniforms[KRShader::KRENGINE_UNIFORM_VIEW_SPACE_MODEL_ORIGIN] != -1 || m_uniforms[KRENGINE_UNIFORM_MODEL_VIEW_INVERSE_TRANSPOSE] != -1 || m_uniforms[KRShader::KRENGINE_UNIFORM_MODEL_VIEW] != -1) {
+    if(hasUniform(KRENGINE_UNIFORM_VIEW_SPACE_MODEL_ORIGIN) || hasUniform(KRENGINE_UNIFORM_MODEL_VIEW_INVERSE_TRANSPOSE) || hasUniform(KRENGINE_UNIFORM_MODEL_VIEW)) {
         Matrix4 matModelView = matModel * viewport.getViewMatrix();
         setUniform(KRENGINE_UNIFORM_MODEL_VIEW, matModelView);
         
         
-        if(m_uniforms[KRShader::KRENGINE_UNIFORM_VIEW_SPACE_MODEL_ORIGIN] != -1) {
+        if(hasUniform(KRENGINE_UNIFORM_VIEW_SPACE_MODEL_ORIGIN)) {
             Vector3 view_space_model_origin = Matrix4::Dot(matModelView, Vector3::Zero()); // Origin point of model space is the light source position.  No perspective, so no w divide required
             setUniform(KRENGINE_UNIFORM_VIEW_SPACE_MODEL_ORIGIN, view_space_model_origin);
         }
         
-        if(m_uniforms[KRENGINE_UNIFORM_MODEL_VIEW_INVERSE_TRANSPOSE] != -1) {
+        if(hasUniform(KRENGINE_UNIFORM_MODEL_VIEW_INVERSE_TRANSPOSE)) {
             Matrix4 matModelViewInverseTranspose = matModelView;
             matModelViewInverseTranspose.transpose();
             matModelViewInverseTranspose.invert();
@@ -471,18 +559,18 @@ bool KRShader::bind(KRCamera &camera, const KRViewport &viewport, const Matrix4
         }
     }
     
-    if(m_uniforms[KRENGINE_UNIFORM_MODEL_INVERSE_TRANSPOSE] != -1) {
+    if(hasUniform(KRENGINE_UNIFORM_MODEL_INVERSE_TRANSPOSE)) {
         Matrix4 matModelInverseTranspose = matModel;
         matModelInverseTranspose.transpose();
         matModelInverseTranspose.invert();
         setUniform(KRENGINE_UNIFORM_MODEL_INVERSE_TRANSPOSE, matModelInverseTranspose);
     }
     
-    if(m_uniforms[KRShader::KRENGINE_UNIFORM_INVP] != -1) {
+    if(hasUniform(KRENGINE_UNIFORM_INVP)) {
         setUniform(KRENGINE_UNIFORM_INVP, viewport.getInverseProjectionMatrix());
     }
     
-    if(m_uniforms[KRShader::KRENGINE_UNIFORM_INVMVP_NO_TRANSLATE] != -1) {
+    if(hasUniform(KRENGINE_UNIFORM_INVMVP_NO_TRANSLATE)) {
         Matrix4 matInvMVPNoTranslate = matModel * viewport.getViewMatrix();;
         // Remove the translation
         matInvMVPNoTranslate.getPointer()[3] = 0;
@@ -498,11 +586,11 @@ bool KRShader::bind(KRCamera &camera, const KRViewport &viewport, const Matrix4
     }
     
     setUniform(KRENGINE_UNIFORM_MODEL_MATRIX, matModel);
-    if(m_uniforms[KRENGINE_UNIFORM_PROJECTION_MATRIX] != -1) {
+    if(hasUniform(KRENGINE_UNIFORM_PROJECTION_MATRIX)) {
         setUniform(KRENGINE_UNIFORM_PROJECTION_MATRIX, viewport.getProjectionMatrix());
     }
     
-    if(m_uniforms[KRENGINE_UNIFORM_VIEWPORT] != -1) {
+    if(hasUniform(KRENGINE_UNIFORM_VIEWPORT)) {
         setUniform(KRENGINE_UNIFORM_VIEWPORT, Vector4::Create(
                 (GLfloat)0.0,
                 (GLfloat)0.0,
@@ -512,7 +600,7 @@ bool KRShader::bind(KRCamera &camera, const KRViewport &viewport, const Matrix4
         );
     }
     
-    if(m_uniforms[KRENGINE_UNIFORM_VIEWPORT_DOWNSAMPLE] != -1) {
+    if(hasUniform(KRENGINE_UNIFORM_VIEWPORT_DOWNSAMPLE)) {
         setUniform(KRENGINE_UNIFORM_VIEWPORT_DOWNSAMPLE, camera.getDownsample());
     }
     
@@ -529,13 +617,13 @@ bool KRShader::bind(KRCamera &camera, const KRViewport &viewport, const Matrix4
     setUniform(KRENGINE_UNIFORM_FOG_DENSITY, camera.settings.fog_density);
     setUniform(KRENGINE_UNIFORM_FOG_COLOR, camera.settings.fog_color);
     
-    if(m_uniforms[KRENGINE_UNIFORM_FOG_SCALE] != -1) {
+    if(hasUniform(KRENGINE_UNIFORM_FOG_SCALE)) {
         setUniform(KRENGINE_UNIFORM_FOG_SCALE, 1.0f / (camera.settings.fog_far - camera.settings.fog_near));
     }
-    if(m_uniforms[KRENGINE_UNIFORM_DENSITY_PREMULTIPLIED_EXPONENTIAL] != -1) {
+    if(hasUniform(KRENGINE_UNIFORM_DENSITY_PREMULTIPLIED_EXPONENTIAL)) {
         setUniform(KRENGINE_UNIFORM_DENSITY_PREMULTIPLIED_EXPONENTIAL, -camera.settings.fog_density * 1.442695f); // -fog_density / log(2)
     }
-    if(m_uniforms[KRENGINE_UNIFORM_DENSITY_PREMULTIPLIED_SQUARED] != -1) {
+    if(hasUniform(KRENGINE_UNIFORM_DENSITY_PREMULTIPLIED_SQUARED)) {
         setUniform(KRENGINE_UNIFORM_DENSITY_PREMULTIPLIED_SQUARED, (float)(-camera.settings.fog_density * camera.settings.fog_density * 1.442695)); // -fog_density * fog_density / log(2)
     }
     
@@ -594,3 +682,94 @@ bool KRShader::bind(KRCamera &camera, const KRViewport &viewport, const Matrix4
 const char *KRShader::getKey() const {
     return m_szKey;
 }
+
+bool KRShader::isLinked() const {
+    return m_iProgram != 0;
+}
+
+void KRShader::getUniformLocations()
+{
+    for(int i=0; i < KRENGINE_NUM_UNIFORMS; i++ ){
+        GLDEBUG(m_uniforms[i] = glGetUniformLocation(m_iProgram, KRENGINE_UNIFORM_NAMES[i]));
+        m_uniform_value_index[i] = -1;
+    }
+#if KRENGINE_UNIFORM_BUFFERS
+    getUniformBlocks();
+#endif
+}
+
+bool KRShader::hasUniform(int location) const
+{
+#if KRENGINE_UNIFORM_BUFFERS
+    if(m_uniform_block[location] != -1) {
+        return true;
+    }
+#endif
+    return m_uniforms[location] != -1;
+}
+
+#if KRENGINE_UNIFORM_BUFFERS
+void KRShader::getUniformBlocks()
+{
+    KRShaderManager *shaderManager = getContext().getShaderManager();
+    
+    GLuint block_indexes[KRShaderManager::UNIFORM_BLOCK_TYPE_COUNT];
+    for(int block=0; block < KRShaderManager::UNIFORM_BLOCK_TYPE_COUNT; block++) {
+        GLDEBUG(block_indexes[block] = glGetUniformBlockIndex(m_iProgram, KRShaderManager::UNIFORM_BLOCK_NAMES[block]));
+        if(block_indexes[block] != GL_INVALID_INDEX) {
+            // Every program reads a block type from the binding point of the same number, where KRShaderManager binds the shared buffer
+            GLint block_size = 0;
+            GLDEBUG(glGetActiveUniformBlockiv(m_iProgram, block_indexes[block], GL_UNIFORM_BLOCK_DATA_SIZE, &block_size));
+            GLDEBUG(glUniformBlockBinding(m_iProgram, block_indexes[block], block));
+            shaderManager->reserveUniformBlock((KRShaderManager::uniform_block_type)block, block_size);
+        }
+    }
+    
+    for(int i=0; i < KRENGINE_NUM_UNIFORMS; i++) {
+        m_uniform_block[i] = -1;
+        m_uniform_offset[i] = -1;
+        if(m_uniforms[i] != -1) {
+            continue; // Uniforms in the default block have a location
+        }
+        GLuint uniform_index = GL_INVALID_INDEX;
+        GLDEBUG(glGetUniformIndices(m_iProgram, 1, &KRENGINE_UNIFORM_NAMES[i], &uniform_index));
+        if(uniform_index == GL_INVALID_INDEX) {
+            continue;
+        }
+        GLint block_index = -1;
+        GLint offset = -1;
+        GLDEBUG(glGetActiveUniformsiv(m_iProgram, 1, &uniform_index, GL_UNIFORM_BLOCK_INDEX, &block_index));
+        GLDEBUG(glGetActiveUniformsiv(m_iProgram, 1, &uniform_index, GL_UNIFORM_OFFSET, &offset));
+        for(int block=0; block < KRShaderManager::UNIFORM_BLOCK_TYPE_COUNT; block++) {
+            if(block_indexes[block] != GL_INVALID_INDEX && (GLuint)block_index == block_indexes[block]) {
+                m_uniform_block[i] = block;
+                m_uniform_offset[i] = offset;
+            }
+        }
+    }
+}
+
+void KRShader::setUniformBlockValue(int location, const void *value, size_t size)
+{
+    getContext().getShaderManager()->setUniformBlockValue((KRShaderManager::uniform_block_type)m_uniform_block[location], m_uniform_offset[location], value, size);
+}
+#endif
+
+#if KRENGINE_PROGRAM_BINARY_CACHE
+bool KRShader::getProgramBinary(GLenum &binary_format, std::vector<__uint8_t> &binary)
+{
+    if(m_iProgram == 0) {
+        return false;
+    }
+    GLint binary_length = 0;
+    GLDEBUG(glGetProgramiv(m_iProgram, GL_PROGRAM_BINARY_LENGTH, &binary_length));
+    if(binary_length <= 0) {
+        return false;
+    }
+    binary.resize(binary_length);
+    GLsizei length = 0;
+    GLDEBUG(glGetProgramBinary(m_iProgram, binary_length, &length, &binary_format, &binary[0]));
+    binary.resize(length);
+    return length > 0;
+}
+#endif
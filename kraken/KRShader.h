@@ -43,8 +43,17 @@
 class KRShader  : public KRContextObject {
 public:
     KRShader(KRContext &context, char *szKey, std::string options, std::string vertShaderSource, const std::string fragShaderSource);
+    
+    // Load a program previously returned by getProgramBinary().  isLinked() is false if the driver rejects the binary.
+    KRShader(KRContext &context, char *szKey, GLenum binary_format, const void *binary, GLsizei binary_length);
     virtual ~KRShader();
     const char *getKey() const;
+    bool isLinked() const;
+    
+#if KRENGINE_PROGRAM_BINARY_CACHE
+    // Retrieve the linked program, to be cached on disk.  Returns false if the driver does not provide it.
+    bool getProgramBinary(GLenum &binary_format, std::vector<__uint8_t> &binary);
+#endif
     
     bool bind(KRCamera &camera, const KRViewport &viewport, const Matrix4 &matModel, const std::vector<KRPointLight *> &point_lights, const std::vector<KRDirectionalLight *> &directional_lights, const std::vector<KRSpotLight *>&spot_lights, const KRNode::RenderPass &renderPass, const Vector3 &rim_color, float rim_power, const Vector4 &fade_color);
     
@@ -153,9 +162,23 @@ public:
     void setUniform(int location, const Vector3 &value);
     void setUniform(int location, const Vector4 &value);
     void setUniform(int location, const Matrix4 &value);
+    void setUniform(int location, const std::vector<Matrix4> &values);
+    
+    // True if the program has the uniform, either at a location of its own or as a member of a shared uniform block
+    bool hasUniform(int location) const;
     
 private:
     GLuint m_iProgram;
+    
+#if KRENGINE_UNIFORM_BUFFERS
+    int m_uniform_block[KRENGINE_NUM_UNIFORMS]; // KRShaderManager::uniform_block_type holding the uniform, or -1
+    GLint m_uniform_offset[KRENGINE_NUM_UNIFORMS]; // Byte offset of the uniform within its block
+    
+    void getUniformBlocks();
+    void setUniformBlockValue(int location, const void *value, size_t size);
+#endif
+    
+    void getUniformLocations();
 };
 
 #endif
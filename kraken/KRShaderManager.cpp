@@ -36,19 +36,149 @@
 #include "KRDirectionalLight.h"
 #include "KRSpotLight.h"
 #include "KRPointLight.h"
+#include "KRRenderSettings.h"
+
+#include <mutex>
 
 using namespace std;
 
+// Shader names registered by GetShaderNameID, shared by the shader managers of all contexts
+static std::mutex s_shaderNamesMutex;
+static unordered_map<std::string, int> s_shaderNameIDs;
+static std::vector<std::string> s_shaderNames;
+
+#if KRENGINE_PROGRAM_BINARY_CACHE
+#define KRENGINE_PROGRAM_CACHE_MAGIC "KRPROG1" // Change when the attribute bindings in KRShader change
+#define KRENGINE_PROGRAM_CACHE_INDEX "programs.krindex"
+
+// 64-bit FNV-1a
+static __uint64_t HashData(const void *data, size_t size, __uint64_t hash = 0xcbf29ce484222325ULL)
+{
+    const unsigned char *p = (const unsigned char *)data;
+    for(size_t i=0; i < size; i++) {
+        hash ^= p[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+#endif
+
 KRShaderManager::KRShaderManager(KRContext &context) : KRContextObject(context) {
     m_active_shader = NULL;
+    m_lastSettingsID = -1;
+#if KRENGINE_PROGRAM_BINARY_CACHE
+    m_driverHash = 0;
+#endif
+#if KRENGINE_UNIFORM_BUFFERS
+    for(int i=0; i < UNIFORM_BLOCK_TYPE_COUNT; i++) {
+        m_uniformBlocks[i].buffer_handle = -1;
+        m_uniformBlocks[i].buffer_size = 0;
+        m_uniformBlocks[i].dirty = false;
+    }
+#endif
+    m_uniformUploadsThisFrame = 0;
+    m_uniformBytesThisFrame = 0;
+    m_uniformUploadsLastFrame = 0;
+    m_uniformBytesLastFrame = 0;
 }
 
 KRShaderManager::~KRShaderManager() {
+#if KRENGINE_PROGRAM_BINARY_CACHE
+    releaseProgramBinaries();
+#endif
+#if KRENGINE_UNIFORM_BUFFERS
+    for(int i=0; i < UNIFORM_BLOCK_TYPE_COUNT; i++) {
+        if(m_uniformBlocks[i].buffer_handle != -1) {
+            GLDEBUG(glDeleteBuffers(1, &m_uniformBlocks[i].buffer_handle));
+            m_uniformBlocks[i].buffer_handle = -1;
+        }
+    }
+#endif
+}
+
+void KRShaderManager::startFrame(float deltaTime)
+{
+    m_uniformUploadsLastFrame = m_uniformUploadsThisFrame;
+    m_uniformBytesLastFrame = m_uniformBytesThisFrame;
+    m_uniformUploadsThisFrame = 0;
+    m_uniformBytesThisFrame = 0;
+}
+
+void KRShaderManager::log_uniform_upload(long size)
+{
+    m_uniformUploadsThisFrame++;
+    m_uniformBytesThisFrame += size;
+}
+
+long KRShaderManager::getUniformUploadsLastFrame()
+{
+    return m_uniformUploadsLastFrame;
+}
+
+long KRShaderManager::getUniformBytesLastFrame()
+{
+    return m_uniformBytesLastFrame;
+}
+
+#if KRENGINE_UNIFORM_BUFFERS
+const char *KRShaderManager::UNIFORM_BLOCK_NAMES[] = {
+    "frame_uniforms", // UNIFORM_BLOCK_FRAME
+    "material_uniforms", // UNIFORM_BLOCK_MATERIAL
+    "object_uniforms", // UNIFORM_BLOCK_OBJECT
+    "bone_uniforms" // UNIFORM_BLOCK_BONES
+};
+
+void KRShaderManager::reserveUniformBlock(uniform_block_type block, GLint size)
+{
+    uniform_block &b = m_uniformBlocks[block];
+    if(size <= b.buffer_size) {
+        return;
+    }
+    if(b.buffer_handle == -1) {
+        GLDEBUG(glGenBuffers(1, &b.buffer_handle));
+    }
+    b.buffer_size = size;
+    b.data.resize(size, 0);
+    GLDEBUG(glBindBuffer(GL_UNIFORM_BUFFER, b.buffer_handle));
+    GLDEBUG(glBufferData(GL_UNIFORM_BUFFER, b.buffer_size, &b.data[0], GL_STREAM_DRAW));
+    GLDEBUG(glBindBufferBase(GL_UNIFORM_BUFFER, block, b.buffer_handle));
+}
+
+void KRShaderManager::setUniformBlockValue(uniform_block_type block, GLint offset, const void *value, size_t size)
+{
+    uniform_block &b = m_uniformBlocks[block];
+    assert(offset >= 0 && offset + (GLsizeiptr)size <= b.buffer_size);
+    __uint8_t *member = &b.data[offset];
+    if(memcmp(member, value, size) != 0) {
+        memcpy(member, value, size);
+        b.dirty = true;
+    }
+}
+#endif
 
+void KRShaderManager::uploadUniformBlocks()
+{
+#if KRENGINE_UNIFORM_BUFFERS
+    for(int i=0; i < UNIFORM_BLOCK_TYPE_COUNT; i++) {
+        uniform_block &b = m_uniformBlocks[i];
+        if(b.dirty) {
+            // Respecifying the whole buffer orphans the contents still being read by earlier draws, rather than waiting for them
+            GLDEBUG(glBindBuffer(GL_UNIFORM_BUFFER, b.buffer_handle));
+            GLDEBUG(glBufferData(GL_UNIFORM_BUFFER, b.buffer_size, &b.data[0], GL_STREAM_DRAW));
+            log_uniform_upload(b.buffer_size);
+            b.dirty = false;
+        }
+    }
+#endif
 }
 
 
-KRShader *KRShaderManager::getShader(const std::string &shader_name, KRCamera *pCamera, const std::vector<KRPointLight *> &point_lights, const std::vector<KRDirectionalLight *> &directional_lights, const std::vector<KRSpotLight *>&spot_lights, int bone_count, bool bDiffuseMap, bool bNormalMap, bool bSpecMap, bool bReflectionMap, bool bReflectionCubeMap, bool bLightMap, bool bDiffuseMapScale,bool bSpecMapScale, bool bNormalMapScale, bool bReflectionMapScale, bool bDiffuseMapOffset, bool bSpecMapOffset, bool bNormalMapOffset, bool bReflectionMapOffset, bool bAlphaTest, bool bAlphaBlend, KRNode::RenderPass renderPass, bool bRimColor) {
+KRShader *KRShaderManager::getShader(const std::string &shader_name, KRCamera *pCamera, const std::vector<KRPointLight *> &point_lights, const std::vector<KRDirectionalLight *> &directional_lights, const std::vector<KRSpotLight *>&spot_lights, int bone_count, bool bDiffuseMap, bool bNormalMap, bool bSpecMap, bool bReflectionMap, bool bReflectionCubeMap, bool bLightMap, bool bDiffuseMapScale,bool bSpecMapScale, bool bNormalMapScale, bool bReflectionMapScale, bool bDiffuseMapOffset, bool bSpecMapOffset, bool bNormalMapOffset, bool bReflectionMapOffset, bool bAlphaTest, bool bAlphaBlend, KRNode::RenderPass renderPass, bool bRimColor, bool bInstanced)
+{
+    return getShader(GetShaderNameID(shader_name), pCamera, point_lights, directional_lights, spot_lights, bone_count, bDiffuseMap, bNormalMap, bSpecMap, bReflectionMap, bReflectionCubeMap, bLightMap, bDiffuseMapScale, bSpecMapScale, bNormalMapScale, bReflectionMapScale, bDiffuseMapOffset, bSpecMapOffset, bNormalMapOffset, bReflectionMapOffset, bAlphaTest, bAlphaBlend, renderPass, bRimColor, bInstanced);
+}
+
+KRShader *KRShaderManager::getShader(int shader_name_id, KRCamera *pCamera, const std::vector<KRPointLight *> &point_lights, const std::vector<KRDirectionalLight *> &directional_lights, const std::vector<KRSpotLight *>&spot_lights, int bone_count, bool bDiffuseMap, bool bNormalMap, bool bSpecMap, bool bReflectionMap, bool bReflectionCubeMap, bool bLightMap, bool bDiffuseMapScale,bool bSpecMapScale, bool bNormalMapScale, bool bReflectionMapScale, bool bDiffuseMapOffset, bool bSpecMapOffset, bool bNormalMapOffset, bool bReflectionMapOffset, bool bAlphaTest, bool bAlphaBlend, KRNode::RenderPass renderPass, bool bRimColor, bool bInstanced) {
     
     int iShadowQuality = 0; // FINDME - HACK - Placeholder code, need to iterate through lights and dynamically build shader
 
@@ -72,67 +202,43 @@ KRShader *KRShaderManager::getShader(const std::string &shader_name, KRCamera *p
     
     bool bFadeColorEnabled = pCamera->getFadeColor().w >= 0.0f;
     
-    std::pair<std::string, std::vector<int> > key;
-    key.first = shader_name;
-    key.second.push_back(light_directional_count);
-    key.second.push_back(light_point_count);
-    key.second.push_back(light_spot_count);
-    key.second.push_back(pCamera->settings.fog_type);
-    key.second.push_back(pCamera->settings.bEnablePerPixel);
-    key.second.push_back(bAlphaTest);
-    key.second.push_back(bAlphaBlend);
-    key.second.push_back(bDiffuseMap);
-    key.second.push_back(bNormalMap);
-    key.second.push_back(bSpecMap);
-    key.second.push_back(bReflectionMap);
-    key.second.push_back(bone_count);
-    key.second.push_back(bSpecMap);
-    key.second.push_back(bReflectionMap);
-    key.second.push_back(bReflectionCubeMap);
-    key.second.push_back(pCamera->settings.bDebugPSSM);
-    key.second.push_back(iShadowQuality);
-    key.second.push_back(pCamera->settings.bEnableAmbient);
-    key.second.push_back(pCamera->settings.bEnableDiffuse);
-    key.second.push_back(pCamera->settings.bEnableSpecular);
-    key.second.push_back(bLightMap);
-    key.second.push_back(bDiffuseMapScale);
-    key.second.push_back(bSpecMapScale);
-    key.second.push_back(bReflectionMapScale);
-    key.second.push_back(bNormalMapScale);
-    key.second.push_back(bDiffuseMapOffset);
-    key.second.push_back(bSpecMapOffset);
-    key.second.push_back(bReflectionMapOffset);
-    key.second.push_back(bNormalMapOffset);
-    key.second.push_back(pCamera->settings.volumetric_environment_enable);
-    key.second.push_back(pCamera->settings.volumetric_environment_downsample != 0);
-    key.second.push_back(renderPass);
-    key.second.push_back(pCamera->settings.dof_quality);
-    key.second.push_back(pCamera->settings.bEnableFlash);
-    key.second.push_back(pCamera->settings.bEnableVignette);
-    key.second.push_back(pCamera->settings.dof_depth * 1000.0f);
-    key.second.push_back(pCamera->settings.dof_falloff * 1000.0f);
-    key.second.push_back(pCamera->settings.flash_depth * 1000.0f);
-    key.second.push_back(pCamera->settings.flash_falloff * 1000.0f);
-    key.second.push_back(pCamera->settings.flash_intensity * 1000.0f);
-    key.second.push_back(pCamera->settings.vignette_radius * 1000.0f);
-    key.second.push_back(pCamera->settings.vignette_falloff * 1000.0f);
-    key.second.push_back(bRimColor);
-    key.second.push_back(bFadeColorEnabled);
-              
-                         
-    KRShader *pShader = m_shaders[key];
+    int flags = 0;
+    if(bAlphaTest) flags |= 0x1;
+    if(bAlphaBlend) flags |= 0x2;
+    if(bDiffuseMap) flags |= 0x4;
+    if(bNormalMap) flags |= 0x8;
+    if(bSpecMap) flags |= 0x10;
+    if(bReflectionMap) flags |= 0x20;
+    if(bReflectionCubeMap) flags |= 0x40;
+    if(bLightMap) flags |= 0x80;
+    if(bDiffuseMapScale) flags |= 0x100;
+    if(bSpecMapScale) flags |= 0x200;
+    if(bReflectionMapScale) flags |= 0x400;
+    if(bNormalMapScale) flags |= 0x800;
+    if(bDiffuseMapOffset) flags |= 0x1000;
+    if(bSpecMapOffset) flags |= 0x2000;
+    if(bReflectionMapOffset) flags |= 0x4000;
+    if(bNormalMapOffset) flags |= 0x8000;
+    if(bRimColor) flags |= 0x10000;
+    if(bFadeColorEnabled) flags |= 0x20000;
+    if(bInstanced) flags |= 0x40000;
+    
+    shader_key key = PackKey(shader_name_id, getSettingsID(pCamera->settings), light_directional_count, light_point_count, light_spot_count, iShadowQuality, bone_count, renderPass, flags);
     
+    KRShader **cached_shader = m_shaders.find(key);
+    KRShader *pShader = cached_shader ? *cached_shader : NULL;
     
     if(pShader == NULL) {
-        if(m_shaders.size() > KRContext::KRENGINE_MAX_SHADER_HANDLES) {
-            // Keep the size of the shader cache reasonable
-            std::map<std::pair<std::string, std::vector<int> > , KRShader *>::iterator itr = m_shaders.begin();
-            delete (*itr).second;
-            m_shaders.erase(itr);
+        // Keep the size of the shader cache reasonable, releasing the shaders that have gone unused the longest
+        while(m_shaders.size() > 0 && m_shaders.size() >= KRContext::KRENGINE_MAX_SHADER_HANDLES) {
+            KRShader *evicted_shader = NULL;
+            m_shaders.evict(evicted_shader);
+            delete evicted_shader;
             KRContext::Log(KRContext::LOG_LEVEL_INFORMATION, "Swapping shaders...\n");
         }
         
         
+        std::string shader_name = GetShaderName(shader_name_id);
         std::string platform_shader_name = shader_name;
 #if TARGET_OS_IPHONE
         platform_shader_name = shader_name;
@@ -155,6 +261,7 @@ KRShader *KRShaderManager::getShader(const std::string &shader_name, KRCamera *p
         stream << "\n#define LIGHT_POINT_COUNT " << light_point_count;
         stream << "\n#define LIGHT_SPOT_COUNT " << light_spot_count;
         stream << "\n#define BONE_COUNT " << bone_count;
+        stream << "\n#define INSTANCED " << (bInstanced ? "1" : "0");
         
         stream << "\n#define HAS_DIFFUSE_MAP " << (bDiffuseMap ? "1" : "0");
         stream << "\n#define HAS_DIFFUSE_MAP_SCALE " << (bDiffuseMapScale ? "1" : "0");
@@ -238,16 +345,33 @@ KRShader *KRShaderManager::getShader(const std::string &shader_name, KRCamera *p
         char szKey[256];
         sprintf(szKey, "%i_%i_%i_%i_%i_%d_%d_%d_%d_%d_%d_%d_%d_%d_%d_%d_%d_%d_%d_%d_%d_%d_%d_%d_%d_%d_%d_%d_%i_%s_%i_%d_%d_%f_%f_%f_%f_%f_%f_%f_%f_%f_%f_%f", light_directional_count, light_point_count, light_spot_count, bone_count, pCamera->settings.fog_type, pCamera->settings.bEnablePerPixel,bAlphaTest, bAlphaBlend, bDiffuseMap, bNormalMap, bSpecMap, bReflectionMap, bReflectionCubeMap, pCamera->settings.bDebugPSSM, iShadowQuality, pCamera->settings.bEnableAmbient, pCamera->settings.bEnableDiffuse, pCamera->settings.bEnableSpecular, bLightMap, bDiffuseMapScale, bSpecMapScale, bReflectionMapScale, bNormalMapScale, bDiffuseMapOffset, bSpecMapOffset, bReflectionMapOffset, bNormalMapOffset,pCamera->settings.volumetric_environment_enable && pCamera->settings.volumetric_environment_downsample != 0, renderPass, shader_name.c_str(),pCamera->settings.dof_quality,pCamera->settings.bEnableFlash,pCamera->settings.bEnableVignette,pCamera->settings.dof_depth,pCamera->settings.dof_falloff,pCamera->settings.flash_depth,pCamera->settings.flash_falloff,pCamera->settings.flash_intensity,pCamera->settings.vignette_radius,pCamera->settings.vignette_falloff, fade_color.x, fade_color.y, fade_color.z, fade_color.w);
         
-        pShader = new KRShader(getContext(), szKey, options, vertShaderSource, fragShaderSource);
+        pShader = NULL;
+#if KRENGINE_PROGRAM_BINARY_CACHE
+        __uint64_t source_hash = HashData(options.c_str(), options.size());
+        source_hash = HashData(vertShaderSource.c_str(), vertShaderSource.size(), source_hash);
+        source_hash = HashData(fragShaderSource.c_str(), fragShaderSource.size(), source_hash);
+        pShader = loadCachedProgram(source_hash, szKey);
+#endif
+        if(pShader == NULL) {
+            pShader = new KRShader(getContext(), szKey, options, vertShaderSource, fragShaderSource);
+#if KRENGINE_PROGRAM_BINARY_CACHE
+            saveCachedProgram(source_hash, pShader);
+#endif
+        }
 
-        m_shaders[key] = pShader;
+        m_shaders.insert(key, pShader);
     }
     return pShader;
 }
 
 bool KRShaderManager::selectShader(const std::string &shader_name, KRCamera &camera, const std::vector<KRPointLight *> &point_lights, const std::vector<KRDirectionalLight *> &directional_lights, const std::vector<KRSpotLight *>&spot_lights, int bone_count, const KRViewport &viewport, const Matrix4 &matModel, bool bDiffuseMap, bool bNormalMap, bool bSpecMap, bool bReflectionMap, bool bReflectionCubeMap, bool bLightMap, bool bDiffuseMapScale,bool bSpecMapScale, bool bNormalMapScale, bool bReflectionMapScale, bool bDiffuseMapOffset, bool bSpecMapOffset, bool bNormalMapOffset, bool bReflectionMapOffset, bool bAlphaTest, bool bAlphaBlend, KRNode::RenderPass renderPass, const Vector3 &rim_color, float rim_power, const Vector4 &fade_color)
 {
-    KRShader *pShader = getShader(shader_name, &camera, point_lights, directional_lights, spot_lights, bone_count, bDiffuseMap, bNormalMap, bSpecMap, bReflectionMap, bReflectionCubeMap, bLightMap, bDiffuseMapScale, bSpecMapScale, bNormalMapScale, bReflectionMapScale, bDiffuseMapOffset, bSpecMapOffset, bNormalMapOffset, bReflectionMapOffset, bAlphaTest, bAlphaBlend, renderPass, rim_power != 0.0f);
+    return selectShader(GetShaderNameID(shader_name), camera, point_lights, directional_lights, spot_lights, bone_count, viewport, matModel, bDiffuseMap, bNormalMap, bSpecMap, bReflectionMap, bReflectionCubeMap, bLightMap, bDiffuseMapScale, bSpecMapScale, bNormalMapScale, bReflectionMapScale, bDiffuseMapOffset, bSpecMapOffset, bNormalMapOffset, bReflectionMapOffset, bAlphaTest, bAlphaBlend, renderPass, rim_color, rim_power, fade_color);
+}
+
+bool KRShaderManager::selectShader(int shader_name_id, KRCamera &camera, const std::vector<KRPointLight *> &point_lights, const std::vector<KRDirectionalLight *> &directional_lights, const std::vector<KRSpotLight *>&spot_lights, int bone_count, const KRViewport &viewport, const Matrix4 &matModel, bool bDiffuseMap, bool bNormalMap, bool bSpecMap, bool bReflectionMap, bool bReflectionCubeMap, bool bLightMap, bool bDiffuseMapScale,bool bSpecMapScale, bool bNormalMapScale, bool bReflectionMapScale, bool bDiffuseMapOffset, bool bSpecMapOffset, bool bNormalMapOffset, bool bReflectionMapOffset, bool bAlphaTest, bool bAlphaBlend, KRNode::RenderPass renderPass, const Vector3 &rim_color, float rim_power, const Vector4 &fade_color)
+{
+    KRShader *pShader = getShader(shader_name_id, &camera, point_lights, directional_lights, spot_lights, bone_count, bDiffuseMap, bNormalMap, bSpecMap, bReflectionMap, bReflectionCubeMap, bLightMap, bDiffuseMapScale, bSpecMapScale, bNormalMapScale, bReflectionMapScale, bDiffuseMapOffset, bSpecMapOffset, bNormalMapOffset, bReflectionMapOffset, bAlphaTest, bAlphaBlend, renderPass, rim_power != 0.0f);
     return selectShader(camera, pShader, viewport, matModel, point_lights, directional_lights, spot_lights, bone_count, renderPass, rim_color, rim_power, fade_color);
 }
 
@@ -281,3 +405,315 @@ const std::string &KRShaderManager::getVertShaderSource(const std::string &name)
 long KRShaderManager::getShaderHandlesUsed() {
     return m_shaders.size();
 }
+
+void KRShaderManager::setProgramCacheDirectory(const std::string &path)
+{
+#if KRENGINE_PROGRAM_BINARY_CACHE
+    releaseProgramBinaries();
+    m_programCacheDirectory = path;
+    m_programCacheIndex.clear();
+    
+    KRDataBlock index;
+    if(index.load(path + "/" KRENGINE_PROGRAM_CACHE_INDEX)) {
+        index.lock();
+        __uint64_t *source_hashes = (__uint64_t *)index.getStart();
+        for(size_t i=0; i < index.getSize() / sizeof(__uint64_t); i++) {
+            if(source_hashes[i] != 0) { // Skip any padding to the allocated size of the file
+                m_programCacheIndex.push_back(source_hashes[i]);
+            }
+        }
+        index.unlock();
+    }
+    
+    // Read the cached programs ahead of their use.  Creating the GL programs waits for the render thread.
+    std::vector<__uint64_t> source_hashes = m_programCacheIndex;
+    m_programCacheThread = std::thread([this, path, source_hashes]() {
+        for(std::vector<__uint64_t>::const_iterator itr = source_hashes.begin(); itr != source_hashes.end(); itr++) {
+            program_binary *program = new program_binary;
+            if(ReadProgramCache(path, *itr, *program)) {
+                std::lock_guard<std::mutex> lock(m_programCacheMutex);
+                if(m_programBinaries.find(*itr) == m_programBinaries.end()) {
+                    m_programBinaries[*itr] = program;
+                    program = NULL;
+                }
+            }
+            delete program;
+        }
+    });
+#endif
+}
+
+#if KRENGINE_PROGRAM_BINARY_CACHE
+
+void KRShaderManager::releaseProgramBinaries()
+{
+    if(m_programCacheThread.joinable()) {
+        m_programCacheThread.join();
+    }
+    for(unordered_map<__uint64_t, program_binary *>::iterator itr = m_programBinaries.begin(); itr != m_programBinaries.end(); itr++) {
+        delete (*itr).second;
+    }
+    m_programBinaries.clear();
+}
+
+bool KRShaderManager::programCacheAvailable()
+{
+    if(m_programCacheDirectory.empty()) {
+        return false;
+    }
+    if(m_driverHash == 0) {
+        GLint format_count = 0;
+        GLDEBUG(glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &format_count));
+        if(format_count == 0) {
+            KRContext::Log(KRContext::LOG_LEVEL_WARNING, "Program binaries are not supported by the driver; shaders will not be cached.");
+            m_programCacheDirectory.clear();
+            return false;
+        }
+        std::string driver;
+        const GLenum driver_strings[] = {GL_VENDOR, GL_RENDERER, GL_VERSION};
+        for(int i=0; i < 3; i++) {
+            const GLubyte *value = glGetString(driver_strings[i]);
+            if(value) {
+                driver += (const char *)value;
+            }
+            driver += "\n";
+        }
+        m_driverHash = HashData(driver.c_str(), driver.size());
+    }
+    return true;
+}
+
+std::string KRShaderManager::GetProgramCachePath(const std::string &directory, __uint64_t source_hash)
+{
+    char szFileName[32];
+    sprintf(szFileName, "/%016llx.krprogram", (unsigned long long)source_hash);
+    return directory + szFileName;
+}
+
+bool KRShaderManager::ReadProgramCache(const std::string &directory, __uint64_t source_hash, program_binary &program)
+{
+    KRDataBlock data;
+    if(!data.load(GetProgramCachePath(directory, source_hash)) || data.getSize() <= sizeof(program_cache_header)) {
+        return false;
+    }
+    data.lock();
+    const program_cache_header *header = (const program_cache_header *)data.getStart();
+    bool valid = memcmp(header->magic, KRENGINE_PROGRAM_CACHE_MAGIC, sizeof(header->magic)) == 0
+              && header->source_hash == source_hash
+              && header->binary_size <= data.getSize() - sizeof(program_cache_header); // On Windows, KRDataBlock reports the allocated size of the file
+    if(valid) {
+        const __uint8_t *binary = (const __uint8_t *)(header + 1);
+        program.driver_hash = header->driver_hash;
+        program.binary_format = header->binary_format;
+        program.binary.assign(binary, binary + header->binary_size);
+    }
+    data.unlock();
+    return valid;
+}
+
+KRShader *KRShaderManager::loadCachedProgram(__uint64_t source_hash, char *szKey)
+{
+    if(!programCacheAvailable()) {
+        return NULL;
+    }
+    
+    program_binary *program = NULL;
+    {
+        std::lock_guard<std::mutex> lock(m_programCacheMutex);
+        unordered_map<__uint64_t, program_binary *>::iterator itr = m_programBinaries.find(source_hash);
+        if(itr != m_programBinaries.end()) {
+            program = (*itr).second;
+            m_programBinaries.erase(itr);
+        }
+    }
+    if(program == NULL) {
+        // Not read ahead yet, or evicted from m_shaders since
+        program = new program_binary;
+        if(!ReadProgramCache(m_programCacheDirectory, source_hash, *program)) {
+            delete program;
+            return NULL;
+        }
+    }
+    
+    KRShader *pShader = NULL;
+    if(program->driver_hash == m_driverHash) {
+        pShader = new KRShader(getContext(), szKey, program->binary_format, &program->binary[0], (GLsizei)program->binary.size());
+        if(!pShader->isLinked()) {
+            delete pShader;
+            pShader = NULL;
+        }
+    }
+    delete program;
+    return pShader;
+}
+
+void KRShaderManager::saveCachedProgram(__uint64_t source_hash, KRShader *pShader)
+{
+    if(!programCacheAvailable()) {
+        return;
+    }
+    
+    program_cache_header header;
+    memset(&header, 0, sizeof(header));
+    std::vector<__uint8_t> binary;
+    GLenum binary_format = 0;
+    if(!pShader->getProgramBinary(binary_format, binary)) {
+        return;
+    }
+    memcpy(header.magic, KRENGINE_PROGRAM_CACHE_MAGIC, sizeof(header.magic));
+    header.source_hash = source_hash;
+    header.driver_hash = m_driverHash;
+    header.binary_format = binary_format;
+    header.binary_size = (__uint32_t)binary.size();
+    
+    KRDataBlock data;
+    data.append(&header, sizeof(header));
+    data.append(&binary[0], binary.size());
+    if(!data.save(GetProgramCachePath(m_programCacheDirectory, source_hash))) {
+        KRContext::Log(KRContext::LOG_LEVEL_WARNING, "Unable to write program cache: %s", m_programCacheDirectory.c_str());
+        return;
+    }
+    
+    // A program that was rejected by the driver is replaced without changing the index
+    if(std::find(m_programCacheIndex.begin(), m_programCacheIndex.end(), source_hash) == m_programCacheIndex.end()) {
+        m_programCacheIndex.push_back(source_hash);
+        KRDataBlock index;
+        index.append(&m_programCacheIndex[0], m_programCacheIndex.size() * sizeof(__uint64_t));
+        index.save(m_programCacheDirectory + "/" KRENGINE_PROGRAM_CACHE_INDEX);
+    }
+}
+
+#endif
+
+int KRShaderManager::GetShaderNameID(const std::string &shader_name)
+{
+    std::lock_guard<std::mutex> lock(s_shaderNamesMutex);
+    unordered_map<std::string, int>::iterator itr = s_shaderNameIDs.find(shader_name);
+    if(itr != s_shaderNameIDs.end()) {
+        return itr->second;
+    }
+    int name_id = (int)s_shaderNames.size();
+    s_shaderNameIDs[shader_name] = name_id;
+    s_shaderNames.push_back(shader_name);
+    return name_id;
+}
+
+std::string KRShaderManager::GetShaderName(int shader_name_id)
+{
+    std::lock_guard<std::mutex> lock(s_shaderNamesMutex);
+    return s_shaderNames[shader_name_id];
+}
+
+int KRShaderManager::getSettingsID(const KRRenderSettings &settings)
+{
+    settings_options options;
+    memset(&options, 0, sizeof(options));
+    options.fog_type = settings.fog_type;
+    options.dof_quality = settings.dof_quality;
+    if(settings.bEnablePerPixel) options.flags |= 0x1;
+    if(settings.bDebugPSSM) options.flags |= 0x2;
+    if(settings.bEnableAmbient) options.flags |= 0x4;
+    if(settings.bEnableDiffuse) options.flags |= 0x8;
+    if(settings.bEnableSpecular) options.flags |= 0x10;
+    if(settings.volumetric_environment_enable) options.flags |= 0x20;
+    if(settings.volumetric_environment_downsample != 0) options.flags |= 0x40;
+    if(settings.bEnableFlash) options.flags |= 0x80;
+    if(settings.bEnableVignette) options.flags |= 0x100;
+    options.dof_depth = settings.dof_depth;
+    options.dof_falloff = settings.dof_falloff;
+    options.flash_depth = settings.flash_depth;
+    options.flash_falloff = settings.flash_falloff;
+    options.flash_intensity = settings.flash_intensity;
+    options.vignette_radius = settings.vignette_radius;
+    options.vignette_falloff = settings.vignette_falloff;
+    
+    // The settings are usually the same as for the previous shader
+    if(m_lastSettingsID >= 0 && memcmp(&m_settingsOptions[m_lastSettingsID], &options, sizeof(options)) == 0) {
+        return m_lastSettingsID;
+    }
+    for(int settings_id=0; settings_id < (int)m_settingsOptions.size(); settings_id++) {
+        if(memcmp(&m_settingsOptions[settings_id], &options, sizeof(options)) == 0) {
+            m_lastSettingsID = settings_id;
+            return settings_id;
+        }
+    }
+    
+    if(m_settingsOptions.size() > 0xffff) {
+        // Out of ids; this only happens when the settings are animated.  Release the shaders before the ids are reused.
+        KRShader *evicted_shader = NULL;
+        while(m_shaders.evict(evicted_shader)) {
+            delete evicted_shader;
+        }
+        m_settingsOptions.clear();
+    }
+    m_settingsOptions.push_back(options);
+    m_lastSettingsID = (int)m_settingsOptions.size() - 1;
+    return m_lastSettingsID;
+}
+
+KRShaderManager::shader_key KRShaderManager::PackKey(int name_id, int settings_id, int light_directional_count, int light_point_count, int light_spot_count, int shadow_quality, int bone_count, int render_pass, int flags)
+{
+    // Light and bone counts are far below the field widths; the shaders could not compile with more uniforms than that
+    shader_key key;
+    key.word[0] = (__uint64_t)(name_id & 0xffff)
+                | (__uint64_t)(settings_id & 0xffff) << 16
+                | (__uint64_t)(light_directional_count & 0xff) << 32
+                | (__uint64_t)(shadow_quality & 0xff) << 40
+                | (__uint64_t)(light_point_count & 0xffff) << 48;
+    key.word[1] = (__uint64_t)(light_spot_count & 0xffff)
+                | (__uint64_t)(bone_count & 0xffff) << 16
+                | (__uint64_t)(render_pass & 0xff) << 32
+                | (__uint64_t)(flags & 0xffffff) << 40;
+    return key;
+}
+
+void KRShaderManager::benchmarkShaders(KRCamera *pCamera, int lookup_count)
+{
+    std::vector<KRPointLight *> point_lights;
+    std::vector<KRDirectionalLight *> directional_lights;
+    std::vector<KRSpotLight *> spot_lights;
+    
+    // Combinations of material maps and alpha modes in the opaque and shadow passes, limited so that they all stay in the cache
+    static const int object_shader_id = GetShaderNameID("ObjectShader");
+    int variant_count = KRMIN(64, KRContext::KRENGINE_MAX_SHADER_HANDLES - 1);
+    std::function<KRShader *(int)> object_shader = [&](int variant) {
+        return getShader(object_shader_id, pCamera, point_lights, directional_lights, spot_lights, 0, (variant & 0x1) != 0, (variant & 0x2) != 0, (variant & 0x4) != 0, false, false, (variant & 0x8) != 0, false, false, false, false, false, false, false, false, (variant & 0x10) != 0, false, (variant & 0x20) ? KRNode::RENDER_PASS_SHADOWMAP : KRNode::RENDER_PASS_FORWARD_OPAQUE);
+    };
+    
+    // A name longer than the small string buffer of std::string, looked up both by its id and by its name, as KRLight selects it
+    static const int fog_shader_id = GetShaderNameID("volumetric_fog_downsampled");
+    std::function<KRShader *(int)> fog_shader_by_id = [&](int) {
+        return getShader(fog_shader_id, pCamera, point_lights, directional_lights, spot_lights, 0, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, KRNode::RENDER_PASS_ADDITIVE_PARTICLES);
+    };
+    std::function<KRShader *(int)> fog_shader_by_name = [&](int) {
+        return getShader("volumetric_fog_downsampled", pCamera, point_lights, directional_lights, spot_lights, 0, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, false, KRNode::RENDER_PASS_ADDITIVE_PARTICLES);
+    };
+    
+    for(int variant=0; variant < variant_count; variant++) {
+        object_shader(variant);
+    }
+    fog_shader_by_id(0);
+    
+    std::function<void(const char *, int, const std::function<KRShader *(int)> &)> benchmark = [&](const char *label, int variants, const std::function<KRShader *(int)> &lookup) {
+        int found = 0;
+        long allocation_count = KRContext::GetAllocationCount();
+        std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+        for(int i=0; i < lookup_count; i++) {
+            if(lookup((i * 7) % variants)) {
+                found++;
+            }
+        }
+        double lookup_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start_time).count() / KRMAX(lookup_count, 1);
+        allocation_count = KRContext::GetAllocationCount() - allocation_count;
+        
+#if KRENGINE_BENCHMARK_ALLOCATIONS
+        KRContext::Log(KRContext::LOG_LEVEL_INFORMATION, "KRShaderManager::benchmarkShaders - %s, %i variants, %i of %i found: %.1f ns/lookup, %.2f allocations/lookup", label, variants, found, lookup_count, lookup_ns, (double)allocation_count / KRMAX(lookup_count, 1));
+#else
+        KRContext::Log(KRContext::LOG_LEVEL_INFORMATION, "KRShaderManager::benchmarkShaders - %s, %i variants, %i of %i found: %.1f ns/lookup (build with KRENGINE_BENCHMARK_ALLOCATIONS to count allocations)", label, variants, found, lookup_count, lookup_ns);
+#endif
+    };
+    
+    benchmark("ObjectShader by id", variant_count, object_shader);
+    benchmark("volumetric_fog_downsampled by id", 1, fog_shader_by_id);
+    benchmark("volumetric_fog_downsampled by name", 1, fog_shader_by_name);
+}
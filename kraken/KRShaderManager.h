@@ -40,12 +40,14 @@ using std::map;
 using std::vector;
 
 #include "KRShader.h"
+#include "KRLRUCache.h"
 
 #ifndef KRSHADERMANAGER_H
 #define KRSHADERMANAGER_H
 
 class KRShader;
 class KRCamera;
+class KRRenderSettings;
 
 class KRShaderManager : public KRContextObject {
 public:
@@ -58,19 +60,144 @@ public:
     const std::string &getVertShaderSource(const std::string &name);
     
     
-    KRShader *getShader(const std::string &shader_name, KRCamera *pCamera, const std::vector<KRPointLight *> &point_lights, const std::vector<KRDirectionalLight *> &directional_lights, const std::vector<KRSpotLight *>&spot_lights, int bone_count, bool bDiffuseMap, bool bNormalMap, bool bSpecMap, bool bReflectionMap, bool bReflectionCubeMap, bool bLightMap, bool bDiffuseMapScale,bool bSpecMapScale, bool bNormalMapScale, bool bReflectionMapScale, bool bDiffuseMapOffset, bool bSpecMapOffset, bool bNormalMapOffset, bool bReflectionMapOffset, bool bAlphaTest, bool bAlphaBlend, KRNode::RenderPass renderPass, bool bRimColor = false);
+    // Resolve a shader name to the id that getShader and selectShader look it up by.  Ids are shared by all contexts and never change,
+    // so callers that select a shader every frame resolve its name once and keep the id in a static.
+    static int GetShaderNameID(const std::string &shader_name);
+    
+    KRShader *getShader(int shader_name_id, KRCamera *pCamera, const std::vector<KRPointLight *> &point_lights, const std::vector<KRDirectionalLight *> &directional_lights, const std::vector<KRSpotLight *>&spot_lights, int bone_count, bool bDiffuseMap, bool bNormalMap, bool bSpecMap, bool bReflectionMap, bool bReflectionCubeMap, bool bLightMap, bool bDiffuseMapScale,bool bSpecMapScale, bool bNormalMapScale, bool bReflectionMapScale, bool bDiffuseMapOffset, bool bSpecMapOffset, bool bNormalMapOffset, bool bReflectionMapOffset, bool bAlphaTest, bool bAlphaBlend, KRNode::RenderPass renderPass, bool bRimColor = false, bool bInstanced = false);
+    KRShader *getShader(const std::string &shader_name, KRCamera *pCamera, const std::vector<KRPointLight *> &point_lights, const std::vector<KRDirectionalLight *> &directional_lights, const std::vector<KRSpotLight *>&spot_lights, int bone_count, bool bDiffuseMap, bool bNormalMap, bool bSpecMap, bool bReflectionMap, bool bReflectionCubeMap, bool bLightMap, bool bDiffuseMapScale,bool bSpecMapScale, bool bNormalMapScale, bool bReflectionMapScale, bool bDiffuseMapOffset, bool bSpecMapOffset, bool bNormalMapOffset, bool bReflectionMapOffset, bool bAlphaTest, bool bAlphaBlend, KRNode::RenderPass renderPass, bool bRimColor = false, bool bInstanced = false);
     
     bool selectShader(KRCamera &camera, KRShader *pShader, const KRViewport &viewport, const Matrix4 &matModel, const std::vector<KRPointLight *> &point_lights, const std::vector<KRDirectionalLight *> &directional_lights, const std::vector<KRSpotLight *>&spot_lights, int bone_count, const KRNode::RenderPass &renderPass, const Vector3 &rim_color, float rim_power, const Vector4 &fade_color);
     
+    bool selectShader(int shader_name_id, KRCamera &camera, const std::vector<KRPointLight *> &point_lights, const std::vector<KRDirectionalLight *> &directional_lights, const std::vector<KRSpotLight *>&spot_lights, int bone_count, const KRViewport &viewport, const Matrix4 &matModel, bool bDiffuseMap, bool bNormalMap, bool bSpecMap, bool bReflectionMap, bool bReflectionCubeMap, bool bLightMap, bool bDiffuseMapScale,bool bSpecMapScale, bool bNormalMapScale, bool bReflectionMapScale, bool bDiffuseMapOffset, bool bSpecMapOffset, bool bNormalMapOffset, bool bReflectionMapOffset, bool bAlphaTest, bool bAlphaBlend, KRNode::RenderPass renderPass, const Vector3 &rim_color, float rim_power, const Vector4 &fade_color);
     bool selectShader(const std::string &shader_name, KRCamera &camera, const std::vector<KRPointLight *> &point_lights, const std::vector<KRDirectionalLight *> &directional_lights, const std::vector<KRSpotLight *>&spot_lights, int bone_count, const KRViewport &viewport, const Matrix4 &matModel, bool bDiffuseMap, bool bNormalMap, bool bSpecMap, bool bReflectionMap, bool bReflectionCubeMap, bool bLightMap, bool bDiffuseMapScale,bool bSpecMapScale, bool bNormalMapScale, bool bReflectionMapScale, bool bDiffuseMapOffset, bool bSpecMapOffset, bool bNormalMapOffset, bool bReflectionMapOffset, bool bAlphaTest, bool bAlphaBlend, KRNode::RenderPass renderPass, const Vector3 &rim_color, float rim_power, const Vector4 &fade_color);
     
     long getShaderHandlesUsed();
     
+    // Keep linked programs in a directory so that later runs do not compile them again.  Programs cached by earlier runs are read in the background.
+    void setProgramCacheDirectory(const std::string &path);
+    
+    // Time getShader for variants already in the cache, selected as a scene would select them, and log the time and allocations per call.
+    // A shader with a name too long for the small string buffer is timed both by id and by name.  Variants that are not yet cached are compiled first.  Allocations are only counted when built with KRENGINE_BENCHMARK_ALLOCATIONS.
+    void benchmarkShaders(KRCamera *pCamera, int lookup_count);
+    
+    void startFrame(float deltaTime);
+    
+#if KRENGINE_UNIFORM_BUFFERS
+    // Uniform blocks shared by every program that declares them, each bound to the binding point of its type
+    typedef enum {
+        UNIFORM_BLOCK_FRAME, // Camera, viewport and fog
+        UNIFORM_BLOCK_MATERIAL,
+        UNIFORM_BLOCK_OBJECT, // Model matrices and the model space light and camera
+        UNIFORM_BLOCK_BONES, // Skinning palette of the KRModel being drawn
+        UNIFORM_BLOCK_TYPE_COUNT
+    } uniform_block_type;
+    
+    static const char *UNIFORM_BLOCK_NAMES[];
+    
+    // Grow a shared block to hold a program's layout of it
+    void reserveUniformBlock(uniform_block_type block, GLint size);
+    // Write a member of a shared block.  The block is only marked for upload if the value differs from the one it holds.
+    void setUniformBlockValue(uniform_block_type block, GLint offset, const void *value, size_t size);
+#endif
+    
+    // Upload the uniform blocks written since the last upload.  Call after setting the uniforms of a shader, before drawing with it.
+    void uploadUniformBlocks();
+    
+    // Count a glUniform* call or uniform block upload
+    void log_uniform_upload(long size);
+    // Uniform uploads and the bytes they sent to the driver, during the last complete frame
+    long getUniformUploadsLastFrame();
+    long getUniformBytesLastFrame();
+    
     KRShader *m_active_shader;
 
 private:
-    //unordered_map<std::string, KRShader *> m_shaders;
-    std::map<std::pair<std::string, std::vector<int> >, KRShader *> m_shaders;
+    // Every option that selects a shader variant, packed into 128 bits
+    struct shader_key {
+        __uint64_t word[2];
+        bool operator==(const shader_key &other) const {
+            return word[0] == other.word[0] && word[1] == other.word[1];
+        }
+    };
+    
+    struct shader_key_hash {
+        size_t operator()(const shader_key &key) const {
+            __uint64_t h = key.word[0] ^ (key.word[1] * 0x9e3779b97f4a7c15ULL);
+            h ^= h >> 33;
+            h *= 0xff51afd7ed558ccdULL;
+            h ^= h >> 33;
+            return (size_t)h;
+        }
+    };
+    
+    // The camera settings that affect the shader source.  These change rarely, so each distinct combination is given a small id for the shader key.
+    // Compared bitwise, so any change to a float setting selects a new variant, as the shader source bakes them in at full precision.
+    typedef struct {
+        int fog_type;
+        int dof_quality;
+        int flags;
+        float dof_depth;
+        float dof_falloff;
+        float flash_depth;
+        float flash_falloff;
+        float flash_intensity;
+        float vignette_radius;
+        float vignette_falloff;
+    } settings_options;
+    
+    static std::string GetShaderName(int shader_name_id);
+    int getSettingsID(const KRRenderSettings &settings);
+    static shader_key PackKey(int name_id, int settings_id, int light_directional_count, int light_point_count, int light_spot_count, int shadow_quality, int bone_count, int render_pass, int flags);
+    
+    KRLRUCache<shader_key, KRShader *, shader_key_hash> m_shaders;
+    std::vector<settings_options> m_settingsOptions;
+    int m_lastSettingsID;
+    
+#if KRENGINE_PROGRAM_BINARY_CACHE
+    typedef struct {
+        char magic[8];
+        __uint64_t source_hash; // Options and source of the shader
+        __uint64_t driver_hash; // GL_VENDOR, GL_RENDERER and GL_VERSION of the driver that linked the program
+        __uint32_t binary_format;
+        __uint32_t binary_size;
+    } program_cache_header;
+    
+    typedef struct {
+        __uint64_t driver_hash;
+        GLenum binary_format;
+        std::vector<__uint8_t> binary;
+    } program_binary;
+    
+    std::string m_programCacheDirectory;
+    std::vector<__uint64_t> m_programCacheIndex; // Source hashes of the programs in the cache directory
+    __uint64_t m_driverHash; // 0 until the driver has been queried on the render thread
+    std::thread m_programCacheThread;
+    std::mutex m_programCacheMutex;
+    unordered_map<__uint64_t, program_binary *> m_programBinaries; // Read ahead by m_programCacheThread, guarded by m_programCacheMutex
+    
+    bool programCacheAvailable();
+    void releaseProgramBinaries();
+    KRShader *loadCachedProgram(__uint64_t source_hash, char *szKey);
+    void saveCachedProgram(__uint64_t source_hash, KRShader *pShader);
+    static std::string GetProgramCachePath(const std::string &directory, __uint64_t source_hash);
+    static bool ReadProgramCache(const std::string &directory, __uint64_t source_hash, program_binary &program);
+#endif
+    
+#if KRENGINE_UNIFORM_BUFFERS
+    typedef struct {
+        GLuint buffer_handle;
+        GLsizeiptr buffer_size;
+        std::vector<__uint8_t> data; // Contents of the buffer, as of the next upload
+        bool dirty;
+    } uniform_block;
+    
+    uniform_block m_uniformBlocks[UNIFORM_BLOCK_TYPE_COUNT];
+#endif
+    long m_uniformUploadsThisFrame;
+    long m_uniformBytesThisFrame;
+    long m_uniformUploadsLastFrame;
+    long m_uniformBytesLastFrame;
     
     unordered_map<std::string, std::string> m_fragShaderSource;
     unordered_map<std::string, std::string> m_vertShaderSource;
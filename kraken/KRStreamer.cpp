@@ -13,11 +13,17 @@
 
 #include <chrono>
 
+#define KRENGINE_STREAMER_MAX_WAIT 100 // Milliseconds to wait for a frame before streaming anyway
+#define KRENGINE_STREAMER_MIN_IDLE_DELAY 2 // Milliseconds to wait after a pass with nothing to stream
+#define KRENGINE_STREAMER_MAX_IDLE_DELAY 50
+
 
 KRStreamer::KRStreamer(KRContext &context) : m_context(context)
 {
     m_running = false;
     m_stop = false;
+    m_frameSignaled = false;
+    m_prioritiesChanged = false;
 }
 
 void KRStreamer::startStreamer()
@@ -31,30 +37,73 @@ void KRStreamer::startStreamer()
 }
 
 KRStreamer::~KRStreamer()
+{
+    stopStreamer();
+}
+
+void KRStreamer::stopStreamer()
 {
     if(m_running) {
-        m_stop = true;
+        {
+            std::lock_guard<std::mutex> lock(m_signalMutex);
+            m_stop = true;
+        }
+        m_signal.notify_one();
         m_thread.join();
         m_running = false;
     }
 }
 
+void KRStreamer::signalFrame(bool prioritiesChanged)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_signalMutex);
+        m_frameSignaled = true;
+        m_prioritiesChanged = m_prioritiesChanged || prioritiesChanged;
+    }
+    m_signal.notify_one();
+}
+
 void KRStreamer::run()
 {
 
 #if defined(_WIN32) || defined(_WIN64)
     // TODO - Set thread names on windows
+#elif defined(__linux__)
+    // Linux limits thread names to 15 characters
+    pthread_setname_np(pthread_self(), "Kraken Streamer");
 #else
    pthread_setname_np("Kraken - Streamer");
 #endif
 
-    std::chrono::microseconds sleep_duration( 15000 );
-    
     KRContext::activateStreamerContext();
+    
+    long idle_delay = 0;
 
+    std::unique_lock<std::mutex> lock(m_signalMutex);
     while(!m_stop)
     {
-        m_context.doStreaming();
-        std::this_thread::sleep_for( sleep_duration );
+        // Stream as soon as a frame has published new priorities
+        m_signal.wait_for(lock, std::chrono::milliseconds(KRENGINE_STREAMER_MAX_WAIT), [this] { return m_stop || m_frameSignaled; });
+        m_frameSignaled = false;
+        m_prioritiesChanged = false;
+        if(m_stop) {
+            break;
+        }
+        
+        lock.unlock();
+        bool streamed = m_context.doStreaming();
+        lock.lock();
+        
+        if(streamed) {
+            idle_delay = 0;
+        } else {
+            // Nothing needed streaming; back off so an idle scene does not wake the streamer every frame.  Frames that publish the same priorities
+            // do not end the back-off, but changed priorities, such as after a camera cut, start streaming again without delay.
+            idle_delay = KRCLAMP(idle_delay * 2, KRENGINE_STREAMER_MIN_IDLE_DELAY, KRENGINE_STREAMER_MAX_IDLE_DELAY);
+            if(m_signal.wait_for(lock, std::chrono::milliseconds(idle_delay), [this] { return m_stop || m_prioritiesChanged; })) {
+                idle_delay = 0;
+            }
+        }
     }
 }
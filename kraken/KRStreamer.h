@@ -36,6 +36,8 @@
 
 #include <thread>
 #include <atomic>
+#include <mutex>
+#include <condition_variable>
 
 class KRContext;
 
@@ -47,6 +49,10 @@ public:
     
     void startStreamer();
     
+    // Wake the streamer to process the priorities published by the managers for a new frame.
+    // prioritiesChanged is set when a manager published priorities that differ from its previous frame, which also cuts short an idle back-off.
+    void signalFrame(bool prioritiesChanged);
+    
 private:
     KRContext &m_context;
     
@@ -54,7 +60,13 @@ private:
     std::atomic<bool> m_stop;
     std::atomic<bool> m_running;
     
+    std::mutex m_signalMutex;
+    std::condition_variable m_signal;
+    bool m_frameSignaled; // Protected by m_signalMutex
+    bool m_prioritiesChanged; // Protected by m_signalMutex
+    
     void run();
+    void stopStreamer();
 };
 
 #endif /* defined(KRSTREAMER_H) */
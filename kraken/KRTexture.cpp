@@ -12,6 +12,8 @@
 #include "KRContext.h"
 #include "KRTextureManager.h"
 
+#define KRENGINE_TEXTURE_WEIGHT_FADE_TIME 1.0f // Seconds for the stream weight of a texture that is no longer drawn to fade out
+
 KRTexture::KRTexture(KRContext &context, std::string name) : KRResource(context, name)
 {
     m_current_lod_max_dim = 0;
@@ -21,9 +23,13 @@ KRTexture::KRTexture(KRContext &context, std::string name) : KRResource(context,
     m_textureMemUsed = 0;
     m_newTextureMemUsed = 0;
     m_last_frame_used = 0;
+    m_last_frame_time = 0.0f;
     m_last_frame_max_lod_coverage = 0.0f;
     m_last_frame_usage = TEXTURE_USAGE_NONE;
     m_handle_lock.clear();
+#if KRENGINE_TEXTURE_PBO_UPLOADS
+    m_newHandleFence = 0;
+#endif
 }
 
 KRTexture::~KRTexture()
@@ -36,6 +42,12 @@ void KRTexture::releaseHandles() {
     
     while(m_handle_lock.test_and_set()); // Spin lock
     
+#if KRENGINE_TEXTURE_PBO_UPLOADS
+    if(m_newHandleFence) {
+        GLDEBUG(glDeleteSync(m_newHandleFence));
+        m_newHandleFence = 0;
+    }
+#endif
     if(m_iNewHandle != 0) {
         GLDEBUG(glDeleteTextures(1, &m_iNewHandle));
         m_iNewHandle = 0;
@@ -86,6 +98,15 @@ void KRTexture::resize(int max_dim)
                     m_newTextureMemUsed = 0;
                     assert(false);  // Failed to create the texture
                 }
+#if KRENGINE_TEXTURE_PBO_UPLOADS
+                else {
+                    // The new handle is swapped in once its uploads have completed, rather than waiting for them here
+                    if(m_newHandleFence) {
+                        GLDEBUG(glDeleteSync(m_newHandleFence));
+                    }
+                    m_newHandleFence = getContext().getTextureManager()->fenceUploads();
+                }
+#endif
             }
         }
     }
@@ -103,6 +124,7 @@ void KRTexture::resetPoolExpiry(float lodCoverage, KRTexture::texture_usage_t te
     long current_frame = getContext().getCurrentFrame();
     if(current_frame != m_last_frame_used) {
         m_last_frame_used = current_frame;
+        m_last_frame_time = getContext().getAbsoluteTime();
         m_last_frame_max_lod_coverage = 0.0f;
         m_last_frame_usage = TEXTURE_USAGE_NONE;
         
@@ -152,6 +174,32 @@ float KRTexture::getStreamPriority()
     }
 }
 
+float KRTexture::getStreamWeight()
+{
+    // Weight by usage type; textures that must always be sharp get nearly all the memory they ask for
+    float weight = 1.0f;
+    if(m_last_frame_usage & (TEXTURE_USAGE_UI | TEXTURE_USAGE_SHADOW_DEPTH)) {
+        weight = 1000.0f;
+    } else if(m_last_frame_usage & (TEXTURE_USAGE_SKY_CUBE | TEXTURE_USAGE_PARTICLE | TEXTURE_USAGE_SPRITE | TEXTURE_USAGE_LIGHT_FLARE)) {
+        weight = 4.0f;
+    } else if(m_last_frame_usage & (TEXTURE_USAGE_DIFFUSE_MAP | TEXTURE_USAGE_LIGHT_MAP)) {
+        weight = 2.0f;
+    } else if(m_last_frame_usage & TEXTURE_USAGE_NORMAL_MAP) {
+        weight = 1.5f;
+    }
+    
+    // Scale by the size on screen of objects using the texture, with a floor so distant objects are not starved.
+    // The square root of the covered area spans the same 0.01 to 1 range as the distance based coverage that these weights were tuned with.
+    weight *= 0.01f + sqrtf(m_last_frame_max_lod_coverage);
+    
+    // Keep recently seen textures loaded, fading out once they are no longer drawn
+    long current_frame = getContext().getCurrentFrame();
+    if(current_frame > m_last_frame_used + 5) {
+        weight *= 1.0f - KRCLAMP((getContext().getAbsoluteTime() - m_last_frame_time) / KRENGINE_TEXTURE_WEIGHT_FADE_TIME, 0.0f, 0.99f);
+    }
+    return weight;
+}
+
 float KRTexture::getLastFrameLodCoverage() const
 {
     return m_last_frame_max_lod_coverage;
@@ -195,10 +243,28 @@ void KRTexture::bind(GLuint texture_unit) {
     
 }
 
+void KRTexture::prefetch(int max_dim, float priority)
+{
+    
+}
+
 void KRTexture::_swapHandles()
 {
     //while(m_handle_lock.test_and_set()); // Spin lock
     if(!m_handle_lock.test_and_set()) {
+#if KRENGINE_TEXTURE_PBO_UPLOADS
+        if(m_iHandle != m_iNewHandle && m_newHandleFence) {
+            GLenum status = GL_ALREADY_SIGNALED;
+            GLDEBUG(status = glClientWaitSync(m_newHandleFence, 0, 0));
+            if(status == GL_TIMEOUT_EXPIRED) {
+                // Still uploading; try again next frame
+                m_handle_lock.clear();
+                return;
+            }
+            GLDEBUG(glDeleteSync(m_newHandleFence));
+            m_newHandleFence = 0;
+        }
+#endif
         if(m_iHandle != m_iNewHandle) {
             if(m_iHandle != 0) {
                 GLDEBUG(glDeleteTextures(1, &m_iHandle));
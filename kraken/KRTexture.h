@@ -53,6 +53,7 @@ public:
     
     virtual long getMemRequiredForSize(int max_dim) = 0;
     virtual void resize(int max_dim);
+    virtual void prefetch(int max_dim, float priority); // Queue asynchronous reads of the data a later resize(max_dim) will need
     
     long getLastFrameUsed();
     
@@ -74,6 +75,7 @@ public:
     } texture_usage_t;
     
     float getStreamPriority();
+    float getStreamWeight(); // Relative share of texture memory, used by the streamer's residency solver.  Like getStreamPriority, only call from the render thread.
     
     virtual void resetPoolExpiry(float lodCoverage, texture_usage_t textureUsage);
     virtual bool isAnimated();
@@ -98,6 +100,9 @@ protected:
     GLuint m_iHandle;
     GLuint m_iNewHandle;
     std::atomic_flag m_handle_lock;
+#if KRENGINE_TEXTURE_PBO_UPLOADS
+    GLsync m_newHandleFence; // Signalled when the uploads to m_iNewHandle have completed
+#endif
     
     int m_current_lod_max_dim;
     int m_new_lod_max_dim;
@@ -106,6 +111,7 @@ protected:
     uint32_t m_min_lod_max_dim;
     
     long m_last_frame_used;
+    float m_last_frame_time; // KRContext::getAbsoluteTime() of m_last_frame_used
     float m_last_frame_max_lod_coverage;
     texture_usage_t m_last_frame_usage;
     
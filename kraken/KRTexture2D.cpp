@@ -89,6 +89,13 @@ void KRTexture2D::bind(GLuint texture_unit) {
     }
 }
 
+void KRTexture2D::prefetch(int max_dim, float priority)
+{
+    if(m_pData) {
+        m_pData->prefetch(0, 0, priority);
+    }
+}
+
 bool KRTexture2D::save(const std::string& path)
 {
     if(m_pData) {
@@ -48,6 +48,7 @@ public:
     
     virtual bool uploadTexture(GLenum target, int lod_max_dim, int &current_lod_max_dim, bool compress = false, bool premultiply_alpha = false) = 0;
     virtual void bind(GLuint texture_unit);
+    virtual void prefetch(int max_dim, float priority);
     
 protected:
     KRDataBlock *m_pData;
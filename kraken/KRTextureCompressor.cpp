@@ -0,0 +1,572 @@
+//
+//  KRTextureCompressor.cpp
+//  KREngine
+//
+//  Copyright 2012 Kearwood Gilbert. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are
+//  permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this list of
+//  conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list
+//  of conditions and the following disclaimer in the documentation and/or other materials
+//  provided with the distribution.
+//
+//  THIS SOFTWARE IS PROVIDED BY KEARWOOD GILBERT ''AS IS'' AND ANY EXPRESS OR IMPLIED
+//  WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+//  FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL KEARWOOD GILBERT OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+//  ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+//  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+//  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//  The views and conclusions contained in the software and documentation are those of the
+//  authors and should not be interpreted as representing official policies, either expressed
+//  or implied, of Kearwood Gilbert.
+//
+
+#include "KRTextureCompressor.h"
+#include "KRWorkerPool.h"
+#include "KRCPUFeatures.h"
+
+#define KRENGINE_KAISER_FILTER_WIDTH 3.0f
+#define KRENGINE_KAISER_FILTER_ALPHA 4.0f
+
+namespace {
+    
+    __uint16_t PackRGB565(int r, int g, int b)
+    {
+        return (__uint16_t)((((r * 31 + 127) / 255) << 11) | (((g * 63 + 127) / 255) << 5) | ((b * 31 + 127) / 255));
+    }
+    
+    void UnpackRGB565(__uint16_t c, int &r, int &g, int &b)
+    {
+        r = (c >> 11) & 0x1f;
+        g = (c >> 5) & 0x3f;
+        b = c & 0x1f;
+        r = (r << 3) | (r >> 2);
+        g = (g << 2) | (g >> 4);
+        b = (b << 3) | (b >> 2);
+    }
+    
+    // Copy a 4x4 block of pixels, repeating the last row and column for blocks that extend past the edge of the image
+    void ExtractBlock(const __uint8_t *image, int width, int height, int block_x, int block_y, __uint8_t *pixels)
+    {
+        for(int y=0; y < 4; y++) {
+            int source_y = block_y * 4 + y;
+            if(source_y >= height) source_y = height - 1;
+            for(int x=0; x < 4; x++) {
+                int source_x = block_x * 4 + x;
+                if(source_x >= width) source_x = width - 1;
+                memcpy(pixels + (y * 4 + x) * 4, image + ((size_t)source_y * width + source_x) * 4, 4);
+            }
+        }
+    }
+    
+    typedef void (*block_bounds_function)(const __uint8_t *pixels, __uint8_t *min_color, __uint8_t *max_color);
+    typedef __uint32_t (*select_indices_function)(const __uint8_t *pixels, const int *dir, int c0_point, int half_point, int c3_point);
+    
+    typedef struct {
+        block_bounds_function block_bounds;
+        select_indices_function select_color_indices;
+    } block_kernels;
+    
+    // Per-channel minimum and maximum of the 16 pixels in a block
+    void BlockBounds_Scalar(const __uint8_t *pixels, __uint8_t *min_color, __uint8_t *max_color)
+    {
+        for(int c=0; c < 4; c++) {
+            min_color[c] = pixels[c];
+            max_color[c] = pixels[c];
+        }
+        for(int i=1; i < 16; i++) {
+            for(int c=0; c < 4; c++) {
+                __uint8_t v = pixels[i * 4 + c];
+                if(v < min_color[c]) min_color[c] = v;
+                if(v > max_color[c]) max_color[c] = v;
+            }
+        }
+    }
+    
+    // Choose the nearest of the four palette colors for each pixel, by projecting the pixels onto dir, the axis between the endpoints.
+    // The thresholds are the midpoints between the projected palette colors, doubled; dir is doubled to match.
+    __uint32_t SelectColorIndices_Scalar(const __uint8_t *pixels, const int *dir, int c0_point, int half_point, int c3_point)
+    {
+        __uint32_t packed = 0;
+        for(int i=0; i < 16; i++) {
+            const __uint8_t *px = pixels + i * 4;
+            int dot = px[0] * dir[0] + px[1] * dir[1] + px[2] * dir[2];
+            __uint32_t index;
+            if(dot < half_point) {
+                index = dot < c0_point ? 1 : 3;
+            } else {
+                index = dot < c3_point ? 2 : 0;
+            }
+            packed |= index << (i * 2);
+        }
+        return packed;
+    }
+    
+#if defined(KRAKEN_USE_SSE2)
+    
+    // Reduce the per-lane minimum and maximum of four pixels to a single pixel
+    inline void StoreBlockBounds(__m128i min_4, __m128i max_4, __uint8_t *min_color, __uint8_t *max_color)
+    {
+        min_4 = _mm_min_epu8(min_4, _mm_shuffle_epi32(min_4, _MM_SHUFFLE(1, 0, 3, 2)));
+        min_4 = _mm_min_epu8(min_4, _mm_shuffle_epi32(min_4, _MM_SHUFFLE(2, 3, 0, 1)));
+        max_4 = _mm_max_epu8(max_4, _mm_shuffle_epi32(max_4, _MM_SHUFFLE(1, 0, 3, 2)));
+        max_4 = _mm_max_epu8(max_4, _mm_shuffle_epi32(max_4, _MM_SHUFFLE(2, 3, 0, 1)));
+        __int32_t min_packed = _mm_cvtsi128_si32(min_4);
+        __int32_t max_packed = _mm_cvtsi128_si32(max_4);
+        memcpy(min_color, &min_packed, 4);
+        memcpy(max_color, &max_packed, 4);
+    }
+    
+    inline __uint32_t PackIndices(const __int32_t *indices)
+    {
+        __uint32_t packed = 0;
+        for(int i=0; i < 16; i++) {
+            packed |= (__uint32_t)indices[i] << (i * 2);
+        }
+        return packed;
+    }
+    
+    void BlockBounds_SSE2(const __uint8_t *pixels, __uint8_t *min_color, __uint8_t *max_color)
+    {
+        const __m128i *p = (const __m128i *)pixels;
+        __m128i min_4 = _mm_min_epu8(_mm_min_epu8(_mm_load_si128(p), _mm_load_si128(p + 1)), _mm_min_epu8(_mm_load_si128(p + 2), _mm_load_si128(p + 3)));
+        __m128i max_4 = _mm_max_epu8(_mm_max_epu8(_mm_load_si128(p), _mm_load_si128(p + 1)), _mm_max_epu8(_mm_load_si128(p + 2), _mm_load_si128(p + 3)));
+        StoreBlockBounds(min_4, max_4, min_color, max_color);
+    }
+    
+    __uint32_t SelectColorIndices_SSE2(const __uint8_t *pixels, const int *dir, int c0_point, int half_point, int c3_point)
+    {
+        alignas(16) __int32_t indices[16];
+        const __m128i dir_16 = _mm_set_epi16(0, (short)dir[2], (short)dir[1], (short)dir[0], 0, (short)dir[2], (short)dir[1], (short)dir[0]);
+        const __m128i c0_threshold = _mm_set1_epi32(c0_point - 1);
+        const __m128i half_threshold = _mm_set1_epi32(half_point - 1);
+        const __m128i c3_threshold = _mm_set1_epi32(c3_point - 1);
+        const __m128i one = _mm_set1_epi32(1);
+        const __m128i two = _mm_set1_epi32(2);
+        const __m128i zero = _mm_setzero_si128();
+        for(int i=0; i < 4; i++) {
+            // Widen to 16 bits, then multiply-add B*dB + G*dG and R*dR for each pixel
+            __m128i px = _mm_load_si128((const __m128i *)pixels + i);
+            __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi8(px, zero), dir_16);
+            __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi8(px, zero), dir_16);
+            __m128i even = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(lo), _mm_castsi128_ps(hi), _MM_SHUFFLE(2, 0, 2, 0)));
+            __m128i odd = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(lo), _mm_castsi128_ps(hi), _MM_SHUFFLE(3, 1, 3, 1)));
+            __m128i dot = _mm_add_epi32(even, odd);
+            
+            __m128i ge_c0 = _mm_cmpgt_epi32(dot, c0_threshold);
+            __m128i ge_half = _mm_cmpgt_epi32(dot, half_threshold);
+            __m128i ge_c3 = _mm_cmpgt_epi32(dot, c3_threshold);
+            __m128i index = _mm_or_si128(_mm_andnot_si128(ge_half, one), _mm_and_si128(_mm_xor_si128(ge_c0, ge_c3), two));
+            _mm_store_si128((__m128i *)indices + i, index);
+        }
+        return PackIndices(indices);
+    }
+    
+    KRAKEN_TARGET_AVX2 void BlockBounds_AVX2(const __uint8_t *pixels, __uint8_t *min_color, __uint8_t *max_color)
+    {
+        __m256i a = _mm256_load_si256((const __m256i *)pixels);
+        __m256i b = _mm256_load_si256((const __m256i *)pixels + 1);
+        __m256i min_8 = _mm256_min_epu8(a, b);
+        __m256i max_8 = _mm256_max_epu8(a, b);
+        __m128i min_4 = _mm_min_epu8(_mm256_castsi256_si128(min_8), _mm256_extracti128_si256(min_8, 1));
+        __m128i max_4 = _mm_max_epu8(_mm256_castsi256_si128(max_8), _mm256_extracti128_si256(max_8, 1));
+        StoreBlockBounds(min_4, max_4, min_color, max_color);
+    }
+    
+    KRAKEN_TARGET_AVX2 __uint32_t SelectColorIndices_AVX2(const __uint8_t *pixels, const int *dir, int c0_point, int half_point, int c3_point)
+    {
+        alignas(32) __int32_t indices[16];
+        const __m256i dir_16 = _mm256_set_epi16(0, (short)dir[2], (short)dir[1], (short)dir[0], 0, (short)dir[2], (short)dir[1], (short)dir[0],
+                                                0, (short)dir[2], (short)dir[1], (short)dir[0], 0, (short)dir[2], (short)dir[1], (short)dir[0]);
+        const __m256i c0_threshold = _mm256_set1_epi32(c0_point - 1);
+        const __m256i half_threshold = _mm256_set1_epi32(half_point - 1);
+        const __m256i c3_threshold = _mm256_set1_epi32(c3_point - 1);
+        const __m256i one = _mm256_set1_epi32(1);
+        const __m256i two = _mm256_set1_epi32(2);
+        const __m256i zero = _mm256_setzero_si256();
+        for(int i=0; i < 2; i++) {
+            // Widen to 16 bits, then multiply-add B*dB + G*dG and R*dR for each pixel.  Unpacking works within each 128-bit lane, so the pixels stay in order.
+            __m256i px = _mm256_load_si256((const __m256i *)pixels + i);
+            __m256i lo = _mm256_madd_epi16(_mm256_unpacklo_epi8(px, zero), dir_16);
+            __m256i hi = _mm256_madd_epi16(_mm256_unpackhi_epi8(px, zero), dir_16);
+            __m256i even = _mm256_castps_si256(_mm256_shuffle_ps(_mm256_castsi256_ps(lo), _mm256_castsi256_ps(hi), _MM_SHUFFLE(2, 0, 2, 0)));
+            __m256i odd = _mm256_castps_si256(_mm256_shuffle_ps(_mm256_castsi256_ps(lo), _mm256_castsi256_ps(hi), _MM_SHUFFLE(3, 1, 3, 1)));
+            __m256i dot = _mm256_add_epi32(even, odd);
+            
+            __m256i ge_c0 = _mm256_cmpgt_epi32(dot, c0_threshold);
+            __m256i ge_half = _mm256_cmpgt_epi32(dot, half_threshold);
+            __m256i ge_c3 = _mm256_cmpgt_epi32(dot, c3_threshold);
+            __m256i index = _mm256_or_si256(_mm256_andnot_si256(ge_half, one), _mm256_and_si256(_mm256_xor_si256(ge_c0, ge_c3), two));
+            _mm256_store_si256((__m256i *)indices + i, index);
+        }
+        return PackIndices(indices);
+    }
+    
+#endif
+    
+    block_kernels GetKernels()
+    {
+        block_kernels kernels;
+        kernels.block_bounds = BlockBounds_Scalar;
+        kernels.select_color_indices = SelectColorIndices_Scalar;
+#if defined(KRAKEN_USE_SSE2)
+        if(KRCPUFeatures::SupportsAVX2()) {
+            kernels.block_bounds = BlockBounds_AVX2;
+            kernels.select_color_indices = SelectColorIndices_AVX2;
+        } else {
+            kernels.block_bounds = BlockBounds_SSE2;
+            kernels.select_color_indices = SelectColorIndices_SSE2;
+        }
+#endif
+        return kernels;
+    }
+    
+    // The fastest kernels supported by this CPU, selected on first use
+    const block_kernels &Kernels()
+    {
+        static const block_kernels kernels = GetKernels();
+        return kernels;
+    }
+    
+    void EncodeColorBlock(const block_kernels &kernels, const __uint8_t *pixels, const __uint8_t *min_color, const __uint8_t *max_color, __uint8_t *dest)
+    {
+        // Use the channel with the largest range as the reference axis, and swap the endpoints of the other channels where they are anti-correlated with it,
+        // so the endpoints lie on the diagonal of the bounding box that follows the colors in the block
+        int lo[3], hi[3], center[3];
+        int axis = 0;
+        for(int c=0; c < 3; c++) {
+            lo[c] = min_color[c];
+            hi[c] = max_color[c];
+            center[c] = (lo[c] + hi[c]) / 2;
+            if(hi[c] - lo[c] > hi[axis] - lo[axis]) {
+                axis = c;
+            }
+        }
+        int covariance[3] = {0, 0, 0};
+        for(int i=0; i < 16; i++) {
+            const __uint8_t *px = pixels + i * 4;
+            int d = px[axis] - center[axis];
+            for(int c=0; c < 3; c++) {
+                covariance[c] += d * (px[c] - center[c]);
+            }
+        }
+        for(int c=0; c < 3; c++) {
+            if(covariance[c] < 0) {
+                int t = lo[c];
+                lo[c] = hi[c];
+                hi[c] = t;
+            }
+        }
+        
+        // Inset the endpoints by 1/16th of the range, which reduces the error for the pixels between them
+        for(int c=0; c < 3; c++) {
+            int inset = (hi[c] - lo[c]) / 16;
+            lo[c] += inset;
+            hi[c] -= inset;
+        }
+        
+        __uint16_t color0 = PackRGB565(hi[2], hi[1], hi[0]);
+        __uint16_t color1 = PackRGB565(lo[2], lo[1], lo[0]);
+        if(color0 < color1) {
+            __uint16_t t = color0;
+            color0 = color1;
+            color1 = t;
+        }
+        
+        __uint32_t indices = 0;
+        if(color0 != color1) {
+            // Palette, in BGR order, as the decoder will reconstruct it from the quantized endpoints
+            int palette[4][3];
+            UnpackRGB565(color0, palette[0][2], palette[0][1], palette[0][0]);
+            UnpackRGB565(color1, palette[1][2], palette[1][1], palette[1][0]);
+            for(int c=0; c < 3; c++) {
+                palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+                palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+            }
+            int dir[3];
+            int stops[4];
+            for(int c=0; c < 3; c++) {
+                dir[c] = palette[0][c] - palette[1][c];
+            }
+            for(int i=0; i < 4; i++) {
+                stops[i] = palette[i][0] * dir[0] + palette[i][1] * dir[1] + palette[i][2] * dir[2];
+            }
+            for(int c=0; c < 3; c++) {
+                dir[c] *= 2;
+            }
+            indices = kernels.select_color_indices(pixels, dir, stops[1] + stops[3], stops[3] + stops[2], stops[2] + stops[0]);
+        }
+        
+        dest[0] = color0 & 0xff;
+        dest[1] = color0 >> 8;
+        dest[2] = color1 & 0xff;
+        dest[3] = color1 >> 8;
+        dest[4] = indices & 0xff;
+        dest[5] = (indices >> 8) & 0xff;
+        dest[6] = (indices >> 16) & 0xff;
+        dest[7] = indices >> 24;
+    }
+    
+    void EncodeAlphaBlock(const __uint8_t *pixels, int min_alpha, int max_alpha, __uint8_t *dest)
+    {
+        // alpha0 > alpha1 selects the mode with six interpolated values.  Index 0 is alpha0, 1 is alpha1, and 2 to 7 step from alpha0 towards alpha1.
+        dest[0] = (__uint8_t)max_alpha;
+        dest[1] = (__uint8_t)min_alpha;
+        
+        __uint64_t indices = 0;
+        int range = max_alpha - min_alpha;
+        if(range > 0) {
+            for(int i=0; i < 16; i++) {
+                int step = ((pixels[i * 4 + 3] - min_alpha) * 14 + range) / (range * 2); // 0 at alpha1 to 7 at alpha0, rounded to nearest
+                __uint64_t index = step == 7 ? 0 : (step == 0 ? 1 : 8 - step);
+                indices |= index << (i * 3);
+            }
+        }
+        for(int i=0; i < 6; i++) {
+            dest[i + 2] = (__uint8_t)(indices >> (i * 8));
+        }
+    }
+    
+    // Encode one row of 4x4 blocks
+    void EncodeBlockRow(const __uint8_t *image, int width, int height, bool alpha, int block_y, __uint8_t *dest)
+    {
+        const block_kernels &kernels = Kernels();
+        alignas(32) __uint8_t pixels[64];
+        int blocks_wide = (width + 3) / 4;
+        for(int block_x=0; block_x < blocks_wide; block_x++) {
+            ExtractBlock(image, width, height, block_x, block_y, pixels);
+            __uint8_t min_color[4], max_color[4];
+            kernels.block_bounds(pixels, min_color, max_color);
+            if(alpha) {
+                EncodeAlphaBlock(pixels, min_color[3], max_color[3], dest);
+                dest += 8;
+            }
+            EncodeColorBlock(kernels, pixels, min_color, max_color, dest);
+            dest += 8;
+        }
+    }
+    
+    float Sinc(float x)
+    {
+        if(fabsf(x) < 1.0e-4f) {
+            return 1.0f;
+        }
+        return sinf((float)M_PI * x) / ((float)M_PI * x);
+    }
+    
+    // Zeroth order modified Bessel function of the first kind
+    float BesselI0(float x)
+    {
+        float sum = 1.0f;
+        float term = 1.0f;
+        float half_x = x * 0.5f;
+        for(int k=1; k < 32; k++) {
+            term *= (half_x / k) * (half_x / k);
+            sum += term;
+            if(term < sum * 1.0e-7f) {
+                break;
+            }
+        }
+        return sum;
+    }
+    
+    float Kaiser(float x)
+    {
+        float t = x / KRENGINE_KAISER_FILTER_WIDTH;
+        if(t <= -1.0f || t >= 1.0f) {
+            return 0.0f;
+        }
+        return Sinc(x) * BesselI0(KRENGINE_KAISER_FILTER_ALPHA * sqrtf(1.0f - t * t)) / BesselI0(KRENGINE_KAISER_FILTER_ALPHA);
+    }
+    
+    typedef struct {
+        int first; // First source pixel
+        std::vector<float> weights; // Weights of the source pixels starting at first, clamped to the edge of the image
+    } filter_taps;
+    
+    // Kaiser-windowed sinc taps for each destination pixel when resampling source_size pixels to dest_size pixels
+    void KaiserTaps(int source_size, int dest_size, std::vector<filter_taps> &taps)
+    {
+        float scale = (float)source_size / (float)dest_size;
+        float radius = KRENGINE_KAISER_FILTER_WIDTH * scale;
+        taps.resize(dest_size);
+        for(int i=0; i < dest_size; i++) {
+            float center = (i + 0.5f) * scale;
+            int first = (int)floorf(center - radius);
+            int last = (int)ceilf(center + radius);
+            filter_taps &t = taps[i];
+            t.first = first;
+            t.weights.clear();
+            float total = 0.0f;
+            for(int s=first; s <= last; s++) {
+                float w = Kaiser((s + 0.5f - center) / scale);
+                t.weights.push_back(w);
+                total += w;
+            }
+            for(std::vector<float>::iterator itr = t.weights.begin(); itr != t.weights.end(); itr++) {
+                *itr /= total;
+            }
+        }
+    }
+}
+
+size_t KRTextureCompressor::GetEncodedSize(int width, int height, bool alpha)
+{
+    return (size_t)((width + 3) / 4) * (size_t)((height + 3) / 4) * (alpha ? 16 : 8);
+}
+
+void KRTextureCompressor::Encode(const __uint8_t *image, int width, int height, bool alpha, __uint8_t *dest)
+{
+    size_t row_size = (size_t)((width + 3) / 4) * (alpha ? 16 : 8);
+    int blocks_high = (height + 3) / 4;
+    KRWorkerPool::get().parallelFor(blocks_high, [=](size_t block_y) {
+        EncodeBlockRow(image, width, height, alpha, (int)block_y, dest + row_size * block_y);
+    });
+}
+
+void KRTextureCompressor::GenerateMipmap(const __uint8_t *image, int width, int height, __uint8_t *dest, mipmap_filter_t filter)
+{
+    int dest_width = width > 1 ? width / 2 : 1;
+    int dest_height = height > 1 ? height / 2 : 1;
+    
+    switch(filter) {
+        case MIPMAP_FILTER_BOX:
+            // Each destination pixel averages a 2x2 box.  Where a dimension is odd, the last box is widened to 3 pixels so the last row or column is not dropped.
+            KRWorkerPool::get().parallelFor(dest_height, [=](size_t y) {
+                int y0 = (int)y * 2;
+                int y1 = y + 1 < (size_t)dest_height ? y0 + 2 : height;
+                if(y1 <= y0) y1 = y0 + 1;
+                __uint8_t *pDest = dest + (size_t)y * dest_width * 4;
+                for(int x=0; x < dest_width; x++) {
+                    int x0 = x * 2;
+                    int x1 = x + 1 < dest_width ? x0 + 2 : width;
+                    if(x1 <= x0) x1 = x0 + 1;
+                    int sum[4] = {0, 0, 0, 0};
+                    for(int source_y=y0; source_y < y1; source_y++) {
+                        const __uint8_t *pSource = image + ((size_t)source_y * width + x0) * 4;
+                        for(int source_x=x0; source_x < x1; source_x++) {
+                            for(int c=0; c < 4; c++) {
+                                sum[c] += *pSource++;
+                            }
+                        }
+                    }
+                    int count = (x1 - x0) * (y1 - y0);
+                    for(int c=0; c < 4; c++) {
+                        *pDest++ = (__uint8_t)((sum[c] + count / 2) / count);
+                    }
+                }
+            });
+            break;
+        case MIPMAP_FILTER_KAISER:
+        {
+            // Separable filter; resample the rows first, then the columns
+            std::vector<filter_taps> horizontal_taps, vertical_taps;
+            KaiserTaps(width, dest_width, horizontal_taps);
+            KaiserTaps(height, dest_height, vertical_taps);
+            
+            std::vector<float> intermediate((size_t)height * dest_width * 4);
+            float *pIntermediate = &intermediate[0];
+            
+            KRWorkerPool::get().parallelFor(height, [=, &horizontal_taps](size_t y) {
+                const __uint8_t *row = image + (size_t)y * width * 4;
+                float *pDest = pIntermediate + (size_t)y * dest_width * 4;
+                for(int x=0; x < dest_width; x++) {
+                    const filter_taps &t = horizontal_taps[x];
+                    float sum[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+                    for(size_t i=0; i < t.weights.size(); i++) {
+                        int source_x = t.first + (int)i;
+                        if(source_x < 0) source_x = 0;
+                        if(source_x >= width) source_x = width - 1;
+                        for(int c=0; c < 4; c++) {
+                            sum[c] += row[source_x * 4 + c] * t.weights[i];
+                        }
+                    }
+                    for(int c=0; c < 4; c++) {
+                        *pDest++ = sum[c];
+                    }
+                }
+            });
+            
+            KRWorkerPool::get().parallelFor(dest_height, [=, &vertical_taps](size_t y) {
+                const filter_taps &t = vertical_taps[y];
+                __uint8_t *pDest = dest + (size_t)y * dest_width * 4;
+                for(int x=0; x < dest_width; x++) {
+                    float sum[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+                    for(size_t i=0; i < t.weights.size(); i++) {
+                        int source_y = t.first + (int)i;
+                        if(source_y < 0) source_y = 0;
+                        if(source_y >= height) source_y = height - 1;
+                        const float *pSource = pIntermediate + ((size_t)source_y * dest_width + x) * 4;
+                        for(int c=0; c < 4; c++) {
+                            sum[c] += pSource[c] * t.weights[i];
+                        }
+                    }
+                    for(int c=0; c < 4; c++) {
+                        // The negative lobes of the filter can ring past the range of the source
+                        int v = (int)(sum[c] + 0.5f);
+                        *pDest++ = (__uint8_t)(v < 0 ? 0 : (v > 255 ? 255 : v));
+                    }
+                }
+            });
+        }
+            break;
+    }
+}
+
+void KRTextureCompressor::Compress(const __uint8_t *image, int width, int height, bool alpha, mipmap_filter_t filter, std::list<KRDataBlock *> &blocks)
+{
+    // Generate the mipmap chain.  Each level is filtered from the one before it, with the rows of each level spread across the threads.
+    std::vector<const __uint8_t *> level_images;
+    std::vector<int> level_widths, level_heights;
+    std::list<std::vector<__uint8_t> > mipmaps;
+    level_images.push_back(image);
+    level_widths.push_back(width);
+    level_heights.push_back(height);
+    while(level_widths.back() > 1 || level_heights.back() > 1) {
+        int source_width = level_widths.back();
+        int source_height = level_heights.back();
+        int dest_width = source_width > 1 ? source_width / 2 : 1;
+        int dest_height = source_height > 1 ? source_height / 2 : 1;
+        mipmaps.push_back(std::vector<__uint8_t>((size_t)dest_width * dest_height * 4));
+        GenerateMipmap(level_images.back(), source_width, source_height, &mipmaps.back()[0], filter);
+        level_images.push_back(&mipmaps.back()[0]);
+        level_widths.push_back(dest_width);
+        level_heights.push_back(dest_height);
+    }
+    
+    // Encode every level at once, taking one row of blocks at a time, so the small levels don't leave the threads idle
+    int level_count = (int)level_images.size();
+    std::vector<KRDataBlock *> level_blocks;
+    std::vector<std::pair<int, int> > rows; // level, block_y
+    for(int level=0; level < level_count; level++) {
+        KRDataBlock *block = new KRDataBlock();
+        block->expand(GetEncodedSize(level_widths[level], level_heights[level], alpha));
+        block->lock();
+        level_blocks.push_back(block);
+        int blocks_high = (level_heights[level] + 3) / 4;
+        for(int block_y=0; block_y < blocks_high; block_y++) {
+            rows.push_back(std::make_pair(level, block_y));
+        }
+    }
+    
+    KRWorkerPool::get().parallelFor(rows.size(), [&](size_t i) {
+        int level = rows[i].first;
+        int block_y = rows[i].second;
+        size_t row_size = (size_t)((level_widths[level] + 3) / 4) * (alpha ? 16 : 8);
+        __uint8_t *dest = (__uint8_t *)level_blocks[level]->getStart() + row_size * block_y;
+        EncodeBlockRow(level_images[level], level_widths[level], level_heights[level], alpha, block_y, dest);
+    });
+    
+    for(std::vector<KRDataBlock *>::iterator itr = level_blocks.begin(); itr != level_blocks.end(); itr++) {
+        (*itr)->unlock();
+        blocks.push_back(*itr);
+    }
+}
@@ -0,0 +1,61 @@
+//
+//  KRTextureCompressor.h
+//  KREngine
+//
+//  Copyright 2012 Kearwood Gilbert. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are
+//  permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this list of
+//  conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list
+//  of conditions and the following disclaimer in the documentation and/or other materials
+//  provided with the distribution.
+//
+//  THIS SOFTWARE IS PROVIDED BY KEARWOOD GILBERT ''AS IS'' AND ANY EXPRESS OR IMPLIED
+//  WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+//  FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL KEARWOOD GILBERT OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+//  ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+//  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+//  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//  The views and conclusions contained in the software and documentation are those of the
+//  authors and should not be interpreted as representing official policies, either expressed
+//  or implied, of Kearwood Gilbert.
+//
+
+#ifndef KRTEXTURECOMPRESSOR_H
+#define KRTEXTURECOMPRESSOR_H
+
+#include "KREngine-common.h"
+#include "KRDataBlock.h"
+
+// CPU encoder for BC1 (DXT1) and BC3 (DXT5) textures.  Does not require a GL context, so it can run in an offline asset pipeline.
+// Images are 32-bit, with the channels in BGRA order as decoded from TGA files.
+namespace KRTextureCompressor {
+
+    typedef enum {
+        MIPMAP_FILTER_BOX,
+        MIPMAP_FILTER_KAISER
+    } mipmap_filter_t;
+    
+    // Size in bytes of a BC1 image, or a BC3 image when alpha is true.  Images are padded out to whole 4x4 blocks.
+    size_t GetEncodedSize(int width, int height, bool alpha);
+    
+    // Encode an image to BC1, or to BC3 when alpha is true.  dest must hold GetEncodedSize(width, height, alpha) bytes.
+    void Encode(const __uint8_t *image, int width, int height, bool alpha, __uint8_t *dest);
+    
+    // Downsample an image to the next mipmap level, which is half the size in each dimension, but no smaller than 1 pixel
+    void GenerateMipmap(const __uint8_t *image, int width, int height, __uint8_t *dest, mipmap_filter_t filter);
+    
+    // Generate the full mipmap chain of an image and encode each level, appending one KRDataBlock per level to blocks, starting with the largest level.
+    // The mipmap levels and blocks are processed on a pool of threads.
+    void Compress(const __uint8_t *image, int width, int height, bool alpha, mipmap_filter_t filter, std::list<KRDataBlock *> &blocks);
+}
+
+#endif
@@ -105,6 +105,15 @@ long KRTextureCube::getMemRequiredForSize(int max_dim)
     return memoryRequired;
 }
 
+void KRTextureCube::prefetch(int max_dim, float priority)
+{
+    for(int i=0; i<6; i++) {
+        if(m_textures[i]) {
+            m_textures[i]->prefetch(max_dim, priority);
+        }
+    }
+}
+
 /*
 void KRTextureCube::resetPoolExpiry(float lodCoverage, texture_usage_t textureUsage)
 {
@@ -46,6 +46,7 @@ public:
     
     virtual void bind(GLuint texture_unit);
     virtual long getMemRequiredForSize(int max_dim);
+    virtual void prefetch(int max_dim, float priority);
 //    virtual void resetPoolExpiry(float lodCoverage, texture_usage_t textureUsage);
     
 private:
@@ -153,6 +153,31 @@ long KRTextureKTX::getMemRequiredForSize(int max_dim)
     return memoryRequired;
 }
 
+void KRTextureKTX::prefetch(int max_dim, float priority)
+{
+    int target_dim = max_dim;
+    if(target_dim < m_min_lod_max_dim) target_dim = m_min_lod_max_dim;
+    
+    // Only read ahead the mip levels that uploadTexture will use for this size
+    int width = m_header.pixelWidth;
+    int height = m_header.pixelHeight;
+    for(std::list<KRDataBlock *>::iterator itr = m_blocks.begin(); itr != m_blocks.end(); itr++) {
+        KRDataBlock *block = *itr;
+        if(width <= target_dim && height <= target_dim) {
+            block->prefetch(0, 0, priority);
+        }
+        
+        width = width >> 1;
+        if(width < 1) {
+            width = 1;
+        }
+        height = height >> 1;
+        if(height < 1) {
+            height = 1;
+        }
+    }
+}
+
 bool KRTextureKTX::uploadTexture(GLenum target, int lod_max_dim, int &current_lod_max_dim, bool compress, bool premultiply_alpha)
 {
     int target_dim = lod_max_dim;
@@ -207,6 +232,7 @@ bool KRTextureKTX::uploadTexture(GLenum target, int lod_max_dim, int &current_lo
 #endif
     
     // Upload texture data
+    KRTextureManager *textureManager = getContext().getTextureManager();
     int destination_level=0;
     int source_level = 0;
     for(std::list<KRDataBlock *>::iterator itr = m_blocks.begin(); itr != m_blocks.end(); itr++) {
@@ -225,20 +251,20 @@ bool KRTextureKTX::uploadTexture(GLenum target, int lod_max_dim, int &current_lo
                 //                GLDEBUG(glTexImage2D(target, 0, GL_RGBA, width, height, 0, GL_BGRA, GL_UNSIGNED_BYTE, NULL));
                 GLDEBUG(glCopyTextureLevelsAPPLE(m_iNewHandle, m_iHandle, source_level, 1));
             } else {
-                block->lock();
-                GLDEBUG(glCompressedTexSubImage2D(target, destination_level, 0, 0, width, height, (GLenum)m_header.glInternalFormat, (GLsizei)block->getSize(), block->getStart()));
-                block->unlock();
+                textureManager->uploadBlock(*block, [&](const GLvoid *pData) {
+                    GLDEBUG(glCompressedTexSubImage2D(target, destination_level, 0, 0, width, height, (GLenum)m_header.glInternalFormat, (GLsizei)block->getSize(), pData));
+                });
                 
                 memoryTransferred += block->getSize(); // memoryTransferred does not include throughput of mipmap levels copied through glCopyTextureLevelsAPPLE
             }
 #else
-            block->lock();
+            textureManager->uploadBlock(*block, [&](const GLvoid *pData) {
 #if GL_EXT_texture_storage
-            GLDEBUG(glCompressedTexSubImage2D(target, destination_level, 0, 0, width, height, (GLenum)m_header.glInternalFormat, (GLsizei)block->getSize(), block->getStart()));
+                GLDEBUG(glCompressedTexSubImage2D(target, destination_level, 0, 0, width, height, (GLenum)m_header.glInternalFormat, (GLsizei)block->getSize(), pData));
 #else
-            GLDEBUG(glCompressedTexImage2D(target, destination_level, (GLenum)m_header.glInternalFormat, width, height, 0, (GLsizei)block->getSize(), block->getStart()));
+                GLDEBUG(glCompressedTexImage2D(target, destination_level, (GLenum)m_header.glInternalFormat, width, height, 0, (GLsizei)block->getSize(), pData));
 #endif
-            block->unlock();
+            });
             memoryTransferred += block->getSize(); // memoryTransferred does not include throughput of mipmap levels copied through glCopyTextureLevelsAPPLE
 #endif
             memoryRequired += block->getSize();
@@ -22,6 +22,7 @@ public:
     bool uploadTexture(GLenum target, int lod_max_dim, int &current_lod_max_dim, bool compress = false, bool premultiply_alpha = false);
     
     virtual long getMemRequiredForSize(int max_dim);
+    virtual void prefetch(int max_dim, float priority);
     
 protected:
     
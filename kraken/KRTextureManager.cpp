@@ -48,7 +48,18 @@ KRTextureManager::KRTextureManager(KRContext &context) : KRContextObject(context
         m_boundTextureHandles[iTexture] = 0;
     }
     m_memoryTransferredThisFrame = 0;
-    m_streamerComplete = true;
+    m_streamerFramesSkipped = 0;
+    m_streamerFramesDeferred = 0;
+    m_streamerPrioritiesHash = 0;
+    m_streamerPrioritiesChanged = false;
+    
+#if KRENGINE_TEXTURE_PBO_UPLOADS
+    m_uploadBuffer = 0;
+    m_uploadMapping = NULL;
+    m_uploadHead = 0;
+    m_uploadFencedHead = 0;
+    m_uploadOffset = 0;
+#endif
     
     _clearGLState();
 }
@@ -57,8 +68,154 @@ KRTextureManager::~KRTextureManager() {
     for(unordered_map<std::string, KRTexture *>::iterator itr = m_textures.begin(); itr != m_textures.end(); ++itr){
         delete (*itr).second;
     }
+    
+#if KRENGINE_TEXTURE_PBO_UPLOADS
+    for(auto itr=m_uploadFences.begin(); itr != m_uploadFences.end(); itr++) {
+        GLDEBUG(glDeleteSync((*itr).fence));
+    }
+    if(m_uploadBuffer != 0) {
+        if(m_uploadMapping) {
+            GLDEBUG(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_uploadBuffer));
+            GLDEBUG(glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER));
+            GLDEBUG(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0));
+        }
+        GLDEBUG(glDeleteBuffers(1, &m_uploadBuffer));
+    }
+#endif
+}
+
+void *KRTextureManager::beginUpload(size_t size)
+{
+#if KRENGINE_TEXTURE_PBO_UPLOADS
+    if(size == 0 || size > KRENGINE_TEXTURE_UPLOAD_RING_SIZE) {
+        return NULL;
+    }
+    
+    if(m_uploadBuffer == 0) {
+        GLDEBUG(glGenBuffers(1, &m_uploadBuffer));
+        GLDEBUG(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_uploadBuffer));
+#if GL_ARB_buffer_storage
+        // Map the ring once for its lifetime when the driver supports persistent mapping
+        GLint major_version = 0, minor_version = 0;
+        GLDEBUG(glGetIntegerv(GL_MAJOR_VERSION, &major_version));
+        GLDEBUG(glGetIntegerv(GL_MINOR_VERSION, &minor_version));
+        if(major_version > 4 || (major_version == 4 && minor_version >= 4)) {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            GLDEBUG(glBufferStorage(GL_PIXEL_UNPACK_BUFFER, KRENGINE_TEXTURE_UPLOAD_RING_SIZE, NULL, flags));
+            GLDEBUG(m_uploadMapping = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, KRENGINE_TEXTURE_UPLOAD_RING_SIZE, flags));
+        }
+        if(m_uploadMapping == NULL)
+#endif
+        {
+            GLDEBUG(glBufferData(GL_PIXEL_UNPACK_BUFFER, KRENGINE_TEXTURE_UPLOAD_RING_SIZE, NULL, GL_STREAM_DRAW));
+        }
+    } else {
+        GLDEBUG(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_uploadBuffer));
+    }
+    
+    size_t offset = (m_uploadHead + KRENGINE_TEXTURE_UPLOAD_ALIGNMENT - 1) & ~(size_t)(KRENGINE_TEXTURE_UPLOAD_ALIGNMENT - 1);
+    if(offset + size > KRENGINE_TEXTURE_UPLOAD_RING_SIZE) {
+        // Wrap around to the start of the ring.  The uploads at the end of the ring are fenced first, so the fences never span the wrap.
+        fenceRing();
+        offset = 0;
+        m_uploadFencedHead = 0;
+    }
+    
+    // Wait for the GPU to finish reading any earlier uploads staged in this part of the ring
+    retireUploads(offset, offset + size);
+    
+    m_uploadOffset = offset;
+    m_uploadHead = offset + size;
+    if(m_uploadMapping) {
+        return (unsigned char *)m_uploadMapping + offset;
+    }
+    
+    void *staging = NULL;
+    GLDEBUG(staging = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, offset, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT));
+    if(staging == NULL) {
+        GLDEBUG(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0));
+    }
+    return staging;
+#else
+    return NULL;
+#endif
+}
+
+const GLvoid *KRTextureManager::commitUpload(void *staging)
+{
+#if KRENGINE_TEXTURE_PBO_UPLOADS
+    if(m_uploadMapping == NULL) {
+        GLDEBUG(glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER));
+    }
+    return (const GLvoid *)((char *)NULL + m_uploadOffset);
+#else
+    return staging;
+#endif
 }
 
+void KRTextureManager::endUpload()
+{
+#if KRENGINE_TEXTURE_PBO_UPLOADS
+    GLDEBUG(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0));
+#endif
+}
+
+void KRTextureManager::uploadBlock(KRDataBlock &data, const std::function<void(const GLvoid *pixels)> &upload)
+{
+    void *staging = beginUpload(data.getSize());
+    if(staging) {
+        data.copy(staging);
+        upload(commitUpload(staging));
+        endUpload();
+    } else {
+        data.lock();
+        upload(data.getStart());
+        data.unlock();
+    }
+}
+
+#if KRENGINE_TEXTURE_PBO_UPLOADS
+
+GLsync KRTextureManager::fenceUploads()
+{
+    fenceRing();
+    
+    GLsync fence = 0;
+    GLDEBUG(fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+    return fence;
+}
+
+void KRTextureManager::fenceRing()
+{
+    if(m_uploadHead != m_uploadFencedHead) {
+        upload_fence ring_fence;
+        GLDEBUG(ring_fence.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+        ring_fence.start = m_uploadFencedHead;
+        ring_fence.end = m_uploadHead;
+        m_uploadFences.push_back(ring_fence);
+        m_uploadFencedHead = m_uploadHead;
+    }
+}
+
+void KRTextureManager::retireUploads(size_t start, size_t end)
+{
+    // Fences are in ring order, so the oldest are the first to be overwritten
+    while(!m_uploadFences.empty()) {
+        upload_fence &ring_fence = m_uploadFences.front();
+        if(ring_fence.start >= end || ring_fence.end <= start) {
+            break;
+        }
+        GLenum status = GL_TIMEOUT_EXPIRED;
+        while(status == GL_TIMEOUT_EXPIRED) {
+            GLDEBUG(status = glClientWaitSync(ring_fence.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000)); // 1ms
+        }
+        GLDEBUG(glDeleteSync(ring_fence.fence));
+        m_uploadFences.pop_front();
+    }
+}
+
+#endif
+
 void KRTextureManager::_clearGLState()
 {
     for(int i=0; i < KRENGINE_MAX_TEXTURE_UNITS; i++) {
@@ -114,16 +271,15 @@ void KRTextureManager::_setWrapModeT(GLuint i, GLuint wrap_mode)
 }
 
 KRTexture *KRTextureManager::loadTexture(const char *szName, const char *szExtension, KRDataBlock *data) {
-    KRTexture *pTexture = NULL; 
-    
-    std::string lowerName = szName;
-    std::transform(lowerName.begin(), lowerName.end(),
-                   lowerName.begin(), ::tolower);
-    
-    std::string lowerExtension = szExtension;
-    std::transform(lowerExtension.begin(), lowerExtension.end(),
-                   lowerExtension.begin(), ::tolower);
+    KRTexture *pTexture = createTexture(szName, szExtension, data);
+    if(pTexture) {
+        addTexture(pTexture);
+    }
+    return pTexture;
+}
 
+KRTexture *KRTextureManager::createTexture(const char *szName, const char *szExtension, KRDataBlock *data) {
+    KRTexture *pTexture = NULL;
     
     if(strcmp(szExtension, "pvr") == 0) {
         pTexture = new KRTexturePVR(getContext(), data, szName);
@@ -132,13 +288,17 @@ KRTexture *KRTextureManager::loadTexture(const char *szName, const char *szExten
     } else if(strcmp(szExtension, "ktx") == 0) {
         pTexture = new KRTextureKTX(getContext(), data, szName);
     }
-    
-    if(pTexture) {
-        m_textures[lowerName] = pTexture;
-    }
     return pTexture;
 }
 
+void KRTextureManager::addTexture(KRTexture *texture) {
+    std::string lowerName = texture->getName();
+    std::transform(lowerName.begin(), lowerName.end(),
+                   lowerName.begin(), ::tolower);
+    
+    m_textures[lowerName] = texture;
+}
+
 KRTexture *KRTextureManager::getTextureCube(const char *szName) {
     std::string lowerName = szName;
     std::transform(lowerName.begin(), lowerName.end(),
@@ -186,6 +346,15 @@ KRTexture *KRTextureManager::getTexture(const std::string &name) {
     
     unordered_map<std::string, KRTexture *>::iterator itr = m_textures.find(lowerName);
     if(itr == m_textures.end()) {
+        // Load the texture from an indexed bundle on first use
+        KRBundleManager *bundleManager = getContext().getBundleManager();
+        if(bundleManager->loadPendingResource(lowerName, "ktx") || bundleManager->loadPendingResource(lowerName, "pvr") || bundleManager->loadPendingResource(lowerName, "tga")) {
+            itr = m_textures.find(lowerName);
+            if(itr != m_textures.end()) {
+                return (*itr).second;
+            }
+        }
+        
         if(lowerName.length() <= 8) {
             return NULL;
         } else if(lowerName.compare(0, 8, "animate:", 0, 8) == 0) {
@@ -215,6 +384,7 @@ void KRTextureManager::selectTexture(int iTextureUnit, KRTexture *pTexture, floa
         if(pTexture != NULL) {
             _setActiveTexture(iTextureUnit);
             pTexture->bind(iTextureUnit);
+            getContext().getMeshManager()->log_bind(KRMeshManager::BIND_TEXTURE);
         } else {
             selectTexture(GL_TEXTURE_2D, iTextureUnit, 0);
         }
@@ -229,6 +399,7 @@ bool KRTextureManager::selectTexture(GLenum target, int iTextureUnit, int iTextu
         m_boundTextureHandles[iTextureUnit] = iTextureHandle;
         _setActiveTexture(iTextureUnit);
         glBindTexture(target, iTextureHandle);
+        getContext().getMeshManager()->log_bind(KRMeshManager::BIND_TEXTURE);
         return true;
     } else {
         return false;
@@ -253,37 +424,53 @@ void KRTextureManager::startFrame(float deltaTime)
 {
     _clearGLState();
     
-    // TODO - Implement proper double-buffering to reduce copy operations
-    m_streamerFenceMutex.lock();
+    // Texture priorities are handed to the streamer every frame without waiting for it.
+    // Handle swaps and expiry must not race with the streamer resizing textures, so they are deferred to a later frame if it is busy.
+    bool streamerIdle = m_streamerFenceMutex.try_lock();
+    if(!streamerIdle) {
+        m_streamerFramesDeferred++;
+    }
     
-    if(m_streamerComplete) {
-        assert(m_activeTextures_streamer_copy.size() == 0); // The streamer should have emptied this if it really did complete
-        
-        const long KRENGINE_TEXTURE_EXPIRY_FRAMES = 10;
-        
-        std::set<KRTexture *> expiredTextures;
-        for(std::set<KRTexture *>::iterator itr=m_activeTextures.begin(); itr != m_activeTextures.end(); itr++) {
-            KRTexture *activeTexture = *itr;
+    const long KRENGINE_TEXTURE_EXPIRY_FRAMES = 10;
+    
+    std::vector<streamer_texture> &activeTextures = m_activeTextures_streamer.getBack();
+    activeTextures.clear();
+    
+    std::set<KRTexture *> expiredTextures;
+    size_t prioritiesHash = 0;
+    for(std::set<KRTexture *>::iterator itr=m_activeTextures.begin(); itr != m_activeTextures.end(); itr++) {
+        KRTexture *activeTexture = *itr;
+        if(streamerIdle) {
             activeTexture->_swapHandles();
             if(activeTexture->getLastFrameUsed() + KRENGINE_TEXTURE_EXPIRY_FRAMES < getContext().getCurrentFrame()) {
                 // Expire textures that haven't been used in a long time
                 expiredTextures.insert(activeTexture);
                 activeTexture->releaseHandles();
-            } else {
-                float priority = activeTexture->getStreamPriority();
-                m_activeTextures_streamer_copy.push_back(std::pair<float, KRTexture *>(priority, activeTexture));
+                continue;
             }
         }
-        for(std::set<KRTexture *>::iterator itr=expiredTextures.begin(); itr != expiredTextures.end(); itr++) {
-            m_activeTextures.erase(*itr);
-        }
-        
-        if(m_activeTextures_streamer_copy.size() > 0) {
-            m_streamerComplete = false;
-        }
+        streamer_texture streamerTexture;
+        streamerTexture.priority = activeTexture->getStreamPriority();
+        streamerTexture.weight = activeTexture->getStreamWeight();
+        streamerTexture.texture = activeTexture;
+        activeTextures.push_back(streamerTexture);
+        prioritiesHash = prioritiesHash * 31 + (hash<KRTexture *>()(activeTexture) ^ hash<float>()(streamerTexture.priority) ^ (hash<float>()(streamerTexture.weight) << 1));
+    }
+    for(std::set<KRTexture *>::iterator itr=expiredTextures.begin(); itr != expiredTextures.end(); itr++) {
+        m_activeTextures.erase(*itr);
+    }
+    
+    m_streamerPrioritiesChanged = prioritiesHash != m_streamerPrioritiesHash;
+    m_streamerPrioritiesHash = prioritiesHash;
+    
+    // Published while still holding the lock when idle, so the streamer never sees a list containing expired textures
+    if(!m_activeTextures_streamer.publish()) {
+        m_streamerFramesSkipped++;
+    }
+    
+    if(streamerIdle) {
+        m_streamerFenceMutex.unlock();
     }
-
-    m_streamerFenceMutex.unlock();
     
     m_memoryTransferredThisFrame = 0;
 }
@@ -299,21 +486,31 @@ void KRTextureManager::endFrame(float deltaTime)
 
 void KRTextureManager::doStreaming(long &memoryRemaining, long &memoryRemainingThisFrame)
 {
-    
-    // TODO - Implement proper double-buffering to reduce copy operations
     m_streamerFenceMutex.lock();
-    m_activeTextures_streamer = std::move(m_activeTextures_streamer_copy);
-    m_streamerFenceMutex.unlock();
     
-    if(m_activeTextures_streamer.size() > 0) {
+    // Only the latest frame's priorities are used; each list is balanced at most once
+    if(m_activeTextures_streamer.consume() && m_activeTextures_streamer.getFront().size() > 0) {
         balanceTextureMemory(memoryRemaining, memoryRemainingThisFrame);
-        
-        m_streamerFenceMutex.lock();
-        m_streamerComplete = true;
-        m_streamerFenceMutex.unlock();
     } else {
         memoryRemaining -= getMemUsed();
     }
+    
+    m_streamerFenceMutex.unlock();
+}
+
+long KRTextureManager::getStreamerFramesSkipped()
+{
+    return m_streamerFramesSkipped;
+}
+
+long KRTextureManager::getStreamerFramesDeferred()
+{
+    return m_streamerFramesDeferred;
+}
+
+bool KRTextureManager::getStreamerPrioritiesChanged()
+{
+    return m_streamerPrioritiesChanged;
 }
 
 void KRTextureManager::balanceTextureMemory(long &memoryRemaining, long &memoryRemainingThisFrame)
@@ -322,45 +519,218 @@ void KRTextureManager::balanceTextureMemory(long &memoryRemaining, long &memoryR
     // Favour performance over maximum texture resolution when memory is insufficient for textures at full resolution.
     
     /*
-     NEW ALGORITHM:
-     
-     Textures are assigned a “weight” by tuneable criteria:
+     Textures are assigned a “weight” by KRTexture::getStreamWeight, on the render thread in startFrame:
      - Area of screen coverage taken by objects containing material (more accurate and generic than distance)
      - Type of texture (separate weight for normal, diffuse, spec maps)
      - Last used time (to keep textures loaded for recently seen objects that are outside of the view frustum)
      Those factors combine together to give a “weight”, which represents a proportion relative to all other textures weights
-     Mipmap levels are stripped off of each texture until they occupy the amount of memory they should proportionally have
-     This is in contrast to the global ceiling of texture resolution that slowly drops until the textures fit
-     
+     Mipmap levels are stripped off of each texture until they occupy the amount of memory they should proportionally have (SolveResidency)
+     This is in contrast to the global ceiling of texture resolution that slowly drops until the textures fit (SolveResidencyCascade)
      */
-
-    // ---------------
     
-    //long MAX_STREAM_TIME = 66;
     //long startTime = getContext().getAbsoluteTimeMilliseconds();
     
-    std::sort(m_activeTextures_streamer.begin(), m_activeTextures_streamer.end(), std::greater<std::pair<float, KRTexture *>>());
+    std::vector<streamer_texture> &activeTextures = m_activeTextures_streamer.getFront();
+    std::sort(activeTextures.begin(), activeTextures.end(), [](const streamer_texture &a, const streamer_texture &b) {
+        return a.priority > b.priority;
+    });
     
-    for(auto itr=m_activeTextures_streamer.begin(); itr != m_activeTextures_streamer.end(); itr++) {
-        KRTexture *texture = (*itr).second;
-        int min_mip_level = KRMAX(getContext().KRENGINE_MIN_TEXTURE_DIM, texture->getMinMipMap());
-        long minLodMem = texture->getMemRequiredForSize(min_mip_level);
-        memoryRemaining -= minLodMem;
+    std::vector<residency_entry> &entries = m_residencyEntries;
+    entries.resize(activeTextures.size());
+    for(size_t i=0; i < activeTextures.size(); i++) {
+        KRTexture *texture = activeTextures[i].texture;
+        residency_entry &entry = entries[i];
+        entry.texture = texture;
+        entry.priority = activeTextures[i].priority;
+        entry.weight = activeTextures[i].weight;
+        entry.current_dim = texture->getNewLodMaxDim();
         
-        if(memoryRemainingThisFrame > minLodMem && texture->getNewLodMaxDim() < min_mip_level) {
-            memoryRemainingThisFrame -= minLodMem;
-            texture->resize(min_mip_level);
+        int max_mip_level = KRMIN(getContext().KRENGINE_MAX_TEXTURE_DIM, texture->getMaxMipMap());
+        int min_mip_level = KRMIN(KRMAX(getContext().KRENGINE_MIN_TEXTURE_DIM, texture->getMinMipMap()), max_mip_level);
+        entry.level_count = 0;
+        for(int dim = min_mip_level; dim <= max_mip_level && entry.level_count < KRENGINE_RESIDENCY_MAX_LEVELS; dim <<= 1) {
+            entry.level_dim[entry.level_count] = dim;
+            entry.level_mem[entry.level_count] = texture->getMemRequiredForSize(dim);
+            entry.level_count++;
+            if(dim == 0) break;
+        }
+        if(entry.level_dim[entry.level_count - 1] != max_mip_level && entry.level_count < KRENGINE_RESIDENCY_MAX_LEVELS) {
+            // Not a power of two multiple of the minimum resolution
+            entry.level_dim[entry.level_count] = max_mip_level;
+            entry.level_mem[entry.level_count] = texture->getMemRequiredForSize(max_mip_level);
+            entry.level_count++;
+        }
+        entry.target_dim = entry.level_dim[0];
+    }
+    
+    if(m_streamTrace.is_open()) {
+        WriteStreamTrace(m_streamTrace, getContext().getCurrentFrame(), memoryRemaining, memoryRemainingThisFrame, entries);
+    }
+    
+    SolveResidency(entries, memoryRemaining);
+    
+    // Bring every texture up to its minimum resolution first, in priority order
+    for(auto itr=entries.begin(); itr != entries.end(); itr++) {
+        residency_entry &entry = *itr;
+        if(entry.current_dim < entry.level_dim[0]) {
+            if(memoryRemainingThisFrame > entry.level_mem[0] && !getContext().getStreamingTimeExceeded()) {
+                memoryRemainingThisFrame -= entry.level_mem[0];
+                entry.texture->resize(entry.level_dim[0]);
+                entry.current_dim = entry.level_dim[0];
+            } else {
+                // Out of transfer or time budget for this pass; start reading it from disk so it is ready for the next pass
+                entry.texture->prefetch(entry.level_dim[0], entry.priority);
+            }
         }
     }
     
     //long minMipTime = getContext().getAbsoluteTimeMilliseconds() - startTime;
     
+    // Then step each texture towards its target resolution as the transfer budget allows
+    for(auto itr=entries.begin(); itr != entries.end(); itr++) {
+        residency_entry &entry = *itr;
+        if(entry.current_dim < entry.level_dim[0] || entry.current_dim == entry.target_dim) {
+            continue;
+        }
+        int next_dim = StepTowards(entry.current_dim, entry.target_dim);
+        long next_mem = entry.texture->getMemRequiredForSize(next_dim);
+        if(memoryRemainingThisFrame > next_mem && !getContext().getStreamingTimeExceeded()) {
+            memoryRemainingThisFrame -= next_mem;
+            entry.texture->resize(next_dim);
+        } else if(next_dim > entry.current_dim) {
+            // Out of transfer or time budget for this pass; start reading it from disk so it is ready for the next pass
+            entry.texture->prefetch(next_dim, entry.priority);
+        }
+    }
+    
+    glFlush();
+    
+    //long streamerTime = getContext().getAbsoluteTimeMilliseconds() - startTime;
+    //fprintf(stderr, "%i / %i\n", (int)minMipTime, (int)streamerTime);
+
+}
+
+int KRTextureManager::StepTowards(int current_dim, int target_dim)
+{
+    // Large increases in resolution are spread over several passes, so the transfer budget is shared between more textures
+    if(target_dim <= current_dim || current_dim >= (target_dim >> 1)) {
+        return target_dim;
+    } else if(current_dim >= (target_dim >> 2)) {
+        return target_dim >> 1;
+    } else {
+        return target_dim >> 2;
+    }
+}
+
+int KRTextureManager::ResidencyLevel(const residency_entry &entry, int dim)
+{
+    // Index of the highest level no larger than dim, or 0 if dim is below the minimum level
+    int level = 0;
+    while(level + 1 < entry.level_count && entry.level_dim[level + 1] <= dim) {
+        level++;
+    }
+    return level;
+}
+
+void KRTextureManager::SolveResidency(std::vector<residency_entry> &entries, long &memoryRemaining)
+{
+    // Every texture is given its minimum resolution
+    float total_weight = 0.0f;
+    std::vector<std::pair<float, residency_entry *> > by_cost;
+    for(auto itr=entries.begin(); itr != entries.end(); itr++) {
+        residency_entry &entry = *itr;
+        entry.target_dim = entry.level_dim[0];
+        memoryRemaining -= entry.level_mem[0];
+        if(entry.weight > 0.0f && entry.level_count > 1) {
+            long full_mem = entry.level_mem[entry.level_count - 1] - entry.level_mem[0];
+            by_cost.push_back(std::pair<float, residency_entry *>((float)full_mem / entry.weight, &entry));
+            total_weight += entry.weight;
+        }
+    }
+    if(memoryRemaining <= 0 || by_cost.empty()) {
+        return;
+    }
+    
+    // The remaining memory is shared in proportion to weight.  Textures whose full resolution needs less than their share are satisfied first, returning the difference to the others.
+    std::sort(by_cost.begin(), by_cost.end());
+    auto itr = by_cost.begin();
+    for(; itr != by_cost.end(); itr++) {
+        float bytes_per_weight = (float)memoryRemaining / total_weight;
+        if((*itr).first > bytes_per_weight) {
+            break;
+        }
+        residency_entry &entry = *(*itr).second;
+        entry.target_dim = entry.level_dim[entry.level_count - 1];
+        memoryRemaining -= entry.level_mem[entry.level_count - 1] - entry.level_mem[0];
+        total_weight -= entry.weight;
+    }
+    if(itr == by_cost.end()) {
+        return;
+    }
+    
+    // The others get the highest resolution their share covers.  A band of KRENGINE_TEXTURE_HYSTERESIS either side of the current resolution stops textures near a threshold from changing every pass.
+    std::vector<std::pair<float, residency_entry *> > partial;
+    float bytes_per_weight = (float)memoryRemaining / total_weight;
+    for(; itr != by_cost.end(); itr++) {
+        residency_entry &entry = *(*itr).second;
+        float share = bytes_per_weight * entry.weight;
+        int up_level = 0;
+        int down_level = 0;
+        for(int level=1; level < entry.level_count; level++) {
+            float additional_mem = (float)(entry.level_mem[level] - entry.level_mem[0]);
+            if(additional_mem * (1.0f + KRENGINE_TEXTURE_HYSTERESIS) <= share) {
+                up_level = level;
+            }
+            if(additional_mem <= share * (1.0f + KRENGINE_TEXTURE_HYSTERESIS)) {
+                down_level = level;
+            }
+        }
+        int level = KRCLAMP(ResidencyLevel(entry, entry.current_dim), up_level, down_level);
+        entry.target_dim = entry.level_dim[level];
+        memoryRemaining -= entry.level_mem[level] - entry.level_mem[0];
+        partial.push_back(std::pair<float, residency_entry *>(entry.weight, &entry));
+    }
+    
+    std::sort(partial.begin(), partial.end());
+    if(memoryRemaining < 0) {
+        // Hysteresis kept more than the budget allows; step the lowest weight textures down until it fits
+        for(auto partial_itr=partial.begin(); partial_itr != partial.end() && memoryRemaining < 0; partial_itr++) {
+            residency_entry &entry = *(*partial_itr).second;
+            int level = ResidencyLevel(entry, entry.target_dim);
+            while(level > 0 && memoryRemaining < 0) {
+                memoryRemaining += entry.level_mem[level] - entry.level_mem[level - 1];
+                level--;
+            }
+            entry.target_dim = entry.level_dim[level];
+        }
+    } else {
+        // Spend what is left over from rounding down to whole mip levels on the highest weight textures
+        for(auto partial_itr=partial.rbegin(); partial_itr != partial.rend(); partial_itr++) {
+            residency_entry &entry = *(*partial_itr).second;
+            int level = ResidencyLevel(entry, entry.target_dim);
+            if(level + 1 < entry.level_count && entry.level_mem[level + 1] - entry.level_mem[level] <= memoryRemaining) {
+                memoryRemaining -= entry.level_mem[level + 1] - entry.level_mem[level];
+                entry.target_dim = entry.level_dim[level + 1];
+            }
+        }
+    }
+}
+
+void KRTextureManager::SolveResidencyCascade(std::vector<residency_entry> &entries, long &memoryRemaining)
+{
+    // The fixed percentage heuristic used before SolveResidency; a global ceiling of texture resolution drops in steps until the textures fit.  Entries must be in priority order.
+    for(auto itr=entries.begin(); itr != entries.end(); itr++) {
+        residency_entry &entry = *itr;
+        entry.target_dim = KRMAX(entry.current_dim, entry.level_dim[0]);
+        memoryRemaining -= entry.level_mem[0];
+    }
+    
     std::vector<int> mipPercents = {75, 75, 50, 50, 50};
     int mip_drop = -1;
     auto mip_itr = mipPercents.begin();
     long memoryRemainingThisMip = 0;
-
-    for(auto itr=m_activeTextures_streamer.begin(); itr != m_activeTextures_streamer.end(); itr++) {
+    
+    for(auto itr=entries.begin(); itr != entries.end(); itr++) {
         if(memoryRemainingThisMip <= 0) {
             if(mip_itr == mipPercents.end()) {
                 break;
@@ -371,38 +741,153 @@ void KRTextureManager::balanceTextureMemory(long &memoryRemaining, long &memoryR
             }
         }
         
-        KRTexture *texture = (*itr).second;
-        int min_mip_level = KRMAX(getContext().KRENGINE_MIN_TEXTURE_DIM, texture->getMinMipMap());
-        int max_mip_level = KRMIN(getContext().KRENGINE_MAX_TEXTURE_DIM, texture->getMaxMipMap());
-        int target_mip_level = (max_mip_level >> mip_drop);
-        long targetMem = texture->getMemRequiredForSize(target_mip_level);
-        long additionalMemRequired = targetMem - texture->getMemRequiredForSize(min_mip_level);
+        residency_entry &entry = *itr;
+        int level = ResidencyLevel(entry, entry.level_dim[entry.level_count - 1] >> mip_drop);
+        long additionalMemRequired = entry.level_mem[level] - entry.level_mem[0];
         memoryRemainingThisMip -= additionalMemRequired;
         memoryRemaining -= additionalMemRequired;
-        if(memoryRemainingThisMip > 0 && memoryRemainingThisFrame > targetMem) {
-            int current_mip_level = texture->getNewLodMaxDim();
-            if(current_mip_level == (target_mip_level >> 1) || target_mip_level < current_mip_level) {
-                memoryRemainingThisFrame -= targetMem;
-                texture->resize(target_mip_level);
-            } else if(current_mip_level == (target_mip_level >> 2)) {
-                memoryRemainingThisFrame -= texture->getMemRequiredForSize(target_mip_level >> 1);
-                texture->resize(target_mip_level >> 1);
-            } else if(current_mip_level < (target_mip_level >> 2)) {
-                memoryRemainingThisFrame -= texture->getMemRequiredForSize(target_mip_level >> 2);
-                texture->resize(target_mip_level >> 2);
+        if(memoryRemainingThisMip > 0) {
+            entry.target_dim = entry.level_dim[level];
+        }
+    }
+}
+
+void KRTextureManager::setStreamTrace(const std::string &path)
+{
+    m_streamerFenceMutex.lock();
+    if(m_streamTrace.is_open()) {
+        m_streamTrace.close();
+    }
+    if(!path.empty()) {
+        m_streamTrace.open(path.c_str(), std::ios::out | std::ios::trunc);
+        if(!m_streamTrace.is_open()) {
+            KRContext::Log(KRContext::LOG_LEVEL_ERROR, "KRTextureManager::setStreamTrace - Failed to open file: %s", path.c_str());
+        }
+    }
+    m_streamerFenceMutex.unlock();
+}
+
+void KRTextureManager::WriteStreamTrace(std::ostream &trace, long frame, long memoryRemaining, long memoryRemainingThisFrame, const std::vector<residency_entry> &entries)
+{
+    // One "pass" line, followed by a "texture" line for each texture.  The name is last, as it may contain spaces.
+    trace << "pass " << frame << " " << memoryRemaining << " " << memoryRemainingThisFrame << " " << entries.size() << "\n";
+    for(auto itr=entries.begin(); itr != entries.end(); itr++) {
+        const residency_entry &entry = *itr;
+        trace << "texture " << entry.priority << " " << entry.weight << " " << entry.current_dim << " " << entry.level_count;
+        for(int level=0; level < entry.level_count; level++) {
+            trace << " " << entry.level_dim[level] << " " << entry.level_mem[level];
+        }
+        trace << " " << entry.texture->getName() << "\n";
+    }
+}
+
+void KRTextureManager::SimulateStreamTrace(const std::string &path)
+{
+    std::ifstream trace(path.c_str());
+    if(!trace.is_open()) {
+        KRContext::Log(KRContext::LOG_LEVEL_ERROR, "KRTextureManager::SimulateStreamTrace - Failed to open file: %s", path.c_str());
+        return;
+    }
+    
+    // Each solver keeps its own simulated resident resolutions, rather than those recorded in the trace
+    typedef struct {
+        const char *name;
+        void (*solve)(std::vector<residency_entry> &entries, long &memoryRemaining);
+        unordered_map<std::string, int> resident_dim;
+        long long upload_bytes;
+        long mip_changes;
+        double quality;
+    } simulation;
+    
+    simulation simulations[2] = {
+        {"weighted", SolveResidency, unordered_map<std::string, int>(), 0, 0, 0.0},
+        {"cascade", SolveResidencyCascade, unordered_map<std::string, int>(), 0, 0, 0.0}
+    };
+    
+    long pass_count = 0;
+    std::vector<residency_entry> entries;
+    std::vector<std::string> names;
+    std::string keyword;
+    while(trace >> keyword) {
+        if(keyword.compare("pass") != 0) {
+            KRContext::Log(KRContext::LOG_LEVEL_ERROR, "KRTextureManager::SimulateStreamTrace - Unexpected \"%s\" in %s", keyword.c_str(), path.c_str());
+            return;
+        }
+        long frame = 0, memoryRemaining = 0, memoryRemainingThisFrame = 0;
+        size_t texture_count = 0;
+        trace >> frame >> memoryRemaining >> memoryRemainingThisFrame >> texture_count;
+        
+        entries.resize(texture_count);
+        names.resize(texture_count);
+        for(size_t i=0; i < texture_count; i++) {
+            residency_entry &entry = entries[i];
+            entry.texture = NULL;
+            trace >> keyword >> entry.priority >> entry.weight >> entry.current_dim >> entry.level_count;
+            entry.level_count = KRCLAMP(entry.level_count, 1, KRENGINE_RESIDENCY_MAX_LEVELS);
+            for(int level=0; level < entry.level_count; level++) {
+                trace >> entry.level_dim[level] >> entry.level_mem[level];
             }
+            std::getline(trace >> std::ws, names[i]);
+        }
+        if(!trace) {
+            KRContext::Log(KRContext::LOG_LEVEL_ERROR, "KRTextureManager::SimulateStreamTrace - Truncated pass for frame %i in %s", (int)frame, path.c_str());
+            break;
         }
+        pass_count++;
         
-        //if(getContext().getAbsoluteTimeMilliseconds() - startTime > MAX_STREAM_TIME) {
-        //    return; // Bail out early if we spend too long
-        //}
+        for(int s=0; s < 2; s++) {
+            simulation &sim = simulations[s];
+            std::vector<residency_entry> sim_entries = entries;
+            for(size_t i=0; i < texture_count; i++) {
+                sim_entries[i].current_dim = sim.resident_dim[names[i]];
+            }
+            long sim_memoryRemaining = memoryRemaining;
+            long sim_memoryRemainingThisFrame = memoryRemainingThisFrame;
+            sim.solve(sim_entries, sim_memoryRemaining);
+            
+            // Same transfer model as balanceTextureMemory, without the time budget
+            for(int pass=0; pass < 2; pass++) {
+                for(size_t i=0; i < texture_count; i++) {
+                    residency_entry &entry = sim_entries[i];
+                    int next_dim = 0;
+                    if(pass == 0 && entry.current_dim < entry.level_dim[0]) {
+                        next_dim = entry.level_dim[0];
+                    } else if(pass == 1 && entry.current_dim >= entry.level_dim[0] && entry.current_dim != entry.target_dim) {
+                        next_dim = StepTowards(entry.current_dim, entry.target_dim);
+                    } else {
+                        continue;
+                    }
+                    long next_mem = entry.level_mem[ResidencyLevel(entry, next_dim)];
+                    if(sim_memoryRemainingThisFrame > next_mem) {
+                        sim_memoryRemainingThisFrame -= next_mem;
+                        sim.upload_bytes += next_mem;
+                        sim.mip_changes++;
+                        entry.current_dim = next_dim;
+                    }
+                }
+            }
+            
+            // Residency quality is the weighted average fraction of full resolution memory that is resident
+            double weighted_quality = 0.0;
+            double total_weight = 0.0;
+            for(size_t i=0; i < texture_count; i++) {
+                residency_entry &entry = sim_entries[i];
+                sim.resident_dim[names[i]] = entry.current_dim;
+                if(entry.current_dim >= entry.level_dim[0]) {
+                    weighted_quality += entry.weight * (double)entry.level_mem[ResidencyLevel(entry, entry.current_dim)] / (double)entry.level_mem[entry.level_count - 1];
+                }
+                total_weight += entry.weight;
+            }
+            if(total_weight > 0.0) {
+                sim.quality += weighted_quality / total_weight;
+            }
+        }
     }
     
-    glFlush();
-    
-    //long streamerTime = getContext().getAbsoluteTimeMilliseconds() - startTime;
-    //fprintf(stderr, "%i / %i\n", (int)minMipTime, (int)streamerTime);
-
+    for(int s=0; s < 2; s++) {
+        simulation &sim = simulations[s];
+        KRContext::Log(KRContext::LOG_LEVEL_INFORMATION, "KRTextureManager::SimulateStreamTrace - %s: %i passes, %i KB uploaded, %i mip changes, %.1f%% weighted residency", sim.name, (int)pass_count, (int)(sim.upload_bytes / 1024), (int)sim.mip_changes, pass_count > 0 ? sim.quality * 100.0 / (double)pass_count : 0.0);
+    }
 }
 
 long KRTextureManager::getMemoryTransferedThisFrame()
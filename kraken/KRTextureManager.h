@@ -40,6 +40,12 @@
 #include "KRDataBlock.h"
 #include "KRContext.h"
 #include "KRStreamer.h"
+#include "KRTripleBuffer.h"
+
+#define KRENGINE_RESIDENCY_MAX_LEVELS 16
+#define KRENGINE_TEXTURE_HYSTERESIS 0.25f
+#define KRENGINE_TEXTURE_UPLOAD_RING_SIZE 0x1000000 // 16MB of staging memory for texture uploads
+#define KRENGINE_TEXTURE_UPLOAD_ALIGNMENT 64
 
 class KRTextureManager : public KRContextObject {
 public:
@@ -50,6 +56,10 @@ public:
     bool selectTexture(GLenum target, int iTextureUnit, int iTextureHandle);
     
     KRTexture *loadTexture(const char *szName, const char *szExtension, KRDataBlock *data);
+    
+    // Construct a texture from its file header without adding it to the manager.  May be called from any thread.
+    KRTexture *createTexture(const char *szName, const char *szExtension, KRDataBlock *data);
+    void addTexture(KRTexture *texture);
     KRTexture *getTextureCube(const char *szName);
     KRTexture *getTexture(const std::string &name);
     
@@ -81,6 +91,50 @@ public:
     void doStreaming(long &memoryRemaining, long &memoryRemainingThisFrame);
     void primeTexture(KRTexture *texture);
     
+    // Frames whose texture priorities were replaced by a newer frame before the streamer read them
+    long getStreamerFramesSkipped();
+    // Frames where handle swaps and texture expiry were deferred, as the streamer was updating textures
+    long getStreamerFramesDeferred();
+    // True if the texture priorities published by the last frame differ from those of the frame before
+    bool getStreamerPrioritiesChanged();
+    
+    // Texture uploads on the streamer thread are staged through a ring of pixel buffer memory, rather than passing client memory to GL and waiting with glFinish.
+    // beginUpload returns memory to write size bytes of pixel data to, or NULL if the data should be passed to GL directly.
+    void *beginUpload(size_t size);
+    // Finish writing the memory returned by beginUpload, returning the pointer to pass to glTexImage2D or glCompressedTexImage2D
+    const GLvoid *commitUpload(void *staging);
+    // Call after issuing the GL upload for a committed staging buffer
+    void endUpload();
+    // Upload the contents of a data block, staged through the ring when available, or from the block's own memory otherwise.
+    // upload issues the GL call, and is passed the pointer to give it.
+    void uploadBlock(KRDataBlock &data, const std::function<void(const GLvoid *pixels)> &upload);
+#if KRENGINE_TEXTURE_PBO_UPLOADS
+    // Fence the uploads issued so far.  Returns a fence for the caller, which is signalled when the uploads have completed.
+    GLsync fenceUploads();
+#endif
+    
+    // A texture as seen by the residency solver.  texture is NULL when replaying a trace.
+    typedef struct {
+        KRTexture *texture;
+        float priority;
+        float weight;
+        int current_dim;
+        int target_dim; // Output of the solver
+        int level_count;
+        int level_dim[KRENGINE_RESIDENCY_MAX_LEVELS]; // Resolutions from the minimum to the maximum allowed, ascending
+        long level_mem[KRENGINE_RESIDENCY_MAX_LEVELS]; // Memory required at each resolution
+    } residency_entry;
+    
+    // Set target_dim for each entry, sharing memoryRemaining between the textures in proportion to their weights
+    static void SolveResidency(std::vector<residency_entry> &entries, long &memoryRemaining);
+    // The fixed percentage heuristic that SolveResidency replaced, kept for comparison
+    static void SolveResidencyCascade(std::vector<residency_entry> &entries, long &memoryRemaining);
+    
+    // Record the solver input for each streamer pass to a file.  An empty path stops recording.
+    void setStreamTrace(const std::string &path);
+    // Replay a recorded trace through both solvers, logging the upload volume, mip changes and weighted residency of each
+    static void SimulateStreamTrace(const std::string &path);
+    
 private:
     int m_iActiveTexture;
     
@@ -97,15 +151,46 @@ private:
     
     std::set<KRTexture *> m_activeTextures;
     
-    std::vector<std::pair<float, KRTexture *> > m_activeTextures_streamer;
-    std::vector<std::pair<float, KRTexture *> > m_activeTextures_streamer_copy;
-    bool m_streamerComplete;
+    // Texture priorities and weights, computed on the render thread and handed to the streamer thread each frame, so the streamer never reads the usage state of a texture
+    typedef struct {
+        float priority;
+        float weight;
+        KRTexture *texture;
+    } streamer_texture;
+    KRTripleBuffer<std::vector<streamer_texture> > m_activeTextures_streamer;
+    std::atomic<long> m_streamerFramesSkipped;
+    std::atomic<long> m_streamerFramesDeferred;
+    size_t m_streamerPrioritiesHash;
+    bool m_streamerPrioritiesChanged;
     
     std::atomic<long> m_textureMemUsed;
     
     void balanceTextureMemory(long &memoryRemaining, long &memoryRemainingThisFrame);
+#if KRENGINE_TEXTURE_PBO_UPLOADS
+    // Upload ring; only used by the streamer thread
+    GLuint m_uploadBuffer;
+    void *m_uploadMapping; // Persistent mapping of the whole ring, if supported
+    size_t m_uploadHead; // Offset where the next upload will be staged
+    size_t m_uploadFencedHead; // Uploads before this offset have a fence in m_uploadFences
+    size_t m_uploadOffset; // Offset of the upload between beginUpload and endUpload
+    typedef struct {
+        GLsync fence;
+        size_t start;
+        size_t end;
+    } upload_fence;
+    std::deque<upload_fence> m_uploadFences;
+    void fenceRing(); // Fence the staged uploads that are not yet covered by a fence in m_uploadFences
+    void retireUploads(size_t start, size_t end);
+#endif
+    
+    std::vector<residency_entry> m_residencyEntries; // Only used by the streamer thread; kept to avoid reallocating each pass
+    std::ofstream m_streamTrace;
+    
+    static int StepTowards(int current_dim, int target_dim);
+    static int ResidencyLevel(const residency_entry &entry, int dim);
+    static void WriteStreamTrace(std::ostream &trace, long frame, long memoryRemaining, long memoryRemainingThisFrame, const std::vector<residency_entry> &entries);
     
-    std::mutex m_streamerFenceMutex;
+    std::mutex m_streamerFenceMutex; // Held by the streamer while it updates textures
 };
 
 #endif
@@ -10,6 +10,8 @@
 #include "KREngine-common.h"
 #include "KRContext.h"
 #include "KRTextureKTX.h"
+#include "KRTextureCompressor.h"
+#include "KRPixelConvert.h"
 
 #if defined(_WIN32) || defined(_WIN64)
 #pragma pack(1)
@@ -108,63 +110,76 @@ bool KRTextureTGA::uploadTexture(GLenum target, int lod_max_dim, int &current_lo
         m_pData->unlock();
         return false; // Mapped colors not supported
     }
+    if(pHeader->imagetype != 2 && pHeader->imagetype != 10) {
+        m_pData->unlock();
+        return false; // Image type not yet supported
+    }
+    if(pHeader->bitsperpixel != 24 && pHeader->bitsperpixel != 32) {
+        m_pData->unlock();
+        return false; // 16-bit images not yet supported
+    }
+    
+    // Decode straight into the texture manager's staging memory when it is available, otherwise into a temporary buffer
+    KRTextureManager *textureManager = getContext().getTextureManager();
+    size_t image_size = pHeader->width * pHeader->height * 4;
+    unsigned char *staging = compress ? NULL : (unsigned char *)textureManager->beginUpload(image_size);
+    unsigned char *converted_image = NULL;
+    const GLvoid *pixels = NULL;
+    if(staging == NULL && pHeader->imagetype == 2 && pHeader->bitsperpixel == 32 && !premultiply_alpha) {
+        pixels = pData; // Already in the format GL expects
+    } else {
+        converted_image = staging ? staging : (unsigned char *)malloc(image_size);
+        if(!decode(converted_image, premultiply_alpha)) {
+            if(staging) {
+                textureManager->commitUpload(staging);
+                textureManager->endUpload();
+            } else {
+                free(converted_image);
+            }
+            m_pData->unlock();
+            return false;
+        }
+        pixels = staging ? textureManager->commitUpload(staging) : converted_image;
+    }
+    
+    // Completion is tracked with a fence by KRTexture::resize, rather than waiting here with glFinish
+    GLDEBUG(glTexImage2D(target, 0, internal_format, pHeader->width, pHeader->height, 0, GL_BGRA, GL_UNSIGNED_BYTE, pixels));
+    if(staging) {
+        textureManager->endUpload();
+    } else if(converted_image) {
+        free(converted_image);
+    }
+    current_lod_max_dim = m_max_lod_max_dim;
+
+    m_pData->unlock();
+    return true;
+}
+
+bool KRTextureTGA::decode(unsigned char *converted_image, bool premultiply_alpha)
+{
+    m_pData->lock();
+    TGA_HEADER *pHeader = (TGA_HEADER *)m_pData->getStart();
+    unsigned char *pData = (unsigned char *)pHeader + (long)pHeader->idlength + (long)pHeader->colourmaplength * (long)pHeader->colourmaptype + sizeof(TGA_HEADER);
     
+    if(pHeader->colourmaptype != 0) {
+        m_pData->unlock();
+        return false; // Mapped colors not supported
+    }
+    
+    size_t pixel_count = pHeader->width * pHeader->height;
     switch(pHeader->imagetype) {
         case 2: // rgb
             switch(pHeader->bitsperpixel) {
                 case 24:
-                    {
-                        unsigned char *converted_image = (unsigned char *)malloc(pHeader->width * pHeader->height * 4);
-//#ifdef __APPLE__
-//                        vImage_Buffer   source_image = { pData, pHeader->height, pHeader->width, pHeader->width*3 };
-//                        vImage_Buffer   dest_image = { converted_image, pHeader->height, pHeader->width, pHeader->width*4 };
-//                        vImageConvert_RGB888toRGBA8888(&source_image, NULL, 0xff, &dest_image, false, kvImageDoNotTile);
-//#else
-                        unsigned char *pSource = pData;
-                        unsigned char *pDest = converted_image;
-                        unsigned char *pEnd = pData + pHeader->height * pHeader->width * 3;
-                        while(pSource < pEnd) {
-                            *pDest++ = pSource[0];
-                            *pDest++ = pSource[1];
-                            *pDest++ = pSource[2];
-                            *pDest++ = 0xff;
-                            pSource += 3;
-                        }
-                        assert(pSource <= m_pData->getEnd());
-//#endif
-                        GLDEBUG(glTexImage2D(target, 0, internal_format, pHeader->width, pHeader->height, 0, GL_BGRA, GL_UNSIGNED_BYTE, (GLvoid *)converted_image));
-                        GLDEBUG(glFinish());
-                        free(converted_image);
-
-                        current_lod_max_dim = m_max_lod_max_dim;
-                    }
+                    assert(pData + pixel_count * 3 <= (unsigned char *)m_pData->getEnd());
+                    KRPixelConvert::ExpandRGBToRGBA(pData, converted_image, pixel_count);
                     break;
                 case 32:
-                    {
-                        if(premultiply_alpha) {
-                            unsigned char *converted_image = (unsigned char *)malloc(pHeader->width * pHeader->height * 4);
-                            
-                            unsigned char *pSource = pData;
-                            unsigned char *pDest = converted_image;
-                            unsigned char *pEnd = pData + pHeader->height * pHeader->width * 3;
-                            while(pSource < pEnd) {
-                                *pDest++ = (__uint32_t)pSource[0] * (__uint32_t)pSource[3] / 0xff;
-                                *pDest++ = (__uint32_t)pSource[1] * (__uint32_t)pSource[3] / 0xff;
-                                *pDest++ = (__uint32_t)pSource[2] * (__uint32_t)pSource[3] / 0xff;
-                                *pDest++ = pSource[3];
-                                pSource += 4;
-                            }
-                            assert(pSource <= m_pData->getEnd());
-                            
-                            GLDEBUG(glTexImage2D(target, 0, internal_format, pHeader->width, pHeader->height, 0, GL_BGRA, GL_UNSIGNED_BYTE, (GLvoid *)converted_image));
-                            GLDEBUG(glFinish());
-                            free(converted_image);
-                        } else {
-                            GLDEBUG(glTexImage2D(target, 0, internal_format, pHeader->width, pHeader->height, 0, GL_BGRA, GL_UNSIGNED_BYTE, (GLvoid *)pData));
-                            GLDEBUG(glFinish());
-                        }
-                        
-                        current_lod_max_dim = m_max_lod_max_dim;
+                    assert(pData + pixel_count * 4 <= (unsigned char *)m_pData->getEnd());
+                    if(premultiply_alpha) {
+                        KRPixelConvert::Premultiply(pData, converted_image, pixel_count);
+                    } else {
+                        memcpy(converted_image, pData, pixel_count * 4);
                     }
                     break;
                 default:
@@ -174,110 +189,12 @@ bool KRTextureTGA::uploadTexture(GLenum target, int lod_max_dim, int &current_lo
             break;
         case 10: // rgb + rle
             switch(pHeader->bitsperpixel) {
-                case 32:
-                {
-                    unsigned char *converted_image = (unsigned char *)malloc(pHeader->width * pHeader->height * 4);
-                    unsigned char *pSource = pData;
-                    unsigned char *pDest = converted_image;
-                    unsigned char *pEnd = converted_image + pHeader->height * pHeader->width * 4;
-                    if(premultiply_alpha) {
-                        while(pDest < pEnd) {
-                            int count = (*pSource & 0x7f) + 1;
-                            if(*pSource & 0x80) {
-                                // RLE Packet
-                                pSource++;
-                                while(count--) {
-                                    *pDest++ = (__uint32_t)pSource[0] * (__uint32_t)pSource[3] / 0xff;
-                                    *pDest++ = (__uint32_t)pSource[1] * (__uint32_t)pSource[3] / 0xff;
-                                    *pDest++ = (__uint32_t)pSource[2] * (__uint32_t)pSource[3] / 0xff;
-                                    *pDest++ = pSource[3];
-                                }
-                                pSource += 4;
-                            } else {
-                                // RAW Packet
-                                pSource++;
-                                while(count--) {
-                                    *pDest++ = (__uint32_t)pSource[0] * (__uint32_t)pSource[3] / 0xff;
-                                    *pDest++ = (__uint32_t)pSource[1] * (__uint32_t)pSource[3] / 0xff;
-                                    *pDest++ = (__uint32_t)pSource[2] * (__uint32_t)pSource[3] / 0xff;
-                                    *pDest++ = pSource[3];
-                                    pSource += 4;
-                                }
-                            }
-                        }
-                        assert(pSource <= m_pData->getEnd());
-                        assert(pDest == pEnd);
-                    } else {
-                        while(pDest < pEnd) {
-                            int count = (*pSource & 0x7f) + 1;
-                            if(*pSource & 0x80) {
-                                // RLE Packet
-                                pSource++;
-                                while(count--) {
-                                    *pDest++ = pSource[0];
-                                    *pDest++ = pSource[1];
-                                    *pDest++ = pSource[2];
-                                    *pDest++ = pSource[3];
-                                }
-                                pSource += 4;
-                            } else {
-                                // RAW Packet
-                                pSource++;
-                                while(count--) {
-                                    *pDest++ = pSource[0];
-                                    *pDest++ = pSource[1];
-                                    *pDest++ = pSource[2];
-                                    *pDest++ = pSource[3];
-                                    pSource += 4;
-                                }
-                            }
-                        }
-                        assert(pSource <= m_pData->getEnd());
-                        assert(pDest == pEnd);
-                    }
-                    GLDEBUG(glTexImage2D(target, 0, internal_format, pHeader->width, pHeader->height, 0, GL_BGRA, GL_UNSIGNED_BYTE, (GLvoid *)converted_image));
-                    GLDEBUG(glFinish());
-                    free(converted_image);
-                    current_lod_max_dim = m_max_lod_max_dim;
-                }
-                break;
                 case 24:
-                {
-                    unsigned char *converted_image = (unsigned char *)malloc(pHeader->width * pHeader->height * 4);
-                    unsigned char *pSource = pData;
-                    unsigned char *pDest = converted_image;
-                    unsigned char *pEnd = converted_image + pHeader->height * pHeader->width * 4;
-                    while(pDest < pEnd) {
-                        int count = (*pSource & 0x7f) + 1;
-                        if(*pSource & 0x80) {
-                            // RLE Packet
-                            pSource++;
-                            while(count--) {
-                                *pDest++ = pSource[0];
-                                *pDest++ = pSource[1];
-                                *pDest++ = pSource[2];
-                                *pDest++ = 0xff;
-                            }
-                            pSource += 3;
-                        } else {
-                            // RAW Packet
-                            pSource++;
-                            while(count--) {
-                                *pDest++ = pSource[0];
-                                *pDest++ = pSource[1];
-                                *pDest++ = pSource[2];
-                                *pDest++ = 0xff;
-                                pSource += 3;
-                            }
-                        }
+                case 32:
+                    if(!KRPixelConvert::ExpandRLE(pData, (unsigned char *)m_pData->getEnd(), converted_image, pixel_count, pHeader->bitsperpixel / 8, premultiply_alpha)) {
+                        m_pData->unlock();
+                        return false; // Truncated image
                     }
-                    assert(pSource <= m_pData->getEnd());
-                    assert(pDest == pEnd);
-                    GLDEBUG(glTexImage2D(target, 0, internal_format, pHeader->width, pHeader->height, 0, GL_BGRA, GL_UNSIGNED_BYTE, (GLvoid *)converted_image));
-                    GLDEBUG(glFinish());
-                    free(converted_image);
-                    current_lod_max_dim = m_max_lod_max_dim;
-                }
                     break;
                 default:
                     m_pData->unlock();
@@ -288,7 +205,7 @@ bool KRTextureTGA::uploadTexture(GLenum target, int lod_max_dim, int &current_lo
             m_pData->unlock();
             return false; // Image type not yet supported
     }
-
+    
     m_pData->unlock();
     return true;
 }
@@ -298,70 +215,25 @@ bool KRTextureTGA::uploadTexture(GLenum target, int lod_max_dim, int &current_lo
 KRTexture *KRTextureTGA::compress(bool premultiply_alpha)
 {
     m_pData->lock();
+    TGA_HEADER *pHeader = (TGA_HEADER *)m_pData->getStart();
+    int width = pHeader->width;
+    int height = pHeader->height;
+    bool alpha = pHeader->bitsperpixel == 32;
     
-    std::list<KRDataBlock *> blocks;
-    
-    getContext().getTextureManager()->_setActiveTexture(0);
-    
-    GLuint compressed_handle = 0;
-    GLDEBUG(glGenTextures(1, &compressed_handle));
-    
-    GLDEBUG(glBindTexture(GL_TEXTURE_2D, compressed_handle));
-    
-    int current_max_dim = 0;
-    if(!uploadTexture(GL_TEXTURE_2D, m_max_lod_max_dim, current_max_dim, true, premultiply_alpha)) {
-        assert(false); // Failed to upload the texture
-    }
-    GLDEBUG(glGenerateMipmap(GL_TEXTURE_2D));
-    
-    GLint width = 0, height = 0, internal_format, base_internal_format;
-
-
-    GLDEBUG(glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width));
-    GLDEBUG(glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height));
-    GLDEBUG(glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &internal_format));
-    
-    /*
-    int texture_base_level = 0;
-    int texture_max_level = 0;
-    GLDEBUG(glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MIN_LOD, &texture_base_level));
-    GLDEBUG(glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MAX_LOD, &texture_max_level));
-    */
-    switch(internal_format)
-    {
-        case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
-            base_internal_format = GL_BGRA;
-            break;
-        case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
-            base_internal_format = GL_BGRA;
-            break;
-        default:
-            assert(false); // Not yet supported
-            break;
-    }
-    
-    GLuint lod_level = 0;
-    GLint compressed_size = 0;
-    int lod_width = width;
-    while(lod_width > 1) {
-        GLDEBUG(glGetTexLevelParameteriv(GL_TEXTURE_2D, lod_level, GL_TEXTURE_WIDTH, &lod_width));
-        GLDEBUG(glGetTexLevelParameteriv(GL_TEXTURE_2D, lod_level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &compressed_size));
-        KRDataBlock *new_block = new KRDataBlock();
-        new_block->expand(compressed_size);
-        new_block->lock();
-        GLDEBUG(glGetCompressedTexImage(GL_TEXTURE_2D, lod_level, new_block->getStart()));
-        new_block->unlock();
-        blocks.push_back(new_block);
-        
-        lod_level++;
+    // Encode on the CPU, so no GL context is required
+    unsigned char *image = (unsigned char *)malloc(width * height * 4);
+    if(!decode(image, premultiply_alpha)) {
+        free(image);
+        m_pData->unlock();
+        return NULL;
     }
-    assert(lod_width == 1);
     
-    GLDEBUG(glBindTexture(GL_TEXTURE_2D, 0));
-    getContext().getTextureManager()->selectTexture(0, NULL, 0.0f, KRTexture::TEXTURE_USAGE_NONE);
-    GLDEBUG(glDeleteTextures(1, &compressed_handle));
+    std::list<KRDataBlock *> blocks;
+    KRTextureCompressor::Compress(image, width, height, alpha, KRTextureCompressor::MIPMAP_FILTER_KAISER, blocks);
+    free(image);
     
-    KRTextureKTX *new_texture = new KRTextureKTX(getContext(), getName(), internal_format, base_internal_format, width, height, blocks);
+    GLenum internal_format = alpha ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    KRTextureKTX *new_texture = new KRTextureKTX(getContext(), getName(), internal_format, GL_BGRA, width, height, blocks);
     
     m_pData->unlock();
     
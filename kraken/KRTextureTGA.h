@@ -26,6 +26,9 @@ public:
     
     virtual long getMemRequiredForSize(int max_dim);
 private:
+    // Decode to 32-bit BGRA pixels.  converted_image must hold width * height * 4 bytes.
+    bool decode(unsigned char *converted_image, bool premultiply_alpha);
+    
     long m_imageSize;
 };
 
@@ -0,0 +1,81 @@
+//
+//  KRTripleBuffer.h
+//  KREngine
+//
+//  Copyright 2012 Kearwood Gilbert. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are
+//  permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this list of
+//  conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list
+//  of conditions and the following disclaimer in the documentation and/or other materials
+//  provided with the distribution.
+//
+//  THIS SOFTWARE IS PROVIDED BY KEARWOOD GILBERT ''AS IS'' AND ANY EXPRESS OR IMPLIED
+//  WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+//  FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL KEARWOOD GILBERT OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+//  ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+//  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+//  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//  The views and conclusions contained in the software and documentation are those of the
+//  authors and should not be interpreted as representing official policies, either expressed
+//  or implied, of Kearwood Gilbert.
+//
+
+#ifndef KRTRIPLEBUFFER_H
+#define KRTRIPLEBUFFER_H
+
+#include <atomic>
+
+// Lock-free handoff of a value from one producer thread to one consumer thread.
+// The producer fills the back buffer and publishes it; the consumer takes the most recently published buffer.
+// Neither side ever waits.  If the producer publishes again before the consumer has taken the last buffer, the older buffer is replaced.
+// Buffers are reused rather than reallocated, so containers keep their capacity between frames.
+template <class T>
+class KRTripleBuffer {
+public:
+    KRTripleBuffer() : m_back(0), m_shared(1), m_front(2) {}
+    
+    // Producer only
+    T &getBack() { return m_buffers[m_back]; }
+    
+    // Producer only.  Returns false if the previously published buffer was replaced before the consumer took it.
+    bool publish() {
+        int previous = m_shared.exchange(m_back | KRTRIPLEBUFFER_FRESH);
+        m_back = previous & KRTRIPLEBUFFER_INDEX_MASK;
+        return (previous & KRTRIPLEBUFFER_FRESH) == 0;
+    }
+    
+    // Consumer only.  Returns true if a buffer was published since the last call, making it the front buffer.
+    bool consume() {
+        if((m_shared.load() & KRTRIPLEBUFFER_FRESH) == 0) {
+            return false;
+        }
+        int previous = m_shared.exchange(m_front);
+        m_front = previous & KRTRIPLEBUFFER_INDEX_MASK;
+        return true;
+    }
+    
+    // Consumer only
+    T &getFront() { return m_buffers[m_front]; }
+    
+private:
+    enum {
+        KRTRIPLEBUFFER_INDEX_MASK = 0x3,
+        KRTRIPLEBUFFER_FRESH = 0x4
+    };
+    
+    T m_buffers[3];
+    int m_back; // Owned by the producer
+    std::atomic<int> m_shared; // Index of the buffer in transit, with KRTRIPLEBUFFER_FRESH set until the consumer takes it
+    int m_front; // Owned by the consumer
+};
+
+#endif
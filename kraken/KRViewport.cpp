@@ -11,6 +11,312 @@
 #include "KREngine-common.h"
 
 #include "KRViewport.h"
+#include "KRCPUFeatures.h"
+
+#if defined(KRAKEN_USE_ARM_NEON) && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+#define KRVIEWPORT_NEON
+#include <arm_neon.h>
+#endif
+
+#define KRENGINE_VIEWPORT_INFINITE_W 1.0e-6f // Frustum corners with a smaller w after unprojection are at infinity
+#define KRENGINE_VIEWPORT_MIN_W 1.0e-4f // Bounds that reach closer to the plane of the camera than this in clip space w cover the whole viewport
+#define KRENGINE_VIEWPORT_MAX_ELONGATION 3.0f // Boxes with a bounding sphere larger than this many times their smallest half extent are measured by projecting their corners
+#define KRENGINE_VIEWPORT_MIN_COVERAGE 0.0001f // Lowest coverage of bounds within the view frustum, so that they are not mistaken for culled bounds
+#define KRENGINE_VIEWPORT_COVERAGE_BATCH 64 // Boxes culled together before their coverage is measured
+#define KRENGINE_VIEWPORT_DISTANCE_COVERAGE_RANGE 1000.0f // World units over which distanceCoverage() falls off
+
+namespace {
+    
+    typedef struct {
+        float plane[6][4];
+        float abs_normal[6][3];
+        float frustum_min[3];
+        float frustum_max[3];
+        bool tight; // Also test against the bounds of the frustum
+    } cull_query;
+    
+    // Each kernel tests the boxes starting at index first, and returns a bit for each box that may be visible
+    typedef int (*cull_kernel)(const cull_query &q, const KRViewport::aabb_batch &boxes, int first);
+    
+    int CullBoxes_Scalar(const cull_query &q, const KRViewport::aabb_batch &boxes, int first)
+    {
+        float c[3], e[3];
+        for(int axis=0; axis < 3; axis++) {
+            c[axis] = boxes.center[axis][first];
+            e[axis] = boxes.extent[axis][first];
+        }
+        for(int p=0; p < 6; p++) {
+            // Distance to the plane of the corner farthest inside it
+            float distance = q.plane[p][0] * c[0] + q.plane[p][1] * c[1] + q.plane[p][2] * c[2] + q.plane[p][3]
+                           + q.abs_normal[p][0] * e[0] + q.abs_normal[p][1] * e[1] + q.abs_normal[p][2] * e[2];
+            if(distance < 0.0f) {
+                return 0;
+            }
+        }
+        if(q.tight) {
+            for(int axis=0; axis < 3; axis++) {
+                if(c[axis] + e[axis] < q.frustum_min[axis] || c[axis] - e[axis] > q.frustum_max[axis]) {
+                    return 0;
+                }
+            }
+        }
+        return 1;
+    }
+    
+#if defined(KRAKEN_USE_SSE2)
+    
+    int CullBoxes_SSE2(const cull_query &q, const KRViewport::aabb_batch &boxes, int first)
+    {
+        __m128 c[3], e[3];
+        for(int axis=0; axis < 3; axis++) {
+            c[axis] = _mm_loadu_ps(boxes.center[axis] + first);
+            e[axis] = _mm_loadu_ps(boxes.extent[axis] + first);
+        }
+        const __m128 zero = _mm_setzero_ps();
+        __m128 visible = _mm_cmpeq_ps(zero, zero);
+        for(int p=0; p < 6; p++) {
+            __m128 distance = _mm_set1_ps(q.plane[p][3]);
+            for(int axis=0; axis < 3; axis++) {
+                distance = _mm_add_ps(distance, _mm_mul_ps(_mm_set1_ps(q.plane[p][axis]), c[axis]));
+                distance = _mm_add_ps(distance, _mm_mul_ps(_mm_set1_ps(q.abs_normal[p][axis]), e[axis]));
+            }
+            visible = _mm_and_ps(visible, _mm_cmpge_ps(distance, zero));
+        }
+        if(q.tight) {
+            for(int axis=0; axis < 3; axis++) {
+                visible = _mm_and_ps(visible, _mm_cmpge_ps(_mm_add_ps(c[axis], e[axis]), _mm_set1_ps(q.frustum_min[axis])));
+                visible = _mm_and_ps(visible, _mm_cmple_ps(_mm_sub_ps(c[axis], e[axis]), _mm_set1_ps(q.frustum_max[axis])));
+            }
+        }
+        return _mm_movemask_ps(visible);
+    }
+    
+    KRAKEN_TARGET_AVX2 int CullBoxes_AVX2(const cull_query &q, const KRViewport::aabb_batch &boxes, int first)
+    {
+        __m256 c[3], e[3];
+        for(int axis=0; axis < 3; axis++) {
+            c[axis] = _mm256_loadu_ps(boxes.center[axis] + first);
+            e[axis] = _mm256_loadu_ps(boxes.extent[axis] + first);
+        }
+        const __m256 zero = _mm256_setzero_ps();
+        __m256 visible = _mm256_cmp_ps(zero, zero, _CMP_EQ_OQ);
+        for(int p=0; p < 6; p++) {
+            __m256 distance = _mm256_set1_ps(q.plane[p][3]);
+            for(int axis=0; axis < 3; axis++) {
+                distance = _mm256_add_ps(distance, _mm256_mul_ps(_mm256_set1_ps(q.plane[p][axis]), c[axis]));
+                distance = _mm256_add_ps(distance, _mm256_mul_ps(_mm256_set1_ps(q.abs_normal[p][axis]), e[axis]));
+            }
+            visible = _mm256_and_ps(visible, _mm256_cmp_ps(distance, zero, _CMP_GE_OQ));
+        }
+        if(q.tight) {
+            for(int axis=0; axis < 3; axis++) {
+                visible = _mm256_and_ps(visible, _mm256_cmp_ps(_mm256_add_ps(c[axis], e[axis]), _mm256_set1_ps(q.frustum_min[axis]), _CMP_GE_OQ));
+                visible = _mm256_and_ps(visible, _mm256_cmp_ps(_mm256_sub_ps(c[axis], e[axis]), _mm256_set1_ps(q.frustum_max[axis]), _CMP_LE_OQ));
+            }
+        }
+        return _mm256_movemask_ps(visible);
+    }
+    
+#elif defined(KRVIEWPORT_NEON)
+    
+    int CullBoxes_NEON(const cull_query &q, const KRViewport::aabb_batch &boxes, int first)
+    {
+        float32x4_t c[3], e[3];
+        for(int axis=0; axis < 3; axis++) {
+            c[axis] = vld1q_f32(boxes.center[axis] + first);
+            e[axis] = vld1q_f32(boxes.extent[axis] + first);
+        }
+        const float32x4_t zero = vdupq_n_f32(0.0f);
+        uint32x4_t visible = vdupq_n_u32(0xffffffff);
+        for(int p=0; p < 6; p++) {
+            float32x4_t distance = vdupq_n_f32(q.plane[p][3]);
+            for(int axis=0; axis < 3; axis++) {
+                distance = vmlaq_n_f32(distance, c[axis], q.plane[p][axis]);
+                distance = vmlaq_n_f32(distance, e[axis], q.abs_normal[p][axis]);
+            }
+            visible = vandq_u32(visible, vcgeq_f32(distance, zero));
+        }
+        if(q.tight) {
+            for(int axis=0; axis < 3; axis++) {
+                visible = vandq_u32(visible, vcgeq_f32(vaddq_f32(c[axis], e[axis]), vdupq_n_f32(q.frustum_min[axis])));
+                visible = vandq_u32(visible, vcleq_f32(vsubq_f32(c[axis], e[axis]), vdupq_n_f32(q.frustum_max[axis])));
+            }
+        }
+        static const uint32_t lane_bits[4] = {1, 2, 4, 8};
+        uint32x4_t bits = vandq_u32(visible, vld1q_u32(lane_bits));
+        uint32x2_t sum = vadd_u32(vget_low_u32(bits), vget_high_u32(bits));
+        return (int)vget_lane_u32(vpadd_u32(sum, sum), 0);
+    }
+    
+#endif
+    
+    typedef struct {
+        float row[3][4]; // Clip space x, y and w
+        float w_gradient;
+        float scale[2];
+    } coverage_query;
+    
+    // Each kernel estimates the coverage of the bounding spheres of the boxes starting at index first, before clamping and LOD bias.
+    // Returns a bit for each box that could be measured by its bounding sphere; the others must be measured by projecting their corners.
+    typedef int (*coverage_kernel)(const coverage_query &q, const KRViewport::aabb_batch &boxes, int first, float *coverage);
+    
+    int CoverageSpheres_Scalar(const coverage_query &q, const KRViewport::aabb_batch &boxes, int first, float *coverage)
+    {
+        float c[3], e[3];
+        for(int axis=0; axis < 3; axis++) {
+            c[axis] = boxes.center[axis][first];
+            e[axis] = boxes.extent[axis][first];
+        }
+        float radius = sqrtf(e[0] * e[0] + e[1] * e[1] + e[2] * e[2]);
+        if(radius > KRENGINE_VIEWPORT_MAX_ELONGATION * KRMIN(e[0], KRMIN(e[1], e[2]))) {
+            return 0;
+        }
+        float clip[3];
+        for(int i=0; i < 3; i++) {
+            clip[i] = q.row[i][0] * c[0] + q.row[i][1] * c[1] + q.row[i][2] * c[2] + q.row[i][3];
+        }
+        float w_radius = q.w_gradient * radius;
+        if(clip[2] - w_radius < KRENGINE_VIEWPORT_MIN_W) {
+            return 0; // The sphere reaches the plane of the camera
+        }
+        // The tangent of the angle subtended by the sphere, which is its radius in clip space when w is 1
+        float inv_tangent_distance = 1.0f / sqrtf(clip[2] * clip[2] - w_radius * w_radius);
+        float area = (float)M_PI / 16.0f; // A circle inscribed in its clipped square, over the 2x2 area of normalized device coordinates
+        for(int i=0; i < 2; i++) {
+            float center = clip[i] / clip[2];
+            float projected_radius = q.scale[i] * radius * inv_tangent_distance;
+            area *= KRMAX(KRMIN(center + projected_radius, 1.0f) - KRMAX(center - projected_radius, -1.0f), 0.0f);
+        }
+        coverage[first] = area;
+        return 1;
+    }
+    
+#if defined(KRAKEN_USE_SSE2)
+    
+    int CoverageSpheres_SSE2(const coverage_query &q, const KRViewport::aabb_batch &boxes, int first, float *coverage)
+    {
+        __m128 c[3], e[3];
+        for(int axis=0; axis < 3; axis++) {
+            c[axis] = _mm_loadu_ps(boxes.center[axis] + first);
+            e[axis] = _mm_loadu_ps(boxes.extent[axis] + first);
+        }
+        __m128 radius = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e[0], e[0]), _mm_mul_ps(e[1], e[1])), _mm_mul_ps(e[2], e[2])));
+        __m128 min_extent = _mm_min_ps(e[0], _mm_min_ps(e[1], e[2]));
+        __m128 clip[3];
+        for(int i=0; i < 3; i++) {
+            clip[i] = _mm_set1_ps(q.row[i][3]);
+            for(int axis=0; axis < 3; axis++) {
+                clip[i] = _mm_add_ps(clip[i], _mm_mul_ps(_mm_set1_ps(q.row[i][axis]), c[axis]));
+            }
+        }
+        __m128 min_w = _mm_set1_ps(KRENGINE_VIEWPORT_MIN_W);
+        __m128 w_radius = _mm_mul_ps(_mm_set1_ps(q.w_gradient), radius);
+        __m128 measured = _mm_and_ps(_mm_cmpge_ps(_mm_sub_ps(clip[2], w_radius), min_w), _mm_cmple_ps(radius, _mm_mul_ps(_mm_set1_ps(KRENGINE_VIEWPORT_MAX_ELONGATION), min_extent)));
+        
+        // Lanes that are not measured are clamped away from zero so that they don't divide by it
+        __m128 inv_w = _mm_div_ps(_mm_set1_ps(1.0f), _mm_max_ps(clip[2], min_w));
+        __m128 tangent_distance_squared = _mm_sub_ps(_mm_mul_ps(clip[2], clip[2]), _mm_mul_ps(w_radius, w_radius));
+        __m128 inv_tangent_distance = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(_mm_max_ps(tangent_distance_squared, _mm_mul_ps(min_w, min_w))));
+        __m128 area = _mm_set1_ps((float)M_PI / 16.0f);
+        for(int i=0; i < 2; i++) {
+            __m128 center = _mm_mul_ps(clip[i], inv_w);
+            __m128 projected_radius = _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(q.scale[i]), radius), inv_tangent_distance);
+            __m128 size = _mm_sub_ps(_mm_min_ps(_mm_add_ps(center, projected_radius), _mm_set1_ps(1.0f)), _mm_max_ps(_mm_sub_ps(center, projected_radius), _mm_set1_ps(-1.0f)));
+            area = _mm_mul_ps(area, _mm_max_ps(size, _mm_setzero_ps()));
+        }
+        _mm_storeu_ps(coverage + first, area);
+        return _mm_movemask_ps(measured);
+    }
+    
+#elif defined(KRVIEWPORT_NEON)
+    
+    int CoverageSpheres_NEON(const coverage_query &q, const KRViewport::aabb_batch &boxes, int first, float *coverage)
+    {
+        float32x4_t c[3], e[3];
+        for(int axis=0; axis < 3; axis++) {
+            c[axis] = vld1q_f32(boxes.center[axis] + first);
+            e[axis] = vld1q_f32(boxes.extent[axis] + first);
+        }
+        float32x4_t radius_squared = vmlaq_f32(vmlaq_f32(vmulq_f32(e[0], e[0]), e[1], e[1]), e[2], e[2]);
+        float32x4_t min_extent = vminq_f32(e[0], vminq_f32(e[1], e[2]));
+        float32x4_t clip[3];
+        for(int i=0; i < 3; i++) {
+            clip[i] = vdupq_n_f32(q.row[i][3]);
+            for(int axis=0; axis < 3; axis++) {
+                clip[i] = vmlaq_n_f32(clip[i], c[axis], q.row[i][axis]);
+            }
+        }
+        // sqrt and division are refined from estimates, as on ARMv7
+        float32x4_t inv_radius = vrsqrteq_f32(vmaxq_f32(radius_squared, vdupq_n_f32(1.0e-20f)));
+        inv_radius = vmulq_f32(inv_radius, vrsqrtsq_f32(vmulq_f32(radius_squared, inv_radius), inv_radius));
+        inv_radius = vmulq_f32(inv_radius, vrsqrtsq_f32(vmulq_f32(radius_squared, inv_radius), inv_radius));
+        float32x4_t radius = vmulq_f32(radius_squared, inv_radius);
+        
+        float32x4_t min_w = vdupq_n_f32(KRENGINE_VIEWPORT_MIN_W);
+        float32x4_t w_radius = vmulq_n_f32(radius, q.w_gradient);
+        uint32x4_t measured = vandq_u32(vcgeq_f32(vsubq_f32(clip[2], w_radius), min_w), vcleq_f32(radius, vmulq_n_f32(min_extent, KRENGINE_VIEWPORT_MAX_ELONGATION)));
+        
+        // Lanes that are not measured are clamped away from zero so that they don't divide by it
+        float32x4_t w = vmaxq_f32(clip[2], min_w);
+        float32x4_t inv_w = vrecpeq_f32(w);
+        inv_w = vmulq_f32(inv_w, vrecpsq_f32(w, inv_w));
+        inv_w = vmulq_f32(inv_w, vrecpsq_f32(w, inv_w));
+        float32x4_t tangent_distance_squared = vmaxq_f32(vmlsq_f32(vmulq_f32(clip[2], clip[2]), w_radius, w_radius), vmulq_f32(min_w, min_w));
+        float32x4_t inv_tangent_distance = vrsqrteq_f32(tangent_distance_squared);
+        inv_tangent_distance = vmulq_f32(inv_tangent_distance, vrsqrtsq_f32(vmulq_f32(tangent_distance_squared, inv_tangent_distance), inv_tangent_distance));
+        inv_tangent_distance = vmulq_f32(inv_tangent_distance, vrsqrtsq_f32(vmulq_f32(tangent_distance_squared, inv_tangent_distance), inv_tangent_distance));
+        float32x4_t area = vdupq_n_f32((float)M_PI / 16.0f);
+        for(int i=0; i < 2; i++) {
+            float32x4_t center = vmulq_f32(clip[i], inv_w);
+            float32x4_t projected_radius = vmulq_f32(vmulq_n_f32(radius, q.scale[i]), inv_tangent_distance);
+            float32x4_t size = vsubq_f32(vminq_f32(vaddq_f32(center, projected_radius), vdupq_n_f32(1.0f)), vmaxq_f32(vsubq_f32(center, projected_radius), vdupq_n_f32(-1.0f)));
+            area = vmulq_f32(area, vmaxq_f32(size, vdupq_n_f32(0.0f)));
+        }
+        vst1q_f32(coverage + first, area);
+        static const uint32_t lane_bits[4] = {1, 2, 4, 8};
+        uint32x4_t bits = vandq_u32(measured, vld1q_u32(lane_bits));
+        uint32x2_t sum = vadd_u32(vget_low_u32(bits), vget_high_u32(bits));
+        return (int)vget_lane_u32(vpadd_u32(sum, sum), 0);
+    }
+    
+#endif
+    
+    typedef struct {
+        cull_kernel cull;
+        int lanes; // Boxes tested by each call to cull
+        coverage_kernel coverage;
+        int coverage_lanes; // Boxes measured by each call to coverage
+    } viewport_kernels;
+    
+    const viewport_kernels &Kernels()
+    {
+        static viewport_kernels kernels = []() {
+            viewport_kernels k;
+            k.cull = CullBoxes_Scalar;
+            k.lanes = 1;
+            k.coverage = CoverageSpheres_Scalar;
+            k.coverage_lanes = 1;
+#if defined(KRAKEN_USE_SSE2)
+            if(KRCPUFeatures::SupportsAVX2()) {
+                k.cull = CullBoxes_AVX2;
+                k.lanes = 8;
+            } else {
+                k.cull = CullBoxes_SSE2;
+                k.lanes = 4;
+            }
+            k.coverage = CoverageSpheres_SSE2;
+            k.coverage_lanes = 4;
+#elif defined(KRVIEWPORT_NEON)
+            k.cull = CullBoxes_NEON;
+            k.lanes = 4;
+            k.coverage = CoverageSpheres_NEON;
+            k.coverage_lanes = 4;
+#endif
+            return k;
+        }();
+        return kernels;
+    }
+}
 
 KRViewport::KRViewport()
 {
@@ -18,7 +324,9 @@ KRViewport::KRViewport()
     m_matProjection = Matrix4();
     m_matView = Matrix4();
     m_lodBias = 0.0f;
+    m_matViewProjection = Matrix4();
     calculateDerivedValues();
+    m_viewChanged = true;
 }
 
 KRViewport::KRViewport(const Vector2 &size, const Matrix4 &matView, const Matrix4 &matProjection)
@@ -26,7 +334,10 @@ KRViewport::KRViewport(const Vector2 &size, const Matrix4 &matView, const Matrix
     m_size = size;
     m_matView = matView;
     m_matProjection = matProjection;
+    m_lodBias = 0.0f;
+    m_matViewProjection = Matrix4();
     calculateDerivedValues();
+    m_viewChanged = true;
 }
 
 
@@ -85,6 +396,11 @@ const Matrix4 &KRViewport::KRViewport::getViewProjectionMatrix() const
     return m_matViewProjection;
 }
 
+bool KRViewport::getViewChanged() const
+{
+    return m_viewChanged;
+}
+
 const Matrix4 &KRViewport::getInverseViewMatrix() const
 {
     return m_matInverseView;
@@ -117,7 +433,9 @@ const int *KRViewport::getBackToFrontOrder() const
 
 void KRViewport::calculateDerivedValues()
 {
+    Matrix4 previous_view_projection = m_matViewProjection;
     m_matViewProjection = m_matView * m_matProjection;
+    m_viewChanged = !(m_matViewProjection == previous_view_projection);
     m_matInverseView = Matrix4::Invert(m_matView);
     m_matInverseProjection = Matrix4::Invert(m_matProjection);
     m_cameraPosition = Matrix4::Dot(m_matInverseView, Vector3::Zero());
@@ -151,6 +469,50 @@ void KRViewport::calculateDerivedValues()
     for(int i=0; i<8; i++) {
         m_backToFrontOrder[i] = m_frontToBackOrder[7-i];
     }
+    
+    // Extract the clip planes, so that boxes can be culled without transforming their corners.
+    // Each row of the view projection matrix is found by transforming the basis vectors, so no particular matrix layout is assumed.
+    Vector4 axis_x = Matrix4::Dot4(m_matViewProjection, Vector4::Create(1.0f, 0.0f, 0.0f, 0.0f));
+    Vector4 axis_y = Matrix4::Dot4(m_matViewProjection, Vector4::Create(0.0f, 1.0f, 0.0f, 0.0f));
+    Vector4 axis_z = Matrix4::Dot4(m_matViewProjection, Vector4::Create(0.0f, 0.0f, 1.0f, 0.0f));
+    Vector4 origin = Matrix4::Dot4(m_matViewProjection, Vector4::Create(0.0f, 0.0f, 0.0f, 1.0f));
+    int clip_row_axes[3] = {0, 1, 3};
+    for(int i=0; i < 3; i++) {
+        m_clipRows[i][0] = axis_x[clip_row_axes[i]];
+        m_clipRows[i][1] = axis_y[clip_row_axes[i]];
+        m_clipRows[i][2] = axis_z[clip_row_axes[i]];
+        m_clipRows[i][3] = origin[clip_row_axes[i]];
+    }
+    m_clipWGradient = sqrtf(axis_x.w * axis_x.w + axis_y.w * axis_y.w + axis_z.w * axis_z.w);
+    m_projectionScale[0] = fabsf(Matrix4::Dot4(m_matProjection, Vector4::Create(1.0f, 0.0f, 0.0f, 0.0f)).x);
+    m_projectionScale[1] = fabsf(Matrix4::Dot4(m_matProjection, Vector4::Create(0.0f, 1.0f, 0.0f, 0.0f)).y);
+    for(int iFace=0; iFace < 6; iFace++) {
+        int clip_axis = iFace % 3; // x, y, then z; matching the faces tested by visible()
+        float sign = iFace < 3 ? 1.0f : -1.0f; // -w <= clip, then clip <= w
+        m_frustumPlanes[iFace][0] = axis_x.w + axis_x[clip_axis] * sign;
+        m_frustumPlanes[iFace][1] = axis_y.w + axis_y[clip_axis] * sign;
+        m_frustumPlanes[iFace][2] = axis_z.w + axis_z[clip_axis] * sign;
+        m_frustumPlanes[iFace][3] = origin.w + origin[clip_axis] * sign;
+    }
+    
+    Matrix4 matInverseViewProjection = Matrix4::Invert(m_matViewProjection);
+    m_frustumBounds = AABB::Zero();
+    for(int iCorner=0; iCorner<8; iCorner++) {
+        Vector4 corner = Matrix4::Dot4(matInverseViewProjection, Vector4::Create(
+                                                                                  (iCorner & 1) == 0 ? -1.0f : 1.0f,
+                                                                                  (iCorner & 2) == 0 ? -1.0f : 1.0f,
+                                                                                  (iCorner & 4) == 0 ? -1.0f : 1.0f, 1.0f));
+        if(fabsf(corner.w) < KRENGINE_VIEWPORT_INFINITE_W) {
+            m_frustumBounds = AABB::Infinite();
+            break;
+        }
+        Vector3 world_corner = Vector3::Create(corner.x / corner.w, corner.y / corner.w, corner.z / corner.w);
+        if(iCorner == 0) {
+            m_frustumBounds = AABB::Create(world_corner, world_corner);
+        } else {
+            m_frustumBounds.encapsulate(AABB::Create(world_corner, world_corner));
+        }
+    }
 }
 
 
@@ -173,43 +535,107 @@ float KRViewport::coverage(const AABB &b) const
 {
     if(!visible(b)) {
         return 0.0f; // Culled out by view frustrum
-    } else {
-        Vector3 nearest_point = b.nearestPoint(getCameraPosition());
-        float distance = (nearest_point - getCameraPosition()).magnitude();
-        
-        Vector3 v = Matrix4::DotWDiv(m_matProjection, getCameraPosition() + getCameraDirection() * distance);
-        
-        float screen_depth = distance / 1000.0f;
-        
-        return KRCLAMP(1.0f - screen_depth, 0.01f, 1.0f);
-        
-        /*
+    }
+    float center[3], extent[3];
+    aabb_batch box = {{&center[0], &center[1], &center[2]}, {&extent[0], &extent[1], &extent[2]}};
+    SetBatchBounds(box, 0, b);
+    float results[1];
+    coverage(box, 1, results);
+    return results[0];
+}
+
+float KRViewport::distanceCoverage(const AABB &b) const
+{
+    if(!visible(b)) {
+        return 0.0f; // Culled out by view frustrum
+    }
+    float distance = (b.nearestPoint(getCameraPosition()) - getCameraPosition()).magnitude();
+    return KRCLAMP(1.0f - distance / KRENGINE_VIEWPORT_DISTANCE_COVERAGE_RANGE, 0.01f, 1.0f);
+}
+
+int KRViewport::coverage(const aabb_batch &boxes, int count, float *results) const
+{
+    coverage_query q;
+    for(int i=0; i < 3; i++) {
+        for(int j=0; j < 4; j++) {
+            q.row[i][j] = m_clipRows[i][j];
+        }
+    }
+    q.w_gradient = m_clipWGradient;
+    q.scale[0] = m_projectionScale[0];
+    q.scale[1] = m_projectionScale[1];
+    
+    // A positive LOD bias makes bounds appear closer, as with KRLODGroup
+    float lod_scale = powf(4.0f, m_lodBias);
+    
+    const viewport_kernels &kernels = Kernels();
+    bool in_viewport[KRENGINE_VIEWPORT_COVERAGE_BATCH];
+    int visible_count = 0;
+    for(int batch_start=0; batch_start < count; batch_start += KRENGINE_VIEWPORT_COVERAGE_BATCH) {
+        int batch_count = KRMIN(count - batch_start, KRENGINE_VIEWPORT_COVERAGE_BATCH);
+        aabb_batch batch;
+        for(int axis=0; axis < 3; axis++) {
+            batch.center[axis] = boxes.center[axis] + batch_start;
+            batch.extent[axis] = boxes.extent[axis] + batch_start;
+        }
+        visible_count += visible(batch, batch_count, in_viewport);
         
-        Vector2 screen_min;
-        Vector2 screen_max;
-        // Loop through all corners and transform them to screen space
-        for(int i=0; i<8; i++) {
-            Vector3 screen_pos = Matrix4::DotWDiv(m_matViewProjection, Vector3(i & 1 ? b.min.x : b.max.x, i & 2 ? b.min.y : b.max.y, i & 4 ? b.min.z : b.max.z));
-            if(i==0) {
-                screen_min = screen_pos.xy();
-                screen_max = screen_pos.xy();
+        float *batch_results = results + batch_start;
+        int first = 0;
+        for(; first < batch_count; first += kernels.coverage_lanes) {
+            int lane_count = KRMIN(batch_count - first, kernels.coverage_lanes);
+            int measured = 0;
+            if(lane_count == kernels.coverage_lanes) {
+                measured = kernels.coverage(q, batch, first, batch_results);
             } else {
-                if(screen_pos.x < screen_min.x) screen_min.x = screen_pos.x;
-                if(screen_pos.y < screen_min.y) screen_min.y = screen_pos.y;
-                if(screen_pos.x > screen_max.x) screen_max.x = screen_pos.x;
-                if(screen_pos.y > screen_max.y) screen_max.y = screen_pos.y;
+                for(int lane=0; lane < lane_count; lane++) {
+                    measured |= CoverageSpheres_Scalar(q, batch, first + lane, batch_results) << lane;
+                }
+            }
+            for(int lane=0; lane < lane_count; lane++) {
+                int i = first + lane;
+                if(!in_viewport[i]) {
+                    batch_results[i] = 0.0f;
+                    continue;
+                }
+                if((measured & (1 << lane)) == 0) {
+                    AABB b;
+                    for(int axis=0; axis < 3; axis++) {
+                        b.min[axis] = batch.center[axis][i] - batch.extent[axis][i];
+                        b.max[axis] = batch.center[axis][i] + batch.extent[axis][i];
+                    }
+                    batch_results[i] = projectedBoxCoverage(b);
+                }
+                batch_results[i] = KRCLAMP(batch_results[i] * lod_scale, KRENGINE_VIEWPORT_MIN_COVERAGE, 1.0f);
             }
         }
-        
-        screen_min.x = KRCLAMP(screen_min.x, 0.0f, 1.0f);
-        screen_min.y = KRCLAMP(screen_min.y, 0.0f, 1.0f);
-        screen_max.x = KRCLAMP(screen_max.x, 0.0f, 1.0f);
-        screen_max.y = KRCLAMP(screen_max.y, 0.0f, 1.0f);
-        
-        float c = (screen_max.x - screen_min.x) * (screen_max.y - screen_min.y);
-        return KRCLAMP(c, 0.01f, 1.0f);
-        */
     }
+    return visible_count;
+}
+
+float KRViewport::projectedBoxCoverage(const AABB &b) const
+{
+    Vector2 screen_min = Vector2::Create(1.0f, 1.0f);
+    Vector2 screen_max = Vector2::Create(-1.0f, -1.0f);
+    // Loop through all corners and transform them to normalized device coordinates
+    for(int iCorner=0; iCorner<8; iCorner++) {
+        Vector4 cornerVertex = Matrix4::Dot4(m_matViewProjection, Vector4::Create(
+                                                                                   (iCorner & 1) == 0 ? b.min.x : b.max.x,
+                                                                                   (iCorner & 2) == 0 ? b.min.y : b.max.y,
+                                                                                   (iCorner & 4) == 0 ? b.min.z : b.max.z, 1.0f));
+        if(cornerVertex.w < KRENGINE_VIEWPORT_MIN_W) {
+            return 1.0f; // The bounds reach the plane of the camera
+        }
+        Vector2 screen_pos = Vector2::Create(cornerVertex.x / cornerVertex.w, cornerVertex.y / cornerVertex.w);
+        screen_min.x = KRMIN(screen_min.x, screen_pos.x);
+        screen_min.y = KRMIN(screen_min.y, screen_pos.y);
+        screen_max.x = KRMAX(screen_max.x, screen_pos.x);
+        screen_max.y = KRMAX(screen_max.y, screen_pos.y);
+    }
+    
+    float width = KRMIN(screen_max.x, 1.0f) - KRMAX(screen_min.x, -1.0f);
+    float height = KRMIN(screen_max.y, 1.0f) - KRMAX(screen_min.y, -1.0f);
+    return KRMAX(width, 0.0f) * KRMAX(height, 0.0f) * 0.25f;
 }
 
 
@@ -217,45 +643,61 @@ bool KRViewport::visible(const AABB &b) const
 {
     // test if bounding box would be within the visible range of the clip space transformed by matViewProjection
     // This is used for view frustrum culling
+    // A box is outside of a clip plane when the corner nearest to the inside of the plane is outside of it
     
-    int outside_count[6] = {0, 0, 0, 0, 0, 0};
-    
-    for(int iCorner=0; iCorner<8; iCorner++) {
-        Vector4 sourceCornerVertex = Vector4::Create(
-                                                 (iCorner & 1) == 0 ? b.min.x : b.max.x,
-                                                 (iCorner & 2) == 0 ? b.min.y : b.max.y,
-                                                 (iCorner & 4) == 0 ? b.min.z : b.max.z, 1.0f);
-        
-        Vector4 cornerVertex = Matrix4::Dot4(m_matViewProjection, sourceCornerVertex);
-        
-        if(cornerVertex.x < -cornerVertex.w) {
-            outside_count[0]++;
-        }
-        if(cornerVertex.y < -cornerVertex.w) {
-            outside_count[1]++;
-        }
-        if(cornerVertex.z < -cornerVertex.w) {
-            outside_count[2]++;
-        }
-        if(cornerVertex.x > cornerVertex.w) {
-            outside_count[3]++;
+    Vector3 center = (b.min + b.max) * 0.5f;
+    Vector3 extent = (b.max - b.min) * 0.5f;
+    for(int iFace=0; iFace < 6; iFace++) {
+        const float *plane = m_frustumPlanes[iFace];
+        float distance = plane[0] * center.x + plane[1] * center.y + plane[2] * center.z + plane[3]
+                       + fabsf(plane[0]) * extent.x + fabsf(plane[1]) * extent.y + fabsf(plane[2]) * extent.z;
+        if(distance < 0.0f) {
+            return false;
         }
-        if(cornerVertex.y > cornerVertex.w) {
-            outside_count[4]++;
+    }
+    return true;
+}
+
+void KRViewport::SetBatchBounds(aabb_batch &batch, int index, const AABB &b)
+{
+    for(int axis=0; axis < 3; axis++) {
+        batch.center[axis][index] = (b.min[axis] + b.max[axis]) * 0.5f;
+        batch.extent[axis][index] = (b.max[axis] - b.min[axis]) * 0.5f;
+    }
+}
+
+int KRViewport::visible(const aabb_batch &boxes, int count, bool *results, cull_mode mode) const
+{
+    cull_query q;
+    for(int iFace=0; iFace < 6; iFace++) {
+        for(int i=0; i < 4; i++) {
+            q.plane[iFace][i] = m_frustumPlanes[iFace][i];
         }
-        if(cornerVertex.z > cornerVertex.w) {
-            outside_count[5]++;
+        for(int axis=0; axis < 3; axis++) {
+            q.abs_normal[iFace][axis] = fabsf(m_frustumPlanes[iFace][axis]);
         }
     }
+    for(int axis=0; axis < 3; axis++) {
+        q.frustum_min[axis] = m_frustumBounds.min[axis];
+        q.frustum_max[axis] = m_frustumBounds.max[axis];
+    }
+    q.tight = mode == CULL_TIGHT;
     
-    bool is_visible = true;
-    for(int iFace=0; iFace < 6; iFace++) {
-        if(outside_count[iFace] == 8) {
-            is_visible = false;
+    const viewport_kernels &kernels = Kernels();
+    int visible_count = 0;
+    int first = 0;
+    for(; first + kernels.lanes <= count; first += kernels.lanes) {
+        int mask = kernels.cull(q, boxes, first);
+        for(int lane=0; lane < kernels.lanes; lane++) {
+            results[first + lane] = (mask & (1 << lane)) != 0;
+            if(results[first + lane]) visible_count++;
         }
     }
-    
-    return is_visible;
+    for(; first < count; first++) {
+        results[first] = CullBoxes_Scalar(q, boxes, first) != 0;
+        if(results[first]) visible_count++;
+    }
+    return visible_count;
 }
 
 
@@ -25,6 +25,7 @@ public:
     const Matrix4 &getViewMatrix() const;
     const Matrix4 &getProjectionMatrix() const;
     const Matrix4 &getViewProjectionMatrix() const;
+    bool getViewChanged() const; // True if the view projection matrix differed from the one it replaced when the viewport was last assigned or updated
     const Matrix4 &getInverseViewMatrix() const;
     const Matrix4 &getInverseProjectionMatrix() const;
     const Vector3 &getCameraDirection() const;
@@ -45,9 +46,36 @@ public:
     const std::set<KRLight *> &getVisibleLights();
     void setVisibleLights(const std::set<KRLight *> visibleLights);
     
-    bool visible(const AABB &b) const;
+    typedef enum {
+        CULL_CONSERVATIVE, // Reject boxes that are entirely outside of any one plane of the view frustum.  Large boxes near the edges of the frustum may be kept.
+        CULL_TIGHT // Also reject boxes that miss the world space bounding box of the view frustum.  This catches most of the boxes kept near the
+                   // edges.  It is not exact: boxes that miss the frustum but overlap its bounding box may still be kept.
+    } cull_mode;
+    
+    // Axis aligned bounding boxes in structure-of-arrays layout, for culling many at once
+    typedef struct {
+        float *center[3];
+        float *extent[3]; // Half of the size on each axis
+    } aabb_batch;
+    static void SetBatchBounds(aabb_batch &batch, int index, const AABB &b);
+    
+    bool visible(const AABB &b) const; // Same as CULL_CONSERVATIVE
+    
+    // Test count boxes against the view frustum with SIMD.  results[i] is set to whether box i may be visible.  Returns the number of boxes that may be visible.
+    int visible(const aabb_batch &boxes, int count, bool *results, cull_mode mode = CULL_CONSERVATIVE) const;
+    
+    // Fraction of the viewport covered by the projected bounds, from 0 to 1, scaled up with the LOD bias.  Returns 0 only when the bounds are outside of the view frustum.
+    // Mesh LOD name suffixes (_lodNN) are percentages of this.
+    // Roughly cubic bounds are measured by their bounding sphere; other bounds by projecting their corners.  Accounts for the field of view and aspect ratio of both perspective and orthographic projections.
     float coverage(const AABB &b) const;
     
+    // Estimate the coverage of count boxes with SIMD, into results.  Returns the number of boxes within the view frustum.
+    int coverage(const aabb_batch &boxes, int count, float *results) const;
+    
+    // The estimate that coverage() returned before it measured projected bounds; 1 near the camera, falling off to 0.01 over KRENGINE_VIEWPORT_DISTANCE_COVERAGE_RANGE world units.
+    // Only for thresholds authored against it, such as the lod_min_coverage of scene models.  Returns 0 when the bounds are outside of the view frustum.
+    float distanceCoverage(const AABB &b) const;
+    
 private:
     Vector2 m_size;
     Matrix4 m_matView;
@@ -57,17 +85,25 @@ private:
     
     // Derived values
     Matrix4 m_matViewProjection;
+    bool m_viewChanged;
     Matrix4 m_matInverseView;
     Matrix4 m_matInverseProjection;
     Vector3 m_cameraDirection;
     Vector3 m_cameraPosition;
+    float m_frustumPlanes[6][4]; // Clip planes in world space, positive inside.  Not normalized.
+    AABB m_frustumBounds; // World space bounds of the frustum corners, or infinite if the far plane is at infinity
+    float m_clipRows[3][4]; // Rows of the view projection matrix that give clip space x, y and w
+    float m_clipWGradient; // Length of the change in clip space w per world unit; 0 for orthographic projections
+    float m_projectionScale[2]; // Scale from view space to clip space in x and y
+    
+    float projectedBoxCoverage(const AABB &b) const;
     
     int m_frontToBackOrder[8];
     int m_backToFrontOrder[8];
     
     void calculateDerivedValues();
     
-    unordered_map<AABB, int> m_visibleBounds; // AABB's that output fragments in the last frame
+    unordered_map<AABB, int> m_visibleBounds; // Occlusion test results of AABB's, with the frame in which they were collected.  See KROcclusionQueryPool
     
     
 };
@@ -0,0 +1,141 @@
+//
+//  KRWorkerPool.cpp
+//  KREngine
+//
+//  Copyright 2012 Kearwood Gilbert. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are
+//  permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this list of
+//  conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list
+//  of conditions and the following disclaimer in the documentation and/or other materials
+//  provided with the distribution.
+//
+//  THIS SOFTWARE IS PROVIDED BY KEARWOOD GILBERT ''AS IS'' AND ANY EXPRESS OR IMPLIED
+//  WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+//  FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL KEARWOOD GILBERT OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+//  ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+//  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+//  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//  The views and conclusions contained in the software and documentation are those of the
+//  authors and should not be interpreted as representing official policies, either expressed
+//  or implied, of Kearwood Gilbert.
+//
+
+#include "KRWorkerPool.h"
+
+KRWorkerPool &KRWorkerPool::get()
+{
+    static KRWorkerPool pool;
+    return pool;
+}
+
+KRWorkerPool::KRWorkerPool()
+{
+    m_stop = false;
+    
+    // The thread calling parallelFor also does work, so leave one core for it
+    int thread_count = (int)std::thread::hardware_concurrency() - 1;
+    if(thread_count > KRENGINE_MAX_WORKER_THREADS) {
+        thread_count = KRENGINE_MAX_WORKER_THREADS;
+    }
+    for(int i=0; i < thread_count; i++) {
+        m_threads.push_back(std::thread(&KRWorkerPool::run, this));
+    }
+}
+
+KRWorkerPool::~KRWorkerPool()
+{
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    for(std::vector<std::thread>::iterator itr = m_threads.begin(); itr != m_threads.end(); itr++) {
+        (*itr).join();
+    }
+}
+
+int KRWorkerPool::getThreadCount() const
+{
+    return (int)m_threads.size();
+}
+
+void KRWorkerPool::parallelFor(size_t count, const std::function<void(size_t)> &fn, int max_threads)
+{
+    if(count == 0) {
+        return;
+    }
+    int max_pool_threads = (int)m_threads.size();
+    if(max_threads > 0 && max_threads - 1 < max_pool_threads) {
+        max_pool_threads = max_threads - 1;
+    }
+    if(count == 1 || max_pool_threads == 0) {
+        for(size_t i=0; i < count; i++) {
+            fn(i);
+        }
+        return;
+    }
+    
+    job j;
+    j.fn = &fn;
+    j.count = count;
+    j.next_index = 0;
+    j.active_threads = 0;
+    j.max_pool_threads = max_pool_threads;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_jobs.push_back(&j);
+    }
+    m_wake.notify_all();
+    
+    for(size_t index = j.next_index++; index < count; index = j.next_index++) {
+        fn(index);
+    }
+    
+    // Every index has been claimed; wait for the pool threads still running one to finish
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_jobs.remove(&j);
+    while(j.active_threads > 0) {
+        m_jobDone.wait(lock);
+    }
+}
+
+void KRWorkerPool::run()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while(!m_stop) {
+        job *j = NULL;
+        for(std::list<job *>::iterator itr = m_jobs.begin(); itr != m_jobs.end(); itr++) {
+            if((*itr)->active_threads < (*itr)->max_pool_threads) {
+                j = *itr;
+                break;
+            }
+        }
+        if(j == NULL) {
+            m_wake.wait(lock);
+            continue;
+        }
+        
+        j->active_threads++;
+        lock.unlock();
+        
+        for(size_t index = j->next_index++; index < j->count; index = j->next_index++) {
+            (*j->fn)(index);
+        }
+        
+        lock.lock();
+        m_jobs.remove(j); // Every index has been claimed, so no other threads need to pick up this job
+        j->active_threads--;
+        if(j->active_threads == 0) {
+            m_jobDone.notify_all();
+        }
+    }
+}
@@ -0,0 +1,73 @@
+//
+//  KRWorkerPool.h
+//  KREngine
+//
+//  Copyright 2012 Kearwood Gilbert. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are
+//  permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this list of
+//  conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list
+//  of conditions and the following disclaimer in the documentation and/or other materials
+//  provided with the distribution.
+//
+//  THIS SOFTWARE IS PROVIDED BY KEARWOOD GILBERT ''AS IS'' AND ANY EXPRESS OR IMPLIED
+//  WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+//  FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL KEARWOOD GILBERT OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+//  ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+//  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+//  ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//  The views and conclusions contained in the software and documentation are those of the
+//  authors and should not be interpreted as representing official policies, either expressed
+//  or implied, of Kearwood Gilbert.
+//
+
+#ifndef KRWORKERPOOL_H
+#define KRWORKERPOOL_H
+
+#include "KREngine-common.h"
+#include <condition_variable>
+
+#define KRENGINE_MAX_WORKER_THREADS 15
+
+// Persistent threads shared by CPU-heavy engine tasks such as texture compression and batched scene queries
+class KRWorkerPool {
+public:
+    static KRWorkerPool &get();
+    
+    KRWorkerPool();
+    ~KRWorkerPool();
+    
+    // Call fn(0) ... fn(count - 1) from the pool threads and the calling thread, returning once every call has completed.
+    // May be called from several threads at once, and from within fn.  max_threads limits the threads working on the job, including the calling thread; 0 allows all of them.
+    void parallelFor(size_t count, const std::function<void(size_t)> &fn, int max_threads = 0);
+    
+    int getThreadCount() const;
+    
+private:
+    typedef struct {
+        const std::function<void(size_t)> *fn;
+        size_t count;
+        std::atomic<size_t> next_index;
+        int active_threads; // Pool threads working on this job, guarded by m_mutex
+        int max_pool_threads;
+    } job;
+    
+    std::vector<std::thread> m_threads;
+    std::list<job *> m_jobs;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_jobDone;
+    bool m_stop;
+    
+    void run();
+};
+
+#endif